@@ -6,33 +6,62 @@
 extern SEXP C_from_toon(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_read_toon(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_to_toon(SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_validate_toon(SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_read_toon_df(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_write_toon(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_from_toon_many(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_validate_toon(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_read_toon_df(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
+                           SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_write_toon_df(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_stream_rows(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_stream_rows(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
+                          SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_build_index(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_arrow_stream_new(void);
+extern SEXP C_toon_arrow_stream(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_write_toon_arrow(SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_csv_to_toon(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_toon_to_csv(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_stream_items(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_format_toon(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_toon_peek(SEXP, SEXP, SEXP);
-extern SEXP C_toon_info(SEXP, SEXP);
+extern SEXP C_toon_info(SEXP, SEXP, SEXP);
 extern SEXP C_from_toon_df(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_stream_write_init(SEXP, SEXP, SEXP);
+extern SEXP C_stream_write_init(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_stream_write_batch(SEXP, SEXP);
 extern SEXP C_stream_write_close(SEXP);
+extern SEXP C_profile_start(SEXP);
+extern SEXP C_profile_stop(void);
+extern SEXP C_last_stats(void);
+
+/* ALTREP classes (toon_lazy.cpp) */
+extern void toonlite_init_lazy(DllInfo *dll);
 
 static const R_CallMethodDef CallEntries[] = {
     {"C_from_toon",          (DL_FUNC) &C_from_toon,          5},
     {"C_read_toon",          (DL_FUNC) &C_read_toon,          5},
     {"C_to_toon",            (DL_FUNC) &C_to_toon,            4},
-    {"C_validate_toon",      (DL_FUNC) &C_validate_toon,      5},
-    {"C_read_toon_df",       (DL_FUNC) &C_read_toon_df,       10},
+    {"C_write_toon",         (DL_FUNC) &C_write_toon,         5},
+    {"C_from_toon_many",     (DL_FUNC) &C_from_toon_many,     7},
+    {"C_validate_toon",      (DL_FUNC) &C_validate_toon,      6},
+    {"C_read_toon_df",       (DL_FUNC) &C_read_toon_df,       21},
     {"C_write_toon_df",      (DL_FUNC) &C_write_toon_df,      6},
-    {"C_stream_rows",        (DL_FUNC) &C_stream_rows,        12},
+    {"C_stream_rows",        (DL_FUNC) &C_stream_rows,        20},
+    {"C_build_index",        (DL_FUNC) &C_build_index,        5},
+    {"C_arrow_stream_new",   (DL_FUNC) &C_arrow_stream_new,   0},
+    {"C_toon_arrow_stream",  (DL_FUNC) &C_toon_arrow_stream,  7},
+    {"C_write_toon_arrow",   (DL_FUNC) &C_write_toon_arrow,   4},
+    {"C_csv_to_toon",        (DL_FUNC) &C_csv_to_toon,        5},
+    {"C_toon_to_csv",        (DL_FUNC) &C_toon_to_csv,        6},
+    {"C_stream_items",       (DL_FUNC) &C_stream_items,       9},
     {"C_format_toon",        (DL_FUNC) &C_format_toon,        5},
     {"C_toon_peek",          (DL_FUNC) &C_toon_peek,          3},
-    {"C_toon_info",          (DL_FUNC) &C_toon_info,          2},
+    {"C_toon_info",          (DL_FUNC) &C_toon_info,          3},
     {"C_from_toon_df",       (DL_FUNC) &C_from_toon_df,       10},
-    {"C_stream_write_init",  (DL_FUNC) &C_stream_write_init,  3},
+    {"C_stream_write_init",  (DL_FUNC) &C_stream_write_init,  5},
     {"C_stream_write_batch", (DL_FUNC) &C_stream_write_batch, 2},
     {"C_stream_write_close", (DL_FUNC) &C_stream_write_close, 1},
+    {"C_profile_start",      (DL_FUNC) &C_profile_start,      1},
+    {"C_profile_stop",       (DL_FUNC) &C_profile_stop,       0},
+    {"C_last_stats",         (DL_FUNC) &C_last_stats,         0},
     {NULL, NULL, 0}
 };
 
@@ -40,4 +69,5 @@ void R_init_toonlite(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
     R_forceSymbols(dll, TRUE);
+    toonlite_init_lazy(dll);
 }
@@ -0,0 +1,514 @@
+#include "toon_arrow.h"
+#include "toon_stream.h"
+#include "toon_charconv.h"
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace toonlite {
+
+// ArrowColumn implementation
+
+void ArrowColumn::init(ColType t, size_t rows) {
+    type = t == ColType::UNKNOWN ? ColType::LOGICAL : t;
+    length = rows;
+    if (type == ColType::STRING) {
+        offsets.reserve(rows + 1);
+        offsets.assign(1, 0);
+    }
+}
+
+namespace {
+
+void mark_null(ArrowColumn& col, size_t row) {
+    if (col.validity.empty()) {
+        col.validity.assign((col.length + 7) / 8, 0xFF);
+    }
+    col.validity[row >> 3] &= static_cast<uint8_t>(~(1u << (row & 7)));
+    col.null_count++;
+}
+
+} // namespace
+
+void ArrowColumn::append_text(std::string_view s) {
+    data.append(s.data(), s.size());
+    offsets.push_back(static_cast<int64_t>(data.size()));
+}
+
+void ArrowColumn::append_null() {
+    mark_null(*this, offsets.size() - 1);
+    offsets.push_back(static_cast<int64_t>(data.size()));
+}
+
+void ArrowColumn::finish() {
+    switch (type) {
+        case ColType::LOGICAL:
+            bits.assign((length + 7) / 8, 0);
+            for (size_t i = 0; i < length; i++) {
+                if (ints[i] == NA_LOGICAL) {
+                    mark_null(*this, i);
+                } else if (ints[i]) {
+                    bits[i >> 3] |= static_cast<uint8_t>(1u << (i & 7));
+                }
+            }
+            std::vector<int>().swap(ints);
+            break;
+        case ColType::INTEGER:
+            for (size_t i = 0; i < length; i++) {
+                if (ints[i] == NA_INTEGER) mark_null(*this, i);
+            }
+            break;
+        case ColType::DOUBLE:
+            // NA and null only; NaN stays a value
+            for (size_t i = 0; i < length; i++) {
+                if (R_IsNA(dbls[i])) mark_null(*this, i);
+            }
+            break;
+        case ColType::STRING:
+            if (data.size() <= static_cast<size_t>(INT32_MAX)) {
+                offsets32.assign(offsets.begin(), offsets.end());
+                std::vector<int64_t>().swap(offsets);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+namespace {
+
+// Export
+
+const char* arrow_format(const ArrowColumn& col) {
+    switch (col.type) {
+        case ColType::INTEGER: return "i";
+        case ColType::DOUBLE: return "g";
+        case ColType::STRING: return col.is_large() ? "U" : "u";
+        default: return "b";
+    }
+}
+
+// Each child schema and array owns its resources, so a consumer may move
+// it out of its parent and release it on its own
+struct FieldSchema {
+    std::string format;
+    std::string name;
+};
+
+struct TableSchema {
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema*> child_ptrs;
+};
+
+void release_field_schema(ArrowSchema* schema) {
+    delete static_cast<FieldSchema*>(schema->private_data);
+    schema->release = nullptr;
+}
+
+void release_table_schema(ArrowSchema* schema) {
+    auto* table = static_cast<TableSchema*>(schema->private_data);
+    for (ArrowSchema& child : table->children) {
+        if (child.release) child.release(&child);
+    }
+    delete table;
+    schema->release = nullptr;
+}
+
+struct ColumnSlice {
+    std::shared_ptr<std::vector<ArrowColumn>> columns;
+    const void* buffers[3] = {nullptr, nullptr, nullptr};
+};
+
+struct BatchArrays {
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray*> child_ptrs;
+    const void* buffers[1] = {nullptr};
+};
+
+void release_column_slice(ArrowArray* array) {
+    delete static_cast<ColumnSlice*>(array->private_data);
+    array->release = nullptr;
+}
+
+void release_batch(ArrowArray* array) {
+    auto* batch = static_cast<BatchArrays*>(array->private_data);
+    for (ArrowArray& child : batch->children) {
+        if (child.release) child.release(&child);
+    }
+    delete batch;
+    array->release = nullptr;
+}
+
+struct StreamState {
+    std::shared_ptr<std::vector<ArrowColumn>> columns;
+    size_t rows = 0;
+    size_t batch_size = 0;
+    size_t next_row = 0;
+    std::string error;
+};
+
+int stream_get_schema(ArrowArrayStream* stream, ArrowSchema* out) {
+    auto* state = static_cast<StreamState*>(stream->private_data);
+    try {
+        const auto& columns = *state->columns;
+        auto table = std::make_unique<TableSchema>();
+        table->children.resize(columns.size());
+        for (size_t j = 0; j < columns.size(); j++) {
+            auto field = std::make_unique<FieldSchema>();
+            field->format = arrow_format(columns[j]);
+            field->name = columns[j].name;
+
+            ArrowSchema& child = table->children[j];
+            child.format = field->format.c_str();
+            child.name = field->name.c_str();
+            child.metadata = nullptr;
+            child.flags = ARROW_FLAG_NULLABLE;
+            child.n_children = 0;
+            child.children = nullptr;
+            child.dictionary = nullptr;
+            child.release = release_field_schema;
+            child.private_data = field.release();
+            table->child_ptrs.push_back(&child);
+        }
+
+        out->format = "+s";
+        out->name = "";
+        out->metadata = nullptr;
+        out->flags = 0;
+        out->n_children = static_cast<int64_t>(columns.size());
+        out->children = table->child_ptrs.data();
+        out->dictionary = nullptr;
+        out->release = release_table_schema;
+        out->private_data = table.release();
+        return 0;
+    } catch (const std::exception& e) {
+        state->error = e.what();
+        return ENOMEM;
+    }
+}
+
+int stream_get_next(ArrowArrayStream* stream, ArrowArray* out) {
+    auto* state = static_cast<StreamState*>(stream->private_data);
+    if (state->next_row >= state->rows) {
+        // End of stream
+        std::memset(out, 0, sizeof(ArrowArray));
+        out->release = nullptr;
+        return 0;
+    }
+
+    try {
+        const auto& columns = *state->columns;
+        size_t start = state->next_row;
+        size_t n = std::min(state->batch_size, state->rows - start);
+
+        auto batch = std::make_unique<BatchArrays>();
+        batch->children.resize(columns.size());
+        for (size_t j = 0; j < columns.size(); j++) {
+            const ArrowColumn& col = columns[j];
+            auto slice = std::make_unique<ColumnSlice>();
+            slice->columns = state->columns;
+            slice->buffers[0] = col.validity.empty() ? nullptr : col.validity.data();
+
+            ArrowArray& child = batch->children[j];
+            child.n_buffers = 2;
+            switch (col.type) {
+                case ColType::INTEGER:
+                    slice->buffers[1] = col.ints.data();
+                    break;
+                case ColType::DOUBLE:
+                    slice->buffers[1] = col.dbls.data();
+                    break;
+                case ColType::STRING:
+                    slice->buffers[1] = col.is_large()
+                        ? static_cast<const void*>(col.offsets.data())
+                        : static_cast<const void*>(col.offsets32.data());
+                    slice->buffers[2] = col.data.data();
+                    child.n_buffers = 3;
+                    break;
+                default:
+                    slice->buffers[1] = col.bits.data();
+                    break;
+            }
+
+            // Batches are slices of the columns, so their null counts are
+            // left for the consumer to compute
+            child.length = static_cast<int64_t>(n);
+            child.null_count = col.validity.empty() ? 0 : -1;
+            child.offset = static_cast<int64_t>(start);
+            child.n_children = 0;
+            child.buffers = slice->buffers;
+            child.children = nullptr;
+            child.dictionary = nullptr;
+            child.release = release_column_slice;
+            child.private_data = slice.release();
+            batch->child_ptrs.push_back(&child);
+        }
+
+        out->length = static_cast<int64_t>(n);
+        out->null_count = 0;
+        out->offset = 0;
+        out->n_buffers = 1;
+        out->n_children = static_cast<int64_t>(columns.size());
+        out->buffers = batch->buffers;
+        out->children = batch->child_ptrs.data();
+        out->dictionary = nullptr;
+        out->release = release_batch;
+        out->private_data = batch.release();
+
+        state->next_row += n;
+        return 0;
+    } catch (const std::exception& e) {
+        state->error = e.what();
+        return ENOMEM;
+    }
+}
+
+const char* stream_get_last_error(ArrowArrayStream* stream) {
+    auto* state = static_cast<StreamState*>(stream->private_data);
+    return state->error.empty() ? nullptr : state->error.c_str();
+}
+
+void stream_release(ArrowArrayStream* stream) {
+    delete static_cast<StreamState*>(stream->private_data);
+    stream->release = nullptr;
+}
+
+// Import
+
+struct SchemaHolder {
+    ArrowSchema schema{};
+    ~SchemaHolder() {
+        if (schema.release) schema.release(&schema);
+    }
+};
+
+struct ArrayHolder {
+    ArrowArray array{};
+    ~ArrayHolder() {
+        if (array.release) array.release(&array);
+    }
+};
+
+std::string stream_error(ArrowArrayStream* stream) {
+    const char* msg = stream->get_last_error ? stream->get_last_error(stream) : nullptr;
+    return msg ? msg : "unknown error";
+}
+
+bool is_integer_format(char f) {
+    return std::strchr("cCsSiIlL", f) != nullptr;
+}
+
+// Value types that map onto TOON scalars: null, boolean, integers,
+// float32/64 and (large) utf8
+bool is_value_format(const char* f) {
+    return f[0] != '\0' && f[1] == '\0' && std::strchr("nbcCsSiIlLfguU", f[0]) != nullptr;
+}
+
+// Column of the stream's schema: the format of its values and, for
+// dictionary columns, of the indices
+struct FieldFormat {
+    char values;
+    char indices = '\0';
+};
+
+bool arrow_is_valid(const ArrowArray* a, int64_t i) {
+    if (a->n_buffers == 0) return false;  // null type
+    const uint8_t* validity = static_cast<const uint8_t*>(a->buffers[0]);
+    if (validity == nullptr || a->null_count == 0) return true;
+    i += a->offset;
+    return (validity[i >> 3] >> (i & 7)) & 1;
+}
+
+// Integer at row i of an integer array (unsigned 64-bit values past
+// INT64_MAX are written separately)
+int64_t arrow_integer(const ArrowArray* a, char f, int64_t i) {
+    const void* values = a->buffers[1];
+    i += a->offset;
+    switch (f) {
+        case 'c': return static_cast<const int8_t*>(values)[i];
+        case 'C': return static_cast<const uint8_t*>(values)[i];
+        case 's': return static_cast<const int16_t*>(values)[i];
+        case 'S': return static_cast<const uint16_t*>(values)[i];
+        case 'i': return static_cast<const int32_t*>(values)[i];
+        case 'I': return static_cast<const uint32_t*>(values)[i];
+        case 'l': return static_cast<const int64_t*>(values)[i];
+        default: return static_cast<int64_t>(static_cast<const uint64_t*>(values)[i]);
+    }
+}
+
+void append_arrow_value(WriteBuffer& out, const ArrowArray* a, char f, int64_t i, bool strict) {
+    if (!arrow_is_valid(a, i)) {
+        out.append("null", 4);
+        return;
+    }
+
+    char buf[24];
+    switch (f) {
+        case 'b': {
+            int64_t bit = a->offset + i;
+            bool v = (static_cast<const uint8_t*>(a->buffers[1])[bit >> 3] >> (bit & 7)) & 1;
+            v ? out.append("true", 4) : out.append("false", 5);
+            break;
+        }
+        case 'L': {
+            uint64_t v = static_cast<const uint64_t*>(a->buffers[1])[a->offset + i];
+            auto res = std::to_chars(buf, buf + sizeof buf, v);
+            out.append(buf, static_cast<size_t>(res.ptr - buf));
+            break;
+        }
+        case 'f':
+        case 'g': {
+            int64_t k = a->offset + i;
+            double v = f == 'f' ? static_cast<const float*>(a->buffers[1])[k]
+                                : static_cast<const double*>(a->buffers[1])[k];
+            if (std::isfinite(v) && f == 'f') {
+                char* end = float_to_chars(buf, static_cast<float>(v));
+                out.append(buf, static_cast<size_t>(end - buf));
+            } else if (std::isfinite(v)) {
+                out.append_double(v);
+            } else if (strict) {
+                throw ParseError(std::isnan(v) ? "NaN values not allowed in strict mode"
+                                               : "Inf/-Inf values not allowed in strict mode");
+            } else {
+                out.append("null", 4);
+            }
+            break;
+        }
+        case 'u':
+        case 'U': {
+            int64_t k = a->offset + i;
+            int64_t begin, end;
+            if (f == 'u') {
+                const int32_t* offsets = static_cast<const int32_t*>(a->buffers[1]);
+                begin = offsets[k];
+                end = offsets[k + 1];
+            } else {
+                const int64_t* offsets = static_cast<const int64_t*>(a->buffers[1]);
+                begin = offsets[k];
+                end = offsets[k + 1];
+            }
+            const char* data = static_cast<const char*>(a->buffers[2]);
+            out.append_escaped_string(std::string_view(data + begin, static_cast<size_t>(end - begin)));
+            break;
+        }
+        default: {
+            auto res = std::to_chars(buf, buf + sizeof buf, arrow_integer(a, f, i));
+            out.append(buf, static_cast<size_t>(res.ptr - buf));
+            break;
+        }
+    }
+}
+
+} // namespace
+
+void export_arrow_stream(std::shared_ptr<std::vector<ArrowColumn>> columns, size_t rows,
+                         size_t batch_size, ArrowArrayStream* out) {
+    auto state = std::make_unique<StreamState>();
+    state->columns = std::move(columns);
+    state->rows = rows;
+    state->batch_size = std::max<size_t>(batch_size, 1);
+
+    out->get_schema = stream_get_schema;
+    out->get_next = stream_get_next;
+    out->get_last_error = stream_get_last_error;
+    out->release = stream_release;
+    out->private_data = state.release();
+}
+
+size_t write_arrow_toon(ArrowArrayStream* stream, const std::string& filepath,
+                        const EncodeOptions& opts) {
+    SchemaHolder schema;
+    if (stream->get_schema(stream, &schema.schema) != 0) {
+        throw ParseError("Cannot read Arrow stream schema: " + stream_error(stream));
+    }
+    if (std::strcmp(schema.schema.format, "+s") != 0) {
+        throw ParseError("Arrow stream does not hold record batches");
+    }
+
+    size_t ncol = static_cast<size_t>(schema.schema.n_children);
+    std::vector<std::string> names(ncol);
+    std::vector<FieldFormat> formats(ncol);
+    for (size_t j = 0; j < ncol; j++) {
+        const ArrowSchema* field = schema.schema.children[j];
+        names[j] = field->name ? field->name : "";
+        const ArrowSchema* values = field->dictionary ? field->dictionary : field;
+        bool ok = is_value_format(values->format);
+        if (field->dictionary) {
+            ok = ok && field->format[1] == '\0' && is_integer_format(field->format[0]);
+            formats[j].indices = field->format[0];
+        }
+        if (!ok) {
+            throw ParseError("Unsupported Arrow type '" + std::string(values->format) +
+                             "' in column " + names[j]);
+        }
+        formats[j].values = values->format[0];
+    }
+
+    // Written beside the target, which is only replaced once complete
+    std::string tmp = filepath + ".tmp";
+    OutputFile file(tmp, compression_for_path(filepath));
+    if (!file.is_open()) {
+        throw ParseError("Cannot open file for writing: " + tmp, 0, 0, "", filepath);
+    }
+
+    size_t rows = 0;
+    try {
+        WriteBuffer out;
+        write_counted_header(file, names);
+        out.set_sink(&file);
+        std::string indent(static_cast<size_t>(std::max(opts.indent, 0)), ' ');
+
+        while (true) {
+            ArrayHolder batch;
+            if (stream->get_next(stream, &batch.array) != 0) {
+                throw ParseError("Cannot read Arrow record batch: " + stream_error(stream));
+            }
+            if (batch.array.release == nullptr) break;
+
+            const ArrowArray* const* cols = batch.array.children;
+            int64_t base = batch.array.offset;
+            for (int64_t i = 0; i < batch.array.length; i++) {
+                out.append(indent);
+                for (size_t j = 0; j < ncol; j++) {
+                    if (j > 0) out.append(", ", 2);
+                    const ArrowArray* col = cols[j];
+                    int64_t row = base + i;
+                    if (formats[j].indices == '\0') {
+                        append_arrow_value(out, col, formats[j].values, row, opts.strict);
+                    } else if (!arrow_is_valid(col, row)) {
+                        out.append("null", 4);
+                    } else {
+                        append_arrow_value(out, col->dictionary, formats[j].values,
+                                           arrow_integer(col, formats[j].indices, row),
+                                           opts.strict);
+                    }
+                }
+                out.append_char('\n');
+            }
+            rows += static_cast<size_t>(batch.array.length);
+        }
+
+        out.flush();
+        file.close();
+        if (!file || !patch_row_count(tmp, rows)) {
+            throw ParseError("Error writing to file: " + filepath, 0, 0, "", filepath);
+        }
+    } catch (...) {
+        // Do not leave a partial document behind
+        file.close();
+        std::remove(tmp.c_str());
+        throw;
+    }
+    if (!replace_file(tmp, filepath)) {
+        throw ParseError("Error writing to file: " + filepath, 0, 0, "", filepath);
+    }
+
+    return rows;
+}
+
+} // namespace toonlite
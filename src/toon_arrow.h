@@ -0,0 +1,126 @@
+#ifndef TOON_ARROW_HPP
+#define TOON_ARROW_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "toon_errors.h"
+#include "toon_df.h"
+#include "toon_encoder.h"
+
+// Arrow C data and stream interfaces, as given in the Arrow specification
+// (https://arrow.apache.org/docs/format/CDataInterface.html). The guards
+// let these ABI-stable definitions coexist with copies from other headers.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    // Array type description
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+    // Callbacks providing stream functionality
+    int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+    int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+    const char* (*get_last_error)(struct ArrowArrayStream*);
+
+    // Release callback
+    void (*release)(struct ArrowArrayStream*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+#endif // ARROW_C_STREAM_INTERFACE
+
+namespace toonlite {
+
+// One column in Arrow layout: bool (bit-packed), int32, float64 or utf8
+// (large_utf8 past 2GB of text), with a validity bitmap when it has nulls.
+// Numeric values are written in R's in-band NA form and finish() derives
+// the bitmaps from them; text rows are appended with their validity.
+struct ArrowColumn {
+    std::string name;
+    ColType type = ColType::LOGICAL;   // LOGICAL, INTEGER, DOUBLE or STRING
+    size_t length = 0;
+
+    std::vector<int> ints;             // LOGICAL (0/1) and INTEGER
+    std::vector<double> dbls;          // DOUBLE
+    std::vector<int64_t> offsets;      // STRING: length + 1 offsets into data
+    std::string data;
+
+    // Set up by finish()
+    std::vector<uint8_t> validity;     // empty if there are no nulls
+    std::vector<uint8_t> bits;         // LOGICAL values
+    std::vector<int32_t> offsets32;    // STRING offsets when data fits int32
+    int64_t null_count = 0;
+
+    // Size for `rows` rows of type t (UNKNOWN is stored as LOGICAL)
+    void init(ColType t, size_t rows);
+
+    // STRING: append a row
+    void append_text(std::string_view s);
+    void append_null();
+
+    // Build the bitmaps and drop the in-band form
+    void finish();
+
+    bool is_large() const { return type == ColType::STRING && offsets32.empty(); }
+};
+
+// Export columns of equal length as a stream of record batches of up to
+// batch_size rows. Batches point into the columns, which are freed once
+// the stream and every batch taken from it have been released.
+void export_arrow_stream(std::shared_ptr<std::vector<ArrowColumn>> columns, size_t rows,
+                         size_t batch_size, ArrowArrayStream* out);
+
+// Write the record batches of an Arrow stream to filepath as a tabular
+// TOON array, formatted as write_toon_df() formats a data.frame. Supports
+// boolean, integer, floating point, utf8 and dictionary columns; throws
+// ParseError on other types. Returns the number of rows written.
+size_t write_arrow_toon(ArrowArrayStream* stream, const std::string& filepath,
+                        const EncodeOptions& opts);
+
+} // namespace toonlite
+
+#endif // TOON_ARROW_HPP
@@ -0,0 +1,367 @@
+#include "toon_cache.h"
+#include "toon_df.h"
+#include "toon_index.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+namespace toonlite {
+
+namespace {
+
+// Format tag; bump the digit when the layout changes
+constexpr char MAGIC[8] = {'T', 'O', 'O', 'N', 'C', 'A', 'C', '1'};
+
+// Upper bound on a stored name or message
+constexpr uint32_t MAX_STRING = uint32_t(1) << 24;
+
+constexpr uint32_t NA_CODE = UINT32_MAX;
+
+// Column types as stored
+enum CacheType : uint8_t { CACHE_LOGICAL, CACHE_INTEGER, CACHE_DOUBLE, CACHE_STRING };
+
+template <typename T>
+void put(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+void put_string(std::ofstream& out, const std::string& s) {
+    put(out, static_cast<uint32_t>(s.size()));
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+// Bounds-checked reads from the mapped cache
+class Cursor {
+public:
+    Cursor(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end_ - p_) < sizeof value) return false;
+        std::memcpy(&value, p_, sizeof value);
+        p_ += sizeof value;
+        return true;
+    }
+
+    bool get_string(std::string& s) {
+        uint32_t n;
+        const char* at;
+        if (!get(n) || n > MAX_STRING || !skip(n, at)) return false;
+        s.assign(at, n);
+        return true;
+    }
+
+    // Step over n bytes, setting at to the first of them
+    bool skip(uint64_t n, const char*& at) {
+        if (static_cast<uint64_t>(end_ - p_) < n) return false;
+        at = p_;
+        p_ += n;
+        return true;
+    }
+
+    // Step over count items of size bytes each
+    bool skip(uint64_t count, size_t size, const char*& at) {
+        return count <= static_cast<uint64_t>(end_ - p_) / size && skip(count * size, at);
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+// Read options that change the result or its warnings, as one string
+std::string options_string(const TabularParseOptions& opts) {
+    std::string s = "key=" + (opts.key ? "1" + *opts.key : std::string("0"));
+    s += ";strict=" + std::to_string(opts.strict);
+    s += ";comments=" + std::to_string(opts.allow_comments);
+    s += ";dupkeys=" + std::to_string(opts.allow_duplicate_keys);
+    s += ";warn=" + std::to_string(opts.warn);
+    s += ";ragged=" + opts.ragged_rows;
+    s += ";n=" + opts.n_mismatch;
+    s += ";extra=" + std::to_string(opts.max_extra_cols);
+    s += ";sample=" + std::to_string(opts.sample_rows);
+    s += ";types=";
+    for (const auto& [name, type] : opts.col_types) {
+        s += std::to_string(name.size()) + ":" + name + "=" + col_type_name(type) + ",";
+    }
+    return s;
+}
+
+// Distinct strings of a text or factor column, and each row's entry
+void string_table(SEXP col, std::vector<SEXP>& strings, std::vector<uint32_t>& codes) {
+    R_xlen_t n = Rf_xlength(col);
+    codes.resize(static_cast<size_t>(n));
+    if (Rf_isFactor(col)) {
+        SEXP levels = Rf_getAttrib(col, R_LevelsSymbol);
+        for (R_xlen_t i = 0; i < Rf_xlength(levels); i++) {
+            strings.push_back(STRING_ELT(levels, i));
+        }
+        const int* in = INTEGER(col);
+        for (R_xlen_t i = 0; i < n; i++) {
+            codes[i] = in[i] == NA_INTEGER ? NA_CODE : static_cast<uint32_t>(in[i] - 1);
+        }
+        return;
+    }
+
+    // Equal strings share a CHARSXP through R's global cache
+    std::unordered_map<SEXP, uint32_t> code_of;
+    for (R_xlen_t i = 0; i < n; i++) {
+        SEXP ch = STRING_ELT(col, i);
+        if (ch == NA_STRING) {
+            codes[i] = NA_CODE;
+            continue;
+        }
+        auto it = code_of.emplace(ch, static_cast<uint32_t>(strings.size())).first;
+        if (it->second == strings.size()) strings.push_back(ch);
+        codes[i] = it->second;
+    }
+}
+
+} // namespace
+
+bool CacheKey::of(const std::string& filepath, const TabularParseOptions& opts, CacheKey& out) {
+    if (!file_stamp(filepath, out.file_size, out.file_mtime) ||
+        !hash_file(filepath, out.file_size, out.content_hash)) {
+        return false;
+    }
+    out.options = options_string(opts);
+    return true;
+}
+
+bool TableCache::open(const std::string& path, const CacheKey& key) {
+    // Mapped as the text readers map their input
+    map_ = std::make_unique<BufferedReader>(path);
+    if (map_->has_error()) return false;
+    if (map_->is_contiguous()) {
+        data_ = map_->data();
+        size_ = map_->size();
+    } else {
+        std::ifstream in(path, std::ios::binary);
+        copy_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data_ = copy_.data();
+        size_ = copy_.size();
+    }
+
+    Cursor in(data_, size_);
+    const char* magic;
+    CacheKey stored;
+    uint64_t nrow;
+    uint32_t ncol, n_warnings;
+    if (!in.skip(sizeof MAGIC, magic) || std::memcmp(magic, MAGIC, sizeof MAGIC) != 0 ||
+        !in.get(stored.file_size) || !in.get(stored.file_mtime) ||
+        !in.get(stored.content_hash) || !in.get_string(stored.options) ||
+        !(stored == key) || !in.get(nrow) || !in.get(ncol) || !in.get(n_warnings) ||
+        nrow > static_cast<uint64_t>(R_XLEN_T_MAX)) {
+        return false;
+    }
+    nrow_ = static_cast<size_t>(nrow);
+
+    warnings_.clear();
+    for (uint32_t i = 0; i < n_warnings; i++) {
+        std::string type, message;
+        if (!in.get_string(type) || !in.get_string(message)) return false;
+        warnings_.push_back(Warning(type, message));
+    }
+
+    columns_.clear();
+    for (uint32_t j = 0; j < ncol; j++) {
+        Column col{};
+        const char* bytes;
+        if (!in.get_string(col.name) || !in.get(col.type)) return false;
+        switch (col.type) {
+            case CACHE_LOGICAL:
+            case CACHE_INTEGER:
+                if (!in.skip(nrow, sizeof(int), col.data)) return false;
+                break;
+            case CACHE_DOUBLE:
+                if (!in.skip(nrow, sizeof(double), col.data)) return false;
+                break;
+            case CACHE_STRING: {
+                uint64_t total = 0;
+                if (!in.get(col.n_strings) || col.n_strings >= NA_CODE ||
+                    !in.skip(col.n_strings, sizeof(uint64_t), col.data)) {
+                    return false;
+                }
+                // String ends must rise, and codes point into the table
+                for (uint64_t s = 0; s < col.n_strings; s++) {
+                    uint64_t end;
+                    std::memcpy(&end, col.data + s * sizeof(uint64_t), sizeof end);
+                    if (end < total || end - total > static_cast<uint64_t>(INT_MAX)) return false;
+                    total = end;
+                }
+                if (!in.skip(total, bytes) || !in.skip(nrow, sizeof(uint32_t), col.codes)) {
+                    return false;
+                }
+                for (uint64_t i = 0; i < nrow; i++) {
+                    uint32_t code;
+                    std::memcpy(&code, col.codes + i * sizeof(uint32_t), sizeof code);
+                    if (code != NA_CODE && code >= col.n_strings) return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+        columns_.push_back(std::move(col));
+    }
+    return true;
+}
+
+SEXP TableCache::build_column(const Column& col, bool as_factor) const {
+    R_xlen_t n = static_cast<R_xlen_t>(nrow_);
+    SEXP vec;
+    switch (col.type) {
+        case CACHE_LOGICAL:
+            vec = PROTECT(Rf_allocVector(LGLSXP, n));
+            if (n > 0) std::memcpy(LOGICAL(vec), col.data, nrow_ * sizeof(int));
+            break;
+        case CACHE_INTEGER:
+            vec = PROTECT(Rf_allocVector(INTSXP, n));
+            if (n > 0) std::memcpy(INTEGER(vec), col.data, nrow_ * sizeof(int));
+            break;
+        case CACHE_DOUBLE:
+            vec = PROTECT(Rf_allocVector(REALSXP, n));
+            if (n > 0) std::memcpy(REAL(vec), col.data, nrow_ * sizeof(double));
+            break;
+        default: {
+            // One CHARSXP per distinct string, shared by all its rows
+            const char* text = col.data + col.n_strings * sizeof(uint64_t);
+            SEXP strings = PROTECT(Rf_allocVector(STRSXP, static_cast<R_xlen_t>(col.n_strings)));
+            uint64_t begin = 0;
+            for (uint64_t s = 0; s < col.n_strings; s++) {
+                uint64_t end;
+                std::memcpy(&end, col.data + s * sizeof(uint64_t), sizeof end);
+                SET_STRING_ELT(strings, static_cast<R_xlen_t>(s),
+                               Rf_mkCharLenCE(text + begin, static_cast<int>(end - begin),
+                                              CE_UTF8));
+                begin = end;
+            }
+
+            vec = PROTECT(Rf_allocVector(as_factor ? INTSXP : STRSXP, n));
+            for (R_xlen_t i = 0; i < n; i++) {
+                uint32_t code;
+                std::memcpy(&code, col.codes + i * sizeof(uint32_t), sizeof code);
+                if (as_factor) {
+                    INTEGER(vec)[i] = code == NA_CODE ? NA_INTEGER : static_cast<int>(code) + 1;
+                } else {
+                    SET_STRING_ELT(vec, i, code == NA_CODE ? NA_STRING : STRING_ELT(strings, code));
+                }
+            }
+            if (as_factor) {
+                Rf_setAttrib(vec, R_LevelsSymbol, strings);
+                Rf_setAttrib(vec, R_ClassSymbol, Rf_mkString("factor"));
+            }
+            UNPROTECT(2);
+            return vec;
+        }
+    }
+    UNPROTECT(1);
+    return vec;
+}
+
+SEXP TableCache::build(const std::vector<std::string>& select, bool as_factor,
+                       const std::string& file) const {
+    std::vector<size_t> picked;
+    if (select.empty()) {
+        for (size_t j = 0; j < columns_.size(); j++) picked.push_back(j);
+    } else {
+        for (const auto& name : select) {
+            auto it = std::find_if(columns_.begin(), columns_.end(),
+                                   [&](const Column& c) { return c.name == name; });
+            if (it == columns_.end()) {
+                throw ParseError("Column not found: " + name, 0, 0, "", file);
+            }
+            picked.push_back(static_cast<size_t>(it - columns_.begin()));
+        }
+    }
+
+    R_xlen_t ncol = static_cast<R_xlen_t>(picked.size());
+    SEXP df = PROTECT(Rf_allocVector(VECSXP, ncol));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, ncol));
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        const Column& col = columns_[picked[j]];
+        SET_VECTOR_ELT(df, j, build_column(col, as_factor));
+        SET_STRING_ELT(names, j, Rf_mkCharCE(col.name.c_str(), CE_UTF8));
+    }
+    set_dataframe_attrs(df, names, nrow_);
+
+    UNPROTECT(2);
+    return df;
+}
+
+void TableCache::save(const std::string& path, const CacheKey& key, SEXP df,
+                      const std::vector<Warning>& warnings) {
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    if (!out.is_open()) {
+        throw ParseError("Cannot open file for writing: " + tmp);
+    }
+
+    R_xlen_t ncol = Rf_xlength(df);
+    uint64_t nrow = ncol > 0 ? static_cast<uint64_t>(Rf_xlength(VECTOR_ELT(df, 0))) : 0;
+    SEXP names = Rf_getAttrib(df, R_NamesSymbol);
+
+    out.write(MAGIC, sizeof MAGIC);
+    put(out, key.file_size);
+    put(out, key.file_mtime);
+    put(out, key.content_hash);
+    put_string(out, key.options);
+    put(out, nrow);
+    put(out, static_cast<uint32_t>(ncol));
+    put(out, static_cast<uint32_t>(warnings.size()));
+    for (const auto& w : warnings) {
+        put_string(out, w.type);
+        put_string(out, w.message);
+    }
+
+    std::vector<SEXP> strings;
+    std::vector<uint32_t> codes;
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        SEXP col = VECTOR_ELT(df, j);
+        put_string(out, CHAR(STRING_ELT(names, j)));
+
+        if (TYPEOF(col) == STRSXP || Rf_isFactor(col)) {
+            put(out, static_cast<uint8_t>(CACHE_STRING));
+            strings.clear();
+            string_table(col, strings, codes);
+            put(out, static_cast<uint64_t>(strings.size()));
+            uint64_t end = 0;
+            for (SEXP s : strings) {
+                end += static_cast<uint64_t>(LENGTH(s));
+                put(out, end);
+            }
+            for (SEXP s : strings) {
+                out.write(CHAR(s), LENGTH(s));
+            }
+            out.write(reinterpret_cast<const char*>(codes.data()),
+                      static_cast<std::streamsize>(codes.size() * sizeof(uint32_t)));
+        } else if (TYPEOF(col) == REALSXP) {
+            put(out, static_cast<uint8_t>(CACHE_DOUBLE));
+            out.write(reinterpret_cast<const char*>(REAL(col)),
+                      static_cast<std::streamsize>(nrow * sizeof(double)));
+        } else if (TYPEOF(col) == INTSXP || TYPEOF(col) == LGLSXP) {
+            put(out, static_cast<uint8_t>(TYPEOF(col) == LGLSXP ? CACHE_LOGICAL : CACHE_INTEGER));
+            out.write(reinterpret_cast<const char*>(INTEGER(col)),
+                      static_cast<std::streamsize>(nrow * sizeof(int)));
+        } else {
+            out.close();
+            std::remove(tmp.c_str());
+            throw ParseError("Cannot cache column " + std::string(CHAR(STRING_ELT(names, j))));
+        }
+    }
+
+    out.close();
+    if (!out) {
+        std::remove(tmp.c_str());
+        throw ParseError("Error writing to file: " + path);
+    }
+    if (!replace_file(tmp, path)) {
+        throw ParseError("Error writing to file: " + path);
+    }
+}
+
+} // namespace toonlite
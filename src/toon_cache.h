@@ -0,0 +1,94 @@
+#ifndef TOON_CACHE_HPP
+#define TOON_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "toon_errors.h"
+#include "toon_io.h"
+
+#include <R.h>
+#include <Rinternals.h>
+#ifdef error
+#undef error
+#endif
+#ifdef length
+#undef length
+#endif
+
+namespace toonlite {
+
+struct TabularParseOptions;
+
+// What a cached read depends on: the file's size, modification time and a
+// hash of its first and last FILE_HASH_BYTES, plus the read options that
+// change the result
+struct CacheKey {
+    uint64_t file_size = 0;
+    int64_t file_mtime = 0;
+    uint64_t content_hash = 0;
+    std::string options;
+
+    bool operator==(const CacheKey& other) const {
+        return file_size == other.file_size && file_mtime == other.file_mtime &&
+            content_hash == other.content_hash && options == other.options;
+    }
+
+    // Key of reading filepath with opts; false if it cannot be stat'ed
+    static bool of(const std::string& filepath, const TabularParseOptions& opts, CacheKey& out);
+};
+
+// Binary columnar snapshot of a tabular read (conventionally
+// <file>.tooncache): the schema, each column's values as stored in R
+// (text as a table of distinct strings plus a code per row) and the
+// warnings the read gave. Loading maps the file and copies the columns
+// out in bulk. Stored in native byte order.
+class TableCache {
+public:
+    // Map the cache at path and check its layout; false if it is missing,
+    // malformed or was not written for key
+    bool open(const std::string& path, const CacheKey& key);
+
+    size_t rows() const { return nrow_; }
+    size_t bytes() const { return size_; }
+    const std::vector<Warning>& warnings() const { return warnings_; }
+
+    // data.frame of the cached columns, or of those in select (in that
+    // order); text columns become factors (levels in order of first
+    // appearance) if as_factor is set. Unknown names are a ParseError
+    // naming `file`; nothing else can fail once open() has succeeded.
+    SEXP build(const std::vector<std::string>& select, bool as_factor,
+               const std::string& file) const;
+
+    // Write the columns of df (as built by TabularParser) and the read's
+    // warnings as the cache of key. Written to a temporary file that then
+    // replaces path; throws ParseError on failure.
+    static void save(const std::string& path, const CacheKey& key, SEXP df,
+                     const std::vector<Warning>& warnings);
+
+private:
+    struct Column {
+        std::string name;
+        uint8_t type;          // CacheType
+        const char* data;      // values, or the string table
+        uint64_t n_strings;    // STRING only
+        const char* codes;     // STRING only: a uint32_t per row
+    };
+
+    SEXP build_column(const Column& col, bool as_factor) const;
+
+    std::unique_ptr<BufferedReader> map_;
+    std::string copy_;         // the file, where it cannot be mapped
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+
+    size_t nrow_ = 0;
+    std::vector<Column> columns_;
+    std::vector<Warning> warnings_;
+};
+
+} // namespace toonlite
+
+#endif // TOON_CACHE_HPP
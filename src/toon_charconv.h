@@ -1,7 +1,8 @@
-#ifndef TOON_CHARCONV_H
-#define TOON_CHARCONV_H
+#ifndef TOON_CHARCONV_HPP
+#define TOON_CHARCONV_HPP
 
 #include <charconv>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <string>
@@ -72,6 +73,116 @@ inline std::from_chars_result double_from_chars(const char* first,
 #endif
 }
 
+namespace detail {
+
+// Shortest round-trip digits of a finite double in scientific form,
+// "[-]d[.ddd]e±XX".  libc++ lacks floating-point std::to_chars, so there
+// the shortest of %.15e..%.17e that reads back exactly is used instead (R
+// keeps LC_NUMERIC at "C").
+inline char* shortest_scientific(char* first, char* last, double value) {
+#ifdef _LIBCPP_VERSION
+    const int cap = static_cast<int>(last - first);
+    int n = 0;
+    for (int precision = 14; precision <= 16; precision++) {
+        n = std::snprintf(first, cap, "%.*e", precision, value);
+        if (precision == 16 || std::strtod(first, nullptr) == value) break;
+    }
+    return first + n;
+#else
+    return std::to_chars(first, last, value, std::chars_format::scientific).ptr;
+#endif
+}
+
+// The same for a float, whose shortest digits are its own rather than
+// those of the double it widens to
+inline char* shortest_scientific(char* first, char* last, float value) {
+#ifdef _LIBCPP_VERSION
+    const int cap = static_cast<int>(last - first);
+    int n = 0;
+    for (int precision = 5; precision <= 8; precision++) {
+        n = std::snprintf(first, cap, "%.*e", precision, static_cast<double>(value));
+        if (precision == 8 || std::strtof(first, nullptr) == value) break;
+    }
+    return first + n;
+#else
+    return std::to_chars(first, last, value, std::chars_format::scientific).ptr;
+#endif
+}
+
+// Lay out scientific digits [sci, end) as double_to_chars() does
+inline char* layout_shortest(char* out, const char* sci, const char* end) {
+    const char* p = sci;
+    if (*p == '-') {
+        *out++ = *p++;
+    }
+
+    // Split "d.ddde±XX" into its significant digits and exponent
+    char digits[20];
+    int ndigits = 0;
+    while (p < end && *p != 'e') {
+        if (*p != '.') digits[ndigits++] = *p;
+        p++;
+    }
+    while (ndigits > 1 && digits[ndigits - 1] == '0') ndigits--;
+    const char* exp_text = p;
+    int exp = 0;
+    for (const char* q = p + 2; q < end; q++) {
+        exp = exp * 10 + (*q - '0');
+    }
+    if (p[1] == '-') exp = -exp;
+
+    if (exp < -4 || exp > 16) {
+        *out++ = digits[0];
+        if (ndigits > 1) {
+            *out++ = '.';
+            std::memcpy(out, digits + 1, static_cast<std::size_t>(ndigits - 1));
+            out += ndigits - 1;
+        }
+        std::memcpy(out, exp_text, static_cast<std::size_t>(end - exp_text));
+        return out + (end - exp_text);
+    }
+
+    if (exp < 0) {
+        *out++ = '0';
+        *out++ = '.';
+        for (int i = -1; i > exp; i--) *out++ = '0';
+        std::memcpy(out, digits, static_cast<std::size_t>(ndigits));
+        return out + ndigits;
+    }
+
+    // Integer part is the first exp + 1 digits, padded with zeros
+    for (int i = 0; i <= exp; i++) {
+        *out++ = i < ndigits ? digits[i] : '0';
+    }
+    if (ndigits > exp + 1) {
+        *out++ = '.';
+        std::memcpy(out, digits + exp + 1, static_cast<std::size_t>(ndigits - exp - 1));
+        out += ndigits - exp - 1;
+    }
+    return out;
+}
+
+}  // namespace detail
+
+// Format a finite double with the fewest significant digits that read
+// back to the same value.  The layout follows printf("%.17g"): fixed
+// notation for decimal exponents -4..16, scientific otherwise, so 0.1 is
+// "0.1" and 1e22 is "1e+22".  Writes at most 32 bytes; returns the end.
+inline char* double_to_chars(char* out, double value) {
+    char sci[32];
+    const char* end = detail::shortest_scientific(sci, sci + sizeof(sci), value);
+    return detail::layout_shortest(out, sci, end);
+}
+
+// Format a finite float the same way, with the fewest digits that read
+// back to the same float: 0.1f is "0.1", not "0.10000000149011612".
+// Writes at most 24 bytes; returns the end.
+inline char* float_to_chars(char* out, float value) {
+    char sci[32];
+    const char* end = detail::shortest_scientific(sci, sci + sizeof(sci), value);
+    return detail::layout_shortest(out, sci, end);
+}
+
 }  // namespace toonlite
 
-#endif  // TOON_CHARCONV_H
+#endif // TOON_CHARCONV_HPP
@@ -0,0 +1,376 @@
+#include "toon_compress.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <zlib.h>
+
+#ifdef TOONLITE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace toonlite {
+
+namespace {
+
+constexpr unsigned char GZIP_MAGIC[2] = {0x1f, 0x8b};
+constexpr unsigned char ZSTD_MAGIC[4] = {0x28, 0xb5, 0x2f, 0xfd};
+
+// Output grows by this much per call into the codec
+constexpr size_t OUT_CHUNK = 64 * 1024;
+
+// zlib counts bytes in uInt
+constexpr size_t ZLIB_MAX = 1u << 30;
+
+bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = std::strlen(suffix);
+    if (s.size() < n) return false;
+    for (size_t i = 0; i < n; i++) {
+        char c = s[s.size() - n + i];
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        if (c != suffix[i]) return false;
+    }
+    return true;
+}
+
+void put_le(std::string& out, uint32_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+uint32_t get_le(const unsigned char* p, int bytes) {
+    uint32_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v |= static_cast<uint32_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+class GzipDecompressor : public Decompressor {
+public:
+    GzipDecompressor() {
+        std::memset(&zs_, 0, sizeof zs_);
+        // 15 + 16: full window, gzip wrapper
+        if (inflateInit2(&zs_, 15 + 16) != Z_OK) {
+            throw std::runtime_error("Cannot initialise gzip decompression");
+        }
+    }
+    ~GzipDecompressor() override { inflateEnd(&zs_); }
+
+    Status run(const char* in, size_t in_len, size_t& in_used,
+               char* out, size_t out_len, size_t& out_used) override {
+        uInt avail_in = static_cast<uInt>(std::min(in_len, ZLIB_MAX));
+        uInt avail_out = static_cast<uInt>(std::min(out_len, ZLIB_MAX));
+        zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        zs_.avail_in = avail_in;
+        zs_.next_out = reinterpret_cast<Bytef*>(out);
+        zs_.avail_out = avail_out;
+
+        int ret = inflate(&zs_, Z_NO_FLUSH);
+        in_used = avail_in - zs_.avail_in;
+        out_used = avail_out - zs_.avail_out;
+        if (ret == Z_STREAM_END) return END;
+        if (ret == Z_OK || ret == Z_BUF_ERROR) return OK;
+        error_ = zs_.msg != nullptr ? zs_.msg : "invalid data";
+        return FAILED;
+    }
+
+    void reset() override { inflateReset(&zs_); }
+
+    std::string error() const override { return error_; }
+
+private:
+    z_stream zs_;
+    std::string error_;
+};
+
+class GzipCompressor : public Compressor {
+public:
+    GzipCompressor() {
+        std::memset(&zs_, 0, sizeof zs_);
+        if (deflateInit2(&zs_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Cannot initialise gzip compression");
+        }
+    }
+    ~GzipCompressor() override { deflateEnd(&zs_); }
+
+    bool run(const char* in, size_t len, Mode mode, std::string& out) override {
+        do {
+            size_t piece = std::min(len, ZLIB_MAX);
+            zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+            zs_.avail_in = static_cast<uInt>(piece);
+            in += piece;
+            len -= piece;
+
+            int flush = Z_NO_FLUSH;
+            if (len == 0 && mode == FLUSH) flush = Z_SYNC_FLUSH;
+            if (len == 0 && mode == FINISH) flush = Z_FINISH;
+
+            // Run until deflate leaves output space unused, at which point
+            // it has taken all the input (and, when finishing, ended)
+            int ret;
+            do {
+                size_t used = out.size();
+                out.resize(used + OUT_CHUNK);
+                zs_.next_out = reinterpret_cast<Bytef*>(&out[used]);
+                zs_.avail_out = static_cast<uInt>(OUT_CHUNK);
+                ret = deflate(&zs_, flush);
+                out.resize(used + OUT_CHUNK - zs_.avail_out);
+                if (ret == Z_STREAM_ERROR) return false;
+            } while (zs_.avail_out == 0);
+            if (flush == Z_FINISH && ret != Z_STREAM_END) return false;
+        } while (len > 0);
+        return true;
+    }
+
+    void reset() override { deflateReset(&zs_); }
+
+private:
+    z_stream zs_;
+};
+
+#ifdef TOONLITE_HAVE_ZSTD
+
+class ZstdDecompressor : public Decompressor {
+public:
+    ZstdDecompressor() : ds_(ZSTD_createDStream()) {
+        if (ds_ == nullptr) {
+            throw std::runtime_error("Cannot initialise zstd decompression");
+        }
+        ZSTD_initDStream(ds_);
+    }
+    ~ZstdDecompressor() override { ZSTD_freeDStream(ds_); }
+
+    Status run(const char* in, size_t in_len, size_t& in_used,
+               char* out, size_t out_len, size_t& out_used) override {
+        ZSTD_inBuffer input = {in, in_len, 0};
+        ZSTD_outBuffer output = {out, out_len, 0};
+        size_t ret = ZSTD_decompressStream(ds_, &output, &input);
+        in_used = input.pos;
+        out_used = output.pos;
+        if (ZSTD_isError(ret)) {
+            error_ = ZSTD_getErrorName(ret);
+            return FAILED;
+        }
+        // 0 once the frame is decoded and fully written out
+        return ret == 0 ? END : OK;
+    }
+
+    void reset() override { ZSTD_initDStream(ds_); }
+
+    std::string error() const override { return error_; }
+
+private:
+    ZSTD_DStream* ds_;
+    std::string error_;
+};
+
+class ZstdCompressor : public Compressor {
+public:
+    static constexpr int LEVEL = 3;
+
+    ZstdCompressor() : cs_(ZSTD_createCStream()) {
+        if (cs_ == nullptr) {
+            throw std::runtime_error("Cannot initialise zstd compression");
+        }
+        ZSTD_initCStream(cs_, LEVEL);
+    }
+    ~ZstdCompressor() override { ZSTD_freeCStream(cs_); }
+
+    bool run(const char* in, size_t len, Mode mode, std::string& out) override {
+        ZSTD_inBuffer input = {in, len, 0};
+        while (input.pos < input.size) {
+            if (!step(out, [&](ZSTD_outBuffer* o) {
+                    return ZSTD_compressStream(cs_, o, &input);
+                })) {
+                return false;
+            }
+        }
+
+        // Flushing and ending return the bytes still to write, 0 when done
+        size_t remaining = mode == NO_FLUSH ? 0 : 1;
+        while (remaining != 0) {
+            if (!step(out, [&](ZSTD_outBuffer* o) {
+                    remaining = mode == FINISH ? ZSTD_endStream(cs_, o) : ZSTD_flushStream(cs_, o);
+                    return remaining;
+                })) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void reset() override { ZSTD_initCStream(cs_, LEVEL); }
+
+private:
+    ZSTD_CStream* cs_;
+
+    template <typename F>
+    bool step(std::string& out, F call) {
+        size_t used = out.size();
+        out.resize(used + OUT_CHUNK);
+        ZSTD_outBuffer output = {&out[used], OUT_CHUNK, 0};
+        size_t ret = call(&output);
+        out.resize(used + output.pos);
+        return !ZSTD_isError(ret);
+    }
+};
+
+#endif // TOONLITE_HAVE_ZSTD
+
+} // namespace
+
+Compression detect_compression(const char* data, size_t len) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if (len >= 2 && std::memcmp(p, GZIP_MAGIC, 2) == 0) return Compression::GZIP;
+    if (len >= 4 && std::memcmp(p, ZSTD_MAGIC, 4) == 0) return Compression::ZSTD;
+    return Compression::NONE;
+}
+
+Compression compression_for_path(const std::string& path) {
+    if (ends_with(path, ".gz")) return Compression::GZIP;
+    if (ends_with(path, ".zst")) return Compression::ZSTD;
+    return Compression::NONE;
+}
+
+const char* compression_name(Compression c) {
+    switch (c) {
+        case Compression::GZIP: return "gzip";
+        case Compression::ZSTD: return "zstd";
+        default: return "none";
+    }
+}
+
+bool compression_supported(Compression c) {
+#ifdef TOONLITE_HAVE_ZSTD
+    (void)c;
+    return true;
+#else
+    return c != Compression::ZSTD;
+#endif
+}
+
+std::unique_ptr<Decompressor> Decompressor::create(Compression c) {
+    if (c == Compression::GZIP) return std::make_unique<GzipDecompressor>();
+#ifdef TOONLITE_HAVE_ZSTD
+    if (c == Compression::ZSTD) return std::make_unique<ZstdDecompressor>();
+#endif
+    return nullptr;
+}
+
+std::unique_ptr<Compressor> Compressor::create(Compression c) {
+    if (c == Compression::GZIP) return std::make_unique<GzipCompressor>();
+#ifdef TOONLITE_HAVE_ZSTD
+    if (c == Compression::ZSTD) return std::make_unique<ZstdCompressor>();
+#endif
+    return nullptr;
+}
+
+std::string stored_member(Compression c, std::string_view data) {
+    std::string out;
+    if (c == Compression::GZIP) {
+        // Header with no flags, mtime or name, then stored deflate blocks
+        // (BTYPE 00) of up to 64KB
+        static const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff'};
+        out.append(header, sizeof header);
+        size_t pos = 0;
+        do {
+            size_t n = std::min(data.size() - pos, size_t(0xffff));
+            bool last = pos + n == data.size();
+            out.push_back(last ? 1 : 0);
+            put_le(out, static_cast<uint32_t>(n), 2);
+            put_le(out, static_cast<uint32_t>(~n & 0xffff), 2);
+            out.append(data.data() + pos, n);
+            pos += n;
+        } while (pos < data.size());
+        uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(data.data()),
+                          static_cast<uInt>(data.size()));
+        put_le(out, static_cast<uint32_t>(crc), 4);
+        put_le(out, static_cast<uint32_t>(data.size()), 4);
+    } else if (c == Compression::ZSTD) {
+        // Single-segment frame with a 4-byte content size and no checksum,
+        // holding raw blocks of up to 128KB
+        out.append(reinterpret_cast<const char*>(ZSTD_MAGIC), 4);
+        out.push_back('\xa0');
+        put_le(out, static_cast<uint32_t>(data.size()), 4);
+        size_t pos = 0;
+        do {
+            size_t n = std::min(data.size() - pos, size_t(128 * 1024));
+            bool last = pos + n == data.size();
+            put_le(out, static_cast<uint32_t>((n << 3) | (last ? 1 : 0)), 3);
+            out.append(data.data() + pos, n);
+            pos += n;
+        } while (pos < data.size());
+    } else {
+        out.assign(data);
+    }
+    return out;
+}
+
+bool patch_stored_prefix(std::fstream& file, size_t offset, std::string_view bytes) {
+    unsigned char head[15];
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(head), sizeof head);
+    size_t got = static_cast<size_t>(file.gcount());
+    file.clear();
+
+    Compression c = detect_compression(reinterpret_cast<const char*>(head), got);
+    if (c == Compression::NONE) {
+        file.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return static_cast<bool>(file);
+    }
+
+    if (c == Compression::ZSTD) {
+        // Frame header as stored_member() writes it, then the first block
+        if (got < 12 || head[4] != 0xa0 || (head[9] & 0x06) != 0 ||
+            offset + bytes.size() > (get_le(head + 9, 3) >> 3)) {
+            return false;
+        }
+        file.seekp(static_cast<std::streamoff>(12 + offset), std::ios::beg);
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return static_cast<bool>(file);
+    }
+
+    // gzip: read back the stored blocks to recompute the CRC
+    if (got < 15 || head[3] != 0) return false;
+    std::string content;
+    size_t pos = 10;
+    bool last = false;
+    while (!last) {
+        unsigned char block[5];
+        file.seekg(static_cast<std::streamoff>(pos), std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(block), sizeof block) ||
+            (block[0] & 0x06) != 0) {
+            return false;
+        }
+        last = (block[0] & 1) != 0;
+        size_t n = get_le(block + 1, 2);
+        size_t used = content.size();
+        content.resize(used + n);
+        if (n > 0 && !file.read(&content[used], static_cast<std::streamsize>(n))) {
+            return false;
+        }
+        pos += 5 + n;
+    }
+    // The patch must fall within the first block
+    if (offset + bytes.size() > std::min(content.size(), size_t(0xffff))) {
+        return false;
+    }
+
+    content.replace(offset, bytes.size(), bytes.data(), bytes.size());
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(content.data()),
+                      static_cast<uInt>(content.size()));
+    std::string trailer;
+    put_le(trailer, static_cast<uint32_t>(crc), 4);
+
+    file.seekp(static_cast<std::streamoff>(15 + offset), std::ios::beg);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    file.seekp(static_cast<std::streamoff>(pos), std::ios::beg);
+    file.write(trailer.data(), static_cast<std::streamsize>(trailer.size()));
+    return static_cast<bool>(file);
+}
+
+} // namespace toonlite
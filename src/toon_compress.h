@@ -0,0 +1,75 @@
+#ifndef TOON_COMPRESS_HPP
+#define TOON_COMPRESS_HPP
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <fstream>
+#include <cstddef>
+
+namespace toonlite {
+
+// Compressed file formats. gzip is always available (zlib); zstd needs the
+// package built with TOONLITE_HAVE_ZSTD and linked against libzstd.
+enum class Compression { NONE, GZIP, ZSTD };
+
+// Format of data starting with these bytes, from its magic number
+Compression detect_compression(const char* data, size_t len);
+
+// Format implied by a file name: .gz is gzip, .zst zstd, anything else none
+Compression compression_for_path(const std::string& path);
+
+const char* compression_name(Compression c);
+
+// Whether this build can read and write c
+bool compression_supported(Compression c);
+
+// Incremental decoder for one gzip member or zstd frame
+class Decompressor {
+public:
+    enum Status { OK, END, FAILED };
+
+    // nullptr if c is NONE or unsupported
+    static std::unique_ptr<Decompressor> create(Compression c);
+    virtual ~Decompressor() = default;
+
+    // Decode from `in` into `out`, reporting how much of each was used.
+    // END once the member or frame is complete.
+    virtual Status run(const char* in, size_t in_len, size_t& in_used,
+                       char* out, size_t out_len, size_t& out_used) = 0;
+
+    // Start on a new member or frame
+    virtual void reset() = 0;
+
+    virtual std::string error() const = 0;
+};
+
+// Incremental encoder writing one gzip member or zstd frame
+class Compressor {
+public:
+    enum Mode { NO_FLUSH, FLUSH, FINISH };
+
+    // nullptr if c is NONE or unsupported
+    static std::unique_ptr<Compressor> create(Compression c);
+    virtual ~Compressor() = default;
+
+    // Encode `len` bytes, appending the output to `out`. FLUSH makes all
+    // input so far decodable; FINISH also ends the member or frame.
+    virtual bool run(const char* in, size_t len, Mode mode, std::string& out) = 0;
+
+    // Start on a new member or frame
+    virtual void reset() = 0;
+};
+
+// `data` as a gzip member or zstd frame stored without compression, so its
+// bytes can be overwritten in place by patch_stored_prefix()
+std::string stored_member(Compression c, std::string_view data);
+
+// Overwrite the content bytes at `offset` of a file that starts with plain
+// text or a stored_member(), fixing up the member's checksum. False if the
+// file has neither layout or cannot be updated.
+bool patch_stored_prefix(std::fstream& file, size_t offset, std::string_view bytes);
+
+} // namespace toonlite
+
+#endif // TOON_COMPRESS_HPP
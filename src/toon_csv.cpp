@@ -0,0 +1,458 @@
+#include "toon_csv.h"
+#include "toon_scan.h"
+#include "toon_sexp.h"
+#include "toon_charconv.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace toonlite {
+
+namespace {
+
+std::string_view trim_space(std::string_view sv) {
+    while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.front()))) {
+        sv.remove_prefix(1);
+    }
+    while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.back()))) {
+        sv.remove_suffix(1);
+    }
+    return sv;
+}
+
+bool odd_quotes(std::string_view s) {
+    return std::count(s.begin(), s.end(), '"') % 2 != 0;
+}
+
+// Reads CSV records, joining physical lines while a quoted field is open
+class CsvReader {
+public:
+    explicit CsvReader(const std::string& filepath)
+        : reader_(filepath), filepath_(filepath) {
+        if (reader_.has_error()) {
+            throw ParseError(reader_.error_message(), 0, 0, "", filepath);
+        }
+    }
+
+    // Next non-blank record split on unquoted commas; views stay valid
+    // until the next call
+    bool next(std::vector<std::string_view>& fields, size_t& line_no);
+
+private:
+    BufferedReader reader_;
+    std::string filepath_;
+    std::string record_;
+    bool first_ = true;
+};
+
+bool CsvReader::next(std::vector<std::string_view>& fields, size_t& line_no) {
+    std::string_view line;
+    while (reader_.next_line(line, line_no)) {
+        if (first_) {
+            first_ = false;
+            if (line.substr(0, 3) == "\xEF\xBB\xBF") line.remove_prefix(3);
+        }
+        if (trim_space(line).empty()) continue;
+
+        std::string_view record = line;
+        if (odd_quotes(line)) {
+            // A quoted field runs on; lines from a streamed file do not
+            // outlive the next read, so the record is copied
+            record_.assign(line.data(), line.size());
+            bool open = true;
+            size_t next_no;
+            while (open) {
+                if (!reader_.next_line(line, next_no)) {
+                    throw ParseError("Unterminated quoted field", line_no, 0, "", filepath_);
+                }
+                record_ += '\n';
+                record_.append(line.data(), line.size());
+                open = !odd_quotes(line);
+            }
+            record = record_;
+        }
+
+        fields.clear();
+        size_t start = 0;
+        while (true) {
+            size_t comma = find_unquoted(record, start, ',', ',', false);
+            if (comma == std::string_view::npos) {
+                fields.push_back(record.substr(start));
+                break;
+            }
+            fields.push_back(record.substr(start, comma - start));
+            start = comma + 1;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Text of a CSV field with surrounding whitespace and CSV quoting removed
+std::string_view csv_unquote(std::string_view field, bool& quoted, std::string& scratch) {
+    field = trim_space(field);
+    quoted = field.size() >= 2 && field.front() == '"' && field.back() == '"';
+    if (!quoted) return field;
+
+    std::string_view body = field.substr(1, field.size() - 2);
+    if (body.find('"') == std::string_view::npos) return body;
+    scratch.clear();
+    for (size_t i = 0; i < body.size(); i++) {
+        scratch += body[i];
+        if (body[i] == '"' && i + 1 < body.size() && body[i + 1] == '"') i++;
+    }
+    return scratch;
+}
+
+// The spellings as.logical() accepts
+bool parse_logical(std::string_view s, bool& out) {
+    if (s == "TRUE" || s == "true" || s == "True" || s == "T") {
+        out = true;
+        return true;
+    }
+    if (s == "FALSE" || s == "false" || s == "False" || s == "F") {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+// A whole field as a number; of the non-finite values only the NaN, Inf
+// and -Inf that write.csv() produces count, so words like "nan" stay text
+bool parse_number(std::string_view s, double& out) {
+    if (s.empty()) return false;
+    auto result = double_from_chars(s.data(), s.data() + s.size(), out);
+    if (result.ec != std::errc{} || result.ptr != s.data() + s.size()) return false;
+    return std::isfinite(out) || s == "NaN" || s == "Inf" || s == "-Inf";
+}
+
+class CellWriter {
+public:
+    CellWriter(WriteBuffer& out, const CsvToToonOptions& opts, const std::string& filepath)
+        : out_(out), opts_(opts), filepath_(filepath) {}
+
+    // Append one CSV field as a TOON value of the given column type
+    void append(std::string_view field, ColType type, size_t line_no);
+
+private:
+    void append_number(double v, size_t line_no);
+    void append_null() { out_.append("null", 4); }
+    void append_bool(bool v) { v ? out_.append("true", 4) : out_.append("false", 5); }
+
+    WriteBuffer& out_;
+    const CsvToToonOptions& opts_;
+    const std::string& filepath_;
+    std::string scratch_;
+};
+
+void CellWriter::append_number(double v, size_t line_no) {
+    if (std::isfinite(v)) {
+        out_.append_double(v);
+    } else if (opts_.strict) {
+        throw ParseError(std::isnan(v) ? "NaN values not allowed in strict mode"
+                                       : "Inf/-Inf values not allowed in strict mode",
+                         line_no, 0, "", filepath_);
+    } else {
+        append_null();
+    }
+}
+
+void CellWriter::append(std::string_view field, ColType type, size_t line_no) {
+    bool quoted;
+    std::string_view text = csv_unquote(field, quoted, scratch_);
+
+    // As in read.csv(), empty fields are missing except in text columns
+    if (text == "NA" || (text.empty() && !quoted && type != ColType::STRING)) {
+        append_null();
+        return;
+    }
+
+    bool b;
+    double d;
+    switch (type) {
+        case ColType::STRING:
+            out_.append_escaped_string(text);
+            break;
+        case ColType::LOGICAL:
+            if (parse_logical(text, b)) {
+                append_bool(b);
+            } else if (parse_number(text, d) && !std::isnan(d)) {
+                append_bool(d != 0);
+            } else {
+                append_null();
+            }
+            break;
+        case ColType::INTEGER:
+            // Truncated like as.integer(); out of range is NA
+            if (parse_number(text, d) && std::isfinite(d) &&
+                std::trunc(d) >= -2147483647.0 && std::trunc(d) <= 2147483647.0) {
+                out_.append_int(static_cast<int>(std::trunc(d)));
+            } else {
+                append_null();
+            }
+            break;
+        case ColType::DOUBLE:
+            if (parse_number(text, d)) {
+                append_number(d, line_no);
+            } else {
+                append_null();
+            }
+            break;
+        default:
+            if (!quoted && parse_logical(text, b)) {
+                append_bool(b);
+            } else if (!quoted && parse_number(text, d)) {
+                append_number(d, line_no);
+            } else {
+                out_.append_escaped_string(text);
+            }
+            break;
+    }
+}
+
+// Column name for the TOON header: bytes that would end the field list are
+// replaced with '.', and unnamed columns are called V1, V2, ...
+std::string header_name(std::string_view field, size_t i, std::string& scratch) {
+    bool quoted;
+    std::string name(csv_unquote(field, quoted, scratch));
+    for (char& c : name) {
+        if (c == ',' || c == '{' || c == '}' || c == ':' || c == '"' || c == '\n' || c == '\r') {
+            c = '.';
+        }
+    }
+    if (name.empty()) {
+        name = "V" + std::to_string(i + 1);
+    }
+    return name;
+}
+
+void append_csv_string(WriteBuffer& out, std::string_view s) {
+    out.append_char('"');
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] != '"') continue;
+        out.append(s.data() + run, i + 1 - run);
+        out.append_char('"');
+        run = i + 1;
+    }
+    out.append(s.data() + run, s.size() - run);
+    out.append_char('"');
+}
+
+// Append one TOON cell as a CSV field, in the spelling write.csv() uses
+void append_csv_value(WriteBuffer& out, std::string_view value, std::string& scratch) {
+    if (value == "null") {
+        out.append("NA", 2);
+    } else if (value == "true") {
+        out.append("TRUE", 4);
+    } else if (value == "false") {
+        out.append("FALSE", 5);
+    } else if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        append_csv_string(out, decode_quoted(value.substr(1, value.size() - 2), scratch));
+    } else {
+        double d;
+        auto result = double_from_chars(value.data(), value.data() + value.size(), d);
+        if (value.empty() || result.ec != std::errc{} ||
+            result.ptr != value.data() + value.size()) {
+            append_csv_string(out, value);
+        } else if (std::isnan(d)) {
+            out.append("NaN", 3);
+        } else if (std::isinf(d)) {
+            d > 0 ? out.append("Inf", 3) : out.append("-Inf", 4);
+        } else {
+            out.append(value);
+        }
+    }
+}
+
+} // namespace
+
+size_t csv_to_toon(const std::string& csv_path, const std::string& toon_path,
+                   const CsvToToonOptions& opts) {
+    CsvReader csv(csv_path);
+    std::vector<std::string_view> fields;
+    size_t line_no = 0;
+    if (!csv.next(fields, line_no)) {
+        throw ParseError("CSV file has no header row", 0, 0, "", csv_path);
+    }
+
+    std::string scratch;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < fields.size(); i++) {
+        names.push_back(header_name(fields[i], i, scratch));
+    }
+    std::vector<ColType> types(names.size(), ColType::UNKNOWN);
+    for (const auto& [name, type] : opts.col_types) {
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == name) types[i] = type;
+        }
+    }
+
+    // Written beside the target, which is only replaced once complete
+    std::string tmp = toon_path + ".tmp";
+    OutputFile file(tmp, compression_for_path(toon_path));
+    if (!file.is_open()) {
+        throw ParseError("Cannot open file for writing: " + tmp, 0, 0, "", toon_path);
+    }
+
+    size_t rows = 0;
+    try {
+        write_counted_header(file, names);
+        WriteBuffer out(std::min(opts.buffer_size, WriteBuffer::DEFAULT_CAPACITY));
+        out.set_sink(&file, opts.buffer_size);
+        CellWriter cells(out, opts, csv_path);
+        std::string indent(static_cast<size_t>(std::max(opts.indent, 0)), ' ');
+
+        size_t check_interrupt_counter = 0;
+        while (csv.next(fields, line_no)) {
+            if (fields.size() > names.size()) {
+                throw ParseError("Row has " + std::to_string(fields.size()) +
+                    " fields but the header has " + std::to_string(names.size()),
+                    line_no, 0, "", csv_path);
+            }
+
+            // Short rows are filled with null, as read.csv() fills with NA
+            out.append(indent);
+            for (size_t i = 0; i < names.size(); i++) {
+                if (i > 0) out.append(", ", 2);
+                if (i < fields.size()) {
+                    cells.append(fields[i], types[i], line_no);
+                } else {
+                    out.append("null", 4);
+                }
+            }
+            out.append_char('\n');
+            rows++;
+
+            if (++check_interrupt_counter >= 10000) {
+                if (interrupt_pending()) {
+                    throw ParseError("Conversion interrupted by the user", 0, 0, "", csv_path);
+                }
+                check_interrupt_counter = 0;
+            }
+        }
+
+        out.flush();
+        file.close();
+        if (!file || !patch_row_count(tmp, rows)) {
+            throw ParseError("Error writing to file: " + toon_path, 0, 0, "", toon_path);
+        }
+    } catch (...) {
+        // Do not leave a partial document behind
+        file.close();
+        std::remove(tmp.c_str());
+        throw;
+    }
+    if (!replace_file(tmp, toon_path)) {
+        throw ParseError("Error writing to file: " + toon_path, 0, 0, "", toon_path);
+    }
+
+    return rows;
+}
+
+size_t toon_to_csv(const std::string& toon_path, const std::string& csv_path,
+                   const StreamOptions& opts, std::vector<Warning>& warnings) {
+    RowStreamer streamer(toon_path, opts);
+    if (!streamer.find_tabular_header()) {
+        throw ParseError("No tabular array found", 0, 0, "", toon_path);
+    }
+    const std::vector<std::string>& names = streamer.field_names();
+
+    std::string tmp = csv_path + ".tmp";
+    OutputFile file(tmp, compression_for_path(csv_path));
+    if (!file.is_open()) {
+        throw ParseError("Cannot open file for writing: " + tmp, 0, 0, "", csv_path);
+    }
+
+    size_t rows = 0;
+    size_t min_fields = SIZE_MAX;
+    size_t max_fields = 0;
+    try {
+        WriteBuffer out;
+        out.set_sink(&file);
+        std::string scratch;
+
+        for (size_t i = 0; i < names.size(); i++) {
+            if (i > 0) out.append_char(',');
+            std::string_view name = names[i];
+            if (name.size() >= 2 && name.front() == '"' && name.back() == '"') {
+                name = decode_quoted(name.substr(1, name.size() - 2), scratch);
+            }
+            append_csv_string(out, name);
+        }
+        out.append_char('\n');
+
+        std::string_view row;
+        size_t line_no;
+        std::vector<std::string_view> fields;
+        size_t check_interrupt_counter = 0;
+        while (streamer.next_row(row, line_no)) {
+            split_fields(row, ',', fields);
+            size_t n_fields = fields.size();
+            if (n_fields < min_fields) min_fields = n_fields;
+            if (n_fields > max_fields) max_fields = n_fields;
+
+            // The CSV header is already written, so long rows cannot add
+            // columns the way read_toon_df() does
+            if (n_fields > names.size() || (n_fields < names.size() && opts.ragged_rows == "error")) {
+                throw ParseError("Row has " + std::to_string(n_fields) + " fields but expected " +
+                    std::to_string(names.size()), line_no, 0, "", toon_path);
+            }
+
+            for (size_t i = 0; i < names.size(); i++) {
+                if (i > 0) out.append_char(',');
+                if (i < n_fields) {
+                    append_csv_value(out, fields[i], scratch);
+                } else {
+                    out.append("NA", 2);
+                }
+            }
+            out.append_char('\n');
+            rows++;
+
+            if (++check_interrupt_counter >= 10000) {
+                if (interrupt_pending()) {
+                    throw ParseError("Conversion interrupted by the user", 0, 0, "", toon_path);
+                }
+                check_interrupt_counter = 0;
+            }
+        }
+
+        size_t declared = streamer.declared_rows();
+        if (declared > 0 && rows != declared) {
+            if (opts.n_mismatch == "error") {
+                throw ParseError("Declared [" + std::to_string(declared) + "] but observed " +
+                    std::to_string(rows) + " rows", 0, 0, "", toon_path);
+            } else if (opts.warn) {
+                warnings.push_back(Warning("n_mismatch",
+                    "Declared [" + std::to_string(declared) + "] but observed " +
+                    std::to_string(rows) + " rows; using observed."));
+            }
+        }
+
+        out.flush();
+        file.close();
+        if (!file) {
+            throw ParseError("Error writing to file: " + csv_path, 0, 0, "", csv_path);
+        }
+    } catch (...) {
+        file.close();
+        std::remove(tmp.c_str());
+        throw;
+    }
+    if (!replace_file(tmp, csv_path)) {
+        throw ParseError("Error writing to file: " + csv_path, 0, 0, "", csv_path);
+    }
+
+    if (min_fields != max_fields && opts.warn) {
+        warnings.push_back(Warning("ragged_rows",
+            "Tabular rows had inconsistent field counts (min=" + std::to_string(min_fields) +
+            ", max=" + std::to_string(max_fields) + "). missing values filled with NA."));
+    }
+
+    return rows;
+}
+
+} // namespace toonlite
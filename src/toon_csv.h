@@ -0,0 +1,42 @@
+#ifndef TOON_CSV_HPP
+#define TOON_CSV_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "toon_errors.h"
+#include "toon_io.h"
+#include "toon_df.h"
+#include "toon_stream.h"
+
+namespace toonlite {
+
+// Native CSV <-> tabular TOON transcoding. Both directions convert one row
+// at a time from a BufferedReader into a WriteBuffer that drains to the
+// output file, so memory use does not grow with the input.
+
+struct CsvToToonOptions {
+    bool strict = true;       // NaN and Inf are errors (written as null otherwise)
+    int indent = 2;
+    size_t buffer_size = WriteBuffer::DEFAULT_CAPACITY;
+    std::vector<std::pair<std::string, ColType>> col_types;
+};
+
+// Convert a CSV file whose first record names the columns (RFC 4180
+// quoting, "" for a quote) into a tabular TOON array. Cells are typed one
+// at a time: NA and empty fields become null, TRUE/FALSE booleans, numbers
+// numbers and everything else strings, unless col_types fixes a column's
+// type. Returns the number of rows written.
+size_t csv_to_toon(const std::string& csv_path, const std::string& toon_path,
+                   const CsvToToonOptions& opts);
+
+// Convert the tabular array of a TOON file into CSV laid out as write.csv()
+// does: quoted names and strings, NA for null, TRUE/FALSE for booleans.
+// Numbers are copied as written. Ragged and row count warnings are added
+// to `warnings`. Returns the number of rows written.
+size_t toon_to_csv(const std::string& toon_path, const std::string& csv_path,
+                   const StreamOptions& opts, std::vector<Warning>& warnings);
+
+} // namespace toonlite
+
+#endif // TOON_CSV_HPP
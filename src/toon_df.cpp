@@ -1,116 +1,312 @@
 #include "toon_df.h"
 #include "toon_charconv.h"
+#include "toon_scan.h"
+#include "toon_arrow.h"
+#include "toon_keys.h"
+#include "toon_lazy.h"
 #include <charconv>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cmath>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <thread>
 
 namespace toonlite {
 
+namespace {
+
+// Chunks smaller than this are not worth a thread of their own
+constexpr size_t MIN_CHUNK_BYTES = size_t(1) << 16;
+
+// ColType is declared in promotion order
+ColType wider_type(ColType a, ColType b) {
+    return a < b ? b : a;
+}
+
+// Call fn(i) for each i in [0, n), each on its own thread. The calling
+// thread takes i = 0 (and any index a thread cannot be started for).
+// fn must not throw.
+template <typename F>
+void run_parallel(size_t n, const F& fn) {
+    std::vector<std::thread> workers;
+    workers.reserve(n);
+    for (size_t i = 1; i < n; i++) {
+        try {
+            workers.emplace_back(std::cref(fn), i);
+        } catch (const std::system_error&) {
+            fn(i);
+        }
+    }
+    if (n > 0) fn(0);
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+// Rethrow the error of the first failing chunk, which is the one a serial
+// parse would have stopped at, with its line number made absolute
+void rethrow_chunk_error(const std::vector<std::exception_ptr>& errors,
+                         const std::vector<size_t>& lines, size_t line_base) {
+    for (size_t c = 0; c < errors.size(); c++) {
+        if (errors[c]) {
+            try {
+                std::rethrow_exception(errors[c]);
+            } catch (const ParseError& e) {
+                throw ParseError(e.what(), e.line() > 0 ? e.line() + line_base : 0,
+                                 e.column(), e.snippet(), e.file());
+            }
+        }
+        line_base += lines[c];
+    }
+}
+
+} // namespace
+
 // ColBuilder implementation
-ColBuilder::ColBuilder(const std::string& name, size_t initial_capacity)
-    : name_(name), capacity_(initial_capacity) {
-    na_mask_.reserve(initial_capacity);
+
+namespace {
+
+// Upper bound on pre-sizing from a declared [N], so a bogus header cannot
+// force a huge allocation up front; larger columns still grow as needed
+constexpr size_t MAX_PRESIZE = size_t(1) << 24;
+
+// Code of an NA cell in a text column
+constexpr uint32_t NA_CODE = UINT32_MAX;
+
+// A text column with more distinct values than this, most of them unique,
+// stops deduplicating: the hash table would cost more than it saves
+constexpr size_t MIN_DEDUPE_ENTRIES = size_t(1) << 16;
+
+// R's NA_real_ is a NaN with 1954 in its low word (see R_IsNA); checked by
+// hand so worker threads need not call into R
+inline bool is_na_real(double x) {
+    if (!std::isnan(x)) return false;
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    return static_cast<uint32_t>(bits) == 1954;
+}
+
+// Bytes from_chars can start an integer or a double with (digits, sign,
+// ".5", inf, nan)
+inline bool can_start_number(char c) {
+    switch (c) {
+        case '-': case '.':
+        case 'i': case 'I': case 'n': case 'N':
+            return true;
+        default:
+            return c >= '0' && c <= '9';
+    }
+}
+
+// Parse [-]digits as an integer strictly inside R's integer range
+// (INT_MIN is NA_integer_, so it is left for the double parser)
+inline bool parse_int32(std::string_view s, int& out) {
+    size_t i = (s[0] == '-') ? 1 : 0;
+    if (i == s.size()) return false;
+
+    int64_t v = 0;
+    for (; i < s.size(); i++) {
+        unsigned d = static_cast<unsigned char>(s[i]) - '0';
+        if (d > 9) return false;
+        v = v * 10 + d;
+        if (v > INT32_MAX) {
+            // Too large for an R integer: left to the double parser
+            return false;
+        }
+    }
+    out = static_cast<int>(s[0] == '-' ? -v : v);
+    return true;
 }
 
-void ColBuilder::ensure_capacity(size_t n) {
-    if (n <= capacity_) return;
+void set_factor_attrs(SEXP codes, const StringPool& levels) {
+    SEXP lev = PROTECT(levels.to_strsxp());
+    Rf_setAttrib(codes, R_LevelsSymbol, lev);
+    SEXP cls = PROTECT(Rf_mkString("factor"));
+    Rf_setAttrib(codes, R_ClassSymbol, cls);
+    UNPROTECT(2);
+}
 
-    size_t new_cap = std::max(n, capacity_ * 2);
-    capacity_ = new_cap;
+} // namespace
 
-    switch (type_) {
+// StringPool implementation
+
+uint32_t StringPool::intern(std::string_view s) {
+    if (dedupe_) {
+        // Keep the table at most half full
+        if ((size() + 1) * 2 > slots_.size()) {
+            rehash(std::max(slots_.size() * 2, size_t(16)));
+        }
+
+        uint32_t h = static_cast<uint32_t>(std::hash<std::string_view>()(s));
+        size_t mask = slots_.size() - 1;
+        size_t i = h & mask;
+        while (slots_[i] != 0) {
+            uint32_t e = slots_[i] - 1;
+            if (hashes_[e] == h && (*this)[e] == s) return e;
+            i = (i + 1) & mask;
+        }
+        slots_[i] = static_cast<uint32_t>(size()) + 1;
+        hashes_.push_back(h);
+    }
+
+    bytes_.append(s.data(), s.size());
+    ends_.push_back(bytes_.size());
+    return static_cast<uint32_t>(size() - 1);
+}
+
+void StringPool::rehash(size_t n_slots) {
+    rehashes_++;
+    slots_.assign(n_slots, 0);
+    size_t mask = n_slots - 1;
+    for (size_t e = 0; e < hashes_.size(); e++) {
+        size_t i = hashes_[e] & mask;
+        while (slots_[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = static_cast<uint32_t>(e) + 1;
+    }
+}
+
+void StringPool::stop_dedupe() {
+    dedupe_ = false;
+    std::vector<uint32_t>().swap(slots_);
+    std::vector<uint32_t>().swap(hashes_);
+}
+
+void StringPool::clear() {
+    bytes_.clear();
+    ends_.clear();
+    hashes_.clear();
+    std::fill(slots_.begin(), slots_.end(), 0);
+    dedupe_ = true;
+    rehashes_ = 0;
+}
+
+std::string_view StringPool::operator[](size_t i) const {
+    size_t begin = i == 0 ? 0 : static_cast<size_t>(ends_[i - 1]);
+    return std::string_view(bytes_.data() + begin, static_cast<size_t>(ends_[i]) - begin);
+}
+
+size_t StringPool::memory() const {
+    return bytes_.capacity() + ends_.capacity() * sizeof(uint64_t) +
+        (hashes_.capacity() + slots_.capacity()) * sizeof(uint32_t);
+}
+
+SEXP StringPool::to_strsxp() const {
+    SEXP out = PROTECT(Rf_allocVector(STRSXP, size()));
+    for (size_t i = 0; i < size(); i++) {
+        std::string_view t = (*this)[i];
+        SET_STRING_ELT(out, i, Rf_mkCharLenCE(t.data(), static_cast<int>(t.size()), CE_UTF8));
+    }
+    UNPROTECT(1);
+    return out;
+}
+
+// ColBuilder implementation
+
+ColBuilder::ColBuilder(const std::string& name, size_t initial_capacity)
+    : name_(name), capacity_(std::min(initial_capacity, MAX_PRESIZE)) {}
+
+void ColBuilder::reset() {
+    type_ = ColType::UNKNOWN;
+    size_ = 0;
+    string_from_ = ColType::UNKNOWN;
+    ints_.clear();
+    dbls_.clear();
+    codes_.clear();
+    strings_.clear();
+
+    promotions_.clear();
+    promoted_values_ = 0;
+    unescaped_ = 0;
+    allocations_ = 0;
+    reserved_ = 0;
+    peak_bytes_ = 0;
+}
+
+// Leave UNKNOWN: rows so far were all null
+void ColBuilder::start_type(ColType t) {
+    type_ = t;
+    size_t cap = std::max(capacity_, size_);
+    size_t held = 0;
+    switch (t) {
+        case ColType::LOGICAL:
+        case ColType::INTEGER: held = ints_.capacity(); break;
+        case ColType::DOUBLE: held = dbls_.capacity(); break;
+        case ColType::STRING: held = codes_.capacity(); break;
+        default: break;
+    }
+    if (t != ColType::UNKNOWN) {
+        // Storage kept by reset() is reused
+        if (held < cap) allocations_++;
+        reserved_ = std::max(cap, held);
+    }
+    switch (t) {
         case ColType::LOGICAL:
-            lgl_data_.reserve(new_cap);
-            break;
         case ColType::INTEGER:
-            int_data_.reserve(new_cap);
+            ints_.reserve(cap);
+            ints_.assign(size_, NA_INTEGER);
             break;
         case ColType::DOUBLE:
-            dbl_data_.reserve(new_cap);
+            dbls_.reserve(cap);
+            dbls_.assign(size_, NA_REAL);
             break;
         case ColType::STRING:
-            str_data_.reserve(new_cap);
+            codes_.reserve(cap);
+            codes_.assign(size_, NA_CODE);
             break;
         default:
             break;
     }
-    na_mask_.reserve(new_cap);
 }
 
 void ColBuilder::promote_to(ColType new_type) {
     if (new_type == type_) return;
 
+    if (type_ == ColType::UNKNOWN) {
+        start_type(new_type);
+        return;
+    }
+
+    promotions_.emplace_back(type_, new_type);
+    if (new_type != ColType::INTEGER) {
+        promoted_values_ += size_;
+        allocations_++;
+        reserved_ = std::max(capacity_, size_);
+    }
+
     switch (new_type) {
         case ColType::INTEGER:
-            if (type_ == ColType::LOGICAL) {
-                // Logical -> Integer
-                int_data_.resize(size_);
-                for (size_t i = 0; i < size_; i++) {
-                    if (na_mask_[i]) {
-                        int_data_[i] = NA_INTEGER;
-                    } else {
-                        int_data_[i] = lgl_data_[i];
-                    }
-                }
-                lgl_data_.clear();
-            }
+            // Logical and integer share storage (NA_LOGICAL == NA_INTEGER)
             break;
 
         case ColType::DOUBLE:
-            if (type_ == ColType::LOGICAL) {
-                dbl_data_.resize(size_);
-                for (size_t i = 0; i < size_; i++) {
-                    if (na_mask_[i]) {
-                        dbl_data_[i] = NA_REAL;
-                    } else {
-                        dbl_data_[i] = static_cast<double>(lgl_data_[i]);
-                    }
-                }
-                lgl_data_.clear();
-            } else if (type_ == ColType::INTEGER) {
-                dbl_data_.resize(size_);
-                for (size_t i = 0; i < size_; i++) {
-                    if (na_mask_[i]) {
-                        dbl_data_[i] = NA_REAL;
-                    } else {
-                        dbl_data_[i] = static_cast<double>(int_data_[i]);
-                    }
-                }
-                int_data_.clear();
+            dbls_.reserve(std::max(capacity_, size_));
+            for (int v : ints_) {
+                dbls_.push_back(v == NA_INTEGER ? NA_REAL : static_cast<double>(v));
             }
+            peak_bytes_ = std::max(peak_bytes_, storage_bytes());
+            std::vector<int>().swap(ints_);
             break;
 
         case ColType::STRING:
-            str_data_.resize(size_);
-            if (type_ == ColType::LOGICAL) {
-                for (size_t i = 0; i < size_; i++) {
-                    if (na_mask_[i]) {
-                        str_data_[i] = "";  // NA marker
-                    } else {
-                        str_data_[i] = lgl_data_[i] ? "true" : "false";
-                    }
-                }
-                lgl_data_.clear();
-            } else if (type_ == ColType::INTEGER) {
-                for (size_t i = 0; i < size_; i++) {
-                    if (na_mask_[i]) {
-                        str_data_[i] = "";
-                    } else {
-                        str_data_[i] = std::to_string(int_data_[i]);
-                    }
-                }
-                int_data_.clear();
-            } else if (type_ == ColType::DOUBLE) {
-                for (size_t i = 0; i < size_; i++) {
-                    if (na_mask_[i]) {
-                        str_data_[i] = "";
-                    } else {
-                        str_data_[i] = std::to_string(dbl_data_[i]);
-                    }
+            codes_.reserve(std::max(capacity_, size_));
+            for (size_t i = 0; i < size_; i++) {
+                if (is_na(i)) {
+                    codes_.push_back(NA_CODE);
+                } else {
+                    push_text(typed_string(i, type_));
                 }
-                dbl_data_.clear();
             }
+            if (size_ > 0) string_from_ = type_;
+            peak_bytes_ = std::max(peak_bytes_, storage_bytes());
+            std::vector<int>().swap(ints_);
+            std::vector<double>().swap(dbls_);
             break;
 
         default:
@@ -121,299 +317,608 @@ void ColBuilder::promote_to(ColType new_type) {
 }
 
 void ColBuilder::force_type(ColType t) {
-    if (type_ == ColType::UNKNOWN) {
-        type_ = t;
-    } else if (type_ != t) {
+    if (size_ == 0) {
+        // Nothing stored yet: any type can be set directly
+        type_ = ColType::UNKNOWN;
+        start_type(t);
+    } else if (type_ < t) {
         promote_to(t);
     }
 }
 
-void ColBuilder::set_null(size_t row) {
-    ensure_capacity(row + 1);
+bool ColBuilder::is_na(size_t row) const {
+    switch (type_) {
+        case ColType::LOGICAL:
+        case ColType::INTEGER:
+            return ints_[row] == NA_INTEGER;
+        case ColType::DOUBLE:
+            return is_na_real(dbls_[row]);
+        case ColType::STRING:
+            return codes_[row] == NA_CODE;
+        default:
+            return true;
+    }
+}
+
+std::string_view ColBuilder::text(size_t row) const {
+    return strings_[codes_[row]];
+}
 
-    // Extend size if needed
-    while (size_ <= row) {
-        na_mask_.push_back(true);
-        switch (type_) {
-            case ColType::LOGICAL: lgl_data_.push_back(NA_LOGICAL); break;
-            case ColType::INTEGER: int_data_.push_back(NA_INTEGER); break;
-            case ColType::DOUBLE: dbl_data_.push_back(NA_REAL); break;
-            case ColType::STRING: str_data_.push_back(""); break;
-            case ColType::UNKNOWN:
-                // First value is null - defer type decision
-                lgl_data_.push_back(NA_LOGICAL);
-                break;
+// Text form of a stored non-NA value, after promotion to type `as`
+std::string ColBuilder::typed_string(size_t row, ColType as) const {
+    switch (as) {
+        case ColType::LOGICAL:
+            return ints_[row] ? "true" : "false";
+        case ColType::INTEGER:
+            return std::to_string(ints_[row]);
+        case ColType::DOUBLE: {
+            double v = type_ == ColType::DOUBLE ? dbls_[row] : static_cast<double>(ints_[row]);
+            if (!std::isfinite(v)) return std::to_string(v);
+            char buf[40];
+            return std::string(buf, double_to_chars(buf, v));
         }
-        size_++;
+        default:
+            return std::string(text(row));
     }
+}
 
-    na_mask_[row] = true;
+void ColBuilder::append_null() {
     switch (type_) {
-        case ColType::LOGICAL: lgl_data_[row] = NA_LOGICAL; break;
-        case ColType::INTEGER: int_data_[row] = NA_INTEGER; break;
-        case ColType::DOUBLE: dbl_data_[row] = NA_REAL; break;
-        case ColType::STRING: str_data_[row] = ""; break;
-        case ColType::UNKNOWN: lgl_data_[row] = NA_LOGICAL; break;
+        case ColType::LOGICAL:
+        case ColType::INTEGER:
+            ints_.push_back(NA_INTEGER);
+            break;
+        case ColType::DOUBLE:
+            dbls_.push_back(NA_REAL);
+            break;
+        case ColType::STRING:
+            codes_.push_back(NA_CODE);
+            break;
+        default:
+            // Type still undecided: just count the row
+            break;
     }
+    size_++;
 }
 
-void ColBuilder::parse_and_store(size_t row, std::string_view value) {
-    // Trim whitespace
-    while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front()))) {
-        value.remove_prefix(1);
+void ColBuilder::append_nulls(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        append_null();
     }
-    while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
-        value.remove_suffix(1);
+}
+
+void ColBuilder::append_bool(bool v) {
+    switch (type_) {
+        case ColType::UNKNOWN:
+            start_type(ColType::LOGICAL);
+            ints_.push_back(v);
+            break;
+        case ColType::LOGICAL:
+        case ColType::INTEGER:
+            ints_.push_back(v);
+            break;
+        case ColType::DOUBLE:
+            dbls_.push_back(v ? 1.0 : 0.0);
+            break;
+        default:
+            push_text(v ? "true" : "false");
+            break;
     }
+    size_++;
+}
 
-    // Check for null
-    if (value == "null") {
-        set_null(row);
+void ColBuilder::append_int(int v, std::string_view raw) {
+    switch (type_) {
+        case ColType::UNKNOWN:
+            start_type(ColType::INTEGER);
+            ints_.push_back(v);
+            break;
+        case ColType::LOGICAL:
+            promotions_.emplace_back(ColType::LOGICAL, ColType::INTEGER);
+            type_ = ColType::INTEGER;
+            ints_.push_back(v);
+            break;
+        case ColType::INTEGER:
+            ints_.push_back(v);
+            break;
+        case ColType::DOUBLE:
+            dbls_.push_back(static_cast<double>(v));
+            break;
+        default:
+            append_text(raw);
+            return;
+    }
+    size_++;
+}
+
+void ColBuilder::append_double(double v, std::string_view raw) {
+    if (type_ == ColType::STRING) {
+        append_text(raw);
         return;
     }
+    promote_to(ColType::DOUBLE);
+    dbls_.push_back(v);
+    size_++;
+}
 
-    // Check for boolean
-    if (value == "true") {
-        if (type_ == ColType::UNKNOWN) {
-            type_ = ColType::LOGICAL;
-            lgl_data_.resize(row + 1, NA_LOGICAL);
-            na_mask_.resize(row + 1, true);
-        } else if (type_ != ColType::LOGICAL) {
-            if (type_ == ColType::INTEGER) {
-                promote_to(ColType::INTEGER);
-                int_data_.resize(row + 1, NA_INTEGER);
-                int_data_[row] = 1;
-                na_mask_[row] = false;
-                if (row >= size_) size_ = row + 1;
-                return;
-            } else if (type_ == ColType::DOUBLE) {
-                dbl_data_.resize(row + 1, NA_REAL);
-                dbl_data_[row] = 1.0;
-                na_mask_[row] = false;
-                if (row >= size_) size_ = row + 1;
-                return;
-            } else {
-                promote_to(ColType::STRING);
-                str_data_.resize(row + 1, "");
-                str_data_[row] = "true";
-                na_mask_[row] = false;
-                if (row >= size_) size_ = row + 1;
-                return;
-            }
+// Store the code of a text cell (the row count is left to the caller)
+void ColBuilder::push_text(std::string_view v) {
+    // Text stops at an embedded NUL, as with a C string, so equal values
+    // here are equal CHARSXPs
+    const void* nul = std::memchr(v.data(), '\0', v.size());
+    if (nul) v = v.substr(0, static_cast<const char*>(nul) - v.data());
+
+    uint32_t code = strings_.intern(v);
+    codes_.push_back(code);
+
+    if (code + size_t(1) == strings_.size() && strings_.dedupes() &&
+        strings_.size() > MIN_DEDUPE_ENTRIES && strings_.size() * 2 > codes_.size()) {
+        strings_.stop_dedupe();
+    }
+}
+
+void ColBuilder::append_text(std::string_view v) {
+    promote_to(ColType::STRING);
+    push_text(v);
+    size_++;
+}
+
+void ColBuilder::append_quoted(std::string_view body) {
+    promote_to(ColType::STRING);
+    std::string_view text = decode_quoted(body, scratch_);
+    if (text.data() != body.data()) unescaped_++;
+    push_text(text);
+    size_++;
+}
+
+void ColBuilder::append(std::string_view value) {
+    // Fields normally arrive trimmed
+    if (!value.empty() && (std::isspace(static_cast<unsigned char>(value.front())) ||
+                           std::isspace(static_cast<unsigned char>(value.back())))) {
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front()))) {
+            value.remove_prefix(1);
         }
-        lgl_data_.resize(row + 1, NA_LOGICAL);
-        na_mask_.resize(row + 1, true);
-        lgl_data_[row] = 1;
-        na_mask_[row] = false;
-        if (row >= size_) size_ = row + 1;
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
+            value.remove_suffix(1);
+        }
+    }
+
+    if (value.empty()) {
+        append_text(value);
         return;
     }
 
-    if (value == "false") {
-        if (type_ == ColType::UNKNOWN) {
-            type_ = ColType::LOGICAL;
-            lgl_data_.resize(row + 1, NA_LOGICAL);
-            na_mask_.resize(row + 1, true);
-        } else if (type_ != ColType::LOGICAL) {
-            if (type_ == ColType::INTEGER) {
-                int_data_.resize(row + 1, NA_INTEGER);
-                int_data_[row] = 0;
-                na_mask_[row] = false;
-                if (row >= size_) size_ = row + 1;
-                return;
-            } else if (type_ == ColType::DOUBLE) {
-                dbl_data_.resize(row + 1, NA_REAL);
-                dbl_data_[row] = 0.0;
-                na_mask_[row] = false;
-                if (row >= size_) size_ = row + 1;
+    // Dispatch on the first byte
+    switch (value[0]) {
+        case 'n':
+            if (value == "null") {
+                append_null();
                 return;
+            }
+            break;  // may still be "nan"
+        case 't':
+            if (value == "true") {
+                append_bool(true);
             } else {
-                promote_to(ColType::STRING);
-                str_data_.resize(row + 1, "");
-                str_data_[row] = "false";
-                na_mask_[row] = false;
-                if (row >= size_) size_ = row + 1;
-                return;
+                append_text(value);
             }
-        }
-        lgl_data_.resize(row + 1, NA_LOGICAL);
-        na_mask_.resize(row + 1, true);
-        lgl_data_[row] = 0;
-        na_mask_[row] = false;
-        if (row >= size_) size_ = row + 1;
-        return;
-    }
-
-    // Check for quoted string
-    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
-        std::string unquoted;
-        unquoted.reserve(value.size() - 2);
-
-        for (size_t i = 1; i < value.size() - 1; i++) {
-            if (value[i] == '\\' && i + 1 < value.size() - 1) {
-                char next = value[i + 1];
-                switch (next) {
-                    case '"': unquoted += '"'; i++; break;
-                    case '\\': unquoted += '\\'; i++; break;
-                    case 'n': unquoted += '\n'; i++; break;
-                    case 'r': unquoted += '\r'; i++; break;
-                    case 't': unquoted += '\t'; i++; break;
-                    default: unquoted += value[i]; break;
-                }
+            return;
+        case 'f':
+            if (value == "false") {
+                append_bool(false);
             } else {
-                unquoted += value[i];
+                append_text(value);
             }
+            return;
+        case '"':
+            if (value.size() >= 2 && value.back() == '"') {
+                append_quoted(value.substr(1, value.size() - 2));
+            } else {
+                append_text(value);
+            }
+            return;
+        default:
+            break;
+    }
+
+    if (can_start_number(value[0])) {
+        int iv;
+        if (parse_int32(value, iv)) {
+            append_int(iv, value);
+            return;
         }
+        double dv;
+        auto result = double_from_chars(value.data(), value.data() + value.size(), dv);
+        if (result.ec == std::errc{} && result.ptr == value.data() + value.size()) {
+            append_double(dv, value);
+            return;
+        }
+    }
 
-        promote_to(ColType::STRING);
-        str_data_.resize(row + 1, "");
-        na_mask_.resize(row + 1, true);
-        str_data_[row] = std::move(unquoted);
-        na_mask_[row] = false;
-        if (row >= size_) size_ = row + 1;
-        return;
+    append_text(value);
+}
+
+namespace {
+
+// Type append() gives a value on its own (UNKNOWN for null), with the same
+// dispatch but nothing stored
+ColType value_type(std::string_view value) {
+    while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front()))) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back()))) {
+        value.remove_suffix(1);
     }
+    if (value.empty()) return ColType::STRING;
 
-    // Try to parse as integer
-    bool has_decimal = false;
-    bool has_exp = false;
-    for (char c : value) {
-        if (c == '.') has_decimal = true;
-        if (c == 'e' || c == 'E') has_exp = true;
+    switch (value[0]) {
+        case 'n':
+            if (value == "null") return ColType::UNKNOWN;
+            break;
+        case 't':
+            return value == "true" ? ColType::LOGICAL : ColType::STRING;
+        case 'f':
+            return value == "false" ? ColType::LOGICAL : ColType::STRING;
+        case '"':
+            return ColType::STRING;
+        default:
+            break;
     }
 
-    if (!has_decimal && !has_exp) {
-        int64_t int_val;
-        auto result = std::from_chars(value.data(), value.data() + value.size(), int_val);
+    if (can_start_number(value[0])) {
+        int iv;
+        if (parse_int32(value, iv)) return ColType::INTEGER;
+        double dv;
+        auto result = double_from_chars(value.data(), value.data() + value.size(), dv);
         if (result.ec == std::errc{} && result.ptr == value.data() + value.size()) {
-            if (int_val >= INT32_MIN && int_val <= INT32_MAX) {
-                if (type_ == ColType::UNKNOWN) {
-                    type_ = ColType::INTEGER;
-                    int_data_.resize(row + 1, NA_INTEGER);
-                    na_mask_.resize(row + 1, true);
-                } else if (type_ == ColType::LOGICAL) {
-                    promote_to(ColType::INTEGER);
-                    int_data_.resize(row + 1, NA_INTEGER);
-                    na_mask_.resize(row + 1, true);
-                } else if (type_ == ColType::DOUBLE) {
-                    dbl_data_.resize(row + 1, NA_REAL);
-                    na_mask_.resize(row + 1, true);
-                    dbl_data_[row] = static_cast<double>(int_val);
-                    na_mask_[row] = false;
-                    if (row >= size_) size_ = row + 1;
-                    return;
-                } else if (type_ == ColType::STRING) {
-                    str_data_.resize(row + 1, "");
-                    na_mask_.resize(row + 1, true);
-                    str_data_[row] = std::string(value);
-                    na_mask_[row] = false;
-                    if (row >= size_) size_ = row + 1;
-                    return;
-                }
-
-                int_data_.resize(row + 1, NA_INTEGER);
-                na_mask_.resize(row + 1, true);
-                int_data_[row] = static_cast<int>(int_val);
-                na_mask_[row] = false;
-                if (row >= size_) size_ = row + 1;
-                return;
-            }
+            return ColType::DOUBLE;
         }
     }
+    return ColType::STRING;
+}
 
-    // Try to parse as double
-    double dbl_val;
-    auto result = double_from_chars(value.data(), value.data() + value.size(), dbl_val);
-    if (result.ec == std::errc{} && result.ptr == value.data() + value.size()) {
-        if (type_ == ColType::UNKNOWN || type_ == ColType::LOGICAL || type_ == ColType::INTEGER) {
-            promote_to(ColType::DOUBLE);
-            dbl_data_.resize(row + 1, NA_REAL);
-            na_mask_.resize(row + 1, true);
-        } else if (type_ == ColType::STRING) {
-            str_data_.resize(row + 1, "");
-            na_mask_.resize(row + 1, true);
-            str_data_[row] = std::string(value);
-            na_mask_[row] = false;
-            if (row >= size_) size_ = row + 1;
-            return;
-        }
+} // namespace
 
-        dbl_data_.resize(row + 1, NA_REAL);
-        na_mask_.resize(row + 1, true);
-        dbl_data_[row] = dbl_val;
-        na_mask_[row] = false;
-        if (row >= size_) size_ = row + 1;
-        return;
+SEXP ColBuilder::finalize(bool as_factor) {
+    SEXP result;
+
+    switch (type_) {
+        case ColType::INTEGER:
+            result = PROTECT(Rf_allocVector(INTSXP, size_));
+            if (size_ > 0) std::memcpy(INTEGER(result), ints_.data(), size_ * sizeof(int));
+            break;
+        case ColType::DOUBLE:
+            result = PROTECT(Rf_allocVector(REALSXP, size_));
+            if (size_ > 0) std::memcpy(REAL(result), dbls_.data(), size_ * sizeof(double));
+            break;
+        case ColType::STRING:
+            if (as_factor) {
+                StringPool levels;
+                result = PROTECT(Rf_allocVector(INTSXP, size_));
+                write_codes(INTEGER(result), levels, ColType::STRING);
+                set_factor_attrs(result, levels);
+            } else {
+                result = PROTECT(Rf_allocVector(STRSXP, size_));
+                write_strings(result, 0, ColType::STRING);
+            }
+            break;
+        default:
+            // Logical, or still unknown (all null)
+            result = PROTECT(Rf_allocVector(LGLSXP, size_));
+            copy_to(LOGICAL(result));
+            break;
     }
 
-    // Treat as string (unquoted)
-    promote_to(ColType::STRING);
-    str_data_.resize(row + 1, "");
-    na_mask_.resize(row + 1, true);
-    str_data_[row] = std::string(value);
-    na_mask_[row] = false;
-    if (row >= size_) size_ = row + 1;
+    UNPROTECT(1);
+    return result;
 }
 
-void ColBuilder::set(size_t row, std::string_view value) {
-    ensure_capacity(row + 1);
-    parse_and_store(row, value);
+const char* col_type_name(ColType t) {
+    switch (t) {
+        case ColType::INTEGER: return "integer";
+        case ColType::DOUBLE: return "double";
+        case ColType::STRING: return "character";
+        default: return "logical";
+    }
 }
 
-SEXP ColBuilder::finalize() {
-    SEXP result;
+size_t ColBuilder::storage_bytes() const {
+    return ints_.capacity() * sizeof(int) + dbls_.capacity() * sizeof(double) +
+        codes_.capacity() * sizeof(uint32_t) + strings_.memory();
+}
 
-    // Default to logical if still unknown
+ColumnStats ColBuilder::stats() const {
+    ColumnStats s;
+    s.name = name_;
+    s.type = col_type_name(type_);
+    for (const auto& [from, to] : promotions_) {
+        s.promotions.push_back(std::string(col_type_name(from)) + " -> " + col_type_name(to));
+    }
+    s.promoted_values = promoted_values_;
+    s.unescaped = unescaped_;
+    if (type_ == ColType::STRING) {
+        // Distinct values share a CHARSXP only while deduplicating
+        s.strings = strings_.dedupes() ? strings_.size()
+            : size_ - static_cast<size_t>(std::count(codes_.begin(), codes_.end(), NA_CODE));
+    }
+
+    // Growth past the reserved capacity, which the standard libraries
+    // double each time
+    size_t capacity = std::max({ints_.capacity(), dbls_.capacity(), codes_.capacity()});
+    size_t growths = 0;
+    for (size_t c = std::max(reserved_, size_t(1)); c < capacity; c *= 2) {
+        growths++;
+    }
+    s.allocations = allocations_ + growths + strings_.rehashes();
+    s.peak_bytes = std::max(peak_bytes_, storage_bytes());
+    return s;
+}
+
+void ColBuilder::copy_to(int* out) const {
     if (type_ == ColType::UNKNOWN) {
-        type_ = ColType::LOGICAL;
+        std::fill_n(out, size_, NA_INTEGER);
+    } else if (size_ > 0) {
+        std::memcpy(out, ints_.data(), size_ * sizeof(int));
     }
+}
 
-    switch (type_) {
-        case ColType::LOGICAL: {
-            result = PROTECT(Rf_allocVector(LGLSXP, size_));
-            int* out = LOGICAL(result);
-            for (size_t i = 0; i < size_; i++) {
-                out[i] = na_mask_[i] ? NA_LOGICAL : lgl_data_[i];
-            }
-            UNPROTECT(1);
-            break;
+void ColBuilder::copy_to(double* out) const {
+    if (type_ == ColType::DOUBLE) {
+        if (size_ > 0) std::memcpy(out, dbls_.data(), size_ * sizeof(double));
+    } else if (type_ == ColType::UNKNOWN) {
+        std::fill_n(out, size_, NA_REAL);
+    } else {
+        for (size_t i = 0; i < size_; i++) {
+            out[i] = ints_[i] == NA_INTEGER ? NA_REAL : static_cast<double>(ints_[i]);
         }
-        case ColType::INTEGER: {
-            result = PROTECT(Rf_allocVector(INTSXP, size_));
-            int* out = INTEGER(result);
-            for (size_t i = 0; i < size_; i++) {
-                out[i] = na_mask_[i] ? NA_INTEGER : int_data_[i];
-            }
-            UNPROTECT(1);
-            break;
+    }
+}
+
+void ColBuilder::write_strings(SEXP out, size_t offset, ColType as) const {
+    if (type_ == ColType::STRING && strings_.dedupes()) {
+        // One CHARSXP per distinct value, shared by all its cells
+        SEXP levels = PROTECT(strings_.to_strsxp());
+        for (size_t i = 0; i < size_; i++) {
+            uint32_t code = codes_[i];
+            SET_STRING_ELT(out, offset + i, code == NA_CODE ? NA_STRING : STRING_ELT(levels, code));
         }
-        case ColType::DOUBLE: {
-            result = PROTECT(Rf_allocVector(REALSXP, size_));
-            double* out = REAL(result);
-            for (size_t i = 0; i < size_; i++) {
-                out[i] = na_mask_[i] ? NA_REAL : dbl_data_[i];
+        UNPROTECT(1);
+        return;
+    }
+
+    for (size_t i = 0; i < size_; i++) {
+        SEXP ch;
+        if (is_na(i)) {
+            ch = NA_STRING;
+        } else if (type_ == ColType::STRING) {
+            std::string_view t = text(i);
+            ch = Rf_mkCharLenCE(t.data(), static_cast<int>(t.size()), CE_UTF8);
+        } else {
+            ch = Rf_mkCharCE(typed_string(i, as).c_str(), CE_UTF8);
+        }
+        SET_STRING_ELT(out, offset + i, ch);
+    }
+}
+
+void ColBuilder::write_codes(int* out, StringPool& levels, ColType as) const {
+    if (type_ == ColType::STRING) {
+        // Map each entry to its level on first use, so levels keep the
+        // order values first appear in
+        std::vector<uint32_t> level_of(strings_.size(), NA_CODE);
+        for (size_t i = 0; i < size_; i++) {
+            uint32_t code = codes_[i];
+            if (code == NA_CODE) {
+                out[i] = NA_INTEGER;
+                continue;
             }
-            UNPROTECT(1);
-            break;
+            if (level_of[code] == NA_CODE) {
+                level_of[code] = levels.intern(strings_[code]);
+            }
+            out[i] = static_cast<int>(level_of[code]) + 1;
         }
-        case ColType::STRING: {
-            result = PROTECT(Rf_allocVector(STRSXP, size_));
+        return;
+    }
+
+    for (size_t i = 0; i < size_; i++) {
+        out[i] = is_na(i) ? NA_INTEGER : static_cast<int>(levels.intern(typed_string(i, as))) + 1;
+    }
+}
+
+void ColBuilder::write_arrow(ArrowColumn& out, size_t offset, ColType as) const {
+    switch (out.type) {
+        case ColType::LOGICAL:
+        case ColType::INTEGER:
+            copy_to(out.ints.data() + offset);
+            break;
+        case ColType::DOUBLE:
+            copy_to(out.dbls.data() + offset);
+            break;
+        default:
             for (size_t i = 0; i < size_; i++) {
-                if (na_mask_[i]) {
-                    SET_STRING_ELT(result, i, NA_STRING);
+                if (is_na(i)) {
+                    out.append_null();
+                } else if (type_ == ColType::STRING) {
+                    out.append_text(text(i));
                 } else {
-                    SET_STRING_ELT(result, i, Rf_mkCharCE(str_data_[i].c_str(), CE_UTF8));
+                    out.append_text(typed_string(i, as));
                 }
             }
-            UNPROTECT(1);
             break;
-        }
+    }
+}
+
+void ColBuilder::take_arrow(ArrowColumn& out) {
+    switch (type_) {
+        case ColType::UNKNOWN:
+            out.ints.assign(size_, NA_LOGICAL);
+            break;
+        case ColType::LOGICAL:
+        case ColType::INTEGER:
+            out.ints = std::move(ints_);
+            break;
+        case ColType::DOUBLE:
+            out.dbls = std::move(dbls_);
+            break;
         default:
-            result = R_NilValue;
+            write_arrow(out, 0, ColType::STRING);
+            strings_ = StringPool();
+            std::vector<uint32_t>().swap(codes_);
             break;
     }
+    type_ = ColType::UNKNOWN;
+    size_ = 0;
+}
 
-    return result;
+// RowFilter / RowProjection implementation
+bool RowFilter::matches(std::string_view field, std::string& scratch) const {
+    if (field == "null") {
+        return false;
+    }
+
+    if (is_range) {
+        if (field.empty() || !can_start_number(field[0])) {
+            return false;
+        }
+        double v;
+        auto result = double_from_chars(field.data(), field.data() + field.size(), v);
+        if (result.ec != std::errc{} || result.ptr != field.data() + field.size()) {
+            return false;
+        }
+        return v >= min && v <= max;
+    }
+
+    if (field.size() >= 2 && field.front() == '"' && field.back() == '"') {
+        field = decode_quoted(field.substr(1, field.size() - 2), scratch);
+    }
+    for (const auto& value : values) {
+        if (field == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RowProjection::resolve(const std::vector<std::string>& header,
+                            const std::vector<std::string>& select,
+                            const std::vector<RowFilter>& filters, const std::string& file) {
+    NameLookup lookup(header);
+    auto position = [&](const std::string& name) {
+        size_t i = lookup.find(name);
+        if (i != KeyIndex::npos) return i;
+        throw ParseError("Column not found: " + name, 0, 0, "", file);
+    };
+
+    fields_.clear();
+    for (const auto& name : select) {
+        fields_.push_back(position(name));
+    }
+    filters_ = filters;
+    filter_fields_.clear();
+    for (const auto& filter : filters_) {
+        filter_fields_.push_back(position(filter.column));
+    }
+
+    // Without a selection every field is stored and the row split in full
+    needed_ = SIZE_MAX;
+    if (!fields_.empty()) {
+        needed_ = 0;
+        for (size_t f : fields_) needed_ = std::max(needed_, f + 1);
+        for (size_t f : filter_fields_) needed_ = std::max(needed_, f + 1);
+    }
+}
+
+bool RowProjection::keep(const std::vector<std::string_view>& row) {
+    for (size_t i = 0; i < filters_.size(); i++) {
+        size_t f = filter_fields_[i];
+        if (f >= row.size() || !filters_[i].matches(row[f], scratch_)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ColType> sample_column_types(BufferedReader& reader, const RowSample& sample,
+                                         RowProjection projection, size_t ncol) {
+    std::vector<ColBuilder> columns;
+    columns.reserve(ncol);
+    for (size_t j = 0; j < ncol; j++) {
+        columns.emplace_back("", std::min(sample.rows, size_t(1000)));
+    }
+
+    std::vector<std::string_view> fields;
+    size_t skip = sample.skip;
+
+    // Add up to n rows from r to the columns
+    auto take_rows = [&](BufferedReader& r, size_t n) {
+        std::string_view line;
+        size_t line_no;
+        try {
+            while (n > 0 && r.next_line(line, line_no)) {
+                size_t start = line.find_first_not_of(" \t\r");
+                if (start == std::string_view::npos) continue;
+                std::string_view content = line.substr(start);
+                if (sample.allow_comments) {
+                    if (content[0] == '#' || (content.size() >= 2 && content[0] == '/' &&
+                                              content[1] == '/')) {
+                        continue;
+                    }
+                    size_t hash = find_unquoted(content, 0, '#', '#', false);
+                    if (hash != std::string_view::npos) content = content.substr(0, hash);
+                }
+                if (skip > 0) {
+                    skip--;
+                    continue;
+                }
+
+                size_t n_fields = split_fields(content, sample.delimiter, fields,
+                                               projection.fields_needed());
+                n--;
+                if (!projection.keep(fields)) continue;
+                for (size_t j = 0; j < ncol; j++) {
+                    size_t f = projection.selects() ? projection.fields()[j] : j;
+                    if (f < n_fields) {
+                        columns[j].append(fields[f]);
+                    }
+                }
+            }
+        } catch (const ParseError&) {
+            // The parse reports it, with the right line
+        }
+    };
+
+    size_t begin = reader.offset();
+    if (sample.spread && reader.is_contiguous() && sample.skip == 0) {
+        // Spans starting just after a newline, as the parallel chunks do,
+        // and not before the end of the previous one: a small table is
+        // then read through instead of sampled twice
+        const char* data = reader.data();
+        size_t end = reader.size();
+        size_t per_span = (sample.rows + SAMPLE_SPANS - 1) / SAMPLE_SPANS;
+        size_t done = begin;
+        for (size_t i = 0; i < SAMPLE_SPANS && done < end; i++) {
+            size_t from = begin + (end - begin) / SAMPLE_SPANS * i;
+            if (i > 0 && from > done) {
+                const void* nl = std::memchr(data + from, '\n', end - from);
+                if (nl == nullptr) break;
+                from = static_cast<const char*>(nl) - data + 1;
+            }
+            from = std::max(from, done);
+            if (from >= end) break;
+            BufferedReader span(data + from, end - from);
+            take_rows(span, per_span);
+            done = from + span.offset();
+        }
+    } else {
+        size_t line = reader.current_line() + 1;
+        take_rows(reader, sample.rows);
+        reader.seek(begin, line);
+    }
+
+    std::vector<ColType> types;
+    for (const auto& col : columns) {
+        types.push_back(col.type());
+    }
+    return types;
 }
 
 // TabularParser implementation
@@ -430,7 +935,8 @@ std::string_view TabularParser::trim(std::string_view sv) {
     return sv;
 }
 
-bool TabularParser::parse_header(std::string_view header) {
+bool TabularParser::split_header(std::string_view header, size_t& declared,
+                                 std::vector<std::string>& fields) {
     header = trim(header);
 
     // Format: [N]{field1,field2,...}:
@@ -446,7 +952,7 @@ bool TabularParser::parse_header(std::string_view header) {
     }
 
     if (pos > 1) {
-        auto result = std::from_chars(header.data() + 1, header.data() + pos, declared_rows_);
+        auto result = std::from_chars(header.data() + 1, header.data() + pos, declared);
         (void)result;
     }
 
@@ -478,7 +984,7 @@ bool TabularParser::parse_header(std::string_view header) {
             : fields_str;
         field = trim(field);
         if (!field.empty()) {
-            field_names_.push_back(std::string(field));
+            fields.push_back(std::string(field));
         }
         if (comma != std::string_view::npos) {
             fields_str = fields_str.substr(comma + 1);
@@ -487,78 +993,80 @@ bool TabularParser::parse_header(std::string_view header) {
         }
     }
 
-    // Create column builders
-    for (const auto& name : field_names_) {
-        columns_.emplace_back(name, std::max(size_t(1000), declared_rows_));
-    }
-
-    // Apply user-specified column types
-    for (const auto& [name, type] : opts_.col_types) {
-        for (auto& col : columns_) {
-            if (col.name() == name) {
-                col.force_type(type);
-                break;
-            }
-        }
-    }
-
-    return !field_names_.empty();
+    return true;
 }
 
-std::vector<std::string_view> TabularParser::split_row(std::string_view line, char delimiter) {
-    std::vector<std::string_view> fields;
-
-    size_t start = 0;
-    bool in_string = false;
-    bool escape = false;
-
-    for (size_t i = 0; i < line.size(); i++) {
-        char c = line[i];
-
-        if (escape) {
-            escape = false;
-            continue;
-        }
-
-        if (c == '\\' && in_string) {
-            escape = true;
-            continue;
-        }
+bool TabularParser::parse_header(std::string_view header) {
+    if (!split_header(header, declared_rows_, field_names_)) {
+        return false;
+    }
 
-        if (c == '"') {
-            in_string = !in_string;
-            continue;
+    // Create column builders, one per selected field
+    header_columns_ = field_names_.size();
+    projection_.resolve(field_names_, opts_.select, opts_.filters, current_file_);
+    if (projection_.selects()) {
+        for (size_t f : projection_.fields()) {
+            columns_.emplace_back(field_names_[f], std::max(size_t(1000), declared_rows_));
         }
-
-        if (!in_string && c == delimiter) {
-            fields.push_back(trim(line.substr(start, i - start)));
-            start = i + 1;
+    } else {
+        for (const auto& name : field_names_) {
+            columns_.emplace_back(name, std::max(size_t(1000), declared_rows_));
         }
     }
 
-    // Last field
-    if (start <= line.size()) {
-        fields.push_back(trim(line.substr(start)));
+    // Apply user-specified column types
+    if (!opts_.col_types.empty()) {
+        std::vector<std::string> names;
+        for (const auto& col : columns_) names.push_back(col.name());
+        NameLookup lookup(names);
+        for (const auto& [name, type] : opts_.col_types) {
+            size_t i = lookup.find(name);
+            if (i != KeyIndex::npos) columns_[i].force_type(type);
+        }
     }
 
-    return fields;
+    return !field_names_.empty();
 }
 
 void TabularParser::parse_row_line(std::string_view line, size_t line_no) {
-    auto fields = split_row(line, delimiter_);
-    size_t n_fields = fields.size();
+    // Fields past the last selected or filtered one are counted, not stored
+    auto& fields = row_fields_;
+    size_t n_fields = split_fields(line, delimiter_, fields, projection_.fields_needed());
+    scanned_rows_++;
 
     // Track min/max fields
     if (n_fields < min_fields_) min_fields_ = n_fields;
     if (n_fields > max_fields_) max_fields_ = n_fields;
 
-    // Handle ragged rows
-    if (n_fields != columns_.size()) {
-        if (opts_.ragged_rows == "error") {
-            throw ParseError("Row has " + std::to_string(n_fields) + " fields but expected " +
-                std::to_string(columns_.size()), line_no, 0, "", current_file_);
+    // Handle ragged rows; a selection never grows the schema
+    size_t expected = projection_.selects() ? header_columns_ : columns_.size();
+    if (n_fields != expected && opts_.ragged_rows == "error") {
+        throw ParseError("Row has " + std::to_string(n_fields) + " fields but expected " +
+            std::to_string(expected), line_no, 0, "", current_file_);
+    }
+
+    if (!projection_.keep(fields)) {
+        return;
+    }
+
+    if (projection_.selects()) {
+        if (lazy_) {
+            scan_row(line, n_fields);
+            return;
         }
+        const auto& map = projection_.fields();
+        for (size_t i = 0; i < columns_.size(); i++) {
+            if (map[i] < n_fields) {
+                columns_[i].append(fields[map[i]]);
+            } else {
+                columns_[i].append_null();
+            }
+        }
+        observed_rows_++;
+        return;
+    }
 
+    if (n_fields != columns_.size()) {
         // expand_warn mode
         if (n_fields > columns_.size()) {
             // Expand schema
@@ -573,27 +1081,54 @@ void TabularParser::parse_row_line(std::string_view line, size_t line_no) {
                 field_names_.push_back(new_name);
 
                 // Backfill with NA
-                for (size_t r = 0; r < observed_rows_; r++) {
-                    columns_.back().set_null(r);
-                }
+                columns_.back().append_nulls(observed_rows_);
             }
             schema_expansions_ += extra;
         }
     }
 
+    if (lazy_) {
+        scan_row(line, n_fields);
+        return;
+    }
+
     // Store values
-    size_t row = observed_rows_;
     for (size_t i = 0; i < columns_.size(); i++) {
         if (i < n_fields) {
-            columns_[i].set(row, fields[i]);
+            columns_[i].append(fields[i]);
         } else {
-            columns_[i].set_null(row);
+            columns_[i].append_null();
         }
     }
 
     observed_rows_++;
 }
 
+void TabularParser::start_scan() {
+    lazy_start_.clear();
+    for (auto& col : columns_) {
+        lazy_start_.push_back(col.type());
+        col = ColBuilder(col.name(), 0);
+    }
+    lazy_types_ = lazy_start_;
+}
+
+void TabularParser::scan_row(std::string_view line, size_t n_fields) {
+    // Columns added by expansion start untyped
+    lazy_start_.resize(columns_.size(), ColType::UNKNOWN);
+    lazy_types_.resize(columns_.size(), ColType::UNKNOWN);
+
+    bool selects = projection_.selects();
+    for (size_t i = 0; i < columns_.size(); i++) {
+        size_t f = selects ? projection_.fields()[i] : i;
+        if (f < n_fields && lazy_types_[i] != ColType::STRING) {
+            lazy_types_[i] = wider_type(lazy_types_[i], value_type(row_fields_[f]));
+        }
+    }
+    lazy_rows_.push_back(line);
+    observed_rows_++;
+}
+
 bool TabularParser::find_tabular_array(BufferedReader& reader, std::string& header_line, size_t& header_line_no) {
     std::string_view line;
     size_t line_no;
@@ -612,22 +1147,19 @@ bool TabularParser::find_tabular_array(BufferedReader& reader, std::string& head
                 continue;
             }
 
-            // Look for "key:"
-            size_t colon = trimmed.find(':');
-            if (colon != std::string_view::npos) {
-                auto key = trim(trimmed.substr(0, colon));
-                if (key == target_key) {
-                    found_key = true;
-                    // Check if value is inline
-                    auto value = trim(trimmed.substr(colon + 1));
-                    if (!value.empty() && value[0] == '[') {
-                        header_line = std::string(value);
-                        header_line_no = line_no;
-                        return true;
-                    }
-                    // Value is on next line(s)
-                    break;
+            // The first member with that name at any depth, as the file is
+            // read a line at a time
+            std::string_view value;
+            if (match_key(trimmed, target_key, value)) {
+                found_key = true;
+                // Check if value is inline
+                if (!value.empty() && value[0] == '[') {
+                    header_line = std::string(value);
+                    header_line_no = line_no;
+                    return true;
                 }
+                // Value is on next line(s)
+                break;
             }
         }
 
@@ -661,6 +1193,23 @@ bool TabularParser::find_tabular_array(BufferedReader& reader, std::string& head
     return false;
 }
 
+void TabularParser::apply_sampled_types(BufferedReader& reader) {
+    bool ranged = opts_.row_start > 0 || opts_.row_count != SIZE_MAX;
+    RowSample sample;
+    sample.rows = std::min(opts_.sample_rows, row_limit_);
+    sample.spread = !ranged;
+    sample.skip = skip_rows_;
+    sample.delimiter = delimiter_;
+    sample.allow_comments = opts_.allow_comments;
+
+    std::vector<ColType> types = sample_column_types(reader, sample, projection_, columns_.size());
+    for (size_t j = 0; j < columns_.size(); j++) {
+        if (types[j] != ColType::UNKNOWN) {
+            columns_[j].force_type(wider_type(columns_[j].type(), types[j]));
+        }
+    }
+}
+
 void TabularParser::parse_rows(BufferedReader& reader, int base_indent) {
     std::string_view line;
     size_t line_no;
@@ -696,17 +1245,21 @@ void TabularParser::parse_rows(BufferedReader& reader, int base_indent) {
             break;
         }
 
+        // Rows before the requested range are counted off unparsed
+        if (skip_rows_ > 0) {
+            skip_rows_--;
+            continue;
+        }
+        if (scanned_rows_ >= row_limit_) {
+            break;
+        }
+
         // Parse row
         // Strip trailing comment
         if (opts_.allow_comments) {
-            bool in_string = false;
-            for (size_t i = 0; i < content.size(); i++) {
-                char c = content[i];
-                if (c == '"') in_string = !in_string;
-                if (!in_string && c == '#') {
-                    content = trim(content.substr(0, i));
-                    break;
-                }
+            size_t hash = find_unquoted(content, 0, '#', '#', false);
+            if (hash != std::string_view::npos) {
+                content = trim(content.substr(0, hash));
             }
         }
 
@@ -714,49 +1267,416 @@ void TabularParser::parse_rows(BufferedReader& reader, int base_indent) {
     }
 }
 
-SEXP TabularParser::parse_file(const std::string& filepath) {
+void TabularParser::start_chunk(const TabularParser& parent, const std::vector<ColType>& types,
+                                size_t rows_hint) {
+    current_file_ = parent.current_file_;
+    delimiter_ = parent.delimiter_;
+    declared_rows_ = rows_hint;
+    header_columns_ = parent.header_columns_;
+    projection_ = parent.projection_;
+    field_names_ = parent.field_names_;
+
+    columns_.clear();
+    columns_.reserve(types.size());
+    for (size_t i = 0; i < types.size(); i++) {
+        columns_.emplace_back(parent.columns_[i].name(), std::max(size_t(1000), rows_hint));
+        if (types[i] != ColType::UNKNOWN) {
+            columns_.back().force_type(types[i]);
+        }
+    }
+    if (!projection_.selects()) {
+        field_names_.resize(types.size());
+        schema_expansions_ = types.size() - header_columns_;
+    }
+}
+
+bool TabularParser::parse_rows_parallel(BufferedReader& reader) {
+    if (opts_.threads <= 1 || lazy_ || !reader.is_contiguous()) {
+        return false;
+    }
+
+    // Rows run to the end of input. Every newline ends a line for
+    // BufferedReader (quoted values cannot hold a raw one), so cutting just
+    // after a newline never splits a row or a quoted string.
+    const char* data = reader.data();
+    size_t begin = reader.offset();
+    size_t end = reader.size();
+    std::vector<size_t> cuts{begin};
+
+    // Row each chunk starts at, when cut at indexed rows
+    std::vector<size_t> first_rows;
+    bool ranged = opts_.row_start > 0 || opts_.row_count != SIZE_MAX;
+
+    if (index_) {
+        // Cut at indexed rows, so each chunk knows which rows it holds and
+        // a row range can be split too
+        const auto& blocks = index_->blocks;
+        size_t every = static_cast<size_t>(index_->every);
+        size_t last = blocks.size();
+        if (opts_.row_count != SIZE_MAX) {
+            size_t stop = opts_.row_start + opts_.row_count;
+            last = std::min(last, stop / every + 1);
+            if (last < blocks.size()) end = blocks[last].offset;
+        }
+        size_t wanted = std::min(static_cast<size_t>(opts_.threads), (end - begin) / MIN_CHUNK_BYTES);
+
+        first_rows.push_back(first_block_ * every);
+        size_t b = first_block_;
+        for (size_t i = 1; i < wanted; i++) {
+            size_t target = begin + (end - begin) / wanted * i;
+            while (b < last && blocks[b].offset < target) b++;
+            if (b >= last) break;
+            if (blocks[b].offset <= cuts.back()) continue;
+            cuts.push_back(blocks[b].offset);
+            first_rows.push_back(b * every);
+        }
+    } else if (ranged) {
+        // Without an index a chunk cannot tell which rows it holds
+        return false;
+    } else {
+        size_t wanted = std::min(static_cast<size_t>(opts_.threads), (end - begin) / MIN_CHUNK_BYTES);
+        for (size_t i = 1; i < wanted; i++) {
+            size_t target = std::max(begin + (end - begin) / wanted * i, cuts.back());
+            const void* nl = std::memchr(data + target, '\n', end - target);
+            if (nl == nullptr) break;
+            size_t cut = static_cast<const char*>(nl) - data + 1;
+            if (cut >= end) break;
+            cuts.push_back(cut);
+        }
+    }
+    cuts.push_back(end);
+
+    size_t n = cuts.size() - 1;
+    if (n < 2) {
+        return false;
+    }
+
+    std::vector<ColType> types;
+    for (const auto& col : columns_) {
+        types.push_back(col.type());
+    }
+    size_t rows_hint = std::min(declared_rows_, opts_.row_count) / n;
+
+    // The part of the requested row range that falls in chunk c
+    auto limit_rows = [&](TabularParser& part, size_t c) {
+        if (first_rows.empty()) return;
+        size_t from = std::max(opts_.row_start, first_rows[c]);
+        part.skip_rows_ = from - first_rows[c];
+        if (opts_.row_count != SIZE_MAX) {
+            size_t stop = opts_.row_start + opts_.row_count;
+            part.row_limit_ = stop > from ? stop - from : 0;
+        }
+    };
+
+    chunks_.clear();
+    chunks_.reserve(n);
+    for (size_t c = 0; c < n; c++) {
+        chunks_.emplace_back(opts_);
+        chunks_.back().start_chunk(*this, types, rows_hint);
+        limit_rows(chunks_.back(), c);
+    }
+
+    std::vector<size_t> lines(n, 0);
+    std::vector<std::exception_ptr> errors(n);
+    auto parse_chunk = [&](size_t c) {
+        try {
+            BufferedReader chunk_reader(data + cuts[c], cuts[c + 1] - cuts[c]);
+            chunks_[c].parse_rows(chunk_reader, -1);
+            lines[c] = chunk_reader.current_line();
+        } catch (...) {
+            errors[c] = std::current_exception();
+        }
+    };
+    run_parallel(n, parse_chunk);
+    rethrow_chunk_error(errors, lines, reader.current_line());
+    if (Stats* st = stats::active()) {
+        // The chunks read the rows straight from the mapping
+        st->bytes_read += end - begin;
+        for (size_t l : lines) st->lines_read += l;
+    }
+
+    // Schema and row statistics as a serial parse would have found them
+    size_t ncol = columns_.size();
+    for (const auto& part : chunks_) {
+        ncol = std::max(ncol, part.columns_.size());
+        observed_rows_ += part.observed_rows_;
+        scanned_rows_ += part.scanned_rows_;
+        min_fields_ = std::min(min_fields_, part.min_fields_);
+        max_fields_ = std::max(max_fields_, part.max_fields_);
+    }
+    for (size_t i = columns_.size(); i < ncol; i++) {
+        std::string new_name = "V" + std::to_string(i + 1);
+        columns_.emplace_back(new_name, 0);
+        field_names_.push_back(new_name);
+    }
+    if (!projection_.selects()) {
+        schema_expansions_ = ncol - header_columns_;
+    }
+
+    // Column types at the start of each chunk in a serial parse; types only
+    // ever widen, so they follow from each chunk's own result
+    std::vector<std::vector<ColType>> start_types(n);
+    for (size_t c = 0; c < n; c++) {
+        start_types[c] = types;
+        const auto& cols = chunks_[c].columns_;
+        types.resize(std::max(types.size(), cols.size()), ColType::UNKNOWN);
+        for (size_t j = 0; j < cols.size(); j++) {
+            types[j] = wider_type(types[j], cols[j].type());
+        }
+    }
+
+    // Numbers widen the same way whatever order they arrive in, but text
+    // does not: a serial parse keeps the raw text of values reaching a
+    // column that is already STRING, and formats earlier values by the type
+    // the column had when it turned STRING. Reparse the (rare) chunks whose
+    // own start state got that wrong, starting from the serial state.
+    std::vector<size_t> redo;
+    for (size_t c = 0; c < n; c++) {
+        const auto& cols = chunks_[c].columns_;
+        for (size_t j = 0; j < cols.size(); j++) {
+            if (types[j] != ColType::STRING) continue;
+            ColType in = j < start_types[c].size() ? start_types[c][j] : ColType::UNKNOWN;
+            ColType from = cols[j].string_promoted_from();
+            bool typed = cols[j].type() != ColType::UNKNOWN && cols[j].type() != ColType::STRING;
+            if ((in == ColType::STRING && (typed || from != ColType::UNKNOWN)) ||
+                (from != ColType::UNKNOWN && from < in)) {
+                redo.push_back(c);
+                break;
+            }
+        }
+    }
+
+    if (!redo.empty()) {
+        for (size_t c : redo) {
+            chunks_[c] = TabularParser(opts_);
+            chunks_[c].start_chunk(*this, start_types[c], rows_hint);
+            limit_rows(chunks_[c], c);
+        }
+        run_parallel(redo.size(), [&](size_t k) { parse_chunk(redo[k]); });
+        rethrow_chunk_error(errors, lines, reader.current_line());
+    }
+
+    string_from_.assign(ncol, ColType::UNKNOWN);
+    for (size_t j = 0; j < ncol; j++) {
+        columns_[j].force_type(types[j]);
+        if (types[j] != ColType::STRING) continue;
+
+        // Values of chunks before the first STRING one get converted
+        for (size_t c = 0; c < n; c++) {
+            const auto& cols = chunks_[c].columns_;
+            if (j < cols.size() && cols[j].type() == ColType::STRING) {
+                ColType from = cols[j].string_promoted_from();
+                if (from == ColType::UNKNOWN && j < start_types[c].size()) {
+                    from = start_types[c][j];
+                }
+                string_from_[j] = from;
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+void TabularParser::reset(const std::string& filepath) {
     warnings_.clear();
     current_file_ = filepath;
     field_names_.clear();
     columns_.clear();
     declared_rows_ = 0;
     observed_rows_ = 0;
+    scanned_rows_ = 0;
     min_fields_ = SIZE_MAX;
     max_fields_ = 0;
     schema_expansions_ = 0;
+    header_columns_ = 0;
+    chunks_.clear();
+    string_from_.clear();
+    skip_rows_ = opts_.row_start;
+    row_limit_ = opts_.row_count;
+    index_.reset();
+    first_block_ = 0;
+    lazy_ = false;
+    lazy_rows_.clear();
+    lazy_start_.clear();
+    lazy_types_.clear();
+}
+
+bool TabularParser::seek_with_index(BufferedReader& reader) {
+    RowIndex index;
+    if (opts_.index_file.empty() ||
+        !load_row_index(opts_.index_file, current_file_, opts_.key, opts_.allow_comments,
+                        index, warnings_)) {
+        return false;
+    }
+
+    if (!parse_header(index.header)) {
+        throw ParseError("Invalid tabular header", index.header_line, 0, index.header,
+                         current_file_);
+    }
+    first_block_ = index.block_of(opts_.row_start);
+    const auto& block = index.blocks[first_block_];
+    reader.seek(block.offset, block.line);
+    skip_rows_ = opts_.row_start - first_block_ * index.every;
+    index_ = std::move(index);
+    return true;
+}
+
+RowIndex TabularParser::build_index(const std::string& filepath, size_t every) {
+    reset(filepath);
 
     BufferedReader reader(filepath);
     if (reader.has_error()) {
         throw ParseError(reader.error_message(), 0, 0, "", filepath);
     }
 
+    RowIndex index;
+    if (!file_stamp(filepath, index.file_size, index.file_mtime) ||
+        !hash_file(filepath, index.file_size, index.content_hash)) {
+        throw ParseError("Cannot open file: " + filepath);
+    }
+
     std::string header_line;
     size_t header_line_no;
-
     if (!find_tabular_array(reader, header_line, header_line_no)) {
         throw ParseError("No tabular array found", 0, 0, "", filepath);
     }
 
-    if (!parse_header(header_line)) {
-        throw ParseError("Invalid tabular header", header_line_no, 0, header_line, filepath);
+    index.key = opts_.key;
+    index.allow_comments = opts_.allow_comments;
+    index.header = header_line;
+    index.header_line = header_line_no;
+    index.every = every;
+    index.blocks.push_back({reader.offset(), reader.current_line() + 1});
+
+    // Count rows as parse_rows does: every line that is not blank or a comment
+    std::string_view line;
+    size_t line_no;
+    size_t offset = reader.offset();
+    while (reader.next_line(line, line_no)) {
+        auto content = trim(line);
+        if (!content.empty() && !(opts_.allow_comments && (content[0] == '#' ||
+            (content.size() >= 2 && content[0] == '/' && content[1] == '/')))) {
+            if (index.rows > 0 && index.rows % every == 0) {
+                index.blocks.push_back({offset, line_no});
+            }
+            index.rows++;
+        }
+        offset = reader.offset();
+    }
+
+    return index;
+}
+
+SEXP TabularParser::parse_file(const std::string& filepath) {
+    read_file(filepath);
+    SEXP result;
+    {
+        PhaseTimer timer("build");
+        result = build_result();
+    }
+    record_stats();
+    return result;
+}
+
+SEXP TabularParser::parse_file_lazy(const std::string& filepath) {
+    // The rows are kept as views into the input, so it must stay mapped
+    ReaderOptions io = opts_.io;
+    io.prefetch = 0;
+    auto reader = std::make_unique<BufferedReader>(filepath, io);
+    if (!reader->has_error() && !reader->is_contiguous()) {
+        reader.reset();
+        return parse_file(filepath);
+    }
+
+    {
+        PhaseTimer timer("parse");
+        reset(filepath);
+        lazy_ = true;
+        read_rows(*reader);
+        if (Stats* st = stats::active()) {
+            st->add_input(*reader);
+        }
+    }
+
+    auto table = std::make_shared<LazyTable>();
+    table->delimiter = delimiter_;
+    bool selects = projection_.selects();
+    for (size_t i = 0; i < columns_.size(); i++) {
+        table->columns.push_back({columns_[i].name(), lazy_start_[i], lazy_types_[i],
+                                  selects ? projection_.fields()[i] : i});
+    }
+    table->rows = std::move(lazy_rows_);
+    table->reader = std::move(reader);
+
+    SEXP result;
+    {
+        PhaseTimer timer("build");
+        result = lazy_dataframe(std::move(table), opts_.as_factor);
+    }
+    if (Stats* st = stats::active()) {
+        st->rows += observed_rows_;
+        st->schema_expansions += schema_expansions_;
+        st->allocations += columns_.size() + 1;
+    }
+    return result;
+}
+
+void TabularParser::read_file(const std::string& filepath) {
+    PhaseTimer timer("parse");
+    reset(filepath);
+
+    BufferedReader reader(filepath, opts_.io);
+    read_rows(reader);
+    if (Stats* st = stats::active()) {
+        st->add_input(reader);
+    }
+}
+
+void TabularParser::read_rows(BufferedReader& reader) {
+    const std::string& filepath = current_file_;
+    if (reader.has_error()) {
+        throw ParseError(reader.error_message(), 0, 0, "", filepath);
+    }
+
+    if (!seek_with_index(reader)) {
+        std::string header_line;
+        size_t header_line_no;
+
+        if (!find_tabular_array(reader, header_line, header_line_no)) {
+            throw ParseError("No tabular array found", 0, 0, "", filepath);
+        }
+
+        if (!parse_header(header_line)) {
+            throw ParseError("Invalid tabular header", header_line_no, 0, header_line, filepath);
+        }
+    }
+
+    if (lazy_) {
+        start_scan();
+    } else if (opts_.sample_rows > 0) {
+        apply_sampled_types(reader);
     }
 
-    parse_rows(reader, -1);
+    if (!parse_rows_parallel(reader)) {
+        parse_rows(reader, -1);
+    }
 
-    // Check row count mismatch
-    if (declared_rows_ > 0 && observed_rows_ != declared_rows_) {
+    // Check row count mismatch (a row range reads only part of [N])
+    bool ranged = opts_.row_start > 0 || opts_.row_count != SIZE_MAX;
+    if (!ranged && declared_rows_ > 0 && scanned_rows_ != declared_rows_) {
         if (opts_.n_mismatch == "error") {
             throw ParseError("Declared [" + std::to_string(declared_rows_) + "] but observed " +
-                std::to_string(observed_rows_) + " rows", 0, 0, "", filepath);
+                std::to_string(scanned_rows_) + " rows", 0, 0, "", filepath);
         } else if (opts_.warn) {
             warnings_.push_back(Warning("n_mismatch",
                 "Declared [" + std::to_string(declared_rows_) + "] but observed " +
-                std::to_string(observed_rows_) + " rows; using observed."));
+                std::to_string(scanned_rows_) + " rows; using observed."));
         }
     }
 
     // Check ragged rows
-    if (min_fields_ != max_fields_ && opts_.warn) {
+    if (min_fields_ < max_fields_ && opts_.warn) {
         std::string msg = "Tabular rows had inconsistent field counts (min=" +
             std::to_string(min_fields_) + ", max=" + std::to_string(max_fields_) + ").";
         if (schema_expansions_ > 0) {
@@ -765,20 +1685,249 @@ SEXP TabularParser::parse_file(const std::string& filepath) {
         msg += " missing values filled with NA.";
         warnings_.push_back(Warning("ragged_rows", msg));
     }
+}
+
+std::vector<std::string> TabularParser::header_fields(const std::string& filepath) {
+    reset(filepath);
+    BufferedReader reader(filepath, opts_.io);
+    if (reader.has_error()) {
+        throw ParseError(reader.error_message(), 0, 0, "", filepath);
+    }
+
+    std::string header_line;
+    size_t header_line_no;
+    if (!find_tabular_array(reader, header_line, header_line_no)) {
+        throw ParseError("No tabular array found", 0, 0, "", filepath);
+    }
+    std::vector<std::string> fields;
+    size_t declared = 0;
+    if (!split_header(header_line, declared, fields) || fields.empty()) {
+        throw ParseError("Invalid tabular header", header_line_no, 0, header_line, filepath);
+    }
+    RowProjection projection;
+    projection.resolve(fields, opts_.select, opts_.filters, filepath);
+    return fields;
+}
+
+void TabularParser::read_files(const std::vector<std::string>& files) {
+    PhaseTimer timer("parse");
+
+    // Headers are checked before any rows are parsed: every file must have
+    // the first one's fields, or at least those selected and filtered on
+    std::vector<std::string> header = header_fields(files.front());
+    for (size_t f = 1; f < files.size(); f++) {
+        std::vector<std::string> fields = header_fields(files[f]);
+        if (opts_.select.empty() && fields != header) {
+            throw ParseError("Tabular fields differ from those of " + files.front(), 0, 0, "",
+                             files[f]);
+        }
+    }
+    reset(files.front());
+
+    // Each file is parsed on one thread, by a parser of its own; its
+    // builders start at the size its [N] declares
+    size_t n = files.size();
+    TabularParseOptions file_opts = opts_;
+    file_opts.threads = 1;
+    chunks_.clear();
+    chunks_.reserve(n);
+    for (size_t f = 0; f < n; f++) {
+        chunks_.emplace_back(file_opts);
+    }
+
+    // Files are taken in order; once one fails, later ones are left, so
+    // the error reported is that of the first failing file
+    bool profiling = stats::active() != nullptr;
+    std::vector<Stats> inputs(profiling ? n : 0);
+    std::vector<std::exception_ptr> errors(n);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> failed{n};
+    auto parse_next = [&](size_t) {
+        for (size_t f = next++; f < n && f < failed; f = next++) {
+            try {
+                TabularParser& part = chunks_[f];
+                part.reset(files[f]);
+                BufferedReader reader(files[f], opts_.io);
+                part.read_rows(reader);
+                if (profiling) inputs[f].add_input(reader);
+            } catch (...) {
+                errors[f] = std::current_exception();
+                size_t prev = failed;
+                while (f < prev && !failed.compare_exchange_weak(prev, f)) {}
+            }
+        }
+    };
+    run_parallel(std::min(n, static_cast<size_t>(std::max(opts_.threads, 1))), parse_next);
+    for (const auto& e : errors) {
+        if (e) std::rethrow_exception(e);
+    }
+    if (Stats* st = stats::active()) {
+        for (const Stats& in : inputs) {
+            st->bytes_read += in.bytes_read;
+            st->lines_read += in.lines_read;
+            st->buffer_refills += in.buffer_refills;
+            st->scratch_copies += in.scratch_copies;
+            st->io_wait += in.io_wait;
+        }
+    }
+
+    const TabularParser& first = chunks_.front();
+    size_t widest = 0;
+    for (size_t f = 0; f < n; f++) {
+        const TabularParser& part = chunks_[f];
+        if (part.columns_.size() > chunks_[widest].columns_.size()) widest = f;
+
+        for (const auto& w : part.warnings_) {
+            warnings_.push_back(Warning(w.type, files[f] + ": " + w.message));
+        }
+        observed_rows_ += part.observed_rows_;
+        scanned_rows_ += part.scanned_rows_;
+        schema_expansions_ = std::max(schema_expansions_, part.schema_expansions_);
+    }
+    header_columns_ = first.header_columns_;
+    field_names_ = chunks_[widest].field_names_;
+
+    // Columns take the widest type any file has for them. Values of files
+    // where a text column is still numeric are written as text of the
+    // widest numeric type, as a serial parse would have promoted them.
+    size_t ncol = chunks_[widest].columns_.size();
+    std::vector<ColType> types(ncol, ColType::UNKNOWN);
+    string_from_.assign(ncol, ColType::UNKNOWN);
+    for (const auto& part : chunks_) {
+        for (size_t j = 0; j < part.columns_.size(); j++) {
+            ColType t = part.columns_[j].type();
+            types[j] = wider_type(types[j], t);
+            if (t != ColType::STRING) string_from_[j] = wider_type(string_from_[j], t);
+        }
+    }
+    for (size_t j = 0; j < ncol; j++) {
+        columns_.emplace_back(chunks_[widest].columns_[j].name(), 0);
+        columns_.back().force_type(types[j]);
+    }
+}
+
+SEXP TabularParser::parse_files(const std::vector<std::string>& files, const std::string& id_column,
+                                const std::vector<std::string>& labels) {
+    read_files(files);
+    SEXP result;
+    {
+        PhaseTimer timer("build");
+        result = PROTECT(build_chunked_dataframe());
+
+        if (!id_column.empty()) {
+            // The id column goes first; the parsed columns are not copied
+            size_t ncol = columns_.size();
+            SEXP df = PROTECT(Rf_allocVector(VECSXP, ncol + 1));
+            SEXP names = PROTECT(Rf_allocVector(STRSXP, ncol + 1));
+            SEXP old_names = Rf_getAttrib(result, R_NamesSymbol);
+            for (size_t j = 0; j < ncol; j++) {
+                SET_VECTOR_ELT(df, j + 1, VECTOR_ELT(result, j));
+                SET_STRING_ELT(names, j + 1, STRING_ELT(old_names, j));
+            }
+            SET_STRING_ELT(names, 0, Rf_mkCharCE(id_column.c_str(), CE_UTF8));
+
+            SEXP id;
+            if (opts_.as_factor) {
+                id = PROTECT(Rf_allocVector(INTSXP, observed_rows_));
+                StringPool levels;
+                int* out = INTEGER(id);
+                for (size_t f = 0; f < files.size(); f++) {
+                    int code = static_cast<int>(levels.intern(labels[f])) + 1;
+                    out = std::fill_n(out, chunks_[f].observed_rows_, code);
+                }
+                set_factor_attrs(id, levels);
+            } else {
+                id = PROTECT(Rf_allocVector(STRSXP, observed_rows_));
+                size_t row = 0;
+                for (size_t f = 0; f < files.size(); f++) {
+                    SEXP label = Rf_mkCharCE(labels[f].c_str(), CE_UTF8);
+                    for (size_t i = 0; i < chunks_[f].observed_rows_; i++) {
+                        SET_STRING_ELT(id, row++, label);
+                    }
+                }
+            }
+            SET_VECTOR_ELT(df, 0, id);
+            set_dataframe_attrs(df, names, observed_rows_);
+            UNPROTECT(4);
+            result = PROTECT(df);
+        }
+    }
+    record_stats();
+    UNPROTECT(1);
+    return result;
+}
+
+void TabularParser::parse_file_arrow(const std::string& filepath, size_t batch_size,
+                                     ArrowArrayStream* out) {
+    read_file(filepath);
+
+    size_t ncol = columns_.size();
+    auto arrow = std::make_shared<std::vector<ArrowColumn>>(ncol);
+    for (size_t j = 0; j < ncol; j++) {
+        (*arrow)[j].name = columns_[j].name();
+        (*arrow)[j].init(columns_[j].type(), observed_rows_);
+    }
+
+    if (chunks_.empty()) {
+        // The column storage itself becomes the Arrow buffers
+        for (size_t j = 0; j < ncol; j++) {
+            columns_[j].take_arrow((*arrow)[j]);
+        }
+    } else {
+        size_t n = chunks_.size();
+        std::vector<size_t> offsets(n + 1, 0);
+        for (size_t c = 0; c < n; c++) {
+            offsets[c + 1] = offsets[c] + chunks_[c].observed_rows_;
+        }
+        for (ArrowColumn& col : *arrow) {
+            if (col.type == ColType::DOUBLE) {
+                col.dbls.resize(observed_rows_);
+            } else if (col.type != ColType::STRING) {
+                col.ints.resize(observed_rows_);
+            }
+        }
+
+        // Numeric columns are copied on the worker threads, text appended
+        // in chunk order on this one
+        run_parallel(n, [&](size_t c) {
+            const auto& cols = chunks_[c].columns_;
+            for (size_t j = 0; j < ncol; j++) {
+                ArrowColumn& col = (*arrow)[j];
+                if (col.type == ColType::STRING) continue;
+                if (j < cols.size()) {
+                    cols[j].write_arrow(col, offsets[c], string_from_[j]);
+                } else if (col.type == ColType::DOUBLE) {
+                    std::fill(col.dbls.begin() + offsets[c], col.dbls.begin() + offsets[c + 1],
+                              NA_REAL);
+                } else {
+                    std::fill(col.ints.begin() + offsets[c], col.ints.begin() + offsets[c + 1],
+                              NA_INTEGER);
+                }
+            }
+        });
+        for (size_t j = 0; j < ncol; j++) {
+            ArrowColumn& col = (*arrow)[j];
+            if (col.type != ColType::STRING) continue;
+            for (size_t c = 0; c < n; c++) {
+                const auto& cols = chunks_[c].columns_;
+                if (j < cols.size()) {
+                    cols[j].write_arrow(col, offsets[c], string_from_[j]);
+                } else {
+                    for (size_t i = offsets[c]; i < offsets[c + 1]; i++) col.append_null();
+                }
+            }
+        }
+        chunks_.clear();
+    }
 
-    return build_dataframe(columns_, observed_rows_);
+    for (ArrowColumn& col : *arrow) {
+        col.finish();
+    }
+    export_arrow_stream(std::move(arrow), observed_rows_, batch_size, out);
 }
 
 SEXP TabularParser::parse_string(const char* data, size_t len) {
-    warnings_.clear();
-    current_file_.clear();
-    field_names_.clear();
-    columns_.clear();
-    declared_rows_ = 0;
-    observed_rows_ = 0;
-    min_fields_ = SIZE_MAX;
-    max_fields_ = 0;
-    schema_expansions_ = 0;
+    reset("");
 
     BufferedReader reader(data, len);
 
@@ -793,21 +1942,24 @@ SEXP TabularParser::parse_string(const char* data, size_t len) {
         throw ParseError("Invalid tabular header", header_line_no, 0, header_line, "");
     }
 
-    parse_rows(reader, -1);
+    if (!parse_rows_parallel(reader)) {
+        parse_rows(reader, -1);
+    }
 
     // Check warnings
-    if (declared_rows_ > 0 && observed_rows_ != declared_rows_) {
+    bool ranged = opts_.row_start > 0 || opts_.row_count != SIZE_MAX;
+    if (!ranged && declared_rows_ > 0 && scanned_rows_ != declared_rows_) {
         if (opts_.n_mismatch == "error") {
             throw ParseError("Declared [" + std::to_string(declared_rows_) + "] but observed " +
-                std::to_string(observed_rows_) + " rows");
+                std::to_string(scanned_rows_) + " rows");
         } else if (opts_.warn) {
             warnings_.push_back(Warning("n_mismatch",
                 "Declared [" + std::to_string(declared_rows_) + "] but observed " +
-                std::to_string(observed_rows_) + " rows; using observed."));
+                std::to_string(scanned_rows_) + " rows; using observed."));
         }
     }
 
-    if (min_fields_ != max_fields_ && opts_.warn) {
+    if (min_fields_ < max_fields_ && opts_.warn) {
         std::string msg = "Tabular rows had inconsistent field counts (min=" +
             std::to_string(min_fields_) + ", max=" + std::to_string(max_fields_) + ").";
         if (schema_expansions_ > 0) {
@@ -817,20 +1969,163 @@ SEXP TabularParser::parse_string(const char* data, size_t len) {
         warnings_.push_back(Warning("ragged_rows", msg));
     }
 
-    return build_dataframe(columns_, observed_rows_);
+    return build_result();
+}
+
+void TabularParser::record_stats() const {
+    Stats* st = stats::active();
+    if (!st) return;
+
+    st->rows += observed_rows_;
+    st->schema_expansions += schema_expansions_;
+    // One R vector per column, plus the data.frame
+    st->allocations += columns_.size() + 1;
+
+    std::vector<ColumnStats> cols;
+    if (chunks_.empty()) {
+        for (const auto& col : columns_) cols.push_back(col.stats());
+    } else {
+        for (const auto& part : chunks_) {
+            std::vector<ColumnStats> part_cols;
+            for (const auto& col : part.columns_) part_cols.push_back(col.stats());
+            for (size_t j = 0; j < part_cols.size(); j++) {
+                if (j < cols.size()) {
+                    cols[j].merge(part_cols[j], true);
+                } else {
+                    cols.push_back(part_cols[j]);
+                }
+            }
+        }
+        // Text columns of some chunks become text once joined
+        for (size_t j = 0; j < cols.size() && j < columns_.size(); j++) {
+            cols[j].type = col_type_name(columns_[j].type());
+        }
+    }
+    st->merge_columns(cols, false);
+}
+
+SEXP TabularParser::build_result() {
+    if (chunks_.empty()) {
+        return build_dataframe(columns_, observed_rows_, opts_.as_factor);
+    }
+    return build_chunked_dataframe();
+}
+
+// Concatenate the chunk builders straight into the result columns
+SEXP TabularParser::build_chunked_dataframe() {
+    size_t ncol = columns_.size();
+    size_t n = chunks_.size();
+
+    std::vector<size_t> offsets(n + 1, 0);
+    for (size_t c = 0; c < n; c++) {
+        offsets[c + 1] = offsets[c] + chunks_[c].observed_rows_;
+    }
+
+    SEXP df = PROTECT(Rf_allocVector(VECSXP, ncol));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, ncol));
+
+    std::vector<int*> int_out(ncol, nullptr);
+    std::vector<double*> dbl_out(ncol, nullptr);
+    for (size_t j = 0; j < ncol; j++) {
+        SEXP vec;
+        switch (columns_[j].type()) {
+            case ColType::INTEGER:
+                vec = Rf_allocVector(INTSXP, observed_rows_);
+                int_out[j] = INTEGER(vec);
+                break;
+            case ColType::DOUBLE:
+                vec = Rf_allocVector(REALSXP, observed_rows_);
+                dbl_out[j] = REAL(vec);
+                break;
+            case ColType::STRING:
+                vec = Rf_allocVector(opts_.as_factor ? INTSXP : STRSXP, observed_rows_);
+                break;
+            default:
+                vec = Rf_allocVector(LGLSXP, observed_rows_);
+                int_out[j] = LOGICAL(vec);
+                break;
+        }
+        SET_VECTOR_ELT(df, j, vec);
+        SET_STRING_ELT(names, j, Rf_mkCharCE(columns_[j].name().c_str(), CE_UTF8));
+    }
+
+    // Numeric columns are copied on the worker threads
+    run_parallel(n, [&](size_t c) {
+        const auto& cols = chunks_[c].columns_;
+        size_t offset = offsets[c];
+        size_t rows = chunks_[c].observed_rows_;
+        for (size_t j = 0; j < ncol; j++) {
+            if (int_out[j] != nullptr) {
+                if (j < cols.size()) {
+                    cols[j].copy_to(int_out[j] + offset);
+                } else {
+                    std::fill_n(int_out[j] + offset, rows, NA_INTEGER);
+                }
+            } else if (dbl_out[j] != nullptr) {
+                if (j < cols.size()) {
+                    cols[j].copy_to(dbl_out[j] + offset);
+                } else {
+                    std::fill_n(dbl_out[j] + offset, rows, NA_REAL);
+                }
+            }
+        }
+    });
+
+    // Text columns need the R string cache, so they stay on this thread
+    for (size_t j = 0; j < ncol; j++) {
+        if (columns_[j].type() != ColType::STRING) continue;
+
+        SEXP vec = VECTOR_ELT(df, j);
+        if (opts_.as_factor) {
+            StringPool levels;
+            for (size_t c = 0; c < n; c++) {
+                const auto& cols = chunks_[c].columns_;
+                if (j < cols.size()) {
+                    cols[j].write_codes(INTEGER(vec) + offsets[c], levels, string_from_[j]);
+                } else {
+                    std::fill(INTEGER(vec) + offsets[c], INTEGER(vec) + offsets[c + 1], NA_INTEGER);
+                }
+            }
+            set_factor_attrs(vec, levels);
+            continue;
+        }
+
+        for (size_t c = 0; c < n; c++) {
+            const auto& cols = chunks_[c].columns_;
+            if (j < cols.size()) {
+                cols[j].write_strings(vec, offsets[c], string_from_[j]);
+            } else {
+                for (size_t i = offsets[c]; i < offsets[c + 1]; i++) {
+                    SET_STRING_ELT(vec, i, NA_STRING);
+                }
+            }
+        }
+    }
+
+    set_dataframe_attrs(df, names, observed_rows_);
+
+    UNPROTECT(2);
+    return df;
 }
 
-SEXP build_dataframe(std::vector<ColBuilder>& columns, size_t nrow) {
+SEXP build_dataframe(std::vector<ColBuilder>& columns, size_t nrow, bool as_factor) {
     size_t ncol = columns.size();
 
     SEXP df = PROTECT(Rf_allocVector(VECSXP, ncol));
     SEXP names = PROTECT(Rf_allocVector(STRSXP, ncol));
 
     for (size_t i = 0; i < ncol; i++) {
-        SET_VECTOR_ELT(df, i, columns[i].finalize());
+        SET_VECTOR_ELT(df, i, columns[i].finalize(as_factor));
         SET_STRING_ELT(names, i, Rf_mkCharCE(columns[i].name().c_str(), CE_UTF8));
     }
 
+    set_dataframe_attrs(df, names, nrow);
+
+    UNPROTECT(2);
+    return df;
+}
+
+void set_dataframe_attrs(SEXP df, SEXP names, size_t nrow) {
     Rf_setAttrib(df, R_NamesSymbol, names);
 
     // Set row.names
@@ -844,8 +2139,7 @@ SEXP build_dataframe(std::vector<ColBuilder>& columns, size_t nrow) {
     SET_STRING_ELT(class_attr, 0, Rf_mkChar("data.frame"));
     Rf_setAttrib(df, R_ClassSymbol, class_attr);
 
-    UNPROTECT(4);
-    return df;
+    UNPROTECT(2);
 }
 
 } // namespace toonlite
@@ -9,6 +9,8 @@
 #include <cstdint>
 #include "toon_errors.h"
 #include "toon_io.h"
+#include "toon_index.h"
+#include "toon_stats.h"
 
 #include <R.h>
 #include <Rinternals.h>
@@ -25,8 +27,12 @@
 #undef Free
 #endif
 
+struct ArrowArrayStream;
+
 namespace toonlite {
 
+struct ArrowColumn;
+
 // Column type for tabular data
 enum class ColType {
     UNKNOWN,
@@ -36,7 +42,49 @@ enum class ColType {
     STRING
 };
 
-// Column builder for efficient vector construction
+// Name of a column type as in col_types ("logical" for UNKNOWN, which
+// becomes an all-NA logical column)
+const char* col_type_name(ColType t);
+
+// Distinct strings of a text column, back to back in one byte buffer, with
+// an open-addressed hash table from text to entry index. Once deduplication
+// is stopped every string is stored as a new entry.
+class StringPool {
+public:
+    // Index of the entry equal to s, adding one if there is none
+    uint32_t intern(std::string_view s);
+
+    // Drop the hash table; later strings are appended without lookup
+    void stop_dedupe();
+    bool dedupes() const { return dedupe_; }
+
+    // Remove every entry, keeping the memory, and deduplicate again
+    void clear();
+
+    size_t size() const { return ends_.size(); }
+    std::string_view operator[](size_t i) const;
+
+    // STRSXP holding one CHARSXP per entry, in order
+    SEXP to_strsxp() const;
+
+    // Bytes held, and times the hash table was (re)built, for profiling
+    size_t memory() const;
+    size_t rehashes() const { return rehashes_; }
+
+private:
+    void rehash(size_t n_slots);
+
+    size_t rehashes_ = 0;
+    std::string bytes_;
+    std::vector<uint64_t> ends_;     // end offset of each entry in bytes_
+    std::vector<uint32_t> hashes_;   // hash of each entry
+    std::vector<uint32_t> slots_;    // entry index + 1, or 0 if empty
+    bool dedupe_ = true;
+};
+
+// Column builder for efficient vector construction. Rows are appended in
+// order; NA is stored in-band (NA_INTEGER / NA_REAL) and text cells are
+// interned, so each distinct value is stored and turned into a CHARSXP once.
 class ColBuilder {
 public:
     ColBuilder(const std::string& name, size_t initial_capacity = 1000);
@@ -45,36 +93,145 @@ public:
     ColType type() const { return type_; }
     size_t size() const { return size_; }
 
-    // Set value at row index, handling type promotion
-    void set(size_t row, std::string_view value);
-    void set_null(size_t row);
+    // Empty the column for the next batch of rows, keeping the storage
+    // already allocated (the type is UNKNOWN again)
+    void reset();
 
-    // Ensure capacity for n rows
-    void ensure_capacity(size_t n);
+    // Append the next row's value, handling type promotion
+    void append(std::string_view value);
+    void append_null();
+    void append_nulls(size_t n);
 
-    // Finalize and create R vector
-    SEXP finalize();
+    // Finalize and create R vector; text columns become factors (levels in
+    // order of first appearance) if as_factor is set
+    SEXP finalize(bool as_factor = false);
 
     // Force specific type
     void force_type(ColType t);
 
+    // Type whose stored values were converted to text when the column
+    // became STRING (UNKNOWN if nothing was converted)
+    ColType string_promoted_from() const { return string_from_; }
+
+    // Copy all rows into a vector of this type or a wider numeric one. Plain
+    // memory writes only, so any thread may call them.
+    void copy_to(int* out) const;
+    void copy_to(double* out) const;
+
+    // Store all rows into a STRSXP starting at offset. Values not yet held as
+    // text are formatted as they would be when promoting from type `as`.
+    void write_strings(SEXP out, size_t offset, ColType as) const;
+
+    // Store all rows as 1-based factor codes into `levels`, adding values
+    // not seen yet; formatting as for write_strings
+    void write_codes(int* out, StringPool& levels, ColType as) const;
+
+    // Store all rows into an ArrowColumn (see toon_arrow.h) from row
+    // `offset`: numeric values as copy_to does, text appended in order and
+    // formatted as for write_strings. take_arrow moves the rows into an
+    // empty ArrowColumn of this column's type, leaving this one empty.
+    void write_arrow(ArrowColumn& out, size_t offset, ColType as) const;
+    void take_arrow(ArrowColumn& out);
+
+    // Work done building the column so far, for profiling
+    ColumnStats stats() const;
+
 private:
+    void start_type(ColType t);
     void promote_to(ColType new_type);
-    void parse_and_store(size_t row, std::string_view value);
+    void append_bool(bool v);
+    void append_int(int v, std::string_view raw);
+    void append_double(double v, std::string_view raw);
+    void append_text(std::string_view v);
+    void append_quoted(std::string_view body);
+    void push_text(std::string_view v);
+
+    bool is_na(size_t row) const;
+    std::string_view text(size_t row) const;
+    std::string typed_string(size_t row, ColType as) const;
 
     std::string name_;
     ColType type_ = ColType::UNKNOWN;
     size_t size_ = 0;
     size_t capacity_ = 0;
+    ColType string_from_ = ColType::UNKNOWN;
+
+    // Storage (only the one for the current type is in use)
+    std::vector<int> ints_;          // LOGICAL (0/1) and INTEGER
+    std::vector<double> dbls_;       // DOUBLE
+    StringPool strings_;             // STRING: distinct cell values
+    std::vector<uint32_t> codes_;    // STRING: entry in strings_ per cell
+    std::string scratch_;            // unescaped quoted value
+
+    // Profiling counters (see stats()), bumped only on rare events
+    size_t storage_bytes() const;
+    std::vector<std::pair<ColType, ColType>> promotions_;
+    size_t promoted_values_ = 0;
+    size_t unescaped_ = 0;
+    size_t allocations_ = 0;     // storage reserved at start or promotion
+    size_t reserved_ = 0;        // capacity reserved for the current storage
+    size_t peak_bytes_ = 0;      // storage held during the largest promotion
+};
+
+// Row filter on one column, tested on the raw field before the rest of the
+// row is stored. Matches a set of text values (quoted fields compared after
+// unescaping) or an inclusive numeric range; null never matches.
+struct RowFilter {
+    std::string column;
+    std::vector<std::string> values;
+    bool is_range = false;
+    double min = 0;
+    double max = 0;
+
+    bool matches(std::string_view field, std::string& scratch) const;
+};
+
+// Columns to store and rows to keep, resolved against a header's fields
+class RowProjection {
+public:
+    // Map select and filter column names to field positions; unknown names
+    // are a ParseError
+    void resolve(const std::vector<std::string>& header, const std::vector<std::string>& select,
+                 const std::vector<RowFilter>& filters, const std::string& file);
+
+    // Whether only the selected fields are stored (in select order)
+    bool selects() const { return !fields_.empty(); }
+    const std::vector<size_t>& fields() const { return fields_; }
 
-    // Storage buffers (only one is active based on type)
-    std::vector<int> lgl_data_;      // 0/1/NA_LOGICAL
-    std::vector<int> int_data_;      // NA_INTEGER for NA
-    std::vector<double> dbl_data_;   // NA_REAL for NA
-    std::vector<std::string> str_data_;
-    std::vector<bool> na_mask_;      // Track NAs for all types
+    // Leading fields a row must be split into (SIZE_MAX if all)
+    size_t fields_needed() const { return needed_; }
+
+    // Whether a row passes every filter; fields past the end are null
+    bool keep(const std::vector<std::string_view>& row);
+
+private:
+    std::vector<size_t> fields_;
+    std::vector<RowFilter> filters_;
+    std::vector<size_t> filter_fields_;
+    size_t needed_ = SIZE_MAX;
+    std::string scratch_;
+};
+
+// Rows to look at before parsing to settle the column types (sample_rows)
+struct RowSample {
+    size_t rows = 0;
+    bool spread = false;       // evenly spaced spans to the end of contiguous input
+    size_t skip = 0;           // rows before the first one that may be sampled
+    char delimiter = ',';
+    bool allow_comments = true;
 };
 
+// Types the first ncol columns would have if only the sampled rows were
+// parsed (UNKNOWN where every sampled value was null), so the builders can
+// start at their final type. Rows are taken from the reader's position: in
+// up to SAMPLE_SPANS spans spread to the end of contiguous input, else the
+// next rows, after which the reader is moved back. Rows the projection
+// drops are not sampled; malformed rows end the sample and are left for
+// the parse to report.
+constexpr size_t SAMPLE_SPANS = 8;
+std::vector<ColType> sample_column_types(BufferedReader& reader, const RowSample& sample,
+                                         RowProjection projection, size_t ncol);
+
 // Options for tabular parsing
 struct TabularParseOptions {
     bool strict = true;
@@ -86,6 +243,15 @@ struct TabularParseOptions {
     size_t max_extra_cols = SIZE_MAX;
     std::optional<std::string> key;           // Extract from root[key]
     std::vector<std::pair<std::string, ColType>> col_types;  // User-specified types
+    int threads = 1;                          // Row parsing threads
+    bool as_factor = false;                   // Text columns as factors
+    std::vector<std::string> select;          // Fields to keep (empty: all)
+    std::vector<RowFilter> filters;           // Rows to keep
+    size_t row_start = 0;                     // First row to read (0-based)
+    size_t row_count = SIZE_MAX;              // Rows to read from row_start
+    std::string index_file;                   // Row index to use ("" if none)
+    ReaderOptions io;                         // Buffering and read-ahead
+    size_t sample_rows = 0;                   // Rows sampled to set types (0: none)
 };
 
 // Tabular array parser
@@ -96,27 +262,103 @@ public:
     // Parse tabular TOON from file to data.frame
     SEXP parse_file(const std::string& filepath);
 
+    // Parse several files holding the same fields into one data.frame, in
+    // order, reading opts_.threads files at a time (see read_files). If
+    // id_column is not empty the result starts with a text column of that
+    // name holding labels[i] on the rows of files[i].
+    SEXP parse_files(const std::vector<std::string>& files, const std::string& id_column,
+                     const std::vector<std::string>& labels);
+
+    // Parse tabular TOON from file to a data.frame of lazy columns (see
+    // lazy_dataframe): one pass finds the rows and the column types, and a
+    // column's values are parsed when it is first used. Input that cannot
+    // stay mapped (compressed, or read ahead) is parsed as parse_file does.
+    SEXP parse_file_lazy(const std::string& filepath);
+
     // Parse tabular TOON from string to data.frame
     SEXP parse_string(const char* data, size_t len);
 
+    // Parse tabular TOON from file into an Arrow stream (see toon_arrow.h)
+    // of record batches of up to batch_size rows. The rows are parsed
+    // before this returns; the batches share the parsed column buffers.
+    void parse_file_arrow(const std::string& filepath, size_t batch_size, ArrowArrayStream* out);
+
+    // Index the rows of a file's tabular array (see RowIndex), which is
+    // found as parse_file finds it
+    RowIndex build_index(const std::string& filepath, size_t every = RowIndex::DEFAULT_EVERY);
+
     // Get warnings accumulated during parsing
     const std::vector<Warning>& warnings() const { return warnings_; }
 
 private:
+    // Reset per-parse state
+    void reset(const std::string& filepath);
+
+    // Parse the rows of a file into columns_ (or chunks_), adding warnings
+    void read_file(const std::string& filepath);
+
+    // Parse the rows of the open current_file_, as read_file does
+    void read_rows(BufferedReader& reader);
+
+    // Check the fields of every file's header, then parse each file into a
+    // parser of its own in chunks_ and join their schemas: columns take the
+    // widest type of any file, and files lacking expanded columns read as
+    // NA there
+    void read_files(const std::vector<std::string>& files);
+
+    // Position reader at the first requested row using the row index, if
+    // there is a current one; the header is then taken from the index
+    bool seek_with_index(BufferedReader& reader);
+
     // Find tabular array in input (handles key extraction)
     bool find_tabular_array(BufferedReader& reader, std::string& header_line, size_t& header_line_no);
 
     // Parse tabular header [N]{field1,field2,...}:
     bool parse_header(std::string_view header);
 
+    // The [N] and the fields of a tabular header, appended to fields;
+    // false if it is not one
+    bool split_header(std::string_view header, size_t& declared,
+                      std::vector<std::string>& fields);
+
+    // Fields of the tabular header of filepath, found as read_rows finds
+    // it. Throws ParseError if there is none or it lacks a selected or
+    // filtered column.
+    std::vector<std::string> header_fields(const std::string& filepath);
+
+    // Start each column at the type sampled for it (opts_.sample_rows)
+    void apply_sampled_types(BufferedReader& reader);
+
     // Parse data rows
     void parse_rows(BufferedReader& reader, int base_indent);
 
+    // Parse the remaining rows in chunks on several threads (contiguous
+    // input only). Returns false if the input should be parsed serially.
+    bool parse_rows_parallel(BufferedReader& reader);
+
+    // Set up as the parser for one chunk, continuing from the given schema
+    void start_chunk(const TabularParser& parent, const std::vector<ColType>& types,
+                     size_t rows_hint);
+
+    // Build the data.frame, concatenating chunks if parsed in parallel
+    SEXP build_result();
+    SEXP build_chunked_dataframe();
+
+    // Add this parse's figures to the active profile, if there is one
+    void record_stats() const;
+
     // Parse a single row line
     void parse_row_line(std::string_view line, size_t line_no);
 
+    // Lazy parse: keep the column types the header forces as the scan's
+    // starting point and drop the builders' storage
+    void start_scan();
+
+    // Lazy parse: keep a row (already split into row_fields_) and widen
+    // the column types to hold its values
+    void scan_row(std::string_view line, size_t n_fields);
+
     // Utility
-    std::vector<std::string_view> split_row(std::string_view line, char delimiter);
     std::string_view trim(std::string_view sv);
 
     TabularParseOptions opts_;
@@ -127,17 +369,45 @@ private:
     std::vector<std::string> field_names_;
     std::vector<ColBuilder> columns_;
     size_t declared_rows_ = 0;
-    size_t observed_rows_ = 0;
+    size_t observed_rows_ = 0;     // rows stored
+    size_t scanned_rows_ = 0;      // rows read, including filtered ones
     char delimiter_ = ',';
+    RowProjection projection_;
+    std::vector<std::string_view> row_fields_;
+
+    // Row range: rows still to skip before the first one read, and rows to
+    // read (counted by scanned_rows_)
+    size_t skip_rows_ = 0;
+    size_t row_limit_ = SIZE_MAX;
+
+    // Row index in use, and the block reading started at
+    std::optional<RowIndex> index_;
+    size_t first_block_ = 0;
 
     // Ragged row tracking
     size_t min_fields_ = SIZE_MAX;
     size_t max_fields_ = 0;
     size_t schema_expansions_ = 0;
+    size_t header_columns_ = 0;
+
+    // Parallel parsing: one parser per chunk, in input order, plus the type
+    // each text column was promoted from in a serial parse
+    std::vector<TabularParser> chunks_;
+    std::vector<ColType> string_from_;
+
+    // Lazy parse: rows kept (views into the input), and each column's
+    // forced and scanned types
+    bool lazy_ = false;
+    std::vector<std::string_view> lazy_rows_;
+    std::vector<ColType> lazy_start_;
+    std::vector<ColType> lazy_types_;
 };
 
 // Build data.frame from column builders
-SEXP build_dataframe(std::vector<ColBuilder>& columns, size_t nrow);
+SEXP build_dataframe(std::vector<ColBuilder>& columns, size_t nrow, bool as_factor = false);
+
+// Set names, compact row.names and class on a list of columns
+void set_dataframe_attrs(SEXP df, SEXP names, size_t nrow);
 
 } // namespace toonlite
 
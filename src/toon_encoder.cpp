@@ -1,10 +1,13 @@
 #include "toon_encoder.h"
 #include "toon_errors.h"
+#include "toon_parser.h"
 #include <cmath>
 #include <algorithm>
 #include <cstring>
-#include <sstream>
-#include <iomanip>
+#include <exception>
+#include <functional>
+#include <system_error>
+#include <thread>
 
 namespace toonlite {
 
@@ -43,6 +46,16 @@ void Encoder::check_special_double(double val) {
     }
 }
 
+// NA, NaN and Inf become null (an error for the latter two in strict mode)
+void Encoder::write_double(double val, bool decimal_point) {
+    if (!std::isfinite(val)) {
+        check_special_double(val);
+        encode_null();
+        return;
+    }
+    buf_.append_double(val, decimal_point);
+}
+
 void Encoder::encode_null() {
     write_string("null");
 }
@@ -86,7 +99,7 @@ void Encoder::encode_integer(SEXP x) {
         if (data[0] == NA_INTEGER) {
             encode_null();
         } else {
-            buf_.append(std::to_string(data[0]));
+            buf_.append_int(data[0]);
         }
         return;
     }
@@ -103,7 +116,7 @@ void Encoder::encode_integer(SEXP x) {
         if (data[i] == NA_INTEGER) {
             encode_null();
         } else {
-            buf_.append(std::to_string(data[i]));
+            buf_.append_int(data[i]);
         }
         write_newline();
     }
@@ -113,29 +126,8 @@ void Encoder::encode_double(SEXP x) {
     R_xlen_t n = Rf_xlength(x);
     double* data = REAL(x);
 
-    auto format_double = [this](double val) {
-        if (ISNA(val) || ISNAN(val)) {
-            check_special_double(val);
-            return std::string("null");
-        }
-        if (std::isinf(val)) {
-            check_special_double(val);
-            return std::string("null"); // Fallback for non-strict
-        }
-
-        std::ostringstream oss;
-        oss << std::setprecision(17) << val;
-        std::string s = oss.str();
-
-        // Ensure we have decimal point for floats
-        if (s.find('.') == std::string::npos && s.find('e') == std::string::npos) {
-            s += ".0";
-        }
-        return s;
-    };
-
     if (n == 1) {
-        buf_.append(format_double(data[0]));
+        write_double(data[0], true);
         return;
     }
 
@@ -148,7 +140,7 @@ void Encoder::encode_double(SEXP x) {
     for (R_xlen_t i = 0; i < n; i++) {
         write_indent(1);
         buf_.append("- ", 2);
-        buf_.append(format_double(data[i]));
+        write_double(data[i], true);
         write_newline();
     }
 }
@@ -260,95 +252,15 @@ void Encoder::encode_list(SEXP x, int depth) {
 }
 
 void Encoder::encode_dataframe_tabular(SEXP df, int depth) {
-    SEXP names = Rf_getAttrib(df, R_NamesSymbol);
-    R_xlen_t ncol = Rf_xlength(df);
-    R_xlen_t nrow = (ncol > 0) ? Rf_xlength(VECTOR_ELT(df, 0)) : 0;
-
-    // Write header: [N]{field1,field2,...}:
-    buf_.append_char('[');
-    buf_.append(std::to_string(nrow));
-    buf_.append("]{", 2);
-
-    for (R_xlen_t j = 0; j < ncol; j++) {
-        if (j > 0) buf_.append_char(',');
-        SEXP name_elem = STRING_ELT(names, j);
-        if (name_elem != NA_STRING) {
-            buf_.append(std::string_view(CHAR(name_elem)));
-        }
-    }
-    buf_.append("}:", 2);
-    write_newline();
-
-    // Write rows
-    for (R_xlen_t i = 0; i < nrow; i++) {
-        write_indent(depth + 1);
-
-        for (R_xlen_t j = 0; j < ncol; j++) {
-            if (j > 0) buf_.append(", ", 2);
-
-            SEXP col = VECTOR_ELT(df, j);
-
-            switch (TYPEOF(col)) {
-                case LGLSXP: {
-                    int val = LOGICAL(col)[i];
-                    if (val == NA_LOGICAL) {
-                        write_string("null");
-                    } else {
-                        write_string(val ? "true" : "false");
-                    }
-                    break;
-                }
-                case INTSXP: {
-                    // Check if it's a factor
-                    SEXP levels = Rf_getAttrib(col, R_LevelsSymbol);
-                    if (levels != R_NilValue) {
-                        int idx = INTEGER(col)[i];
-                        R_xlen_t nlevels = Rf_xlength(levels);
-                        if (idx == NA_INTEGER || idx < 1 || idx > nlevels) {
-                            write_string("null");
-                        } else {
-                            write_escaped_string(CHAR(STRING_ELT(levels, idx - 1)));
-                        }
-                    } else {
-                        int val = INTEGER(col)[i];
-                        if (val == NA_INTEGER) {
-                            write_string("null");
-                        } else {
-                            buf_.append(std::to_string(val));
-                        }
-                    }
-                    break;
-                }
-                case REALSXP: {
-                    double val = REAL(col)[i];
-                    if (ISNA(val) || ISNAN(val)) {
-                        check_special_double(val);
-                        write_string("null");
-                    } else if (std::isinf(val)) {
-                        check_special_double(val);
-                        write_string("null");
-                    } else {
-                        std::ostringstream oss;
-                        oss << std::setprecision(17) << val;
-                        buf_.append(oss.str());
-                    }
-                    break;
-                }
-                case STRSXP: {
-                    SEXP elem = STRING_ELT(col, i);
-                    if (elem == NA_STRING) {
-                        write_string("null");
-                    } else {
-                        write_escaped_string(CHAR(elem));
-                    }
-                    break;
-                }
-                default:
-                    write_string("null");
-                    break;
-            }
-        }
-        write_newline();
+    TabularWriter writer(df, opts_, depth);
+    writer.check_values();
+    writer.write_header(buf_);
+
+    // String cells are read a chunk at a time to keep their table small
+    for (R_xlen_t begin = 0; begin < writer.nrow(); begin += TabularWriter::CHUNK_ROWS) {
+        R_xlen_t end = std::min(writer.nrow(), begin + TabularWriter::CHUNK_ROWS);
+        writer.load_strings(begin, end);
+        writer.format_rows(begin, end, buf_);
     }
 }
 
@@ -530,9 +442,27 @@ void Encoder::encode_value(SEXP x, int depth) {
 }
 
 std::string Encoder::encode(SEXP x) {
+    return std::string(encode_view(x));
+}
+
+std::string_view Encoder::encode_view(SEXP x) {
     buf_.clear();
     encode_value(x, 0);
-    return buf_.str();
+    return buf_.view();
+}
+
+void Encoder::encode_to(SEXP x, std::ostream& out, size_t buffer_size) {
+    buf_.clear();
+    buf_.set_sink(&out, buffer_size);
+    try {
+        encode_value(x, 0);
+        buf_.flush();
+    } catch (...) {
+        buf_.clear();
+        buf_.set_sink(nullptr);
+        throw;
+    }
+    buf_.set_sink(nullptr);
 }
 
 std::string Encoder::encode_dataframe(SEXP df, bool tabular) {
@@ -545,4 +475,367 @@ std::string Encoder::encode_dataframe(SEXP df, bool tabular) {
     return buf_.str();
 }
 
+// Document formatting
+namespace {
+
+// Walks a Document making the calls Encoder makes for the R value that
+// from_toon(simplify = FALSE) builds from it: a scalar per primitive, an
+// unnamed list per array and a named list per object
+class DocumentFormatter {
+public:
+    DocumentFormatter(const Document& doc, const EncodeOptions& opts, WriteBuffer& out)
+        : doc_(doc), opts_(opts), out_(out) {}
+
+    void value(NodeId id, int depth) {
+        if (id == NO_NODE) {
+            out_.append("null", 4);
+            return;
+        }
+        const Node& node = doc_.node(id);
+        switch (node.kind) {
+            case NodeKind::N_NULL:
+                out_.append("null", 4);
+                break;
+            case NodeKind::N_BOOL:
+                if (node.bool_val) {
+                    out_.append("true", 4);
+                } else {
+                    out_.append("false", 5);
+                }
+                break;
+            case NodeKind::N_INT:
+                // The parser keeps only integers R can hold as N_INT
+                out_.append_int(static_cast<int>(node.int_val));
+                break;
+            case NodeKind::N_DOUBLE:
+                write_double(node.double_val);
+                break;
+            case NodeKind::N_STRING:
+                out_.append_escaped_string(doc_.string_value(id));
+                break;
+            case NodeKind::N_ARRAY:
+                array(id, depth);
+                break;
+            case NodeKind::N_OBJECT:
+                object(id, depth);
+                break;
+        }
+    }
+
+private:
+    void write_indent(int depth) {
+        if (opts_.pretty && depth > 0) {
+            for (int i = 0; i < depth * opts_.indent; i++) {
+                out_.append_char(' ');
+            }
+        }
+    }
+
+    void write_newline() {
+        if (opts_.pretty) {
+            out_.append_char('\n');
+        }
+    }
+
+    void write_double(double val) {
+        if (!std::isfinite(val)) {
+            if (opts_.strict) {
+                throw ParseError(std::isnan(val) ? "NaN values not allowed in strict mode"
+                                                 : "Inf/-Inf values not allowed in strict mode");
+            }
+            out_.append("null", 4);
+            return;
+        }
+        out_.append_double(val, true);
+    }
+
+    void array(NodeId id, int depth) {
+        size_t n = doc_.size(id);
+        const NodeId* items = doc_.items(id);
+
+        out_.append_char('[');
+        out_.append(std::to_string(n));
+        out_.append("]:", 2);
+        write_newline();
+
+        for (size_t i = 0; i < n; i++) {
+            write_indent(depth + 1);
+            out_.append("- ", 2);
+            value(items[i], depth + 1);
+            write_newline();
+        }
+    }
+
+    void object(NodeId id, int depth) {
+        size_t n = doc_.size(id);
+        const Member* members = doc_.members(id);
+
+        // Member order for this object, on a stack shared by nested objects
+        size_t base = order_.size();
+        for (size_t i = 0; i < n; i++) {
+            order_.push_back(static_cast<uint32_t>(i));
+        }
+        if (opts_.canonical) {
+            std::sort(order_.begin() + base, order_.end(), [&](uint32_t a, uint32_t b) {
+                return doc_.key(members[a]) < doc_.key(members[b]);
+            });
+        }
+
+        for (size_t j = 0; j < n; j++) {
+            const Member& m = members[order_[base + j]];
+            std::string_view name = doc_.key(m);
+
+            if (depth > 0) {
+                write_indent(depth);
+            }
+
+            bool needs_quotes = name.empty() || name.find(':') != std::string_view::npos ||
+                                name.find(' ') != std::string_view::npos ||
+                                name.find('"') != std::string_view::npos;
+            if (needs_quotes) {
+                out_.append_escaped_string(name);
+            } else {
+                out_.append(name);
+            }
+            out_.append(": ", 2);
+
+            // Non-empty arrays and objects go on the following lines
+            NodeKind kind = m.value == NO_NODE ? NodeKind::N_NULL : doc_.kind(m.value);
+            bool is_complex = (kind == NodeKind::N_ARRAY || kind == NodeKind::N_OBJECT) &&
+                              doc_.size(m.value) > 0;
+
+            if (is_complex) {
+                write_newline();
+                value(m.value, depth + 1);
+            } else {
+                value(m.value, depth + 1);
+                write_newline();
+            }
+        }
+        order_.resize(base);
+    }
+
+    const Document& doc_;
+    const EncodeOptions& opts_;
+    WriteBuffer& out_;
+    std::vector<uint32_t> order_;
+};
+
+} // namespace
+
+void format_document(const Document& doc, const EncodeOptions& opts, WriteBuffer& out) {
+    DocumentFormatter formatter(doc, opts, out);
+    formatter.value(doc.root(), 0);
+}
+
+// TabularWriter implementation
+TabularWriter::TabularWriter(SEXP df, const EncodeOptions& opts, int depth)
+    : names_(Rf_getAttrib(df, R_NamesSymbol)), strict_(opts.strict) {
+    R_xlen_t ncol = Rf_xlength(df);
+    nrow_ = ncol > 0 ? Rf_xlength(VECTOR_ELT(df, 0)) : 0;
+
+    if (opts.pretty) {
+        indent_.assign(static_cast<size_t>((depth + 1) * opts.indent), ' ');
+        newline_ = "\n";
+    }
+
+    columns_.resize(static_cast<size_t>(ncol));
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        SEXP col = VECTOR_ELT(df, j);
+        Column& c = columns_[j];
+        c.type = TYPEOF(col);
+        switch (c.type) {
+            case LGLSXP:
+                c.ints = LOGICAL(col);
+                break;
+            case INTSXP: {
+                c.ints = INTEGER(col);
+                SEXP levels = Rf_getAttrib(col, R_LevelsSymbol);
+                if (levels != R_NilValue) {
+                    c.factor = true;
+                    for (R_xlen_t k = 0; k < Rf_xlength(levels); k++) {
+                        SEXP level = STRING_ELT(levels, k);
+                        c.levels.emplace_back(CHAR(level), LENGTH(level));
+                    }
+                }
+                break;
+            }
+            case REALSXP:
+                c.dbls = REAL(col);
+                break;
+            case STRSXP:
+                c.strings = col;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void TabularWriter::check_values() const {
+    if (!strict_) return;
+
+    // First non-finite cell in row-major order
+    R_xlen_t bad_row = nrow_;
+    double bad = 0;
+    for (const Column& c : columns_) {
+        if (c.type != REALSXP) continue;
+        for (R_xlen_t i = 0; i < bad_row; i++) {
+            if (!std::isfinite(c.dbls[i])) {
+                bad_row = i;
+                bad = c.dbls[i];
+                break;
+            }
+        }
+    }
+    if (bad_row == nrow_) return;
+
+    if (std::isnan(bad)) {
+        throw ParseError("NaN values not allowed in strict mode");
+    }
+    throw ParseError("Inf/-Inf values not allowed in strict mode");
+}
+
+void TabularWriter::write_header(WriteBuffer& out) const {
+    // Write header: [N]{field1,field2,...}:
+    out.append_char('[');
+    out.append(std::to_string(nrow_));
+    out.append("]{", 2);
+
+    for (size_t j = 0; j < columns_.size(); j++) {
+        if (j > 0) out.append_char(',');
+        SEXP name_elem = STRING_ELT(names_, j);
+        if (name_elem != NA_STRING) {
+            out.append(std::string_view(CHAR(name_elem)));
+        }
+    }
+    out.append("}:", 2);
+    out.append(newline_);
+}
+
+void TabularWriter::load_strings(R_xlen_t begin, R_xlen_t end) {
+    loaded_begin_ = begin;
+    for (Column& c : columns_) {
+        if (c.type != STRSXP) continue;
+        c.cells.resize(static_cast<size_t>(end - begin));
+        for (R_xlen_t i = begin; i < end; i++) {
+            SEXP elem = STRING_ELT(c.strings, i);
+            c.cells[i - begin] = elem == NA_STRING ? std::string_view()
+                                                   : std::string_view(CHAR(elem), LENGTH(elem));
+        }
+    }
+}
+
+void TabularWriter::format_rows(R_xlen_t begin, R_xlen_t end, WriteBuffer& out) const {
+    for (R_xlen_t i = begin; i < end; i++) {
+        out.append(indent_);
+
+        for (size_t j = 0; j < columns_.size(); j++) {
+            if (j > 0) out.append(", ", 2);
+
+            const Column& c = columns_[j];
+            switch (c.type) {
+                case LGLSXP: {
+                    int val = c.ints[i];
+                    if (val == NA_LOGICAL) {
+                        out.append("null", 4);
+                    } else if (val) {
+                        out.append("true", 4);
+                    } else {
+                        out.append("false", 5);
+                    }
+                    break;
+                }
+                case INTSXP: {
+                    int val = c.ints[i];
+                    if (val == NA_INTEGER) {
+                        out.append("null", 4);
+                    } else if (!c.factor) {
+                        out.append_int(val);
+                    } else if (val < 1 || static_cast<size_t>(val) > c.levels.size()) {
+                        out.append("null", 4);
+                    } else {
+                        out.append_escaped_string(c.levels[val - 1]);
+                    }
+                    break;
+                }
+                case REALSXP: {
+                    double val = c.dbls[i];
+                    if (std::isfinite(val)) {
+                        out.append_double(val);
+                    } else {
+                        out.append("null", 4);
+                    }
+                    break;
+                }
+                case STRSXP: {
+                    std::string_view cell = c.cells[i - loaded_begin_];
+                    if (cell.data() == nullptr) {
+                        out.append("null", 4);
+                    } else {
+                        out.append_escaped_string(cell);
+                    }
+                    break;
+                }
+                default:
+                    out.append("null", 4);
+                    break;
+            }
+        }
+        out.append(newline_);
+    }
+}
+
+void TabularWriter::write(std::ostream& out, int threads) {
+    WriteBuffer header(0);
+    write_header(header);
+    out.write(header.view().data(), static_cast<std::streamsize>(header.size()));
+
+    // Rows go out in waves of one chunk per worker. The calling thread
+    // formats the first chunk of a wave and then writes the chunks in order,
+    // waiting on each worker in turn, so at most one wave of output is held.
+    R_xlen_t n_chunks = (nrow_ + CHUNK_ROWS - 1) / CHUNK_ROWS;
+    size_t workers = static_cast<size_t>(std::max<R_xlen_t>(1, std::min<R_xlen_t>(threads, n_chunks)));
+    std::vector<WriteBuffer> bufs(workers, WriteBuffer(0));
+    std::vector<std::exception_ptr> errors(workers);
+    R_xlen_t wave_rows = static_cast<R_xlen_t>(workers) * CHUNK_ROWS;
+
+    for (R_xlen_t wave = 0; wave < nrow_; wave += wave_rows) {
+        R_xlen_t wave_end = std::min(nrow_, wave + wave_rows);
+        load_strings(wave, wave_end);
+
+        size_t n = static_cast<size_t>((wave_end - wave + CHUNK_ROWS - 1) / CHUNK_ROWS);
+        auto format_chunk = [&](size_t c) {
+            try {
+                R_xlen_t begin = wave + static_cast<R_xlen_t>(c) * CHUNK_ROWS;
+                bufs[c].clear();
+                format_rows(begin, std::min(wave_end, begin + CHUNK_ROWS), bufs[c]);
+            } catch (...) {
+                errors[c] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> pool(n);
+        for (size_t c = 1; c < n; c++) {
+            try {
+                pool[c] = std::thread(std::cref(format_chunk), c);
+            } catch (const std::system_error&) {
+                format_chunk(c);
+            }
+        }
+        format_chunk(0);
+
+        std::exception_ptr error;
+        for (size_t c = 0; c < n; c++) {
+            if (pool[c].joinable()) pool[c].join();
+            if (errors[c] && !error) error = errors[c];
+            if (!error) {
+                out.write(bufs[c].view().data(), static_cast<std::streamsize>(bufs[c].size()));
+            }
+        }
+        if (error) std::rethrow_exception(error);
+        if (!out) return;
+    }
+}
+
 } // namespace toonlite
@@ -2,6 +2,8 @@
 #define TOON_ENCODER_HPP
 
 #include <string>
+#include <string_view>
+#include <ostream>
 #include <vector>
 #include <cstdint>
 #include "toon_io.h"
@@ -40,6 +42,14 @@ public:
     // Encode R object to TOON string
     std::string encode(SEXP x);
 
+    // Encode into the internal buffer; the view is valid until the next
+    // call on this encoder
+    std::string_view encode_view(SEXP x);
+
+    // Encode straight to `out`, holding at most about `buffer_size` bytes
+    void encode_to(SEXP x, std::ostream& out,
+                   size_t buffer_size = WriteBuffer::DEFAULT_CAPACITY);
+
     // Encode data.frame to tabular TOON
     std::string encode_dataframe(SEXP df, bool tabular = true);
 
@@ -64,10 +74,70 @@ private:
     // Check for special values in strict mode
     void check_special_double(double val);
 
+    // Shortest round-trip form; `decimal_point` keeps integral values
+    // looking like doubles (1.0 rather than 1)
+    void write_double(double val, bool decimal_point);
+
     EncodeOptions opts_;
     WriteBuffer buf_;
 };
 
+class Document;
+
+// Format a parsed document as encode() formats the R value that
+// from_toon(simplify = FALSE) gives for it, without building that value
+void format_document(const Document& doc, const EncodeOptions& opts, WriteBuffer& out);
+
+// Tabular encoding of a data.frame. Column data is read out of R up front
+// (and string cells a range of rows at a time), so that rows can then be
+// formatted on worker threads without touching the R API.
+class TabularWriter {
+public:
+    // Rows per chunk handed to a worker
+    static constexpr R_xlen_t CHUNK_ROWS = R_xlen_t(1) << 16;
+
+    TabularWriter(SEXP df, const EncodeOptions& opts, int depth = 0);
+
+    R_xlen_t nrow() const { return nrow_; }
+
+    // Throw the error a row-by-row encode would hit first, if any (NaN and
+    // Inf in strict mode)
+    void check_values() const;
+
+    // [N]{fields}: line
+    void write_header(WriteBuffer& out) const;
+
+    // Read the string cells of rows [begin, end) out of R. Main thread only.
+    void load_strings(R_xlen_t begin, R_xlen_t end);
+
+    // Format rows [begin, end), which must lie in the loaded range
+    void format_rows(R_xlen_t begin, R_xlen_t end, WriteBuffer& out) const;
+
+    // Write the whole table to `out`, formatting chunks on up to `threads`
+    // threads and writing them in order as they complete
+    void write(std::ostream& out, int threads);
+
+private:
+    struct Column {
+        SEXPTYPE type = NILSXP;
+        const int* ints = nullptr;
+        const double* dbls = nullptr;
+        SEXP strings = R_NilValue;
+        bool factor = false;
+        std::vector<std::string_view> levels;
+        // Cells of the loaded rows; NA has a null data()
+        std::vector<std::string_view> cells;
+    };
+
+    SEXP names_;
+    R_xlen_t nrow_ = 0;
+    R_xlen_t loaded_begin_ = 0;
+    bool strict_;
+    std::string indent_;
+    std::string newline_;
+    std::vector<Column> columns_;
+};
+
 } // namespace toonlite
 
 #endif // TOON_ENCODER_HPP
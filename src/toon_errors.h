@@ -3,6 +3,7 @@
 
 #include <string>
 #include <stdexcept>
+#include <vector>
 #include <cstddef>
 
 namespace toonlite {
@@ -68,9 +69,10 @@ struct ValidationResult {
     size_t column = 0;
     std::string snippet;
     std::string file;
+    std::vector<ParseError> errors;  // Every error found, in input order
 
     static ValidationResult ok() {
-        return ValidationResult{true, ErrorType::PARSE_ERROR, "", 0, 0, "", ""};
+        return ValidationResult{true, ErrorType::PARSE_ERROR, "", 0, 0, "", "", {}};
     }
 
     static ValidationResult error(const std::string& msg,
@@ -78,7 +80,7 @@ struct ValidationResult {
                                    size_t col = 0,
                                    const std::string& snippet = "",
                                    const std::string& file = "") {
-        return ValidationResult{false, ErrorType::PARSE_ERROR, msg, line, col, snippet, file};
+        return ValidationResult{false, ErrorType::PARSE_ERROR, msg, line, col, snippet, file, {}};
     }
 };
 
@@ -0,0 +1,172 @@
+#include "toon_index.h"
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace toonlite {
+
+namespace {
+
+// Format tag; bump the digit when the layout changes
+constexpr char MAGIC[8] = {'T', 'O', 'O', 'N', 'I', 'D', 'X', '2'};
+
+// Upper bound on a stored string, so a corrupt length cannot force a huge
+// allocation
+constexpr uint32_t MAX_STRING = uint32_t(1) << 24;
+
+template <typename T>
+void put(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+void put_string(std::ofstream& out, const std::string& s) {
+    put(out, static_cast<uint32_t>(s.size()));
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+template <typename T>
+bool get(std::ifstream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof value));
+}
+
+bool get_string(std::ifstream& in, std::string& s) {
+    uint32_t n;
+    if (!get(in, n) || n > MAX_STRING) return false;
+    s.resize(n);
+    return n == 0 || static_cast<bool>(in.read(&s[0], n));
+}
+
+uint64_t fnv1a(uint64_t h, const char* data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+} // namespace
+
+bool file_stamp(const std::string& filepath, uint64_t& size, int64_t& mtime) {
+    struct stat st;
+    if (stat(filepath.c_str(), &st) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+bool hash_file(const std::string& filepath, uint64_t size, uint64_t& out) {
+    std::ifstream in(filepath, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    std::vector<char> buf(FILE_HASH_BYTES);
+    uint64_t h = 14695981039346656037ULL;
+    in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+    h = fnv1a(h, buf.data(), static_cast<size_t>(in.gcount()));
+    if (size > FILE_HASH_BYTES) {
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(std::max<uint64_t>(size - FILE_HASH_BYTES,
+                                                                FILE_HASH_BYTES)));
+        in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        h = fnv1a(h, buf.data(), static_cast<size_t>(in.gcount()));
+    }
+    out = h;
+    return true;
+}
+
+void RowIndex::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw ParseError("Cannot open file for writing: " + path);
+    }
+
+    out.write(MAGIC, sizeof MAGIC);
+    put(out, file_size);
+    put(out, file_mtime);
+    put(out, content_hash);
+    put(out, static_cast<uint8_t>(key.has_value()));
+    put_string(out, key.value_or(""));
+    put(out, static_cast<uint8_t>(allow_comments));
+    put_string(out, header);
+    put(out, header_line);
+    put(out, rows);
+    put(out, every);
+    put(out, static_cast<uint64_t>(blocks.size()));
+    out.write(reinterpret_cast<const char*>(blocks.data()),
+              static_cast<std::streamsize>(blocks.size() * sizeof(Block)));
+
+    out.close();
+    if (!out) {
+        throw ParseError("Error writing to file: " + path);
+    }
+}
+
+bool RowIndex::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof MAGIC];
+    if (!in.read(magic, sizeof magic) || std::memcmp(magic, MAGIC, sizeof MAGIC) != 0) {
+        return false;
+    }
+
+    uint8_t has_key, comments;
+    std::string key_str;
+    uint64_t n_blocks;
+    if (!get(in, file_size) || !get(in, file_mtime) || !get(in, content_hash) ||
+        !get(in, has_key) || !get_string(in, key_str) || !get(in, comments) ||
+        !get_string(in, header) || !get(in, header_line) || !get(in, rows) ||
+        !get(in, every) || !get(in, n_blocks)) {
+        return false;
+    }
+    key = has_key ? std::optional<std::string>(key_str) : std::nullopt;
+    allow_comments = comments != 0;
+
+    // One block per `every` rows, and always the first. The blocks must
+    // all be in the rest of the index before room is made for them.
+    if (every == 0 || n_blocks != std::max<uint64_t>(1, rows / every + (rows % every != 0))) {
+        return false;
+    }
+    std::streamoff at = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff end = in.tellg();
+    if (at < 0 || end < at ||
+        n_blocks > static_cast<uint64_t>(end - at) / sizeof(Block)) {
+        return false;
+    }
+    in.seekg(at);
+    blocks.resize(n_blocks);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(blocks.data()),
+                                     static_cast<std::streamsize>(n_blocks * sizeof(Block))));
+}
+
+bool RowIndex::describes(const std::string& filepath, const std::optional<std::string>& for_key,
+                         bool with_comments) const {
+    uint64_t size, hash;
+    int64_t mtime;
+    return file_stamp(filepath, size, mtime) && size == file_size && mtime == file_mtime &&
+        for_key == key && with_comments == allow_comments &&
+        hash_file(filepath, size, hash) && hash == content_hash;
+}
+
+size_t RowIndex::block_of(size_t row) const {
+    return static_cast<size_t>(std::min<uint64_t>(row / every, blocks.size() - 1));
+}
+
+bool load_row_index(const std::string& index_path, const std::string& filepath,
+                    const std::optional<std::string>& key, bool allow_comments,
+                    RowIndex& index, std::vector<Warning>& warnings) {
+    if (!index.load(index_path)) {
+        warnings.push_back(Warning("index", "Cannot read row index " + index_path +
+            "; scanning rows instead."));
+        return false;
+    }
+    if (!index.describes(filepath, key, allow_comments)) {
+        warnings.push_back(Warning("index", "Row index " + index_path +
+            " is out of date; scanning rows instead. Rebuild it with toon_build_index()."));
+        return false;
+    }
+    return true;
+}
+
+} // namespace toonlite
@@ -0,0 +1,74 @@
+#ifndef TOON_INDEX_HPP
+#define TOON_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include "toon_errors.h"
+
+namespace toonlite {
+
+// Sidecar row index of a tabular TOON file (conventionally <file>.toonidx).
+// It holds the tabular header and the byte offset and line number of every
+// `every`-th row, so readers can seek to any row or split the rows into
+// chunks without scanning the lines before them. It records the size,
+// modification time and a hash of the ends (see hash_file()) of the file
+// it describes and is ignored once they change. Stored in native byte
+// order.
+struct RowIndex {
+    static constexpr size_t DEFAULT_EVERY = 65536;
+
+    struct Block {
+        uint64_t offset;   // byte offset of the block's first row
+        uint64_t line;     // line number of that row
+    };
+
+    uint64_t file_size = 0;
+    int64_t file_mtime = 0;
+    uint64_t content_hash = 0;
+    std::optional<std::string> key;
+    bool allow_comments = true;
+    std::string header;          // tabular header, e.g. [N]{a,b}:
+    uint64_t header_line = 0;
+    uint64_t rows = 0;           // data rows in the file
+    uint64_t every = DEFAULT_EVERY;
+    // blocks[i] starts row i * every; blocks[0], always present, starts
+    // right after the header
+    std::vector<Block> blocks;
+
+    // Write to path; throws ParseError on failure
+    void save(const std::string& path) const;
+
+    // Read from path; false if it is missing or not an index
+    bool load(const std::string& path);
+
+    // Whether the index still describes `filepath` read with these options
+    bool describes(const std::string& filepath, const std::optional<std::string>& for_key,
+                   bool with_comments) const;
+
+    // Index of the block holding row `row` (0-based); rows past the end
+    // give the last block
+    size_t block_of(size_t row) const;
+};
+
+// Size and modification time of a file; false if it cannot be stat'ed
+bool file_stamp(const std::string& filepath, uint64_t& size, int64_t& mtime);
+
+constexpr size_t FILE_HASH_BYTES = size_t(1) << 16;
+
+// Hash of the first and last FILE_HASH_BYTES of a file of the given size,
+// catching rewrites the stamp misses (same size, same second); false if
+// it cannot be read
+bool hash_file(const std::string& filepath, uint64_t size, uint64_t& out);
+
+// Load the index at index_path for reading filepath with these options.
+// Returns false, adding a warning, if it is unreadable or out of date.
+bool load_row_index(const std::string& index_path, const std::string& filepath,
+                    const std::optional<std::string>& key, bool allow_comments,
+                    RowIndex& index, std::vector<Warning>& warnings);
+
+} // namespace toonlite
+
+#endif // TOON_INDEX_HPP
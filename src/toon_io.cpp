@@ -1,27 +1,367 @@
 #include "toon_io.h"
+#include "toon_charconv.h"
+#include "toon_errors.h"
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
+#include <cstdint>
+
+#if !defined(_WIN32)
+#define TOONLITE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace toonlite {
 
 BufferedReader::BufferedReader(const std::string& filepath, size_t buffer_size)
     : filepath_(filepath), buffer_size_(buffer_size) {
+    open_file(true);
+}
+
+BufferedReader::BufferedReader(const std::string& filepath, const ReaderOptions& opts)
+    : filepath_(filepath), buffer_size_(std::max<size_t>(opts.buffer_size, 4)),  // room to sniff
+      prefetch_(opts.prefetch) {
+    open_file(prefetch_ == 0);
+    if (!has_error_ && (file_.is_open() || decompressor_) && prefetch_ > 0) {
+        start_prefetch();
+    }
+}
+
+BufferedReader::BufferedReader(const char* data, size_t length)
+    : buffer_size_(0), string_data_(data), string_length_(length) {
+}
+
+void BufferedReader::open_file(bool map) {
+    if (map && map_file()) {
+        // A compressed mapping is the input of the decoder instead
+        Compression c = detect_compression(string_data_, string_length_);
+        if (c != Compression::NONE) {
+            z_data_ = string_data_;
+            z_length_ = string_length_;
+            string_data_ = nullptr;
+            string_length_ = 0;
+            start_decompression(c);
+        }
+        return;
+    }
+
     buffer_.resize(buffer_size_);
-    file_.open(filepath, std::ios::binary);
+    file_.open(filepath_, std::ios::binary);
     if (!file_.is_open()) {
         has_error_ = true;
-        error_message_ = "Cannot open file: " + filepath;
+        error_message_ = "Cannot open file: " + filepath_;
+        return;
+    }
+
+    // Sniff the format from the first bytes; plain text stays in the buffer
+    file_.read(buffer_.data(), static_cast<std::streamsize>(std::min<size_t>(4, buffer_size_)));
+    buffer_end_ = static_cast<size_t>(file_.gcount());
+    Compression c = detect_compression(buffer_.data(), buffer_end_);
+    if (c != Compression::NONE) {
+        zbuf_.resize(COMPRESSED_CHUNK);
+        std::memcpy(zbuf_.data(), buffer_.data(), buffer_end_);
+        z_data_ = zbuf_.data();
+        z_length_ = buffer_end_;
+        buffer_end_ = 0;
+        start_decompression(c);
     }
 }
 
-BufferedReader::BufferedReader(const char* data, size_t length)
-    : buffer_size_(0), string_data_(data), string_length_(length) {
+BufferedReader::~BufferedReader() {
+    if (prefetcher_.joinable()) {
+        stop_prefetch();
+    }
+#ifdef TOONLITE_HAVE_MMAP
+    if (mapped_ != nullptr) {
+        munmap(mapped_, mapped_length_);
+    }
+#endif
+}
+
+// Map a regular file read-only. Returns false (leaving the reader untouched)
+// if mapping is unsupported or fails, in which case the caller streams it.
+bool BufferedReader::map_file() {
+#ifdef TOONLITE_HAVE_MMAP
+    int fd = open(filepath_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<uintmax_t>(st.st_size) > SIZE_MAX) {
+        close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    if (length == 0) {
+        // Nothing to map: behave as empty input
+        close(fd);
+        static const char empty = '\0';
+        string_data_ = &empty;
+        string_length_ = 0;
+        return true;
+    }
+
+    void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+#ifdef MADV_SEQUENTIAL
+    madvise(addr, length, MADV_SEQUENTIAL);
+#endif
+
+    mapped_ = addr;
+    mapped_length_ = length;
+    string_data_ = static_cast<const char*>(addr);
+    string_length_ = length;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void BufferedReader::start_decompression(Compression c) {
+    compression_ = c;
+    if (!compression_supported(c)) {
+        has_error_ = true;
+        error_message_ = std::string("Cannot read ") + compression_name(c) +
+                         " file (toonlite was built without " + compression_name(c) +
+                         " support)";
+        return;
+    }
+    decompressor_ = Decompressor::create(c);
+    buffer_.resize(buffer_size_);
+}
+
+// Start compressed input over from the beginning
+void BufferedReader::rewind() {
+    bool prefetching = prefetcher_.joinable();
+    if (prefetching) stop_prefetch();
+
+    decompressor_->reset();
+    z_member_done_ = false;
+    z_pos_ = 0;
+    if (file_.is_open()) {
+        file_.clear();
+        file_.seekg(0);
+        z_length_ = 0;
+    }
+    source_done_ = false;
+    buffer_pos_ = 0;
+    buffer_end_ = 0;
+    buffer_offset_ = 0;
+    eof_reached_ = false;
+
+    if (prefetching) start_prefetch();
+}
+
+// Refill zbuf_ from the file, keeping the bytes not decoded yet. False if
+// nothing more was read; a mapping is all there from the start.
+bool BufferedReader::read_compressed() {
+    if (!file_.is_open()) return false;
+
+    size_t left = z_length_ - z_pos_;
+    std::memmove(zbuf_.data(), z_data_ + z_pos_, left);
+    file_.read(zbuf_.data() + left, static_cast<std::streamsize>(zbuf_.size() - left));
+    size_t got = static_cast<size_t>(file_.gcount());
+    z_data_ = zbuf_.data();
+    z_pos_ = 0;
+    z_length_ = left + got;
+    return got > 0;
+}
+
+// Decode into out until it is full or the input ends. Concatenated gzip
+// members or zstd frames read as one stream.
+size_t BufferedReader::decompress(char* out, size_t len) {
+    size_t produced = 0;
+    while (produced < len) {
+        if (z_member_done_) {
+            // Anything but another member, such as padding, ends the input
+            if (z_length_ - z_pos_ < 4) read_compressed();
+            if (detect_compression(z_data_ + z_pos_, z_length_ - z_pos_) != compression_) {
+                source_done_ = true;
+                break;
+            }
+            decompressor_->reset();
+            z_member_done_ = false;
+        }
+        if (z_pos_ == z_length_ && !read_compressed()) {
+            throw ParseError(std::string("Unexpected end of ") + compression_name(compression_) +
+                             " data", 0, 0, "", filepath_);
+        }
+
+        size_t in_used = 0;
+        size_t out_used = 0;
+        Decompressor::Status status = decompressor_->run(
+            z_data_ + z_pos_, z_length_ - z_pos_, in_used,
+            out + produced, len - produced, out_used);
+        z_pos_ += in_used;
+        produced += out_used;
+        if (status == Decompressor::FAILED || (status == Decompressor::OK &&
+                                               in_used == 0 && out_used == 0)) {
+            throw ParseError(std::string("Corrupt ") + compression_name(compression_) +
+                             " data: " + decompressor_->error(), 0, 0, "", filepath_);
+        }
+        z_member_done_ = status == Decompressor::END;
+    }
+    return produced;
+}
+
+size_t BufferedReader::read_source(char* out, size_t len) {
+    if (decompressor_) {
+        return decompress(out, len);
+    }
+
+    file_.read(out, static_cast<std::streamsize>(len));
+    size_t bytes_read = static_cast<size_t>(file_.gcount());
+    if (bytes_read == 0 || file_.eof()) {
+        source_done_ = true;
+    }
+    return bytes_read;
+}
+
+void BufferedReader::start_prefetch() {
+    stop_ = false;
+    prefetch_done_ = false;
+    prefetch_error_.clear();
+    free_.resize(prefetch_);
+    prefetcher_ = std::thread(&BufferedReader::prefetch_loop, this);
+}
+
+// Stop the thread and take back the buffers it filled
+void BufferedReader::stop_prefetch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    free_cv_.notify_all();
+    prefetcher_.join();
+
+    for (auto& block : ready_) {
+        free_.push_back(std::move(block.data));
+    }
+    ready_.clear();
+}
+
+// Runs on the read-ahead thread: only file I/O and decoding, never R
+void BufferedReader::prefetch_loop() {
+    while (true) {
+        std::vector<char> data;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            free_cv_.wait(lock, [this] { return stop_ || !free_.empty(); });
+            if (stop_) return;
+            data = std::move(free_.back());
+            free_.pop_back();
+        }
+
+        data.resize(buffer_size_);
+        size_t size = 0;
+        std::string error;
+        try {
+            size = read_source(data.data(), data.size());
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        bool done = source_done_ || !error.empty();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.push_back({std::move(data), size});
+            prefetch_done_ = done;
+            prefetch_error_ = error;
+        }
+        ready_cv_.notify_one();
+        if (done) return;
+    }
+}
+
+// Make the next filled buffer current, returning the consumed one to the
+// thread. Only called once the current buffer has been used up.
+bool BufferedReader::next_block() {
+    buffer_offset_ += buffer_end_;
+    buffer_pos_ = 0;
+    buffer_end_ = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (buffer_end_ == 0) {
+        ready_cv_.wait(lock, [this] { return !ready_.empty() || prefetch_done_; });
+        if (ready_.empty()) {
+            eof_reached_ = true;
+            if (!prefetch_error_.empty()) {
+                throw ParseError(prefetch_error_, 0, 0, "", filepath_);
+            }
+            return false;
+        }
+
+        free_.push_back(std::move(buffer_));
+        buffer_ = std::move(ready_.front().data);
+        buffer_end_ = ready_.front().size;
+        ready_.pop_front();
+        free_cv_.notify_one();
+    }
+    return true;
+}
+
+void BufferedReader::seek(size_t offset, size_t line_no) {
+    line_no_ = line_no > 0 ? line_no - 1 : 0;
+    counters_.start_offset = offset;
+    counters_.start_line = line_no_;
+    if (string_data_ != nullptr) {
+        string_pos_ = std::min(offset, string_length_);
+        return;
+    }
+
+    // Still in the buffer (such as back to rows just sampled): only the
+    // position moves
+    if (offset >= buffer_offset_ && offset <= buffer_offset_ + buffer_end_) {
+        buffer_pos_ = offset - buffer_offset_;
+        return;
+    }
+
+    if (decompressor_) {
+        if (offset < buffer_offset_ + buffer_pos_) {
+            rewind();
+        }
+        // Decode and drop everything before offset
+        while (offset >= buffer_offset_ + buffer_end_) {
+            buffer_pos_ = buffer_end_;
+            if (!fill_buffer()) break;
+        }
+        buffer_pos_ = std::min(offset - buffer_offset_, buffer_end_);
+        return;
+    }
+
+    bool prefetching = prefetcher_.joinable();
+    if (prefetching) stop_prefetch();
+
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(offset));
+    buffer_pos_ = 0;
+    buffer_end_ = 0;
+    buffer_offset_ = offset;
+    eof_reached_ = false;
+    source_done_ = false;
+
+    if (prefetching) start_prefetch();
 }
 
 bool BufferedReader::fill_buffer() {
     if (eof_reached_) return false;
 
+    if (prefetcher_.joinable()) {
+        return next_block();
+    }
+
     // Move remaining data to beginning of buffer
+    buffer_offset_ += buffer_pos_;
     if (buffer_pos_ < buffer_end_) {
         size_t remaining = buffer_end_ - buffer_pos_;
         std::memmove(buffer_.data(), buffer_.data() + buffer_pos_, remaining);
@@ -32,23 +372,31 @@ bool BufferedReader::fill_buffer() {
         buffer_end_ = 0;
     }
 
-    if (!file_.is_open()) {
+    if (!file_.is_open() && !decompressor_) {
         eof_reached_ = true;
         return buffer_end_ > 0;
     }
 
     // Read more data
-    file_.read(buffer_.data() + buffer_end_, buffer_size_ - buffer_end_);
-    size_t bytes_read = static_cast<size_t>(file_.gcount());
-    buffer_end_ += bytes_read;
-
-    if (bytes_read == 0 || file_.eof()) {
+    buffer_end_ += read_source(buffer_.data() + buffer_end_, buffer_size_ - buffer_end_);
+    if (source_done_) {
         eof_reached_ = true;
     }
 
     return buffer_end_ > 0;
 }
 
+// fill_buffer(), counted and (while profiling) timed
+bool BufferedReader::refill() {
+    counters_.refills++;
+    if (!timed_) return fill_buffer();
+
+    auto start = stats::Clock::now();
+    bool filled = fill_buffer();
+    counters_.wait_seconds += stats::seconds_since(start);
+    return filled;
+}
+
 void BufferedReader::handle_crlf(std::string_view& line) {
     // Strip trailing \r if present (CRLF handling)
     if (!line.empty() && line.back() == '\r') {
@@ -57,7 +405,7 @@ void BufferedReader::handle_crlf(std::string_view& line) {
 }
 
 bool BufferedReader::next_line(std::string_view& out_line, size_t& out_line_no) {
-    // Handle string input
+    // Handle string or memory-mapped input
     if (string_data_ != nullptr) {
         if (string_pos_ >= string_length_) {
             return false;
@@ -65,9 +413,10 @@ bool BufferedReader::next_line(std::string_view& out_line, size_t& out_line_no)
 
         const char* start = string_data_ + string_pos_;
         const char* end = string_data_ + string_length_;
-        const char* newline = std::find(start, end, '\n');
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', end - start));
+        if (newline == nullptr) newline = end;
 
-        size_t line_len = (newline != end) ? (newline - start) : (end - start);
+        size_t line_len = newline - start;
         out_line = std::string_view(start, line_len);
         handle_crlf(out_line);
 
@@ -83,9 +432,10 @@ bool BufferedReader::next_line(std::string_view& out_line, size_t& out_line_no)
     while (true) {
         // Need more data?
         if (buffer_pos_ >= buffer_end_) {
-            if (!fill_buffer()) {
+            if (!refill()) {
                 // No more data - if we have scratch content, return it
                 if (!scratch_.empty()) {
+                    counters_.scratch_copies++;
                     out_line = std::string_view(scratch_);
                     handle_crlf(out_line);
                     line_no_++;
@@ -99,7 +449,8 @@ bool BufferedReader::next_line(std::string_view& out_line, size_t& out_line_no)
         // Find newline in buffer
         const char* buf_start = buffer_.data() + buffer_pos_;
         const char* buf_end = buffer_.data() + buffer_end_;
-        const char* newline = std::find(buf_start, buf_end, '\n');
+        const char* newline = static_cast<const char*>(std::memchr(buf_start, '\n', buf_end - buf_start));
+        if (newline == nullptr) newline = buf_end;
 
         if (newline != buf_end) {
             // Found newline
@@ -111,6 +462,7 @@ bool BufferedReader::next_line(std::string_view& out_line, size_t& out_line_no)
             } else {
                 // Append to scratch and return
                 scratch_.append(buf_start, line_len);
+                counters_.scratch_copies++;
                 out_line = std::string_view(scratch_);
             }
 
@@ -132,8 +484,22 @@ WriteBuffer::WriteBuffer(size_t initial_capacity) {
     data_.reserve(initial_capacity);
 }
 
+void WriteBuffer::set_sink(std::ostream* sink, size_t high_water) {
+    flush();
+    sink_ = sink;
+    high_water_ = high_water;
+}
+
+void WriteBuffer::flush() {
+    if (sink_ && !data_.empty()) {
+        sink_->write(data_.data(), static_cast<std::streamsize>(data_.size()));
+        data_.clear();
+    }
+}
+
 void WriteBuffer::append(const char* data, size_t len) {
     data_.insert(data_.end(), data, data + len);
+    maybe_flush();
 }
 
 void WriteBuffer::append(const std::string& s) {
@@ -146,39 +512,63 @@ void WriteBuffer::append(std::string_view sv) {
 
 void WriteBuffer::append_char(char c) {
     data_.push_back(c);
+    maybe_flush();
 }
 
+namespace {
+
+inline bool needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+} // namespace
+
 void WriteBuffer::append_escaped_string(std::string_view s) {
     append_char('"');
-    for (char c : s) {
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (!needs_escape(static_cast<unsigned char>(c))) continue;
+
+        // Copy the run of plain bytes before this one in one go
+        append(s.data() + run, i - run);
+        run = i + 1;
         switch (c) {
             case '"':  append("\\\"", 2); break;
             case '\\': append("\\\\", 2); break;
             case '\n': append("\\n", 2); break;
             case '\r': append("\\r", 2); break;
             case '\t': append("\\t", 2); break;
-            default:
-                if (static_cast<unsigned char>(c) < 0x20) {
-                    // Control character - encode as \uXXXX
-                    char buf[7];
-                    int written = snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
-                    // snprintf returns number of characters that would be written (excluding null)
-                    // For valid control chars (0x00-0x1F), this should always be 6
-                    if (written == 6) {
-                        append(buf, 6);
-                    } else {
-                        // Fallback: use replacement character sequence
-                        append("\\uFFFD", 6);
-                    }
-                } else {
-                    append_char(c);
-                }
+            default: {
+                // Control character - encode as \uXXXX
+                static const char hex[] = "0123456789abcdef";
+                unsigned char u = static_cast<unsigned char>(c);
+                char buf[6] = {'\\', 'u', '0', '0', hex[u >> 4], hex[u & 0xF]};
+                append(buf, 6);
                 break;
+            }
         }
     }
+    append(s.data() + run, s.size() - run);
     append_char('"');
 }
 
+void WriteBuffer::append_int(int v) {
+    char buf[16];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    append(buf, static_cast<size_t>(res.ptr - buf));
+}
+
+void WriteBuffer::append_double(double v, bool decimal_point) {
+    char buf[40];
+    char* end = double_to_chars(buf, v);
+    if (decimal_point && !std::memchr(buf, '.', end - buf) && !std::memchr(buf, 'e', end - buf)) {
+        *end++ = '.';
+        *end++ = '0';
+    }
+    append(buf, static_cast<size_t>(end - buf));
+}
+
 std::string_view WriteBuffer::view() const {
     return std::string_view(data_.data(), data_.size());
 }
@@ -200,4 +590,126 @@ void WriteBuffer::clear() {
     data_.clear();
 }
 
+// OutputFile implementation
+
+// Stream buffer that collects output and passes it through a Compressor
+// to the file
+class OutputFile::CompressedBuf : public std::streambuf {
+public:
+    static constexpr size_t CHUNK = 256 * 1024;
+
+    CompressedBuf(std::filebuf& file, Compression c)
+        : file_(file), compressor_(Compressor::create(c)), in_(CHUNK) {
+        setp(in_.data(), in_.data() + in_.size());
+    }
+
+    // Encode the buffered bytes and write the output; FINISH ends the
+    // member or frame, if one has been started
+    bool drain(Compressor::Mode mode) {
+        size_t n = static_cast<size_t>(pptr() - pbase());
+        setp(in_.data(), in_.data() + in_.size());
+        if (n > 0) started_ = true;
+        if (!started_) return true;
+
+        out_.clear();
+        if (!compressor_->run(in_.data(), n, mode, out_)) return false;
+        if (mode == Compressor::FINISH) {
+            compressor_->reset();
+            started_ = false;
+        }
+        return file_.sputn(out_.data(), static_cast<std::streamsize>(out_.size())) ==
+               static_cast<std::streamsize>(out_.size());
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (!drain(Compressor::NO_FLUSH)) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        return drain(Compressor::FLUSH) && file_.pubsync() == 0 ? 0 : -1;
+    }
+
+private:
+    std::filebuf& file_;
+    std::unique_ptr<Compressor> compressor_;
+    std::vector<char> in_;
+    std::string out_;
+    bool started_ = false;
+};
+
+bool replace_file(const std::string& tmp, const std::string& path) {
+    if (std::rename(tmp.c_str(), path.c_str()) == 0) {
+        return true;
+    }
+    // Windows renames only onto a free name
+    std::remove(path.c_str());
+    if (std::rename(tmp.c_str(), path.c_str()) == 0) {
+        return true;
+    }
+    std::remove(tmp.c_str());
+    return false;
+}
+
+OutputFile::OutputFile(const std::string& filepath)
+    : OutputFile(filepath, compression_for_path(filepath)) {
+}
+
+OutputFile::OutputFile(const std::string& filepath, Compression compression)
+    : std::ostream(nullptr), compression_(compression) {
+    if (!compression_supported(compression)) {
+        throw ParseError(std::string("Cannot write ") + compression_name(compression) +
+                         " file (toonlite was built without " + compression_name(compression) +
+                         " support)", 0, 0, "", filepath);
+    }
+
+    file_.open(filepath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (compression != Compression::NONE) {
+        compressed_ = std::make_unique<CompressedBuf>(file_, compression);
+        rdbuf(compressed_.get());
+    } else {
+        rdbuf(&file_);
+    }
+    if (!file_.is_open()) {
+        setstate(std::ios::failbit);
+    }
+}
+
+OutputFile::~OutputFile() {
+    try {
+        close();
+    } catch (...) {
+        // Ignore errors in destructor
+    }
+}
+
+void OutputFile::write_patchable(std::string_view data) {
+    if (!compressed_) {
+        write(data.data(), static_cast<std::streamsize>(data.size()));
+        return;
+    }
+
+    std::string member = stored_member(compression_, data);
+    if (!compressed_->drain(Compressor::FINISH) ||
+        file_.sputn(member.data(), static_cast<std::streamsize>(member.size())) !=
+            static_cast<std::streamsize>(member.size())) {
+        setstate(std::ios::badbit);
+    }
+}
+
+void OutputFile::close() {
+    if (!file_.is_open()) return;
+    if (compressed_ && !compressed_->drain(Compressor::FINISH)) {
+        setstate(std::ios::badbit);
+    }
+    if (file_.close() == nullptr) {
+        setstate(std::ios::failbit);
+    }
+}
+
 } // namespace toonlite
@@ -4,19 +4,39 @@
 #include <string>
 #include <string_view>
 #include <fstream>
+#include <ostream>
 #include <vector>
 #include <cstddef>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include "toon_compress.h"
+#include "toon_stats.h"
 
 namespace toonlite {
 
-// Buffered line reader for efficient file I/O
+struct ReaderOptions;
+
+// Buffered line reader for efficient file I/O. Regular files are
+// memory-mapped where the platform allows it, so lines are returned as views
+// into the mapping; otherwise the file is streamed through a buffer.
+// gzip and zstd files (recognised by their magic number) are decompressed
+// incrementally into the buffer as it is read. With read-ahead (see
+// ReaderOptions) a background thread reads and decompresses into a ring of
+// buffers while lines are taken from the current one.
 class BufferedReader {
 public:
     static constexpr size_t DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024; // 4MB buffer
 
     BufferedReader(const std::string& filepath, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+    BufferedReader(const std::string& filepath, const ReaderOptions& opts);
     BufferedReader(const char* data, size_t length);
+    ~BufferedReader();
+
+    BufferedReader(const BufferedReader&) = delete;
+    BufferedReader& operator=(const BufferedReader&) = delete;
 
     // Returns false when no more lines available
     bool next_line(std::string_view& out_line, size_t& out_line_no);
@@ -25,7 +45,29 @@ public:
     size_t current_line() const { return line_no_; }
 
     // Check if reading from file
-    bool is_file() const { return file_.is_open(); }
+    bool is_file() const { return file_.is_open() || mapped_ != nullptr; }
+
+    // Format of the file being read
+    Compression compression() const { return compression_; }
+
+    // Whole input is addressable in memory (string input or mapped file).
+    // Views returned by next_line then stay valid for the reader's lifetime.
+    bool is_contiguous() const { return string_data_ != nullptr; }
+    bool is_mapped() const { return mapped_ != nullptr; }
+
+    // Contiguous input only: raw bytes
+    const char* data() const { return string_data_; }
+    size_t size() const { return string_length_; }
+
+    // Byte offset of the next line (in the decompressed text)
+    size_t offset() const {
+        return string_data_ != nullptr ? string_pos_ : buffer_offset_ + buffer_pos_;
+    }
+
+    // Continue reading at a byte offset that starts a line, numbering that
+    // line line_no. Compressed input is decompressed up to the offset,
+    // from the start again for a backward seek.
+    void seek(size_t offset, size_t line_no);
 
     // Get file path (empty if reading from string)
     const std::string& filepath() const { return filepath_; }
@@ -34,28 +76,104 @@ public:
     bool has_error() const { return has_error_; }
     const std::string& error_message() const { return error_message_; }
 
+    // Work done so far, for profiling (see toon_stats.h). String and
+    // memory-mapped input is never refilled.
+    struct Counters {
+        size_t refills = 0;
+        size_t scratch_copies = 0;
+        double wait_seconds = 0;   // measured only while profiling
+        size_t start_offset = 0;   // where reading (re)started, after a seek
+        size_t start_line = 0;
+    };
+    const Counters& counters() const { return counters_; }
+
 private:
+    void open_file(bool map);
+    bool map_file();
     bool fill_buffer();
+    bool refill();
     void handle_crlf(std::string_view& line);
 
+    // Read up to len bytes of (decompressed) text into out, setting
+    // source_done_ at the end of the file
+    size_t read_source(char* out, size_t len);
+    bool source_done_ = false;
+
+    // Compressed input
+    static constexpr size_t COMPRESSED_CHUNK = 256 * 1024;
+    void start_decompression(Compression c);
+    void rewind();
+    bool read_compressed();
+    size_t decompress(char* out, size_t len);
+
     std::ifstream file_;
     std::string filepath_;
     std::vector<char> buffer_;
     size_t buffer_size_;
     size_t buffer_pos_ = 0;
     size_t buffer_end_ = 0;
+    size_t buffer_offset_ = 0;  // file offset of buffer_[0]
     size_t line_no_ = 0;
     bool eof_reached_ = false;
     bool has_error_ = false;
     std::string error_message_;
 
-    // For string input
+    // For string input (also used for memory-mapped files)
     const char* string_data_ = nullptr;
     size_t string_length_ = 0;
     size_t string_pos_ = 0;
 
+    // Memory-mapped file region (nullptr if not mapped)
+    void* mapped_ = nullptr;
+    size_t mapped_length_ = 0;
+
     // Scratch buffer for lines spanning buffer boundaries
     std::string scratch_;
+
+    Counters counters_;
+    bool timed_ = stats::active() != nullptr;
+
+    // Compressed bytes not yet decoded: the whole mapping, or a chunk of
+    // the file in zbuf_
+    Compression compression_ = Compression::NONE;
+    std::unique_ptr<Decompressor> decompressor_;
+    const char* z_data_ = nullptr;
+    size_t z_length_ = 0;
+    size_t z_pos_ = 0;
+    std::vector<char> zbuf_;
+    bool z_member_done_ = false;
+
+    // Read-ahead: the thread takes empty buffers from free_, fills them
+    // with read_source() and queues them on ready_; fill_buffer() swaps the
+    // next ready one with the consumed buffer_. Lines crossing a buffer
+    // boundary are assembled in scratch_ as without read-ahead.
+    struct Block {
+        std::vector<char> data;
+        size_t size = 0;
+    };
+    void start_prefetch();
+    void stop_prefetch();
+    void prefetch_loop();
+    bool next_block();
+    size_t prefetch_ = 0;
+    std::thread prefetcher_;
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable free_cv_;
+    std::deque<Block> ready_;
+    std::vector<std::vector<char>> free_;
+    bool stop_ = false;            // ask the thread to exit
+    bool prefetch_done_ = false;   // the thread has queued the last block
+    std::string prefetch_error_;
+};
+
+// How BufferedReader reads a file
+struct ReaderOptions {
+    size_t buffer_size = BufferedReader::DEFAULT_BUFFER_SIZE;
+    // Buffers to fill ahead on a background thread; 0 reads on demand.
+    // Read-ahead streams the file rather than memory-mapping it, so reads
+    // overlap with parsing on storage where page faults are slow.
+    size_t prefetch = 0;
 };
 
 // Write buffer for efficient output
@@ -65,6 +183,14 @@ public:
 
     WriteBuffer(size_t initial_capacity = DEFAULT_CAPACITY);
 
+    // Sink mode: whenever the buffer reaches `high_water` bytes its content
+    // is written to `sink` and dropped, so memory stays bounded however much
+    // is appended. view() and str() then see only the unflushed tail.
+    void set_sink(std::ostream* sink, size_t high_water = DEFAULT_CAPACITY);
+
+    // Write buffered bytes to the sink, if there is one
+    void flush();
+
     void append(const char* data, size_t len);
     void append(const std::string& s);
     void append(std::string_view sv);
@@ -73,6 +199,12 @@ public:
     // Append with proper TOON string escaping
     void append_escaped_string(std::string_view s);
 
+    // Append numbers formatted with std::to_chars. Doubles must be finite
+    // and use the shortest form that reads back exactly; with
+    // `decimal_point`, integral values get ".0" so they stay doubles.
+    void append_int(int v);
+    void append_double(double v, bool decimal_point = false);
+
     // Get current content
     std::string_view view() const;
     std::string str() const;
@@ -85,6 +217,49 @@ public:
 
 private:
     std::vector<char> data_;
+    std::ostream* sink_ = nullptr;
+    size_t high_water_ = 0;
+
+    void maybe_flush() {
+        if (sink_ && data_.size() >= high_water_) flush();
+    }
+};
+
+// Move the finished file tmp onto path, replacing any file there. Writers
+// fill path + ".tmp" first, so a failed write leaves what was at path
+// as it was. Returns false, with tmp removed, if the move fails.
+bool replace_file(const std::string& tmp, const std::string& path);
+
+// Output file for the writers. Files named *.gz or *.zst (see
+// compression_for_path()) are compressed as they are written; flush()
+// makes everything so far decodable and close() ends the stream. Throws
+// ParseError if the compression is not available in this build.
+class OutputFile : public std::ostream {
+public:
+    explicit OutputFile(const std::string& filepath);
+    OutputFile(const std::string& filepath, Compression compression);
+    ~OutputFile() override;
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool is_open() const { return file_.is_open(); }
+    Compression compression() const { return compression_; }
+
+    // Write bytes that patch_stored_prefix() can later overwrite: as they
+    // are in a plain file, else as a stored gzip member or zstd frame of
+    // their own. Meant for the start of the file.
+    void write_patchable(std::string_view data);
+
+    // Finish the compressed stream and close; sets failbit on error
+    void close();
+
+private:
+    class CompressedBuf;
+
+    Compression compression_;
+    std::filebuf file_;
+    std::unique_ptr<CompressedBuf> compressed_;
 };
 
 } // namespace toonlite
@@ -0,0 +1,113 @@
+#include "toon_keys.h"
+
+namespace toonlite {
+
+KeyIndex::KeyIndex(const std::vector<std::string>& keys) {
+    bool inserted;
+    for (const auto& k : keys) {
+        insert(k, inserted);
+    }
+}
+
+// FNV-1a
+uint32_t KeyIndex::hash(std::string_view k) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : k) {
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+size_t KeyIndex::find(std::string_view k) const {
+    if (!hashed()) {
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (key(i) == k) return i;
+        }
+        return npos;
+    }
+
+    uint32_t h = hash(k);
+    size_t mask = slots_.size() - 1;
+    for (size_t s = h & mask; slots_[s] != 0; s = (s + 1) & mask) {
+        size_t i = slots_[s] - 1;
+        if (entries_[i].hash == h && key(i) == k) return i;
+    }
+    return npos;
+}
+
+size_t KeyIndex::insert(std::string_view k, bool& inserted) {
+    size_t found = find(k);
+    if (found != npos) {
+        inserted = false;
+        return found;
+    }
+
+    inserted = true;
+    Entry e;
+    e.offset = arena_.size();
+    e.len = static_cast<uint32_t>(k.size());
+    e.hash = hash(k);
+    e.slot = 0;
+    arena_.append(k.data(), k.size());
+    entries_.push_back(e);
+
+    size_t i = entries_.size() - 1;
+    if (entries_.size() == LINEAR_MAX + 1 || entries_.size() * 2 > slots_.size()) {
+        // Start hashing, or keep the table at most half full
+        grow();
+    } else if (hashed()) {
+        place(i);
+    }
+    return i;
+}
+
+void KeyIndex::place(size_t i) {
+    size_t mask = slots_.size() - 1;
+    size_t s = entries_[i].hash & mask;
+    while (slots_[s] != 0) {
+        s = (s + 1) & mask;
+    }
+    slots_[s] = static_cast<uint32_t>(i + 1);
+    entries_[i].slot = s;
+}
+
+// Place every entry, in a larger table if needed. The table is empty
+// while there are too few keys to hash, so one left by an earlier, larger
+// key set is reused as it is.
+void KeyIndex::grow() {
+    size_t capacity = slots_.empty() ? 32 : slots_.size();
+    while (entries_.size() * 2 > capacity) {
+        capacity *= 2;
+    }
+    if (capacity != slots_.size() || entries_.size() > LINEAR_MAX + 1) {
+        slots_.assign(capacity, 0);
+    }
+    for (size_t i = 0; i < entries_.size(); i++) {
+        place(i);
+    }
+}
+
+void KeyIndex::clear() {
+    if (hashed()) {
+        for (const Entry& e : entries_) {
+            slots_[e.slot] = 0;
+        }
+    }
+    entries_.clear();
+    arena_.clear();
+}
+
+NameLookup::NameLookup(const std::vector<std::string>& names) {
+    bool inserted;
+    for (size_t i = 0; i < names.size(); i++) {
+        index_.insert(names[i], inserted);
+        if (inserted) first_.push_back(i);
+    }
+}
+
+size_t NameLookup::find(std::string_view name) const {
+    size_t i = index_.find(name);
+    return i == KeyIndex::npos ? KeyIndex::npos : first_[i];
+}
+
+} // namespace toonlite
@@ -0,0 +1,74 @@
+#ifndef TOON_KEYS_HPP
+#define TOON_KEYS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace toonlite {
+
+// Insertion-ordered set of distinct keys. Keys are copied into one arena
+// and, past a handful, indexed by a flat open-addressed hash table with
+// linear probing, so lookups and inserts are O(1) and a key costs no
+// allocation of its own. clear() keeps the storage for reuse and only
+// touches the slots that were filled.
+class KeyIndex {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    KeyIndex() = default;
+    explicit KeyIndex(const std::vector<std::string>& keys);
+
+    // Position of k in insertion order, or npos
+    size_t find(std::string_view k) const;
+
+    // Position of k, adding it at the end if absent (inserted tells which)
+    size_t insert(std::string_view k, bool& inserted);
+
+    size_t size() const { return entries_.size(); }
+    std::string_view key(size_t i) const {
+        return std::string_view(arena_.data() + entries_[i].offset, entries_[i].len);
+    }
+
+    void clear();
+
+private:
+    // Up to this many keys are compared directly, without the table
+    static constexpr size_t LINEAR_MAX = 8;
+
+    struct Entry {
+        size_t offset;
+        uint32_t len;
+        uint32_t hash;
+        size_t slot;   // Its place in slots_ once hashed
+    };
+
+    static uint32_t hash(std::string_view k);
+    bool hashed() const { return entries_.size() > LINEAR_MAX; }
+    void place(size_t i);
+    void grow();
+
+    std::string arena_;
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> slots_;   // Entry index + 1, 0 when empty
+};
+
+// Lookup of names by position in a list that may repeat them, such as a
+// header; a repeated name resolves to its first occurrence
+class NameLookup {
+public:
+    explicit NameLookup(const std::vector<std::string>& names);
+
+    // Position of name in the list, or KeyIndex::npos
+    size_t find(std::string_view name) const;
+
+private:
+    KeyIndex index_;
+    std::vector<size_t> first_;
+};
+
+} // namespace toonlite
+
+#endif // TOON_KEYS_HPP
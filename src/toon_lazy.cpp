@@ -0,0 +1,200 @@
+#include "toon_lazy.h"
+#include "toon_scan.h"
+#include <R_ext/Altrep.h>
+#include <cstdio>
+
+namespace toonlite {
+
+SEXP LazyTable::materialize(size_t j, bool as_factor) const {
+    const Column& col = columns[j];
+
+    // Numeric promotions keep every value, so such columns can start at
+    // their final type. Text replays the promotions of an eager read, which
+    // decide how the numbers before the first text value are written.
+    ColBuilder builder(col.name, rows.size());
+    ColType start = col.type == ColType::STRING ? col.start : col.type;
+    if (start != ColType::UNKNOWN) {
+        builder.force_type(start);
+    }
+
+    std::vector<std::string_view> fields;
+    for (std::string_view row : rows) {
+        size_t n_fields = split_fields(row, delimiter, fields, col.field + 1);
+        if (col.field < n_fields) {
+            builder.append(fields[col.field]);
+        } else {
+            builder.append_null();
+        }
+    }
+    return builder.finalize(as_factor);
+}
+
+namespace {
+
+R_altrep_class_t lazy_integer_class;
+R_altrep_class_t lazy_real_class;
+R_altrep_class_t lazy_logical_class;
+R_altrep_class_t lazy_string_class;
+
+// data1 of a lazy column: an external pointer to its state. data2 is the
+// parsed vector, or R_NilValue until the column is first used.
+struct LazyColumn {
+    std::shared_ptr<const LazyTable> table;   // dropped once parsed
+    size_t column;
+    R_xlen_t length;
+};
+
+LazyColumn* lazy_column(SEXP x) {
+    return static_cast<LazyColumn*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+}
+
+// The parsed values of x, parsing them on first use
+SEXP column_values(SEXP x) {
+    SEXP values = R_altrep_data2(x);
+    if (values != R_NilValue) {
+        return values;
+    }
+
+    // The error is raised once the handler has returned: Rf_error does not
+    // return, and would skip destroying the caught exception
+    LazyColumn* col = lazy_column(x);
+    char message[8192] = "";
+    try {
+        values = col->table->materialize(col->column, false);
+    } catch (const ParseError& e) {
+        std::snprintf(message, sizeof message, "%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        std::snprintf(message, sizeof message, "Error parsing lazy column: %s", e.what());
+    }
+    if (message[0] != '\0') {
+        Rf_error("%s", message);
+    }
+    R_set_altrep_data2(x, values);
+    col->table.reset();
+    return values;
+}
+
+R_xlen_t lazy_length(SEXP x) {
+    return lazy_column(x)->length;
+}
+
+Rboolean lazy_inspect(SEXP x, int, int, int, void (*)(SEXP, int, int, int)) {
+    Rprintf(" toonlite lazy column (%s)\n",
+            R_altrep_data2(x) == R_NilValue ? "not parsed" : "parsed");
+    return TRUE;
+}
+
+void* lazy_dataptr(SEXP x, Rboolean) {
+    SEXP values = column_values(x);
+    switch (TYPEOF(values)) {
+        case INTSXP: return INTEGER(values);
+        case REALSXP: return REAL(values);
+        case LGLSXP: return LOGICAL(values);
+        default: return const_cast<SEXP*>(STRING_PTR_RO(values));
+    }
+}
+
+// Never parses, so R can ask without forcing the column
+const void* lazy_dataptr_or_null(SEXP x) {
+    return R_altrep_data2(x) == R_NilValue ? nullptr : lazy_dataptr(x, FALSE);
+}
+
+int lazy_integer_elt(SEXP x, R_xlen_t i) {
+    return INTEGER(column_values(x))[i];
+}
+
+double lazy_real_elt(SEXP x, R_xlen_t i) {
+    return REAL(column_values(x))[i];
+}
+
+int lazy_logical_elt(SEXP x, R_xlen_t i) {
+    return LOGICAL(column_values(x))[i];
+}
+
+SEXP lazy_string_elt(SEXP x, R_xlen_t i) {
+    return STRING_ELT(column_values(x), i);
+}
+
+void lazy_string_set_elt(SEXP x, R_xlen_t i, SEXP v) {
+    SET_STRING_ELT(column_values(x), i, v);
+}
+
+void set_common_methods(R_altrep_class_t cls) {
+    R_set_altrep_Length_method(cls, lazy_length);
+    R_set_altrep_Inspect_method(cls, lazy_inspect);
+    R_set_altvec_Dataptr_method(cls, lazy_dataptr);
+    R_set_altvec_Dataptr_or_null_method(cls, lazy_dataptr_or_null);
+}
+
+R_altrep_class_t class_of(ColType type) {
+    switch (type) {
+        case ColType::INTEGER: return lazy_integer_class;
+        case ColType::DOUBLE: return lazy_real_class;
+        case ColType::STRING: return lazy_string_class;
+        default: return lazy_logical_class;   // logical, or all null
+    }
+}
+
+} // namespace
+
+SEXP lazy_dataframe(std::shared_ptr<const LazyTable> table, bool as_factor) {
+    size_t ncol = table->columns.size();
+    size_t nrow = table->rows.size();
+
+    SEXP df = PROTECT(Rf_allocVector(VECSXP, ncol));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, ncol));
+
+    for (size_t j = 0; j < ncol; j++) {
+        const auto& col = table->columns[j];
+        SET_STRING_ELT(names, j, Rf_mkCharCE(col.name.c_str(), CE_UTF8));
+
+        if (col.type == ColType::STRING && as_factor) {
+            SET_VECTOR_ELT(df, j, table->materialize(j, true));
+            continue;
+        }
+
+        auto* state = new LazyColumn{table, j, static_cast<R_xlen_t>(nrow)};
+        SEXP ptr = PROTECT(R_MakeExternalPtr(state, R_NilValue, R_NilValue));
+        R_RegisterCFinalizerEx(ptr, [](SEXP p) {
+            auto* c = static_cast<LazyColumn*>(R_ExternalPtrAddr(p));
+            if (c) {
+                delete c;
+                R_ClearExternalPtr(p);
+            }
+        }, TRUE);
+        SET_VECTOR_ELT(df, j, R_new_altrep(class_of(col.type), ptr, R_NilValue));
+        UNPROTECT(1);
+    }
+
+    set_dataframe_attrs(df, names, nrow);
+
+    UNPROTECT(2);
+    return df;
+}
+
+} // namespace toonlite
+
+extern "C" {
+
+void toonlite_init_lazy(DllInfo* dll) {
+    using namespace toonlite;
+
+    lazy_integer_class = R_make_altinteger_class("toon_lazy_integer", "toonlite", dll);
+    set_common_methods(lazy_integer_class);
+    R_set_altinteger_Elt_method(lazy_integer_class, lazy_integer_elt);
+
+    lazy_real_class = R_make_altreal_class("toon_lazy_real", "toonlite", dll);
+    set_common_methods(lazy_real_class);
+    R_set_altreal_Elt_method(lazy_real_class, lazy_real_elt);
+
+    lazy_logical_class = R_make_altlogical_class("toon_lazy_logical", "toonlite", dll);
+    set_common_methods(lazy_logical_class);
+    R_set_altlogical_Elt_method(lazy_logical_class, lazy_logical_elt);
+
+    lazy_string_class = R_make_altstring_class("toon_lazy_string", "toonlite", dll);
+    set_common_methods(lazy_string_class);
+    R_set_altstring_Elt_method(lazy_string_class, lazy_string_elt);
+    R_set_altstring_Set_elt_method(lazy_string_class, lazy_string_set_elt);
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef TOON_LAZY_HPP
+#define TOON_LAZY_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include "toon_df.h"
+#include "toon_io.h"
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+#ifdef error
+#undef error
+#endif
+#ifdef length
+#undef length
+#endif
+
+namespace toonlite {
+
+// Rows of a tabular read kept unparsed (lazy = TRUE): the mapped file, a
+// view of each kept row into it, and the columns found by the scan. A
+// column's values are parsed from the rows when it is first used.
+struct LazyTable {
+    struct Column {
+        std::string name;
+        ColType start;     // type forced by col_types (UNKNOWN if none)
+        ColType type;      // type the scan found the column to have
+        size_t field;      // position of its field in a row
+    };
+
+    std::unique_ptr<BufferedReader> reader;   // owns the bytes rows point into
+    std::vector<std::string_view> rows;
+    char delimiter = ',';
+    std::vector<Column> columns;
+
+    // R vector of column j over every row, as an eager read builds it; text
+    // columns become factors if as_factor is set
+    SEXP materialize(size_t j, bool as_factor) const;
+};
+
+// data.frame whose columns are ALTREP vectors parsing themselves from table
+// on first access of their data (an element, a pointer to the values).
+// Their length is known without parsing. Text columns are built at once if
+// as_factor is set, as a factor needs its levels up front. The table is
+// released once every lazy column has been parsed.
+SEXP lazy_dataframe(std::shared_ptr<const LazyTable> table, bool as_factor);
+
+} // namespace toonlite
+
+extern "C" {
+
+// Register the lazy column classes; called from R_init_toonlite
+void toonlite_init_lazy(DllInfo* dll);
+
+}
+
+#endif // TOON_LAZY_HPP
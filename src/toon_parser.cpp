@@ -1,79 +1,124 @@
 #include "toon_parser.h"
 #include "toon_charconv.h"
+#include "toon_scan.h"
+#include "toon_stats.h"
 #include <charconv>
 #include <algorithm>
 #include <cctype>
 #include <cmath>
-#include <unordered_set>
+#include <cstring>
 
 namespace toonlite {
 
-// Node factory methods
-NodePtr Node::make_null() {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_NULL;
-    return n;
+// Document implementation
+NodeId Document::push(const Node& n) {
+    if (nodes_.size() >= static_cast<size_t>(NO_NODE)) {
+        throw std::length_error("TOON document has too many nodes");
+    }
+    nodes_.push_back(n);
+    return static_cast<NodeId>(nodes_.size() - 1);
+}
+
+NodeId Document::add_null() {
+    Node n;
+    n.kind = NodeKind::N_NULL;
+    n.len = 0;
+    n.int_val = 0;
+    return push(n);
+}
+
+NodeId Document::add_bool(bool v) {
+    Node n;
+    n.kind = NodeKind::N_BOOL;
+    n.len = 0;
+    n.int_val = 0;
+    n.bool_val = v;
+    return push(n);
 }
 
-NodePtr Node::make_bool(bool v) {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_BOOL;
-    n->bool_val = v;
-    return n;
+NodeId Document::add_int(int64_t v) {
+    Node n;
+    n.kind = NodeKind::N_INT;
+    n.len = 0;
+    n.int_val = v;
+    return push(n);
 }
 
-NodePtr Node::make_int(int64_t v) {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_INT;
-    n->int_val = v;
-    return n;
+NodeId Document::add_double(double v) {
+    Node n;
+    n.kind = NodeKind::N_DOUBLE;
+    n.len = 0;
+    n.double_val = v;
+    return push(n);
 }
 
-NodePtr Node::make_double(double v) {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_DOUBLE;
-    n->double_val = v;
-    return n;
+uint64_t Document::store_string(std::string_view v) {
+    uint64_t offset = strings_.size();
+    strings_.append(v.data(), v.size());
+    return offset;
 }
 
-NodePtr Node::make_string(const std::string& v) {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_STRING;
-    n->string_val = v;
-    return n;
+NodeId Document::add_string(std::string_view v) {
+    return add_string_at(store_string(v), v.size());
 }
 
-NodePtr Node::make_string(std::string_view v) {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_STRING;
-    n->string_val = std::string(v);
-    return n;
+NodeId Document::add_string_at(uint64_t offset, size_t len) {
+    if (len > UINT32_MAX) {
+        throw std::length_error("TOON string value too long");
+    }
+    Node n;
+    n.kind = NodeKind::N_STRING;
+    n.len = static_cast<uint32_t>(len);
+    n.offset = offset;
+    return push(n);
 }
 
-NodePtr Node::make_array() {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_ARRAY;
-    return n;
+NodeId Document::add_array(const NodeId* items, size_t count) {
+    if (count > UINT32_MAX) {
+        throw std::length_error("TOON array has too many items");
+    }
+    Node n;
+    n.kind = NodeKind::N_ARRAY;
+    n.len = static_cast<uint32_t>(count);
+    n.offset = items_.size();
+    items_.insert(items_.end(), items, items + count);
+    return push(n);
 }
 
-NodePtr Node::make_object() {
-    auto n = std::make_shared<Node>();
-    n->kind = NodeKind::N_OBJECT;
-    return n;
+NodeId Document::add_object(const Member* members, size_t count) {
+    if (count > UINT32_MAX) {
+        throw std::length_error("TOON object has too many members");
+    }
+    Node n;
+    n.kind = NodeKind::N_OBJECT;
+    n.len = static_cast<uint32_t>(count);
+    n.offset = members_.size();
+    members_.insert(members_.end(), members, members + count);
+    return push(n);
+}
+
+void Document::clear() {
+    nodes_.clear();
+    items_.clear();
+    members_.clear();
+    strings_.clear();
+    root_ = NO_NODE;
 }
 
 // Parser implementation
 Parser::Parser(const ParseOptions& opts) : opts_(opts) {}
 
-size_t Parser::count_indent(std::string_view line) {
+size_t Parser::count_indent(std::string_view line, size_t line_no) {
     size_t indent = 0;
+    bool tab_seen = false;
     for (char c : line) {
         if (c == ' ') {
             indent++;
         } else if (c == '\t') {
-            if (opts_.strict) {
-                error("Tab characters not allowed in indentation (strict mode)", 0);
+            if (opts_.strict && !tab_seen) {
+                error("Tab characters not allowed in indentation (strict mode)", line_no);
             }
+            tab_seen = true;
             indent++; // Count tab as 1 space for non-strict mode
         } else {
             break;
@@ -110,49 +155,23 @@ bool Parser::is_comment_line(std::string_view content) {
 void Parser::strip_trailing_comment(std::string_view& content) {
     if (!opts_.allow_comments) return;
 
-    // Find # or // not inside a string
-    bool in_string = false;
-    bool escape = false;
-
-    for (size_t i = 0; i < content.size(); i++) {
-        char c = content[i];
-
-        if (escape) {
-            escape = false;
-            continue;
-        }
-
-        if (c == '\\' && in_string) {
-            escape = true;
-            continue;
-        }
-
-        if (c == '"') {
-            in_string = !in_string;
-            continue;
-        }
-
-        if (!in_string) {
-            if (c == '#') {
-                // Check for preceding whitespace
-                if (i > 0 && std::isspace(static_cast<unsigned char>(content[i-1]))) {
-                    content = trim_trailing(content.substr(0, i));
-                    return;
-                }
-            } else if (c == '/' && i + 1 < content.size() && content[i+1] == '/') {
-                if (i > 0 && std::isspace(static_cast<unsigned char>(content[i-1]))) {
-                    content = trim_trailing(content.substr(0, i));
-                    return;
-                }
-            }
+    // Find # or // not inside a string, preceded by whitespace
+    size_t i = find_unquoted(content, 0, '#', '/');
+    while (i != std::string_view::npos) {
+        bool is_comment = content[i] == '#' ||
+            (i + 1 < content.size() && content[i+1] == '/');
+        if (is_comment && i > 0 && std::isspace(static_cast<unsigned char>(content[i-1]))) {
+            content = trim_trailing(content.substr(0, i));
+            return;
         }
+        i = find_unquoted(content, i + 1, '#', '/');
     }
 }
 
 LineInfo Parser::classify_line(std::string_view line, size_t line_no) {
     LineInfo info;
     info.line_no = line_no;
-    info.indent = count_indent(line);
+    info.indent = count_indent(line, line_no);
     info.content = line.substr(info.indent);
 
     // Empty line
@@ -190,33 +209,7 @@ LineInfo Parser::classify_line(std::string_view line, size_t line_no) {
     }
 
     // Key-value: contains ':'
-    size_t colon_pos = std::string_view::npos;
-    bool in_string = false;
-    bool escape = false;
-
-    for (size_t i = 0; i < content.size(); i++) {
-        char c = content[i];
-
-        if (escape) {
-            escape = false;
-            continue;
-        }
-
-        if (c == '\\' && in_string) {
-            escape = true;
-            continue;
-        }
-
-        if (c == '"') {
-            in_string = !in_string;
-            continue;
-        }
-
-        if (!in_string && c == ':') {
-            colon_pos = i;
-            break;
-        }
-    }
+    size_t colon_pos = find_unquoted(content, 0, ':', ':');
 
     if (colon_pos != std::string_view::npos) {
         info.key = trim(content.substr(0, colon_pos));
@@ -369,13 +362,14 @@ std::optional<double> Parser::parse_number(std::string_view text) {
     return std::nullopt;
 }
 
-std::optional<std::string> Parser::parse_quoted_string(std::string_view text) {
+bool Parser::parse_quoted_string(std::string_view text, std::string& out) {
     if (text.size() < 2 || text.front() != '"' || text.back() != '"') {
-        return std::nullopt;
+        return false;
     }
 
-    std::string result;
-    result.reserve(text.size() - 2);
+    // Decoded bytes are appended to out; on failure the caller discards them
+    std::string& result = out;
+    result.reserve(result.size() + text.size() - 2);
 
     for (size_t i = 1; i < text.size() - 1; i++) {
         char c = text[i];
@@ -409,13 +403,13 @@ std::optional<std::string> Parser::parse_quoted_string(std::string_view text) {
                             i += 5;
                         } else {
                             if (opts_.strict) {
-                                return std::nullopt;
+                                return false;
                             }
                             result += c;
                         }
                     } else {
                         if (opts_.strict) {
-                            return std::nullopt;
+                            return false;
                         }
                         result += c;
                     }
@@ -423,7 +417,7 @@ std::optional<std::string> Parser::parse_quoted_string(std::string_view text) {
                 }
                 default:
                     if (opts_.strict) {
-                        return std::nullopt; // Invalid escape sequence
+                        return false; // Invalid escape sequence
                     }
                     result += c;
                     break;
@@ -433,125 +427,316 @@ std::optional<std::string> Parser::parse_quoted_string(std::string_view text) {
         }
     }
 
-    return result;
+    return true;
 }
 
-NodePtr Parser::parse_primitive(std::string_view text) {
+bool Parser::parse_primitive(std::string_view text) {
     text = trim(text);
 
     if (text.empty()) {
-        return nullptr;
+        return false;
     }
 
     // null
     if (parse_null(text)) {
-        return Node::make_null();
+        handler_->null_value();
+        return true;
     }
 
     // boolean
     auto bool_val = parse_bool(text);
     if (bool_val.has_value()) {
-        return Node::make_bool(*bool_val);
+        handler_->bool_value(*bool_val);
+        return true;
     }
 
     // quoted string
     if (!text.empty() && text.front() == '"') {
-        auto str_val = parse_quoted_string(text);
-        if (str_val.has_value()) {
-            return Node::make_string(*str_val);
+        // Pass the body through unchanged when there is nothing to unescape
+        if (text.size() >= 2 && text.back() == '"') {
+            std::string_view body = text.substr(1, text.size() - 2);
+            if (body.find('\\') == std::string_view::npos) {
+                handler_->string_value(body);
+                return true;
+            }
+        }
+        decode_buf_.clear();
+        if (parse_quoted_string(text, decode_buf_)) {
+            handler_->string_value(decode_buf_);
+            return true;
         }
         // In non-strict mode, treat as unquoted string
         if (!opts_.strict) {
-            return Node::make_string(text);
+            handler_->string_value(text);
+            return true;
         }
-        return nullptr;
+        return false;
     }
 
     // integer (fits in 32-bit)
     auto int_val = parse_integer(text);
     if (int_val.has_value()) {
-        return Node::make_int(*int_val);
+        handler_->int_value(*int_val);
+        return true;
     }
 
     // double
     auto dbl_val = parse_number(text);
     if (dbl_val.has_value()) {
-        return Node::make_double(*dbl_val);
+        handler_->double_value(*dbl_val);
+        return true;
     }
 
     // In non-strict mode, treat unrecognized as string
     if (!opts_.strict) {
-        return Node::make_string(text);
+        handler_->string_value(text);
+        return true;
     }
 
-    return nullptr;
+    return false;
 }
 
-std::vector<std::string_view> Parser::parse_tabular_row(std::string_view line, char delimiter) {
-    std::vector<std::string_view> fields;
+void Parser::parse_tabular_row(std::string_view line, char delimiter) {
+    split_fields(line, delimiter, row_fields_);
+}
 
-    size_t start = 0;
-    bool in_string = false;
-    bool escape = false;
+void Parser::error(const std::string& msg, size_t line, size_t col) {
+    ParseError e(msg, line, col, "", current_file_);
+    if (errors_.size() + 1 < max_errors_) {
+        errors_.push_back(e);
+        return;
+    }
+    throw e;
+}
 
-    for (size_t i = 0; i < line.size(); i++) {
-        char c = line[i];
+std::string Parser::get_snippet(std::string_view line, size_t col) {
+    std::string snippet(line);
+    if (snippet.length() > 60) {
+        snippet = snippet.substr(0, 57) + "...";
+    }
+    return snippet;
+}
 
-        if (escape) {
-            escape = false;
-            continue;
+namespace {
+
+// Builds a Document from parse events. Open containers collect their
+// children on scratch stacks, which are copied into the document when the
+// container closes.
+class DomBuilder : public ParseHandler {
+public:
+    explicit DomBuilder(Document& doc) : doc_(doc) {}
+
+    void null_value() override { attach(doc_.add_null()); }
+    void bool_value(bool v) override { attach(doc_.add_bool(v)); }
+    void int_value(int64_t v) override { attach(doc_.add_int(v)); }
+    void double_value(double v) override { attach(doc_.add_double(v)); }
+    void string_value(std::string_view v) override { attach(doc_.add_string(v)); }
+
+    void start_array(size_t, const TabularHeader* header) override {
+        if (header) {
+            // Field names are stored once and shared by every row object
+            field_keys_.clear();
+            for (const auto& field : header->fields) {
+                Member member;
+                member.key_offset = doc_.store_string(field);
+                member.key_len = static_cast<uint32_t>(field.size());
+                member.value = NO_NODE;
+                field_keys_.push_back(member);
+            }
         }
+        frames_.push_back({false, item_stack_.size()});
+    }
 
-        if (c == '\\' && in_string) {
-            escape = true;
-            continue;
-        }
+    void end_array() override {
+        size_t base = frames_.back().base;
+        frames_.pop_back();
+        NodeId id = doc_.add_array(item_stack_.data() + base, item_stack_.size() - base);
+        item_stack_.resize(base);
+        attach(id);
+    }
 
-        if (c == '"') {
-            in_string = !in_string;
-            continue;
+    void start_object() override {
+        frames_.push_back({true, member_stack_.size()});
+    }
+
+    void key(std::string_view k, size_t replaces) override {
+        if (replaces != NEW_KEY) {
+            // Last one wins: the old member is dropped when the object ends
+            member_stack_[frames_.back().base + replaces].key_len = DROPPED;
+            frames_.back().dropped++;
         }
+        Member member;
+        member.key_offset = doc_.store_string(k);
+        member.key_len = static_cast<uint32_t>(k.size());
+        member.value = NO_NODE;
+        member_stack_.push_back(member);
+    }
+
+    void field_key(size_t index) override {
+        member_stack_.push_back(field_keys_[index]);
+    }
 
-        if (!in_string && c == delimiter) {
-            fields.push_back(trim(line.substr(start, i - start)));
-            start = i + 1;
+    void end_object() override {
+        size_t base = frames_.back().base;
+        if (frames_.back().dropped > 0) {
+            auto end = std::remove_if(member_stack_.begin() + base, member_stack_.end(),
+                                      [](const Member& m) { return m.key_len == DROPPED; });
+            member_stack_.erase(end, member_stack_.end());
         }
+        frames_.pop_back();
+        NodeId id = doc_.add_object(member_stack_.data() + base, member_stack_.size() - base);
+        member_stack_.resize(base);
+        attach(id);
     }
 
-    // Last field
-    if (start <= line.size()) {
-        fields.push_back(trim(line.substr(start)));
+private:
+    // Key length marking a member replaced by a later one with its key
+    static constexpr uint32_t DROPPED = UINT32_MAX;
+
+    struct Frame {
+        bool is_object;
+        size_t base;
+        size_t dropped = 0;
+    };
+
+    void attach(NodeId id) {
+        if (frames_.empty()) {
+            doc_.set_root(id);
+        } else if (frames_.back().is_object) {
+            member_stack_.back().value = id;
+        } else {
+            item_stack_.push_back(id);
+        }
     }
 
-    return fields;
+    Document& doc_;
+    std::vector<Frame> frames_;
+    std::vector<NodeId> item_stack_;
+    std::vector<Member> member_stack_;
+    std::vector<Member> field_keys_;
+};
+
+// Discards every event: validation needs only the parser's own state
+class NullHandler : public ParseHandler {
+public:
+    void null_value() override {}
+    void bool_value(bool) override {}
+    void int_value(int64_t) override {}
+    void double_value(double) override {}
+    void string_value(std::string_view) override {}
+    void start_array(size_t, const TabularHeader*) override {}
+    void end_array() override {}
+    void start_object() override {}
+    void key(std::string_view, size_t) override {}
+    void field_key(size_t) override {}
+    void end_object() override {}
+};
+
+} // namespace
+
+void EventRecorder::clear() {
+    events_.clear();
+    text_.clear();
+    n_headers_ = 0;
 }
 
-void Parser::error(const std::string& msg, size_t line, size_t col) {
-    throw ParseError(msg, line, col, "", current_file_);
+uint64_t EventRecorder::store(std::string_view v) {
+    uint64_t offset = text_.size();
+    text_.append(v.data(), v.size());
+    return offset;
 }
 
-std::string Parser::get_snippet(std::string_view line, size_t col) {
-    std::string snippet(line);
-    if (snippet.length() > 60) {
-        snippet = snippet.substr(0, 57) + "...";
+void EventRecorder::null_value() { push(Op::NULL_VALUE); }
+void EventRecorder::bool_value(bool v) { push(Op::BOOL, v ? 1 : 0); }
+void EventRecorder::int_value(int64_t v) { push(Op::INT, static_cast<uint64_t>(v)); }
+
+void EventRecorder::double_value(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    push(Op::DOUBLE, bits);
+}
+
+void EventRecorder::string_value(std::string_view v) {
+    push(Op::STRING, store(v), 0, static_cast<uint32_t>(v.size()));
+}
+
+void EventRecorder::start_array(size_t declared, const TabularHeader* header) {
+    uint64_t h = 0;
+    if (header) {
+        if (n_headers_ == headers_.size()) headers_.emplace_back();
+        headers_[n_headers_] = *header;
+        h = ++n_headers_;
     }
-    return snippet;
+    push(Op::START_ARRAY, declared, h);
 }
 
-NodePtr Parser::parse_string(const std::string& text) {
+void EventRecorder::end_array() { push(Op::END_ARRAY); }
+void EventRecorder::start_object() { push(Op::START_OBJECT); }
+
+void EventRecorder::key(std::string_view k, size_t replaces) {
+    push(Op::KEY, store(k), replaces, static_cast<uint32_t>(k.size()));
+}
+
+void EventRecorder::field_key(size_t index) { push(Op::FIELD_KEY, index); }
+void EventRecorder::end_object() { push(Op::END_OBJECT); }
+
+void EventRecorder::replay(ParseHandler& out) const {
+    for (const Event& e : events_) {
+        switch (e.op) {
+            case Op::NULL_VALUE: out.null_value(); break;
+            case Op::BOOL: out.bool_value(e.a != 0); break;
+            case Op::INT: out.int_value(static_cast<int64_t>(e.a)); break;
+            case Op::DOUBLE: {
+                double v;
+                std::memcpy(&v, &e.a, sizeof(v));
+                out.double_value(v);
+                break;
+            }
+            case Op::STRING:
+                out.string_value(std::string_view(text_.data() + e.a, e.len));
+                break;
+            case Op::START_ARRAY:
+                out.start_array(static_cast<size_t>(e.a), e.b ? &headers_[e.b - 1] : nullptr);
+                break;
+            case Op::END_ARRAY: out.end_array(); break;
+            case Op::START_OBJECT: out.start_object(); break;
+            case Op::KEY:
+                out.key(std::string_view(text_.data() + e.a, e.len), static_cast<size_t>(e.b));
+                break;
+            case Op::FIELD_KEY: out.field_key(static_cast<size_t>(e.a)); break;
+            case Op::END_OBJECT: out.end_object(); break;
+        }
+    }
+}
+
+Document Parser::parse_string(const std::string& text) {
     return parse_string(text.data(), text.size());
 }
 
-NodePtr Parser::parse_string(const char* data, size_t len) {
+Document Parser::parse_string(const char* data, size_t len) {
+    Document doc;
+    DomBuilder builder(doc);
+    parse_string(data, len, builder);
+    return doc;
+}
+
+Document Parser::parse_file(const std::string& filepath) {
+    Document doc;
+    DomBuilder builder(doc);
+    parse_file(filepath, builder);
+    return doc;
+}
+
+bool Parser::parse_string(const char* data, size_t len, ParseHandler& handler) {
     warnings_.clear();
     current_file_.clear();
     has_peeked_ = false;
 
     BufferedReader reader(data, len);
-    return parse_value(reader, -1);
+    return parse_document(reader, handler);
 }
 
-NodePtr Parser::parse_file(const std::string& filepath) {
+bool Parser::parse_file(const std::string& filepath, ParseHandler& handler) {
     warnings_.clear();
     current_file_ = filepath;
     has_peeked_ = false;
@@ -561,34 +746,272 @@ NodePtr Parser::parse_file(const std::string& filepath) {
         throw ParseError(reader.error_message(), 0, 0, "", filepath);
     }
 
-    return parse_value(reader, -1);
+    bool ok = parse_document(reader, handler);
+    if (Stats* st = stats::active()) st->add_input(reader);
+    return ok;
 }
 
-ValidationResult Parser::validate_string(const std::string& text) {
+bool Parser::parse_document(BufferedReader& reader, ParseHandler& handler) {
+    handler_ = &handler;
+    object_depth_ = 0;
+    bool produced;
     try {
-        auto node = parse_string(text);
-        if (!node) {
-            return ValidationResult::error("Failed to parse TOON");
-        }
-        return ValidationResult::ok();
-    } catch (const ParseError& e) {
-        return ValidationResult::error(e.what(), e.line(), e.column(), e.snippet(), e.file());
+        produced = parse_value(reader, -1);
+    } catch (...) {
+        handler_ = nullptr;
+        throw;
     }
+    handler_ = nullptr;
+    return produced;
 }
 
-ValidationResult Parser::validate_file(const std::string& filepath) {
+ValidationResult Parser::validate_string(const std::string& text, size_t max_errors) {
+    warnings_.clear();
+    current_file_.clear();
+    has_peeked_ = false;
+
+    BufferedReader reader(text.data(), text.size());
+    return validate_document(reader, max_errors);
+}
+
+ValidationResult Parser::validate_file(const std::string& filepath, size_t max_errors) {
+    warnings_.clear();
+    current_file_ = filepath;
+    has_peeked_ = false;
+
+    BufferedReader reader(filepath);
+    if (reader.has_error()) {
+        ValidationResult result = ValidationResult::error(reader.error_message(), 0, 0, "", filepath);
+        result.errors.emplace_back(reader.error_message(), 0, 0, "", filepath);
+        return result;
+    }
+    return validate_document(reader, max_errors);
+}
+
+ValidationResult Parser::validate_document(BufferedReader& reader, size_t max_errors) {
+    NullHandler handler;
+    errors_.clear();
+    max_errors_ = std::max(max_errors, size_t(1));
+
+    bool produced = false;
     try {
-        auto node = parse_file(filepath);
-        if (!node) {
-            return ValidationResult::error("Failed to parse TOON", 0, 0, "", filepath);
-        }
-        return ValidationResult::ok();
+        produced = parse_document(reader, handler);
     } catch (const ParseError& e) {
-        return ValidationResult::error(e.what(), e.line(), e.column(), e.snippet(), e.file());
+        errors_.push_back(e);
+    }
+    max_errors_ = 0;
+
+    if (errors_.empty() && !produced) {
+        errors_.emplace_back("Failed to parse TOON", 0, 0, "", current_file_);
+    }
+    if (errors_.empty()) {
+        return ValidationResult::ok();
+    }
+
+    const ParseError& first = errors_.front();
+    ValidationResult result = ValidationResult::error(first.what(), first.line(), first.column(),
+                                                      first.snippet(), first.file());
+    result.errors.swap(errors_);
+    return result;
+}
+
+ScanResult Parser::scan_file(const std::string& filepath, const ScanOptions& scan_opts) {
+    warnings_.clear();
+    current_file_ = filepath;
+    has_peeked_ = false;
+
+    BufferedReader reader(filepath);
+    if (reader.has_error()) {
+        throw ParseError(reader.error_message(), 0, 0, "", filepath);
     }
+    return scan_document(reader, scan_opts);
 }
 
-NodePtr Parser::parse_value(BufferedReader& reader, int parent_indent) {
+ScanResult Parser::scan_document(BufferedReader& reader, const ScanOptions& scan_opts) {
+    // Open containers. A line indented at least as far as an object's keys
+    // or a list's items continues it (deeper lines are the value of its
+    // last key or item); tabular rows are the lines right of the line that
+    // holds the array.
+    struct Frame {
+        enum Kind { OBJECT, LIST, TABLE } kind;
+        int indent;           // Keys, items or rows; -1 until the first item or row
+        int owner;            // Indent of the line holding the array
+        std::string key;      // Current key of an object
+        size_t items = 0;     // Items of a list so far
+        size_t table = 0;     // Index into tables for TABLE
+    };
+
+    ScanResult result;
+    std::vector<Frame> stack;
+    std::string_view line;
+    size_t line_no;
+    size_t lines = 0;
+    size_t offset = reader.offset();
+
+    auto path = [&stack]() {
+        std::string p;
+        for (const Frame& f : stack) {
+            if (f.kind == Frame::TABLE) continue;
+            if (!p.empty()) p += '.';
+            p += f.kind == Frame::OBJECT ? f.key : "[" + std::to_string(f.items) + "]";
+        }
+        return p;
+    };
+
+    // Array header (on its own line or after a key) read at this line;
+    // false once the scan should stop
+    auto open_array = [&](const TabularHeader& header, int owner) {
+        result.arrays++;
+        if (!header.is_tabular) {
+            stack.push_back({Frame::LIST, -1, owner, {}});
+            result.max_depth = std::max(result.max_depth, stack.size());
+            return true;
+        }
+
+        ScanTable table;
+        table.path = path();
+        table.line = line_no;
+        table.offset = offset;
+        table.declared = header.declared_count;
+        table.fields = header.fields;
+        result.tables.push_back(std::move(table));
+        result.max_depth = std::max(result.max_depth, stack.size() + 1);
+
+        if (scan_opts.header_only) {
+            ScanTable& t = result.tables.back();
+            t.rows = t.declared;
+            result.objects += t.declared;
+            if (t.declared > 0) {
+                result.max_depth = std::max(result.max_depth, stack.size() + 2);
+            }
+            return false;
+        }
+        Frame frame{Frame::TABLE, -1, owner, {}};
+        frame.table = result.tables.size() - 1;
+        stack.push_back(std::move(frame));
+        return true;
+    };
+
+    // Key or list item line continuing the frame on top of the stack
+    auto add_member = [&](const LineInfo& info) {
+        Frame& f = stack.back();
+        if (f.kind == Frame::LIST) {
+            f.items++;
+            return true;
+        }
+        f.key.assign(info.key);
+        bool root_object = stack.size() == 1 && (result.top_type == LineType::KEY_VALUE ||
+                                                 result.top_type == LineType::KEY_NESTED);
+        if (root_object && result.top_keys.size() < scan_opts.max_keys) {
+            result.top_keys.push_back(f.key);
+        }
+        // An inline header, as parse_object() recognises it
+        if (info.type == LineType::KEY_VALUE && info.value[0] == '[') {
+            TabularHeader header = parse_array_header(info.value);
+            if (header.declared_count > 0 || header.is_tabular) {
+                return open_array(header, static_cast<int>(info.indent));
+            }
+        }
+        return true;
+    };
+
+    bool stopped = false;
+    while (!stopped) {
+        if (scan_opts.max_lines > 0 && lines >= scan_opts.max_lines) {
+            break;
+        }
+        offset = reader.offset();
+        if (!reader.next_line(line, line_no)) {
+            break;
+        }
+        lines++;
+
+        // Rows are counted from their indentation alone
+        if (!stack.empty() && stack.back().kind == Frame::TABLE) {
+            size_t indent = count_indent(line, line_no);
+            std::string_view content = line.substr(indent);
+            if (content.empty() || (opts_.allow_comments && is_comment_line(content))) {
+                continue;
+            }
+            Frame& t = stack.back();
+            int d = static_cast<int>(indent);
+            if (d > t.owner && d >= t.indent) {
+                if (t.indent < 0) {
+                    t.indent = d;
+                    result.max_depth = std::max(result.max_depth, stack.size() + 1);
+                }
+                result.tables[t.table].rows++;
+                result.objects++;
+                continue;
+            }
+        }
+
+        LineInfo info = classify_line(line, line_no);
+        if (info.type == LineType::EMPTY || info.type == LineType::COMMENT) {
+            continue;
+        }
+        int d = static_cast<int>(info.indent);
+        bool is_key = info.type == LineType::KEY_VALUE || info.type == LineType::KEY_NESTED;
+
+        // Close the containers this line does not belong to
+        while (!stack.empty()) {
+            const Frame& f = stack.back();
+            if (f.kind == Frame::TABLE) {
+                if (d > f.owner && d >= f.indent) break;
+            } else if (f.indent < 0) {
+                // List of a header, waiting for its first item
+                if (d > f.owner && info.type == LineType::LIST_ITEM) break;
+            } else if (d > f.indent) {
+                break;
+            } else if (d == f.indent && (f.kind == Frame::OBJECT ? is_key : info.type == LineType::LIST_ITEM)) {
+                break;
+            }
+            stack.pop_back();
+        }
+
+        if (!stack.empty() && stack.back().indent < 0) {
+            // First item of a header's list
+            stack.back().indent = d;
+            stopped = !add_member(info);
+            continue;
+        }
+        if (!stack.empty() && d == stack.back().indent) {
+            stopped = !add_member(info);
+            continue;
+        }
+
+        // A new value: the root, or the nested value of the last key or item
+        int owner = stack.empty() ? -1 : stack.back().indent;
+        if (result.top_type == LineType::EMPTY) {
+            result.top_type = info.type;
+        }
+        switch (info.type) {
+            case LineType::KEY_VALUE:
+            case LineType::KEY_NESTED:
+            case LineType::LIST_ITEM:
+                if (is_key) {
+                    result.objects++;
+                } else {
+                    result.arrays++;
+                }
+                stack.push_back({is_key ? Frame::OBJECT : Frame::LIST, d, owner, {}});
+                result.max_depth = std::max(result.max_depth, stack.size());
+                stopped = !add_member(info);
+                break;
+            case LineType::ARRAY_HEADER:
+            case LineType::TABULAR_HEADER:
+                stopped = !open_array(info.tabular, owner);
+                break;
+            default:
+                break;
+        }
+    }
+
+    result.complete = !stopped && !(scan_opts.max_lines > 0 && lines >= scan_opts.max_lines);
+    return result;
+}
+
+bool Parser::parse_value(BufferedReader& reader, int parent_indent) {
     std::string_view line;
     size_t line_no;
 
@@ -603,62 +1026,45 @@ NodePtr Parser::parse_value(BufferedReader& reader, int parent_indent) {
             LineInfo& info = peeked_line_;
 
             if (static_cast<int>(info.indent) <= parent_indent) {
-                // Dedent - return null to signal end of nested block
+                // Dedent - nothing produced, signals end of nested block
                 has_peeked_ = true;
-                return nullptr;
+                return false;
             }
 
             switch (info.type) {
                 case LineType::KEY_VALUE:
                 case LineType::KEY_NESTED:
-                    return parse_object(reader, parent_indent, info.key);
-
-                case LineType::LIST_ITEM: {
-                    auto arr = Node::make_array();
-                    // Parse first item
-                    if (!info.value.empty()) {
-                        auto item_val = parse_primitive(info.value);
-                        if (item_val) {
-                            arr->array_items.push_back(item_val);
-                        } else {
-                            // May need to parse nested value
-                            has_peeked_ = true;
-                            peeked_line_.type = LineType::RAW_VALUE;
-                            peeked_line_.value = info.value;
-                            peeked_line_.indent = info.indent + 2;
-                            auto nested = parse_value(reader, info.indent);
-                            if (nested) {
-                                arr->array_items.push_back(nested);
-                            }
-                        }
-                    } else {
-                        auto nested = parse_value(reader, info.indent);
-                        if (nested) {
-                            arr->array_items.push_back(nested);
-                        }
-                    }
-                    // Continue parsing list items at same level
-                    return parse_array(reader, parent_indent, TabularHeader());
-                }
+                    parse_object(reader, parent_indent, info.key);
+                    return true;
+
+                case LineType::LIST_ITEM:
+                    // Leave the item peeked; parse_array takes it as its first element
+                    has_peeked_ = true;
+                    parse_array(reader, parent_indent, TabularHeader());
+                    return true;
 
                 case LineType::ARRAY_HEADER:
-                case LineType::TABULAR_HEADER:
-                    return parse_array(reader, parent_indent, info.tabular);
+                case LineType::TABULAR_HEADER: {
+                    // Copy: peeked_line_ is overwritten while the array is parsed
+                    TabularHeader header = info.tabular;
+                    parse_array(reader, parent_indent, header);
+                    return true;
+                }
 
                 case LineType::RAW_VALUE: {
-                    auto prim = parse_primitive(info.value);
-                    if (prim) return prim;
+                    if (parse_primitive(info.value)) return true;
                     error("Invalid value: " + std::string(info.value), info.line_no);
-                    return nullptr;
+                    handler_->string_value(info.value);
+                    return true;
                 }
 
                 default:
-                    return nullptr;
+                    return false;
             }
         }
 
         if (!reader.next_line(line, line_no)) {
-            return nullptr;
+            return false;
         }
 
         LineInfo info = classify_line(line, line_no);
@@ -672,7 +1078,7 @@ NodePtr Parser::parse_value(BufferedReader& reader, int parent_indent) {
             has_peeked_ = true;
             peeked_line_ = info;
             peeked_raw_ = line;
-            return nullptr;
+            return false;
         }
 
         switch (info.type) {
@@ -680,28 +1086,23 @@ NodePtr Parser::parse_value(BufferedReader& reader, int parent_indent) {
             case LineType::KEY_NESTED:
                 // Set peeked_line_ so parse_object can access full line info
                 peeked_line_ = info;
-                return parse_object(reader, parent_indent, info.key);
+                parse_object(reader, parent_indent, info.key);
+                return true;
 
             case LineType::LIST_ITEM: {
-                auto arr = Node::make_array();
+                handler_->start_array(0, nullptr);
                 int list_indent = info.indent;
 
                 // Parse first item
                 if (!info.value.empty()) {
-                    auto item_val = parse_primitive(info.value);
-                    if (item_val) {
-                        arr->array_items.push_back(item_val);
-                    } else {
+                    if (!parse_primitive(info.value)) {
                         // May be inline object/array start
                         // For simplicity, treat as string if not primitive
-                        arr->array_items.push_back(Node::make_string(info.value));
+                        handler_->string_value(info.value);
                     }
                 } else {
-                    auto nested = parse_value(reader, info.indent);
-                    if (nested) {
-                        arr->array_items.push_back(nested);
-                    } else {
-                        arr->array_items.push_back(Node::make_null());
+                    if (!parse_value(reader, info.indent)) {
+                        handler_->null_value();
                     }
                 }
 
@@ -730,49 +1131,56 @@ NodePtr Parser::parse_value(BufferedReader& reader, int parent_indent) {
 
                     // Another list item
                     if (!next_info.value.empty()) {
-                        auto item_val = parse_primitive(next_info.value);
-                        if (item_val) {
-                            arr->array_items.push_back(item_val);
-                        } else {
-                            arr->array_items.push_back(Node::make_string(next_info.value));
+                        if (!parse_primitive(next_info.value)) {
+                            handler_->string_value(next_info.value);
                         }
                     } else {
-                        auto nested = parse_value(reader, next_info.indent);
-                        if (nested) {
-                            arr->array_items.push_back(nested);
-                        } else {
-                            arr->array_items.push_back(Node::make_null());
+                        if (!parse_value(reader, next_info.indent)) {
+                            handler_->null_value();
                         }
                     }
                 }
 
-                return arr;
+                handler_->end_array();
+                return true;
             }
 
             case LineType::ARRAY_HEADER:
             case LineType::TABULAR_HEADER: {
                 has_peeked_ = true;
                 peeked_line_ = info;
-                return parse_array(reader, parent_indent, info.tabular);
+                parse_array(reader, parent_indent, info.tabular);
+                return true;
             }
 
             case LineType::RAW_VALUE: {
-                auto prim = parse_primitive(info.value);
-                if (prim) return prim;
+                if (parse_primitive(info.value)) return true;
                 error("Invalid value: " + std::string(info.value), line_no);
-                return nullptr;
+                handler_->string_value(info.value);
+                return true;
             }
 
             default:
-                return nullptr;
+                return false;
         }
     }
 }
 
-NodePtr Parser::parse_object(BufferedReader& reader, int parent_indent, std::string_view first_key) {
-    auto obj = Node::make_object();
-    std::unordered_set<std::string> seen_keys;
-    std::unordered_map<std::string, int> duplicate_counts;
+void Parser::parse_object(BufferedReader& reader, int parent_indent, std::string_view first_key) {
+    // Nested objects each take the next level; the entry is looked up by
+    // index since they may grow object_keys_
+    size_t level = object_depth_++;
+    if (object_keys_.size() <= level) {
+        object_keys_.emplace_back();
+    }
+    {
+        ObjectKeys& keys = object_keys_[level];
+        keys.index.clear();
+        keys.last.clear();
+        keys.count.clear();
+        keys.members = 0;
+    }
+    bool has_duplicates = false;
 
     std::string_view line;
     size_t line_no;
@@ -782,30 +1190,31 @@ NodePtr Parser::parse_object(BufferedReader& reader, int parent_indent, std::str
     LineInfo info = peeked_line_;
     int obj_indent = info.indent;
 
-    auto process_key_value = [&](const LineInfo& kv_info) {
-        std::string key_str(kv_info.key);
+    handler_->start_object();
 
-        // Check for duplicates
-        if (seen_keys.count(key_str)) {
+    auto process_key_value = [&](const LineInfo& kv_info) {
+        ObjectKeys& keys = object_keys_[level];
+        bool inserted;
+        size_t pos = keys.index.insert(kv_info.key, inserted);
+        size_t replaces = ParseHandler::NEW_KEY;
+        if (inserted) {
+            keys.last.push_back(keys.members);
+            keys.count.push_back(1);
+        } else {
             if (!opts_.allow_duplicate_keys) {
-                error("Duplicate key: " + key_str, kv_info.line_no);
-            } else if (opts_.warn) {
-                duplicate_counts[key_str]++;
-            }
-            // Remove old entry (last-one-wins)
-            for (auto it = obj->object_items.begin(); it != obj->object_items.end(); ++it) {
-                if (it->first == key_str) {
-                    obj->object_items.erase(it);
-                    break;
-                }
+                error("Duplicate key: " + std::string(kv_info.key), kv_info.line_no);
             }
+            replaces = keys.last[pos];
+            keys.last[pos] = keys.members;
+            keys.count[pos]++;
+            has_duplicates = true;
         }
-        seen_keys.insert(key_str);
+        keys.members++;
+
+        handler_->key(kv_info.key, replaces);
 
-        NodePtr value;
         if (kv_info.type == LineType::KEY_VALUE) {
-            value = parse_primitive(kv_info.value);
-            if (!value) {
+            if (!parse_primitive(kv_info.value)) {
                 // Could be inline array or object start
                 if (!kv_info.value.empty() && kv_info.value[0] == '[') {
                     // Inline array header
@@ -815,23 +1224,20 @@ NodePtr Parser::parse_object(BufferedReader& reader, int parent_indent, std::str
                         peeked_line_.type = header.is_tabular ? LineType::TABULAR_HEADER : LineType::ARRAY_HEADER;
                         peeked_line_.tabular = header;
                         peeked_line_.indent = kv_info.indent + 2;
-                        value = parse_array(reader, kv_info.indent, header);
+                        parse_array(reader, kv_info.indent, header);
                     } else {
-                        value = Node::make_string(kv_info.value);
+                        handler_->string_value(kv_info.value);
                     }
                 } else {
-                    value = Node::make_string(kv_info.value);
+                    handler_->string_value(kv_info.value);
                 }
             }
         } else {
             // KEY_NESTED
-            value = parse_value(reader, kv_info.indent);
-            if (!value) {
-                value = Node::make_null();
+            if (!parse_value(reader, kv_info.indent)) {
+                handler_->null_value();
             }
         }
-
-        obj->object_items.push_back({key_str, value});
     };
 
     // Process first key
@@ -875,28 +1281,31 @@ NodePtr Parser::parse_object(BufferedReader& reader, int parent_indent, std::str
         process_key_value(info);
     }
 
-    // Emit duplicate key warnings
-    if (opts_.warn && !duplicate_counts.empty()) {
+    // Emit duplicate key warnings, in order of first appearance
+    if (opts_.warn && opts_.allow_duplicate_keys && has_duplicates) {
+        const ObjectKeys& keys = object_keys_[level];
         std::string warn_msg = "Duplicate keys found: ";
         bool first = true;
-        for (const auto& [key, count] : duplicate_counts) {
+        for (size_t i = 0; i < keys.index.size(); i++) {
+            if (keys.count[i] < 2) continue;
             if (!first) warn_msg += ", ";
-            warn_msg += key + " (" + std::to_string(count + 1) + " times)";
+            warn_msg += std::string(keys.index.key(i)) + " (" + std::to_string(keys.count[i]) + " times)";
             first = false;
         }
         warnings_.push_back(Warning("duplicate_key", warn_msg));
     }
+    object_depth_--;
 
-    return obj;
+    handler_->end_object();
 }
 
-NodePtr Parser::parse_array(BufferedReader& reader, int parent_indent, const TabularHeader& header) {
-    auto arr = Node::make_array();
-
+void Parser::parse_array(BufferedReader& reader, int parent_indent, const TabularHeader& header) {
     std::string_view line;
     size_t line_no;
     int arr_indent = -1;
 
+    handler_->start_array(header.declared_count, header.is_tabular ? &header : nullptr);
+
     // Handle header line if present
     // Note: We don't set arr_indent from the header - arr_indent should be the indent of the actual items
     if (has_peeked_ && (peeked_line_.type == LineType::ARRAY_HEADER || peeked_line_.type == LineType::TABULAR_HEADER)) {
@@ -934,18 +1343,17 @@ NodePtr Parser::parse_array(BufferedReader& reader, int parent_indent, const Tab
             }
 
             // Parse row
-            auto fields = parse_tabular_row(info.content, header.delimiter);
-            auto row_obj = Node::make_object();
+            parse_tabular_row(info.content, header.delimiter);
+            handler_->start_object();
 
-            for (size_t i = 0; i < fields.size() && i < header.fields.size(); i++) {
-                auto field_val = parse_primitive(fields[i]);
-                if (!field_val) {
-                    field_val = Node::make_string(fields[i]);
+            for (size_t i = 0; i < row_fields_.size() && i < header.fields.size(); i++) {
+                handler_->field_key(i);
+                if (!parse_primitive(row_fields_[i])) {
+                    handler_->string_value(row_fields_[i]);
                 }
-                row_obj->object_items.push_back({header.fields[i], field_val});
             }
 
-            arr->array_items.push_back(row_obj);
+            handler_->end_object();
             rows_seen++;
         }
 
@@ -957,6 +1365,21 @@ NodePtr Parser::parse_array(BufferedReader& reader, int parent_indent, const Tab
         }
     } else {
         // Non-tabular array - parse list items
+        size_t n_items = 0;
+
+        auto parse_item = [&](const LineInfo& item) {
+            if (!item.value.empty()) {
+                if (!parse_primitive(item.value)) {
+                    handler_->string_value(item.value);
+                }
+            } else {
+                if (!parse_value(reader, item.indent)) {
+                    handler_->null_value();
+                }
+            }
+            n_items++;
+        };
+
         while (true) {
             if (has_peeked_) {
                 LineInfo info = peeked_line_;
@@ -977,17 +1400,7 @@ NodePtr Parser::parse_array(BufferedReader& reader, int parent_indent, const Tab
                 }
 
                 if (info.type == LineType::LIST_ITEM && static_cast<int>(info.indent) == arr_indent) {
-                    if (!info.value.empty()) {
-                        auto item_val = parse_primitive(info.value);
-                        if (item_val) {
-                            arr->array_items.push_back(item_val);
-                        } else {
-                            arr->array_items.push_back(Node::make_string(info.value));
-                        }
-                    } else {
-                        auto nested = parse_value(reader, info.indent);
-                        arr->array_items.push_back(nested ? nested : Node::make_null());
-                    }
+                    parse_item(info);
                     continue;
                 }
 
@@ -1015,17 +1428,7 @@ NodePtr Parser::parse_array(BufferedReader& reader, int parent_indent, const Tab
             }
 
             if (info.type == LineType::LIST_ITEM && static_cast<int>(info.indent) == arr_indent) {
-                if (!info.value.empty()) {
-                    auto item_val = parse_primitive(info.value);
-                    if (item_val) {
-                        arr->array_items.push_back(item_val);
-                    } else {
-                        arr->array_items.push_back(Node::make_string(info.value));
-                    }
-                } else {
-                    auto nested = parse_value(reader, info.indent);
-                    arr->array_items.push_back(nested ? nested : Node::make_null());
-                }
+                parse_item(info);
             } else {
                 has_peeked_ = true;
                 peeked_line_ = info;
@@ -1034,14 +1437,14 @@ NodePtr Parser::parse_array(BufferedReader& reader, int parent_indent, const Tab
         }
 
         // Check declared count
-        if (opts_.warn && header.declared_count > 0 && arr->array_items.size() != header.declared_count) {
+        if (opts_.warn && header.declared_count > 0 && n_items != header.declared_count) {
             std::string msg = "Declared [" + std::to_string(header.declared_count) +
-                "] but observed " + std::to_string(arr->array_items.size()) + " items; using observed.";
+                "] but observed " + std::to_string(n_items) + " items; using observed.";
             warnings_.push_back(Warning("n_mismatch", msg));
         }
     }
 
-    return arr;
+    handler_->end_array();
 }
 
 } // namespace toonlite
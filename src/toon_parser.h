@@ -11,13 +11,10 @@
 #include <unordered_map>
 #include "toon_errors.h"
 #include "toon_io.h"
+#include "toon_keys.h"
 
 namespace toonlite {
 
-// Forward declarations
-struct Node;
-using NodePtr = std::shared_ptr<Node>;
-
 // Node kinds
 enum class NodeKind {
     N_NULL,
@@ -29,29 +26,79 @@ enum class NodeKind {
     N_OBJECT
 };
 
-// DOM node representing parsed TOON value
+// Index of a node inside a Document
+using NodeId = uint32_t;
+constexpr NodeId NO_NODE = static_cast<NodeId>(-1);
+
+// Tagged DOM node (16 bytes). Strings live in the document's string arena
+// and array/object children are contiguous ranges in its child tables, so a
+// node never owns heap memory of its own.
 struct Node {
     NodeKind kind;
+    uint32_t len;          // String length in bytes, or child count
+    union {
+        bool bool_val;
+        int64_t int_val;
+        double double_val;
+        uint64_t offset;   // Arena offset (string) or child table offset
+    };
+};
+
+// Object member: key bytes in the string arena plus the value node
+struct Member {
+    uint64_t key_offset;
+    uint32_t key_len;
+    NodeId value;
+};
+
+// Flat DOM produced by Parser. All nodes, child ranges and strings are held
+// in a handful of contiguous buffers that are released together.
+class Document {
+public:
+    NodeId root() const { return root_; }
+    bool empty() const { return root_ == NO_NODE; }
+
+    const Node& node(NodeId id) const { return nodes_[id]; }
+    NodeKind kind(NodeId id) const { return nodes_[id].kind; }
+
+    std::string_view string_value(NodeId id) const {
+        const Node& n = nodes_[id];
+        return std::string_view(strings_.data() + n.offset, n.len);
+    }
+
+    // Children of arrays (items) and objects (members)
+    size_t size(NodeId id) const { return nodes_[id].len; }
+    const NodeId* items(NodeId id) const { return items_.data() + nodes_[id].offset; }
+    const Member* members(NodeId id) const { return members_.data() + nodes_[id].offset; }
+    std::string_view key(const Member& m) const {
+        return std::string_view(strings_.data() + m.key_offset, m.key_len);
+    }
+
+    // Construction (used by Parser)
+    NodeId add_null();
+    NodeId add_bool(bool v);
+    NodeId add_int(int64_t v);
+    NodeId add_double(double v);
+    NodeId add_string(std::string_view v);
+    NodeId add_string_at(uint64_t offset, size_t len);
+    NodeId add_array(const NodeId* items, size_t n);
+    NodeId add_object(const Member* members, size_t n);
 
-    // Value storage
-    bool bool_val = false;
-    int64_t int_val = 0;
-    double double_val = 0.0;
-    std::string string_val;
-
-    // Children for array/object
-    std::vector<NodePtr> array_items;
-    std::vector<std::pair<std::string, NodePtr>> object_items;
-
-    // Factory methods
-    static NodePtr make_null();
-    static NodePtr make_bool(bool v);
-    static NodePtr make_int(int64_t v);
-    static NodePtr make_double(double v);
-    static NodePtr make_string(const std::string& v);
-    static NodePtr make_string(std::string_view v);
-    static NodePtr make_array();
-    static NodePtr make_object();
+    // Raw access to the string arena so callers can decode in place
+    std::string& arena() { return strings_; }
+    uint64_t store_string(std::string_view v);
+
+    void set_root(NodeId id) { root_ = id; }
+    void clear();
+
+private:
+    NodeId push(const Node& n);
+
+    std::vector<Node> nodes_;
+    std::vector<NodeId> items_;
+    std::vector<Member> members_;
+    std::string strings_;
+    NodeId root_ = NO_NODE;
 };
 
 // Parser options
@@ -93,21 +140,143 @@ struct LineInfo {
     size_t line_no;
 };
 
+// Structure of a document as found by Parser::scan_file(), which follows
+// the indentation of the lines without parsing values or building a tree
+struct ScanTable {
+    std::string path;       // Keys (and "[i]" list items) from the root, joined by "."
+    size_t line = 0;        // Header line number
+    size_t offset = 0;      // Byte offset of the header line
+    size_t declared = 0;    // [N] count
+    size_t rows = 0;        // Rows seen, or the declared count if not read
+    std::vector<std::string> fields;
+};
+
+struct ScanOptions {
+    // Stop at the first tabular header, taking its [N] as its row count
+    bool header_only = false;
+    // Stop after this many lines (0: no limit)
+    size_t max_lines = 0;
+    // Number of root object keys to collect
+    size_t max_keys = 5;
+};
+
+struct ScanResult {
+    // Type of the first line holding a value (EMPTY if there is none)
+    LineType top_type = LineType::EMPTY;
+    std::vector<std::string> top_keys;
+    size_t arrays = 0;
+    size_t objects = 0;     // Including the rows of tabular arrays
+    size_t max_depth = 0;
+    std::vector<ScanTable> tables;
+    bool complete = true;   // false if the scan stopped before the end
+};
+
+// Receives parse events in document order (SAX style). Containers are
+// bracketed by start/end calls; object members are announced by key() or,
+// for rows of a tabular array, by field_key() before their value.
+class ParseHandler {
+public:
+    virtual ~ParseHandler() = default;
+
+    virtual void null_value() = 0;
+    virtual void bool_value(bool v) = 0;
+    virtual void int_value(int64_t v) = 0;
+    virtual void double_value(double v) = 0;
+    virtual void string_value(std::string_view v) = 0;
+
+    // declared is the [N] count (0 if absent); header is set for tabular arrays
+    virtual void start_array(size_t declared, const TabularHeader* header) = 0;
+    virtual void end_array() = 0;
+
+    virtual void start_object() = 0;
+    // replaces is NEW_KEY, or the position (counting every key() call of
+    // this object) of an earlier member with the same key, which must be
+    // dropped: the last one wins, in the new position
+    static constexpr size_t NEW_KEY = static_cast<size_t>(-1);
+    virtual void key(std::string_view k, size_t replaces) = 0;
+    // Member of a tabular row, by index into the enclosing header's fields
+    virtual void field_key(size_t index) = 0;
+    virtual void end_object() = 0;
+};
+
+// Records parse events to be replayed into another handler later, so a
+// document can be parsed on a worker thread and its R objects built on the
+// main thread. Strings and tabular headers are copied into buffers that
+// clear() keeps for the next document.
+class EventRecorder : public ParseHandler {
+public:
+    // Forget the recorded events, keeping the memory
+    void clear();
+
+    // Send the recorded events to out, in order
+    void replay(ParseHandler& out) const;
+
+    void null_value() override;
+    void bool_value(bool v) override;
+    void int_value(int64_t v) override;
+    void double_value(double v) override;
+    void string_value(std::string_view v) override;
+    void start_array(size_t declared, const TabularHeader* header) override;
+    void end_array() override;
+    void start_object() override;
+    void key(std::string_view k, size_t replaces) override;
+    void field_key(size_t index) override;
+    void end_object() override;
+
+private:
+    enum class Op : uint8_t {
+        NULL_VALUE, BOOL, INT, DOUBLE, STRING, START_ARRAY, END_ARRAY,
+        START_OBJECT, KEY, FIELD_KEY, END_OBJECT
+    };
+
+    // Operands by op: the value (BOOL, INT, DOUBLE as bits), text offset
+    // and len (STRING, KEY; b is the replaced position), declared count
+    // and header number + 1, or 0 if none (START_ARRAY), field (FIELD_KEY)
+    struct Event {
+        Op op;
+        uint32_t len;
+        uint64_t a;
+        uint64_t b;
+    };
+
+    void push(Op op, uint64_t a = 0, uint64_t b = 0, uint32_t len = 0) {
+        events_.push_back({op, len, a, b});
+    }
+    uint64_t store(std::string_view v);
+
+    std::vector<Event> events_;
+    std::string text_;
+    std::vector<TabularHeader> headers_;   // the first n_headers_ are in use
+    size_t n_headers_ = 0;
+};
+
 // Parser class
 class Parser {
 public:
     Parser(const ParseOptions& opts = ParseOptions());
 
     // Parse from string
-    NodePtr parse_string(const std::string& text);
-    NodePtr parse_string(const char* data, size_t len);
+    Document parse_string(const std::string& text);
+    Document parse_string(const char* data, size_t len);
 
     // Parse from file
-    NodePtr parse_file(const std::string& filepath);
+    Document parse_file(const std::string& filepath);
+
+    // Stream parse events to handler instead of building a Document.
+    // Returns false if the input contained no value.
+    bool parse_string(const char* data, size_t len, ParseHandler& handler);
+    bool parse_file(const std::string& filepath, ParseHandler& handler);
 
-    // Validate without building DOM
-    ValidationResult validate_string(const std::string& text);
-    ValidationResult validate_file(const std::string& filepath);
+    // Validate in one pass over the input, without building anything.
+    // Parsing continues past recoverable errors until max_errors are found;
+    // all of them are returned in input order.
+    ValidationResult validate_string(const std::string& text, size_t max_errors = 1);
+    ValidationResult validate_file(const std::string& filepath, size_t max_errors = 1);
+
+    // Summarise the structure of a file in one pass, in memory bounded by
+    // its nesting depth. Rows of tabular arrays are only counted. Values
+    // are not checked, so malformed input is scanned as well as it can be.
+    ScanResult scan_file(const std::string& filepath, const ScanOptions& scan_opts = ScanOptions());
 
     // Get warnings accumulated during parsing
     const std::vector<Warning>& warnings() const { return warnings_; }
@@ -117,32 +286,36 @@ private:
     LineInfo classify_line(std::string_view line, size_t line_no);
 
     // Primitive parsing
-    NodePtr parse_primitive(std::string_view text);
+    bool parse_primitive(std::string_view text);
     bool parse_null(std::string_view text);
     std::optional<bool> parse_bool(std::string_view text);
     std::optional<int64_t> parse_integer(std::string_view text);
     std::optional<double> parse_number(std::string_view text);
-    std::optional<std::string> parse_quoted_string(std::string_view text);
+    bool parse_quoted_string(std::string_view text, std::string& out);
 
     // Header parsing
     TabularHeader parse_array_header(std::string_view text);
 
-    // Row parsing for tabular arrays
-    std::vector<std::string_view> parse_tabular_row(std::string_view line, char delimiter);
+    // Row parsing for tabular arrays (into row_fields_)
+    void parse_tabular_row(std::string_view line, char delimiter);
 
     // Utility functions
-    size_t count_indent(std::string_view line);
+    size_t count_indent(std::string_view line, size_t line_no);
     std::string_view trim(std::string_view sv);
     std::string_view trim_trailing(std::string_view sv);
     bool is_comment_line(std::string_view content);
     void strip_trailing_comment(std::string_view& content);
 
     // Main parsing logic
-    NodePtr parse_value(BufferedReader& reader, int parent_indent);
-    NodePtr parse_object(BufferedReader& reader, int parent_indent, std::string_view first_key);
-    NodePtr parse_array(BufferedReader& reader, int parent_indent, const TabularHeader& header);
+    bool parse_document(BufferedReader& reader, ParseHandler& handler);
+    ValidationResult validate_document(BufferedReader& reader, size_t max_errors);
+    ScanResult scan_document(BufferedReader& reader, const ScanOptions& scan_opts);
+    bool parse_value(BufferedReader& reader, int parent_indent);
+    void parse_object(BufferedReader& reader, int parent_indent, std::string_view first_key);
+    void parse_array(BufferedReader& reader, int parent_indent, const TabularHeader& header);
 
-    // Error handling
+    // Error handling. Throws, unless validating with room for more errors,
+    // in which case the error is recorded and the caller recovers.
     void error(const std::string& msg, size_t line, size_t col = 0);
     std::string get_snippet(std::string_view line, size_t col);
 
@@ -150,6 +323,28 @@ private:
     std::vector<Warning> warnings_;
     std::string current_file_;
 
+    // Receiver of parse events for the current parse
+    ParseHandler* handler_ = nullptr;
+
+    // Errors recorded while validating, and how many to collect
+    std::vector<ParseError> errors_;
+    size_t max_errors_ = 0;
+
+    // Keys of the objects being parsed, one entry per nesting level:
+    // where each key last appeared and how often
+    struct ObjectKeys {
+        KeyIndex index;
+        std::vector<size_t> last;
+        std::vector<uint32_t> count;
+        size_t members = 0;
+    };
+    std::vector<ObjectKeys> object_keys_;
+    size_t object_depth_ = 0;
+
+    // Scratch buffers for decoding escaped strings and splitting rows
+    std::string decode_buf_;
+    std::vector<std::string_view> row_fields_;
+
     // For peeking at next line
     bool has_peeked_ = false;
     LineInfo peeked_line_;
@@ -0,0 +1,318 @@
+#include "toon_scan.h"
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(TOONLITE_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TOONLITE_SCAN_SSE2 1
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TOONLITE_SCAN_AVX2 1
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TOONLITE_SCAN_NEON 1
+#endif
+#endif
+
+namespace toonlite {
+
+namespace {
+
+constexpr size_t BLOCK = 64;
+
+// One bit per byte of a 64-byte block
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t target;
+};
+
+using ClassifyFn = void (*)(const char* p, char t1, char t2, BlockMasks& m);
+
+[[maybe_unused]] void classify_scalar(const char* p, char t1, char t2, BlockMasks& m) {
+    m.quote = m.backslash = m.target = 0;
+    for (size_t i = 0; i < BLOCK; i++) {
+        char c = p[i];
+        uint64_t bit = uint64_t(1) << i;
+        if (c == '"') m.quote |= bit;
+        if (c == '\\') m.backslash |= bit;
+        if (c == t1 || c == t2) m.target |= bit;
+    }
+}
+
+#ifdef TOONLITE_SCAN_SSE2
+void classify_sse2(const char* p, char t1, char t2, BlockMasks& m) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i a = _mm_set1_epi8(t1);
+    const __m128i b = _mm_set1_epi8(t2);
+
+    m.quote = m.backslash = m.target = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        int shift = 16 * i;
+        m.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))) << shift;
+        m.backslash |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)))) << shift;
+        m.target |= uint64_t(uint16_t(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b))))) << shift;
+    }
+}
+#endif
+
+#ifdef TOONLITE_SCAN_AVX2
+__attribute__((target("avx2")))
+void classify_avx2(const char* p, char t1, char t2, BlockMasks& m) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i a = _mm256_set1_epi8(t1);
+    const __m256i b = _mm256_set1_epi8(t2);
+
+    m.quote = m.backslash = m.target = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * i));
+        int shift = 32 * i;
+        m.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)))) << shift;
+        m.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)))) << shift;
+        m.target |= uint64_t(uint32_t(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, b))))) << shift;
+    }
+}
+#endif
+
+#ifdef TOONLITE_SCAN_NEON
+// Pack four 16-lane compare results into one 64-bit mask
+inline uint64_t neon_movemask(uint8x16_t r0, uint8x16_t r1, uint8x16_t r2, uint8x16_t r3) {
+    const uint8x16_t bits = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                             0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+    uint8x16_t s0 = vpaddq_u8(vandq_u8(r0, bits), vandq_u8(r1, bits));
+    uint8x16_t s1 = vpaddq_u8(vandq_u8(r2, bits), vandq_u8(r3, bits));
+    s0 = vpaddq_u8(s0, s1);
+    s0 = vpaddq_u8(s0, s0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+void classify_neon(const char* p, char t1, char t2, BlockMasks& m) {
+    const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+    uint8x16_t v0 = vld1q_u8(u);
+    uint8x16_t v1 = vld1q_u8(u + 16);
+    uint8x16_t v2 = vld1q_u8(u + 32);
+    uint8x16_t v3 = vld1q_u8(u + 48);
+
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t a = vdupq_n_u8(static_cast<uint8_t>(t1));
+    const uint8x16_t b = vdupq_n_u8(static_cast<uint8_t>(t2));
+
+    m.quote = neon_movemask(vceqq_u8(v0, quote), vceqq_u8(v1, quote),
+                            vceqq_u8(v2, quote), vceqq_u8(v3, quote));
+    m.backslash = neon_movemask(vceqq_u8(v0, backslash), vceqq_u8(v1, backslash),
+                                vceqq_u8(v2, backslash), vceqq_u8(v3, backslash));
+    m.target = neon_movemask(vorrq_u8(vceqq_u8(v0, a), vceqq_u8(v0, b)),
+                             vorrq_u8(vceqq_u8(v1, a), vceqq_u8(v1, b)),
+                             vorrq_u8(vceqq_u8(v2, a), vceqq_u8(v2, b)),
+                             vorrq_u8(vceqq_u8(v3, a), vceqq_u8(v3, b)));
+}
+#endif
+
+ClassifyFn select_classify() {
+#ifdef TOONLITE_SCAN_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return classify_avx2;
+    }
+#endif
+#ifdef TOONLITE_SCAN_SSE2
+    return classify_sse2;
+#elif defined(TOONLITE_SCAN_NEON)
+    return classify_neon;
+#else
+    return classify_scalar;
+#endif
+}
+
+const ClassifyFn classify = select_classify();
+
+// Bit i set iff an odd number of bits at positions <= i are set
+inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+inline unsigned lowest_bit(uint64_t x) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+    unsigned i = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+// Call on_target(pos) for each unquoted t1/t2 in s from `from` on, in
+// order, until it returns false
+template <typename F>
+void scan_unquoted(std::string_view s, size_t from, char t1, char t2, bool escapes, F on_target) {
+    bool in_string = false;
+    bool escape = false;
+    char tail[BLOCK];
+
+    for (size_t base = from; base < s.size(); base += BLOCK) {
+        size_t n = s.size() - base;
+        const char* p = s.data() + base;
+        uint64_t valid = ~uint64_t(0);
+        if (n < BLOCK) {
+            // Short final block: pad with NULs, which match nothing
+            std::memset(tail, 0, BLOCK);
+            std::memcpy(tail, p, n);
+            p = tail;
+            valid = (uint64_t(1) << n) - 1;
+        } else {
+            n = BLOCK;
+        }
+
+        BlockMasks m;
+        classify(p, t1, t2, m);
+
+        if (escapes && (m.backslash != 0 || escape)) {
+            // Escapes make the quote mask unreliable: walk this block bytewise
+            for (size_t i = 0; i < n; i++) {
+                char c = p[i];
+                if (escape) {
+                    escape = false;
+                    continue;
+                }
+                if (c == '\\' && in_string) {
+                    escape = true;
+                    continue;
+                }
+                if (c == '"') {
+                    in_string = !in_string;
+                    continue;
+                }
+                if (!in_string && (c == t1 || c == t2)) {
+                    if (!on_target(base + i)) return;
+                }
+            }
+            continue;
+        }
+
+        uint64_t inside = prefix_xor(m.quote) ^ (in_string ? ~uint64_t(0) : 0);
+        uint64_t hits = m.target & ~inside & valid;
+        while (hits != 0) {
+            if (!on_target(base + lowest_bit(hits))) return;
+            hits &= hits - 1;
+        }
+        in_string = (inside >> 63) & 1;
+    }
+}
+
+std::string_view trim(std::string_view sv) {
+    while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.front()))) {
+        sv.remove_prefix(1);
+    }
+    while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.back()))) {
+        sv.remove_suffix(1);
+    }
+    return sv;
+}
+
+} // namespace
+
+void split_fields(std::string_view line, char delimiter, std::vector<std::string_view>& fields) {
+    fields.clear();
+    size_t start = 0;
+    scan_unquoted(line, 0, delimiter, delimiter, true, [&](size_t pos) {
+        fields.push_back(trim(line.substr(start, pos - start)));
+        start = pos + 1;
+        return true;
+    });
+    fields.push_back(trim(line.substr(start)));
+}
+
+size_t split_fields(std::string_view line, char delimiter, std::vector<std::string_view>& fields,
+                    size_t max_fields) {
+    fields.clear();
+    size_t count = 0;
+    size_t start = 0;
+    scan_unquoted(line, 0, delimiter, delimiter, true, [&](size_t pos) {
+        if (count < max_fields) {
+            fields.push_back(trim(line.substr(start, pos - start)));
+        }
+        count++;
+        start = pos + 1;
+        return true;
+    });
+    if (count < max_fields) {
+        fields.push_back(trim(line.substr(start)));
+    }
+    return count + 1;
+}
+
+std::string_view decode_quoted(std::string_view body, std::string& scratch) {
+    size_t bs = body.find('\\');
+    if (bs == std::string_view::npos) {
+        return body;
+    }
+
+    scratch.assign(body.data(), bs);
+    size_t i = bs;
+    while (i < body.size()) {
+        bs = body.find('\\', i);
+        if (bs == std::string_view::npos) {
+            scratch.append(body.data() + i, body.size() - i);
+            break;
+        }
+        scratch.append(body.data() + i, bs - i);
+        i = bs + 1;
+        if (i >= body.size()) {
+            scratch += '\\';
+            break;
+        }
+        switch (body[i]) {
+            case '"': scratch += '"'; i++; break;
+            case '\\': scratch += '\\'; i++; break;
+            case 'n': scratch += '\n'; i++; break;
+            case 'r': scratch += '\r'; i++; break;
+            case 't': scratch += '\t'; i++; break;
+            default: scratch += '\\'; break;  // kept; next byte copied as is
+        }
+    }
+    return scratch;
+}
+
+size_t find_unquoted(std::string_view s, size_t from, char t1, char t2, bool escapes) {
+    size_t found = std::string_view::npos;
+    scan_unquoted(s, from, t1, t2, escapes, [&](size_t pos) {
+        found = pos;
+        return false;
+    });
+    return found;
+}
+
+bool match_key(std::string_view content, std::string_view key, std::string_view& value) {
+    // Cheap reject before scanning for the colon
+    if (content.size() <= key.size()) return false;
+    size_t colon = find_unquoted(content, 0, ':', ':');
+    if (colon == std::string_view::npos) return false;
+    std::string_view k = trim(content.substr(0, colon));
+    if (k.size() >= 2 && k.front() == '"' && k.back() == '"') {
+        k = k.substr(1, k.size() - 2);
+    }
+    if (k != key) return false;
+    value = trim(content.substr(colon + 1));
+    return true;
+}
+
+} // namespace toonlite
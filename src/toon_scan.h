@@ -0,0 +1,45 @@
+#ifndef TOON_SCAN_HPP
+#define TOON_SCAN_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+namespace toonlite {
+
+// Structural scanning of TOON lines, in the style of simdjson. Input is
+// classified 64 bytes at a time into bitmasks of quotes, backslashes and
+// target bytes (SSE2, AVX2 or NEON, chosen at runtime, with a portable
+// fallback), and quoted regions are found with a prefix XOR over the quote
+// mask. Define TOONLITE_NO_SIMD to build the portable version only.
+//
+// Quoting follows the parser's rules: every '"' toggles the quoted state,
+// and when `escapes` is set a backslash inside quotes escapes the next byte.
+// Blocks holding a backslash are scanned bytewise.
+
+// Split a row on unquoted delimiters, trimming whitespace around each field
+void split_fields(std::string_view line, char delimiter, std::vector<std::string_view>& fields);
+
+// As above, but keep only the first `max_fields` fields; returns the number
+// of fields in the whole line
+size_t split_fields(std::string_view line, char delimiter, std::vector<std::string_view>& fields,
+                    size_t max_fields);
+
+// Position of the first t1 or t2 at or after `from` that lies outside
+// quotes, or npos. `from` must itself be outside quotes.
+size_t find_unquoted(std::string_view s, size_t from, char t1, char t2, bool escapes = true);
+
+// Whether `content`, a line without its indent, is a member with key `key`
+// (bare or quoted, as the parser reads keys). If so, value is set to the
+// trimmed text after the colon.
+bool match_key(std::string_view content, std::string_view key, std::string_view& value);
+
+// Decode the body of a quoted value (\" \\ \n \r \t; other escapes are kept
+// as written). Returns body itself if it has no escapes, otherwise the
+// decoded text held in scratch.
+std::string_view decode_quoted(std::string_view body, std::string& scratch);
+
+} // namespace toonlite
+
+#endif // TOON_SCAN_HPP
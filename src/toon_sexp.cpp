@@ -0,0 +1,534 @@
+#include "toon_sexp.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+namespace toonlite {
+
+namespace {
+
+// Upper bound on pre-sizing from a declared [N], so a bogus header cannot
+// force a huge allocation up front; larger arrays still grow as needed
+constexpr R_xlen_t MAX_PRESIZE = R_xlen_t(1) << 22;
+constexpr R_xlen_t MIN_CAPACITY = 4;
+
+// Documents each thread parses per batch of parse_documents(); a batch's
+// recorded events are held until it is built
+constexpr size_t DOCUMENTS_PER_THREAD = 256;
+
+// Documents parsed between checks for a user interrupt
+constexpr size_t INTERRUPT_EVERY = 1024;
+
+void check_interrupt(void*) {
+    R_CheckUserInterrupt();
+}
+
+enum StateSlot {
+    VALUES = 0,
+    NAMES = 1,
+    FIELDS = 2
+};
+
+} // namespace
+
+SEXP make_charsxp(std::string_view v) {
+    const void* nul = std::memchr(v.data(), '\0', v.size());
+    if (nul) v = v.substr(0, static_cast<const char*>(nul) - v.data());
+    return Rf_mkCharLenCE(v.data(), static_cast<int>(v.size()), CE_UTF8);
+}
+
+bool interrupt_pending() {
+    return R_ToplevelExec(check_interrupt, nullptr) == FALSE;
+}
+
+SexpBuilder::SexpBuilder(bool simplify) : simplify_(simplify) {
+    state_ = Rf_allocVector(VECSXP, 3);
+    R_PreserveObject(state_);
+    SET_VECTOR_ELT(state_, VALUES, Rf_allocVector(VECSXP, 16));
+    SET_VECTOR_ELT(state_, NAMES, Rf_allocVector(VECSXP, 16));
+}
+
+SexpBuilder::~SexpBuilder() {
+    R_ReleaseObject(state_);
+}
+
+SEXP SexpBuilder::result() const {
+    return slot(0);
+}
+
+void SexpBuilder::reset() {
+    // Slots past the open frames are already cleared by finish_frame()
+    for (size_t depth = frames_.size(); depth > 0; depth--) {
+        set_slot(depth, R_NilValue);
+        set_names_slot(depth, R_NilValue);
+    }
+    frames_.clear();
+    set_slot(0, R_NilValue);
+}
+
+SEXP SexpBuilder::slot(size_t depth) const {
+    return VECTOR_ELT(VECTOR_ELT(state_, VALUES), depth);
+}
+
+void SexpBuilder::set_slot(size_t depth, SEXP x) {
+    SET_VECTOR_ELT(VECTOR_ELT(state_, VALUES), depth, x);
+}
+
+SEXP SexpBuilder::names_slot(size_t depth) const {
+    return VECTOR_ELT(VECTOR_ELT(state_, NAMES), depth);
+}
+
+void SexpBuilder::set_names_slot(size_t depth, SEXP x) {
+    SET_VECTOR_ELT(VECTOR_ELT(state_, NAMES), depth, x);
+}
+
+void SexpBuilder::push_frame(bool is_object, bool is_tabular, SEXPTYPE type, R_xlen_t capacity) {
+    size_t depth = frames_.size() + 1;
+
+    // Slot lists grow with nesting depth
+    R_xlen_t slots = Rf_xlength(VECTOR_ELT(state_, VALUES));
+    if (static_cast<R_xlen_t>(depth) >= slots) {
+        SET_VECTOR_ELT(state_, VALUES, Rf_xlengthgets(VECTOR_ELT(state_, VALUES), slots * 2));
+        SET_VECTOR_ELT(state_, NAMES, Rf_xlengthgets(VECTOR_ELT(state_, NAMES), slots * 2));
+    }
+
+    Frame f;
+    f.is_object = is_object;
+    f.is_tabular = is_tabular;
+    f.type = type;
+    f.size = 0;
+    f.capacity = capacity;
+    f.dropped = 0;
+    frames_.push_back(f);
+
+    // Arrays that may still simplify allocate on their first typed item
+    set_slot(depth, type == NILSXP ? R_NilValue : Rf_allocVector(type, capacity));
+    set_names_slot(depth, is_object ? Rf_allocVector(STRSXP, capacity) : R_NilValue);
+}
+
+void SexpBuilder::ensure_capacity(R_xlen_t n) {
+    Frame& f = frames_.back();
+    if (n <= f.capacity) return;
+
+    size_t depth = frames_.size();
+    R_xlen_t new_cap = std::max(n, std::max(f.capacity * 2, MIN_CAPACITY));
+    if (f.type != NILSXP) {
+        set_slot(depth, Rf_xlengthgets(slot(depth), new_cap));
+    }
+    if (f.is_object) {
+        set_names_slot(depth, Rf_xlengthgets(names_slot(depth), new_cap));
+    }
+    f.capacity = new_cap;
+}
+
+// Switch the current (simplified) array to a list, boxing existing items
+void SexpBuilder::convert_to_list() {
+    Frame& f = frames_.back();
+    size_t depth = frames_.size();
+    R_xlen_t cap = std::max(f.capacity, f.size + 1);
+
+    SEXP old = PROTECT(slot(depth));
+    SEXP list = Rf_allocVector(VECSXP, cap);
+    set_slot(depth, list);
+
+    for (R_xlen_t i = 0; i < f.size; i++) {
+        switch (f.type) {
+            case LGLSXP: {
+                int v = LOGICAL(old)[i];
+                if (v != NA_LOGICAL) SET_VECTOR_ELT(list, i, Rf_ScalarLogical(v));
+                break;
+            }
+            case INTSXP: {
+                int v = INTEGER(old)[i];
+                if (v != NA_INTEGER) SET_VECTOR_ELT(list, i, Rf_ScalarInteger(v));
+                break;
+            }
+            case REALSXP: {
+                double v = REAL(old)[i];
+                if (!ISNA(v)) SET_VECTOR_ELT(list, i, Rf_ScalarReal(v));
+                break;
+            }
+            case STRSXP: {
+                SEXP v = STRING_ELT(old, i);
+                if (v != NA_STRING) SET_VECTOR_ELT(list, i, Rf_ScalarString(v));
+                break;
+            }
+            default:
+                // NILSXP: only nulls so far
+                break;
+        }
+    }
+
+    UNPROTECT(1);
+    f.type = VECSXP;
+    f.capacity = cap;
+}
+
+// Prepare the current array to take an item of the given atomic type in
+// place. Returns false if the item has to be boxed into a list instead.
+bool SexpBuilder::accept_atomic(SEXPTYPE type) {
+    if (frames_.empty()) return false;
+
+    Frame& f = frames_.back();
+    if (f.is_object || f.type == VECSXP) return false;
+
+    if (f.type == NILSXP) {
+        // First typed item: nulls seen so far become NA
+        R_xlen_t cap = std::max(f.capacity, f.size + 1);
+        SEXP vec = Rf_allocVector(type, cap);
+        set_slot(frames_.size(), vec);
+        for (R_xlen_t i = 0; i < f.size; i++) {
+            switch (type) {
+                case LGLSXP: LOGICAL(vec)[i] = NA_LOGICAL; break;
+                case INTSXP: INTEGER(vec)[i] = NA_INTEGER; break;
+                case REALSXP: REAL(vec)[i] = NA_REAL; break;
+                case STRSXP: SET_STRING_ELT(vec, i, NA_STRING); break;
+                default: break;
+            }
+        }
+        f.type = type;
+        f.capacity = cap;
+    } else if (f.type != type) {
+        convert_to_list();
+        return false;
+    }
+
+    ensure_capacity(f.size + 1);
+    return true;
+}
+
+// Place a finished value into the enclosing container (or as the result)
+void SexpBuilder::attach(SEXP x) {
+    if (frames_.empty()) {
+        set_slot(0, x);
+        return;
+    }
+
+    PROTECT(x);
+    Frame& f = frames_.back();
+    if (!f.is_object && f.type != VECSXP) {
+        convert_to_list();
+    }
+    if (!f.is_object) {
+        ensure_capacity(f.size + 1);
+    }
+    SET_VECTOR_ELT(slot(frames_.size()), f.size, x);
+    f.size++;
+    UNPROTECT(1);
+}
+
+void SexpBuilder::null_value() {
+    if (!frames_.empty()) {
+        Frame& f = frames_.back();
+        if (f.type == NILSXP) {
+            // Nulls are counted until the array's type is known
+            f.size++;
+            return;
+        }
+        if (!f.is_object && f.type != VECSXP) {
+            ensure_capacity(f.size + 1);
+            SEXP vec = slot(frames_.size());
+            switch (f.type) {
+                case LGLSXP: LOGICAL(vec)[f.size] = NA_LOGICAL; break;
+                case INTSXP: INTEGER(vec)[f.size] = NA_INTEGER; break;
+                case REALSXP: REAL(vec)[f.size] = NA_REAL; break;
+                case STRSXP: SET_STRING_ELT(vec, f.size, NA_STRING); break;
+                default: break;
+            }
+            f.size++;
+            return;
+        }
+    }
+    attach(R_NilValue);
+}
+
+void SexpBuilder::bool_value(bool v) {
+    if (accept_atomic(LGLSXP)) {
+        Frame& f = frames_.back();
+        LOGICAL(slot(frames_.size()))[f.size++] = v ? TRUE : FALSE;
+    } else {
+        attach(Rf_ScalarLogical(v ? TRUE : FALSE));
+    }
+}
+
+void SexpBuilder::int_value(int64_t v) {
+    if (accept_atomic(INTSXP)) {
+        Frame& f = frames_.back();
+        INTEGER(slot(frames_.size()))[f.size++] = static_cast<int>(v);
+    } else {
+        attach(Rf_ScalarInteger(static_cast<int>(v)));
+    }
+}
+
+void SexpBuilder::double_value(double v) {
+    if (accept_atomic(REALSXP)) {
+        Frame& f = frames_.back();
+        REAL(slot(frames_.size()))[f.size++] = v;
+    } else {
+        attach(Rf_ScalarReal(v));
+    }
+}
+
+void SexpBuilder::string_value(std::string_view v) {
+    strings_++;
+    SEXP ch = PROTECT(make_charsxp(v));
+    if (accept_atomic(STRSXP)) {
+        Frame& f = frames_.back();
+        SET_STRING_ELT(slot(frames_.size()), f.size++, ch);
+    } else {
+        attach(Rf_ScalarString(ch));
+    }
+    UNPROTECT(1);
+}
+
+void SexpBuilder::start_array(size_t declared, const TabularHeader* header) {
+    if (header) {
+        SEXP fields = Rf_allocVector(STRSXP, header->fields.size());
+        SET_VECTOR_ELT(state_, FIELDS, fields);
+        strings_ += header->fields.size();
+        for (size_t i = 0; i < header->fields.size(); i++) {
+            const std::string& name = header->fields[i];
+            SET_STRING_ELT(fields, i, make_charsxp(name));
+        }
+    }
+
+    R_xlen_t capacity = std::min(static_cast<R_xlen_t>(declared), MAX_PRESIZE);
+    push_frame(false, header != nullptr, simplify_ ? NILSXP : VECSXP, capacity);
+}
+
+// Pop the current frame, returning its vector trimmed to size (protected
+// by one PROTECT the caller must release)
+SEXP SexpBuilder::finish_frame() {
+    Frame f = frames_.back();
+    size_t depth = frames_.size();
+
+    if (f.is_object && f.dropped > 0) {
+        // Close the gaps left by replaced members
+        SEXP vec = slot(depth);
+        SEXP names = names_slot(depth);
+        R_xlen_t kept = 0;
+        for (R_xlen_t i = 0; i < f.size; i++) {
+            if (STRING_ELT(names, i) == NA_STRING) continue;
+            SET_VECTOR_ELT(vec, kept, VECTOR_ELT(vec, i));
+            SET_STRING_ELT(names, kept, STRING_ELT(names, i));
+            kept++;
+        }
+        f.size = kept;
+    }
+
+    SEXP vec;
+    if (f.type == NILSXP) {
+        // Empty, or only nulls: stays a list
+        vec = PROTECT(Rf_allocVector(VECSXP, f.size));
+    } else {
+        vec = slot(depth);
+        if (f.size != f.capacity) {
+            vec = Rf_xlengthgets(vec, f.size);
+        }
+        PROTECT(vec);
+        if (f.is_object) {
+            SEXP names = names_slot(depth);
+            if (f.size != f.capacity) {
+                names = Rf_xlengthgets(names, f.size);
+            }
+            Rf_setAttrib(vec, R_NamesSymbol, names);
+        }
+    }
+
+    set_slot(depth, R_NilValue);
+    set_names_slot(depth, R_NilValue);
+    frames_.pop_back();
+    return vec;
+}
+
+void SexpBuilder::end_array() {
+    SEXP vec = finish_frame();
+    attach(vec);
+    UNPROTECT(1);
+}
+
+void SexpBuilder::start_object() {
+    // Rows of a tabular array have one member per header field
+    R_xlen_t capacity = MIN_CAPACITY;
+    if (!frames_.empty() && frames_.back().is_tabular) {
+        capacity = Rf_xlength(VECTOR_ELT(state_, FIELDS));
+    }
+    push_frame(true, false, VECSXP, capacity);
+}
+
+void SexpBuilder::key(std::string_view k, size_t replaces) {
+    Frame& f = frames_.back();
+    size_t depth = frames_.size();
+    strings_++;
+    SEXP ch = PROTECT(make_charsxp(k));
+
+    if (replaces != NEW_KEY) {
+        // Last one wins: the old member becomes a gap (NA name), closed
+        // when the object ends
+        R_xlen_t i = static_cast<R_xlen_t>(replaces);
+        SET_VECTOR_ELT(slot(depth), i, R_NilValue);
+        SET_STRING_ELT(names_slot(depth), i, NA_STRING);
+        f.dropped++;
+    }
+
+    ensure_capacity(f.size + 1);
+    SET_STRING_ELT(names_slot(depth), f.size, ch);
+    UNPROTECT(1);
+}
+
+void SexpBuilder::field_key(size_t index) {
+    Frame& f = frames_.back();
+    ensure_capacity(f.size + 1);
+    SET_STRING_ELT(names_slot(frames_.size()), f.size, STRING_ELT(VECTOR_ELT(state_, FIELDS), index));
+}
+
+void SexpBuilder::end_object() {
+    SEXP vec = finish_frame();
+    attach(vec);
+    UNPROTECT(1);
+}
+
+namespace {
+
+std::string element_prefix(size_t i) {
+    return "Element " + std::to_string(i + 1) + ": ";
+}
+
+// Note the error of element i, or throw it with its position
+void element_failed(size_t i, const ParseError& e, bool collect_errors,
+                    std::vector<std::pair<size_t, ParseError>>& errors) {
+    if (!collect_errors) {
+        throw ParseError(element_prefix(i) + e.what(), e.line(), e.column(), e.snippet(), e.file());
+    }
+    errors.emplace_back(i, e);
+}
+
+void element_warnings(size_t i, const std::vector<Warning>& from, std::vector<Warning>& to) {
+    for (const auto& w : from) {
+        to.emplace_back(w.type, element_prefix(i) + w.message);
+    }
+}
+
+} // namespace
+
+SEXP parse_documents(SEXP text, const ParseOptions& opts, int threads, bool collect_errors,
+                     std::vector<std::pair<size_t, ParseError>>& errors,
+                     std::vector<Warning>& warnings) {
+    size_t n = static_cast<size_t>(Rf_xlength(text));
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, n));
+    SexpBuilder builder(opts.simplify);
+
+    size_t n_threads = std::min(static_cast<size_t>(std::max(threads, 1)), n);
+    if (n_threads <= 1) {
+        Parser parser(opts);
+        for (size_t i = 0; i < n; i++) {
+            SEXP s = STRING_ELT(text, i);
+            if (s == NA_STRING) continue;
+
+            builder.reset();
+            bool produced;
+            try {
+                produced = parser.parse_string(CHAR(s), static_cast<size_t>(LENGTH(s)), builder);
+            } catch (const ParseError& e) {
+                element_failed(i, e, collect_errors, errors);
+                continue;
+            }
+            element_warnings(i, parser.warnings(), warnings);
+            if (produced) {
+                SET_VECTOR_ELT(out, i, builder.result());
+            }
+            if ((i + 1) % INTERRUPT_EVERY == 0 && interrupt_pending()) {
+                throw ParseError("Parsing interrupted by the user");
+            }
+        }
+        builder.reset();
+        UNPROTECT(1);
+        return out;
+    }
+
+    // The workers only read bytes: element pointers are taken here
+    std::vector<std::string_view> docs(n);
+    for (size_t i = 0; i < n; i++) {
+        SEXP s = STRING_ELT(text, i);
+        if (s != NA_STRING) docs[i] = std::string_view(CHAR(s), static_cast<size_t>(LENGTH(s)));
+    }
+
+    struct Parsed {
+        EventRecorder events;
+        bool produced = false;
+        std::exception_ptr error;
+        std::vector<Warning> warnings;
+    };
+    size_t batch = n_threads * DOCUMENTS_PER_THREAD;
+    std::vector<Parsed> parsed(std::min(batch, n));
+    std::vector<std::unique_ptr<Parser>> parsers;
+    for (size_t t = 0; t < n_threads; t++) {
+        parsers.push_back(std::make_unique<Parser>(opts));
+    }
+
+    for (size_t begin = 0; begin < n; begin += batch) {
+        size_t end = std::min(n, begin + batch);
+        std::atomic<size_t> next{begin};
+        auto work = [&](size_t t) {
+            Parser& parser = *parsers[t];
+            for (size_t i = next++; i < end; i = next++) {
+                Parsed& p = parsed[i - begin];
+                p.events.clear();
+                p.produced = false;
+                p.error = nullptr;
+                p.warnings.clear();
+                if (docs[i].data() == nullptr) continue;
+                try {
+                    p.produced = parser.parse_string(docs[i].data(), docs[i].size(), p.events);
+                    p.warnings = parser.warnings();
+                } catch (...) {
+                    p.error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < n_threads; t++) {
+            try {
+                workers.emplace_back(work, t);
+            } catch (const std::system_error&) {
+                break;   // the calling thread takes the rest
+            }
+        }
+        work(0);
+        for (auto& w : workers) {
+            w.join();
+        }
+
+        // Build the batch in element order
+        for (size_t i = begin; i < end; i++) {
+            Parsed& p = parsed[i - begin];
+            if (p.error) {
+                try {
+                    std::rethrow_exception(p.error);
+                } catch (const ParseError& e) {
+                    element_failed(i, e, collect_errors, errors);
+                    continue;
+                }
+            }
+            element_warnings(i, p.warnings, warnings);
+            if (!p.produced) continue;
+            builder.reset();
+            p.events.replay(builder);
+            SET_VECTOR_ELT(out, i, builder.result());
+        }
+        if (interrupt_pending()) {
+            throw ParseError("Parsing interrupted by the user");
+        }
+    }
+
+    builder.reset();
+    UNPROTECT(1);
+    return out;
+}
+
+} // namespace toonlite
@@ -0,0 +1,118 @@
+#ifndef TOON_SEXP_HPP
+#define TOON_SEXP_HPP
+
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "toon_parser.h"
+
+#include <R.h>
+#include <Rinternals.h>
+#ifdef error
+#undef error
+#endif
+#ifdef length
+#undef length
+#endif
+#ifdef Realloc
+#undef Realloc
+#endif
+#ifdef Free
+#undef Free
+#endif
+
+namespace toonlite {
+
+// CHARSXP (UTF-8) of v up to its first NUL: R strings cannot hold one, and
+// Rf_mkCharLenCE would raise an R error past the C++ frames
+SEXP make_charsxp(std::string_view v);
+
+// Whether the user has interrupted, without R_CheckUserInterrupt()'s long
+// jump: callers throw instead, so destructors run (worker threads joined,
+// temporary files removed, preserved objects released)
+bool interrupt_pending();
+
+// Builds R objects directly from parser events, skipping the Document.
+// Arrays are pre-sized from their declared [N]; when simplifying, an array
+// stays an atomic vector for as long as its items agree on one primitive
+// type and only falls back to a list on the first mismatch.
+class SexpBuilder : public ParseHandler {
+public:
+    explicit SexpBuilder(bool simplify);
+    ~SexpBuilder() override;
+
+    SexpBuilder(const SexpBuilder&) = delete;
+    SexpBuilder& operator=(const SexpBuilder&) = delete;
+
+    void null_value() override;
+    void bool_value(bool v) override;
+    void int_value(int64_t v) override;
+    void double_value(double v) override;
+    void string_value(std::string_view v) override;
+
+    void start_array(size_t declared, const TabularHeader* header) override;
+    void end_array() override;
+
+    void start_object() override;
+    void key(std::string_view k, size_t replaces) override;
+    void field_key(size_t index) override;
+    void end_object() override;
+
+    // Parsed value (R_NilValue if nothing was produced)
+    SEXP result() const;
+
+    // Drop the result and any value left half built by a failed parse, so
+    // the builder can take the next document
+    void reset();
+
+    // CHARSXPs made for values, keys and tabular fields
+    size_t strings_created() const { return strings_; }
+
+private:
+    struct Frame {
+        bool is_object;
+        bool is_tabular;     // Array whose items are tabular rows
+        SEXPTYPE type;       // NILSXP while an array holds only nulls, the
+                             // atomic type while simplified, else VECSXP
+        R_xlen_t size;
+        R_xlen_t capacity;
+        R_xlen_t dropped;    // Object members replaced by a later duplicate
+    };
+
+    void push_frame(bool is_object, bool is_tabular, SEXPTYPE type, R_xlen_t capacity);
+    SEXP slot(size_t depth) const;
+    void set_slot(size_t depth, SEXP x);
+    SEXP names_slot(size_t depth) const;
+    void set_names_slot(size_t depth, SEXP x);
+
+    bool accept_atomic(SEXPTYPE type);
+    void ensure_capacity(R_xlen_t n);
+    void convert_to_list();
+    void attach(SEXP x);
+    SEXP finish_frame();
+
+    bool simplify_;
+    std::vector<Frame> frames_;
+    size_t strings_ = 0;
+
+    // Preserved list: [0] value slots (0 = result, d + 1 = frame d),
+    // [1] object name slots, [2] CHARSXPs of the active tabular header
+    SEXP state_;
+};
+
+// Parse each element of the character vector text as a document, into a
+// list of the same length (NULL for NA, empty and failed elements). One
+// Parser and SexpBuilder serve every document. With threads > 1 the
+// documents are parsed on that many threads in batches, each into an
+// EventRecorder that is replayed into R objects on the calling thread.
+// A failed element throws its ParseError, prefixed with its position,
+// unless collect_errors is set: its position and error are then added to
+// errors, in element order. Warnings are prefixed the same way.
+SEXP parse_documents(SEXP text, const ParseOptions& opts, int threads, bool collect_errors,
+                     std::vector<std::pair<size_t, ParseError>>& errors,
+                     std::vector<Warning>& warnings);
+
+} // namespace toonlite
+
+#endif // TOON_SEXP_HPP
@@ -0,0 +1,98 @@
+#include "toon_stats.h"
+#include "toon_io.h"
+#include <algorithm>
+#include <memory>
+
+namespace toonlite {
+
+void ColumnStats::merge(const ColumnStats& other, bool concurrent) {
+    type = other.type;
+    for (const auto& p : other.promotions) {
+        if (std::find(promotions.begin(), promotions.end(), p) == promotions.end()) {
+            promotions.push_back(p);
+        }
+    }
+    promoted_values += other.promoted_values;
+    unescaped += other.unescaped;
+    strings += other.strings;
+    allocations += other.allocations;
+    peak_bytes = concurrent ? peak_bytes + other.peak_bytes : std::max(peak_bytes, other.peak_bytes);
+}
+
+void Stats::add_phase(const std::string& name, double s) {
+    for (auto& phase : phases) {
+        if (phase.first == name) {
+            phase.second += s;
+            return;
+        }
+    }
+    phases.emplace_back(name, s);
+}
+
+double Stats::phase(const std::string& name) const {
+    for (const auto& p : phases) {
+        if (p.first == name) return p.second;
+    }
+    return 0;
+}
+
+void Stats::add_input(const BufferedReader& reader) {
+    const auto& c = reader.counters();
+    bytes_read += reader.offset() - c.start_offset;
+    lines_read += reader.current_line() - c.start_line;
+    buffer_refills += c.refills;
+    scratch_copies += c.scratch_copies;
+    io_wait += c.wait_seconds;
+}
+
+void Stats::merge_columns(const std::vector<ColumnStats>& cols, bool concurrent) {
+    for (size_t i = 0; i < cols.size(); i++) {
+        if (i < columns.size()) {
+            columns[i].merge(cols[i], concurrent);
+        } else {
+            columns.push_back(cols[i]);
+        }
+    }
+}
+
+namespace stats {
+
+namespace {
+
+std::unique_ptr<Stats> g_active;
+std::unique_ptr<Stats> g_last;
+Clock::time_point g_start;
+
+} // namespace
+
+Stats* active() {
+    return g_active.get();
+}
+
+void start(const std::string& operation) {
+    g_active = std::make_unique<Stats>();
+    g_active->operation = operation;
+    g_start = Clock::now();
+}
+
+void stop() {
+    if (!g_active) return;
+    g_active->seconds = seconds_since(g_start);
+
+    size_t builder_peak = 0;
+    for (const auto& col : g_active->columns) {
+        g_active->allocations += col.allocations;
+        g_active->strings_created += col.strings;
+        builder_peak += col.peak_bytes;
+    }
+    g_active->peak_builder_bytes = std::max(g_active->peak_builder_bytes, builder_peak);
+    g_last = std::move(g_active);
+}
+
+const Stats* last() {
+    return g_last.get();
+}
+
+} // namespace stats
+
+} // namespace toonlite
@@ -0,0 +1,109 @@
+#ifndef TOON_STATS_HPP
+#define TOON_STATS_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <cstddef>
+
+namespace toonlite {
+
+class BufferedReader;
+
+// Work done building one column of a tabular read
+struct ColumnStats {
+    std::string name;
+    std::string type;                     // final type
+    std::vector<std::string> promotions;  // e.g. "integer -> double", in order
+    size_t promoted_values = 0;           // values converted by promotions
+    size_t unescaped = 0;                 // quoted cells decoded into a copy
+    size_t strings = 0;                   // CHARSXPs made for its text
+    size_t allocations = 0;               // storage buffers allocated or grown
+    size_t peak_bytes = 0;                // largest storage held at once
+
+    // Fold in the same column of another chunk (parsed at the same time)
+    // or batch (parsed one after another)
+    void merge(const ColumnStats& other, bool concurrent);
+};
+
+// Statistics of one profiled read or write (profile = TRUE), reported by
+// toon_last_stats(). The readers and builders keep their counters as plain
+// members bumped on rare events (a buffer refill, a type promotion), and
+// these are only gathered here while a profile is active; phases and I/O
+// waits are timed only then. Profiles are started and stopped from the
+// main thread.
+struct Stats {
+    std::string operation;
+    double seconds = 0;
+    std::vector<std::pair<std::string, double>> phases;  // seconds, in first-use order
+
+    // Input, summed over readers
+    size_t bytes_read = 0;      // text bytes (decompressed)
+    size_t lines_read = 0;
+    size_t buffer_refills = 0;
+    size_t scratch_copies = 0;  // lines assembled across buffer boundaries
+    double io_wait = 0;         // seconds spent refilling buffers
+
+    size_t bytes_written = 0;
+    size_t rows = 0;
+    size_t schema_expansions = 0;
+    size_t strings_created = 0;  // CHARSXPs made for the result
+    size_t allocations = 0;      // builder storage and result vectors
+    size_t peak_builder_bytes = 0;
+    std::vector<ColumnStats> columns;
+
+    void add_phase(const std::string& name, double s);
+    double phase(const std::string& name) const;   // 0 if not timed
+    void add_input(const BufferedReader& reader);
+
+    // Fold in columns built as one chunk or batch (see ColumnStats::merge)
+    void merge_columns(const std::vector<ColumnStats>& cols, bool concurrent);
+};
+
+namespace stats {
+
+using Clock = std::chrono::steady_clock;
+
+inline double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The profile being collected, or nullptr
+Stats* active();
+
+// Start collecting for `operation`, replacing any profile in progress
+void start(const std::string& operation);
+
+// Finish the profile in progress, which becomes the last one
+void stop();
+
+// The last finished profile, or nullptr if there has been none
+const Stats* last();
+
+} // namespace stats
+
+// Adds the time until it goes out of scope to a phase of the active
+// profile; does nothing without one
+class PhaseTimer {
+public:
+    explicit PhaseTimer(const char* phase)
+        : stats_(stats::active()), phase_(phase) {
+        if (stats_) start_ = stats::Clock::now();
+    }
+    ~PhaseTimer() {
+        if (stats_) stats_->add_phase(phase_, stats::seconds_since(start_));
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Stats* stats_;
+    const char* phase_;
+    stats::Clock::time_point start_;
+};
+
+} // namespace toonlite
+
+#endif // TOON_STATS_HPP
@@ -1,13 +1,41 @@
 #include "toon_stream.h"
+#include "toon_scan.h"
+#include "toon_sexp.h"
+#include "toon_keys.h"
 #include <charconv>
+#include <cmath>
 #include <algorithm>
 #include <cctype>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <exception>
 
 namespace toonlite {
 
+namespace {
+
+// Call the R callback on one batch, turning an R error into a ParseError
+void run_callback(SEXP callback, SEXP batch, const std::string& filepath) {
+    SEXP call = PROTECT(Rf_lang2(callback, batch));
+    int error_occurred = 0;
+    R_tryEval(call, R_GlobalEnv, &error_occurred);
+    UNPROTECT(1);
+    if (error_occurred) {
+        throw ParseError("Callback error during streaming", 0, 0, "", filepath);
+    }
+}
+
+// How long the pipelined stream waits for a batch between interrupt checks
+constexpr std::chrono::milliseconds INTERRUPT_WAIT{100};
+
+} // namespace
+
 std::string_view RowStreamer::trim(std::string_view sv) {
     while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.front()))) {
         sv.remove_prefix(1);
@@ -20,7 +48,7 @@ std::string_view RowStreamer::trim(std::string_view sv) {
 
 RowStreamer::RowStreamer(const std::string& filepath, const StreamOptions& opts)
     : filepath_(filepath), opts_(opts) {
-    reader_ = std::make_unique<BufferedReader>(filepath);
+    reader_ = std::make_unique<BufferedReader>(filepath, opts_.io);
     if (reader_->has_error()) {
         throw ParseError(reader_->error_message(), 0, 0, "", filepath);
     }
@@ -102,19 +130,17 @@ bool RowStreamer::find_tabular_header() {
                 continue;
             }
 
-            size_t colon = trimmed.find(':');
-            if (colon != std::string_view::npos) {
-                auto key = trim(trimmed.substr(0, colon));
-                if (key == target_key) {
-                    found_key = true;
-                    auto value = trim(trimmed.substr(colon + 1));
-                    if (!value.empty() && value[0] == '[') {
-                        if (parse_header(value)) {
-                            return true;
-                        }
+            // The first member with that name at any depth, as the file is
+            // read a line at a time
+            std::string_view value;
+            if (match_key(trimmed, target_key, value)) {
+                found_key = true;
+                if (!value.empty() && value[0] == '[') {
+                    if (parse_header(value)) {
+                        return true;
                     }
-                    break;
                 }
+                break;
             }
         }
 
@@ -146,82 +172,41 @@ bool RowStreamer::find_tabular_header() {
     return false;
 }
 
-std::vector<std::string_view> RowStreamer::split_row(std::string_view line, char delimiter) {
-    std::vector<std::string_view> fields;
-
-    size_t start = 0;
-    bool in_string = false;
-    bool escape = false;
-
-    for (size_t i = 0; i < line.size(); i++) {
-        char c = line[i];
-
-        if (escape) {
-            escape = false;
-            continue;
-        }
-
-        if (c == '\\' && in_string) {
-            escape = true;
-            continue;
+void RowStreamer::start_batch(Batch& batch) {
+    auto& columns = batch.columns;
+    for (size_t i = 0; i < field_names_.size(); i++) {
+        if (i < columns.size()) {
+            columns[i].reset();
+        } else {
+            columns.emplace_back(field_names_[i], opts_.batch_size);
         }
-
-        if (c == '"') {
-            in_string = !in_string;
-            continue;
+        if (i < batch_types_.size() && batch_types_[i] != ColType::UNKNOWN) {
+            columns[i].force_type(batch_types_[i]);
         }
-
-        if (!in_string && c == delimiter) {
-            fields.push_back(trim(line.substr(start, i - start)));
-            start = i + 1;
-        }
-    }
-
-    if (start <= line.size()) {
-        fields.push_back(trim(line.substr(start)));
     }
-
-    return fields;
-}
-
-void RowStreamer::process_batch() {
-    // Build data.frame from batch_columns_
-    SEXP df = build_dataframe(batch_columns_, batch_rows_);
-
-    // Reset batch
-    batch_columns_.clear();
-    for (const auto& name : field_names_) {
-        batch_columns_.emplace_back(name, opts_.batch_size);
-    }
-    batch_rows_ = 0;
-
-    (void)df; // Used by caller
+    batch.rows = 0;
 }
 
-void RowStreamer::stream(SEXP callback) {
-    if (!find_tabular_header()) {
-        throw ParseError("No tabular array found", 0, 0, "", filepath_);
-    }
-
-    // Initialize batch columns
-    for (const auto& name : field_names_) {
-        batch_columns_.emplace_back(name, opts_.batch_size);
-    }
-
-    // Apply user-specified column types
-    for (const auto& [name, type] : opts_.col_types) {
-        for (auto& col : batch_columns_) {
-            if (col.name() == name) {
-                col.force_type(type);
-                break;
-            }
+void RowStreamer::escalate_types(const Batch& batch) {
+    const auto& columns = batch.columns;
+    batch_types_.resize(columns.size(), ColType::UNKNOWN);
+    for (size_t i = 0; i < columns.size(); i++) {
+        ColType type = columns[i].type();
+        if (type <= batch_types_[i]) continue;
+
+        // A column sampled as all null takes the first type seen without
+        // counting as a change
+        bool seen = std::any_of(escalated_.begin(), escalated_.end(),
+                                [&](const auto& e) { return e.first == i; });
+        if (batch_types_[i] != ColType::UNKNOWN && !seen) {
+            escalated_.emplace_back(i, batch_types_[i]);
         }
+        batch_types_[i] = type;
     }
+}
 
+bool RowStreamer::next_row(std::string_view& row, size_t& line_no) {
     std::string_view line;
-    size_t line_no;
-    size_t check_interrupt_counter = 0;
-
     while (reader_->next_line(line, line_no)) {
         // Count indentation
         size_t indent = 0;
@@ -242,104 +227,291 @@ void RowStreamer::stream(SEXP callback) {
 
         // Strip trailing comment
         if (opts_.allow_comments) {
-            bool in_string = false;
-            for (size_t i = 0; i < content.size(); i++) {
-                char c = content[i];
-                if (c == '"') in_string = !in_string;
-                if (!in_string && c == '#') {
-                    content = trim(content.substr(0, i));
-                    break;
-                }
+            size_t hash = find_unquoted(content, 0, '#', '#', false);
+            if (hash != std::string_view::npos) {
+                content = trim(content.substr(0, hash));
             }
         }
 
-        // Parse row
-        auto fields = split_row(content, delimiter_);
-        size_t n_fields = fields.size();
+        row = content;
+        return true;
+    }
+    return false;
+}
+
+bool RowStreamer::fill_batch(Batch& batch, bool check_interrupts) {
+    start_batch(batch);
+    auto& columns = batch.columns;
+
+    std::string_view content;
+    size_t line_no;
+
+    while (batch.rows < opts_.batch_size && next_row(content, line_no)) {
+        if (skip_rows_ > 0) {
+            skip_rows_--;
+            continue;
+        }
+
+        // Parse row; fields past the last selected or filtered one are
+        // counted, not stored
+        auto& fields = row_fields_;
+        size_t n_fields = split_fields(content, delimiter_, fields, projection_.fields_needed());
+        observed_rows_++;
 
         if (n_fields < min_fields_) min_fields_ = n_fields;
         if (n_fields > max_fields_) max_fields_ = n_fields;
 
-        // Handle ragged rows
-        if (n_fields != batch_columns_.size()) {
-            if (opts_.ragged_rows == "error") {
-                throw ParseError("Row has " + std::to_string(n_fields) + " fields but expected " +
-                    std::to_string(batch_columns_.size()), line_no, 0, "", filepath_);
-            }
+        // Check for user interrupt
+        if (check_interrupts && ++check_interrupt_counter_ >= 10000) {
+            R_CheckUserInterrupt();
+            check_interrupt_counter_ = 0;
+        }
 
-            if (n_fields > batch_columns_.size()) {
-                size_t extra = n_fields - batch_columns_.size();
+        // Handle ragged rows; a selection never grows the schema
+        size_t expected = projection_.selects() ? header_columns_ : columns.size();
+        if (n_fields != expected && opts_.ragged_rows == "error") {
+            throw ParseError("Row has " + std::to_string(n_fields) + " fields but expected " +
+                std::to_string(expected), line_no, 0, "", filepath_);
+        }
+
+        if (!projection_.keep(fields)) {
+            continue;
+        }
+
+        if (projection_.selects()) {
+            const auto& map = projection_.fields();
+            for (size_t i = 0; i < columns.size(); i++) {
+                if (map[i] < n_fields) {
+                    columns[i].append(fields[map[i]]);
+                } else {
+                    columns[i].append_null();
+                }
+            }
+        } else {
+            if (n_fields > columns.size()) {
+                size_t extra = n_fields - columns.size();
                 if (schema_expansions_ + extra > opts_.max_extra_cols) {
                     throw ParseError("max_extra_cols exceeded", line_no, 0, "", filepath_);
                 }
 
-                for (size_t i = batch_columns_.size(); i < n_fields; i++) {
+                for (size_t i = columns.size(); i < n_fields; i++) {
                     std::string new_name = "V" + std::to_string(i + 1);
-                    batch_columns_.emplace_back(new_name, opts_.batch_size);
+                    columns.emplace_back(new_name, opts_.batch_size);
                     field_names_.push_back(new_name);
 
-                    for (size_t r = 0; r < batch_rows_; r++) {
-                        batch_columns_.back().set_null(r);
-                    }
+                    columns.back().append_nulls(batch.rows);
                 }
                 schema_expansions_ += extra;
             }
-        }
 
-        // Store values
-        for (size_t i = 0; i < batch_columns_.size(); i++) {
-            if (i < n_fields) {
-                batch_columns_[i].set(batch_rows_, fields[i]);
-            } else {
-                batch_columns_[i].set_null(batch_rows_);
+            // Store values
+            for (size_t i = 0; i < columns.size(); i++) {
+                if (i < n_fields) {
+                    columns[i].append(fields[i]);
+                } else {
+                    columns[i].append_null();
+                }
             }
         }
 
-        batch_rows_++;
-        observed_rows_++;
+        batch.rows++;
+    }
 
-        // Emit batch if full
-        if (batch_rows_ >= opts_.batch_size) {
-            SEXP df = PROTECT(build_dataframe(batch_columns_, batch_rows_));
-
-            // Call R callback with error checking
-            SEXP call = PROTECT(Rf_lang2(callback, df));
-            int error_occurred = 0;
-            R_tryEval(call, R_GlobalEnv, &error_occurred);
-            UNPROTECT(2);
-            if (error_occurred) {
-                throw ParseError("Callback error during streaming", 0, 0, "", filepath_);
-            }
+    if (batch.rows == 0) return false;
+    if (opts_.sample_rows > 0) escalate_types(batch);
+    return true;
+}
 
-            // Reset batch
-            batch_columns_.clear();
-            for (const auto& name : field_names_) {
-                batch_columns_.emplace_back(name, opts_.batch_size);
+double RowStreamer::stream_pipelined(const std::function<void(Batch&)>& emit) {
+    // Two batches: the worker fills one while the other is with emit
+    Batch slots[2];
+    std::vector<Batch*> free_batches{&slots[0], &slots[1]};
+    std::deque<Batch*> ready;
+    bool done = false;
+    bool stop = false;
+    std::exception_ptr error;
+    double parse_seconds = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::thread worker([&] {
+        try {
+            while (true) {
+                Batch* batch;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return stop || !free_batches.empty(); });
+                    if (stop) break;
+                    batch = free_batches.back();
+                    free_batches.pop_back();
+                }
+                auto start = stats::Clock::now();
+                bool filled = fill_batch(*batch, false);
+                parse_seconds += stats::seconds_since(start);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (filled) {
+                    ready.push_back(batch);
+                } else {
+                    done = true;
+                }
+                cv.notify_all();
+                if (!filled) break;
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            done = true;
+            cv.notify_all();
+        }
+    });
+
+    // Stop the worker however this returns, such as on a callback error
+    struct Join {
+        std::thread& worker;
+        std::mutex& mutex;
+        std::condition_variable& cv;
+        bool& stop;
+        ~Join() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            cv.notify_all();
+            worker.join();
+        }
+    } join{worker, mutex, cv, stop};
+
+    // A slow batch is waited for in slices, so an interrupt stops the
+    // stream; the worker is joined before the error is raised
+    bool interrupted = false;
+    while (true) {
+        Batch* batch;
+        {
+            PhaseTimer timer("wait");
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!cv.wait_for(lock, INTERRUPT_WAIT, [&] { return done || !ready.empty(); })) {
+                lock.unlock();
+                interrupted = interrupt_pending();
+                lock.lock();
+                if (interrupted) break;
             }
-            batch_rows_ = 0;
+            if (interrupted || ready.empty()) break;
+            batch = ready.front();
+            ready.pop_front();
         }
+        emit(*batch);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_batches.push_back(batch);
+        }
+        cv.notify_all();
+    }
 
-        // Check for user interrupt
-        if (++check_interrupt_counter >= 10000) {
-            R_CheckUserInterrupt();
-            check_interrupt_counter = 0;
+    if (interrupted) {
+        throw ParseError("Streaming interrupted by the user", 0, 0, "", filepath_);
+    }
+
+    // Batches parsed before an error have been passed on, as when serial
+    if (error) std::rethrow_exception(error);
+    return parse_seconds;
+}
+
+void RowStreamer::stream(SEXP callback) {
+    // With a current row index, go straight to the block holding the first
+    // row and count off the rest
+    RowIndex index;
+    skip_rows_ = opts_.row_start;
+    if (!opts_.index_file.empty() &&
+        load_row_index(opts_.index_file, filepath_, opts_.key, opts_.allow_comments,
+                       index, warnings_)) {
+        if (!parse_header(index.header)) {
+            throw ParseError("Invalid tabular header", index.header_line, 0, index.header,
+                             filepath_);
+        }
+        size_t b = index.block_of(opts_.row_start);
+        reader_->seek(index.blocks[b].offset, index.blocks[b].line);
+        skip_rows_ -= b * index.every;
+    } else if (!find_tabular_header()) {
+        throw ParseError("No tabular array found", 0, 0, "", filepath_);
+    }
+
+    header_columns_ = field_names_.size();
+    projection_.resolve(field_names_, opts_.select, opts_.filters, filepath_);
+    if (projection_.selects()) {
+        field_names_ = opts_.select;
+    }
+
+    // Types every batch starts at: user-specified ones, widened to those
+    // of a sample of the rows
+    batch_types_.assign(field_names_.size(), ColType::UNKNOWN);
+    if (!opts_.col_types.empty()) {
+        NameLookup lookup(field_names_);
+        for (const auto& [name, type] : opts_.col_types) {
+            size_t i = lookup.find(name);
+            if (i != KeyIndex::npos) batch_types_[i] = type;
+        }
+    }
+    if (opts_.sample_rows > 0) {
+        RowSample sample;
+        sample.rows = opts_.sample_rows;
+        sample.spread = opts_.row_start == 0;
+        sample.skip = skip_rows_;
+        sample.delimiter = delimiter_;
+        sample.allow_comments = opts_.allow_comments;
+        std::vector<ColType> sampled =
+            sample_column_types(*reader_, sample, projection_, field_names_.size());
+        for (size_t i = 0; i < sampled.size(); i++) {
+            batch_types_[i] = std::max(batch_types_[i], sampled[i]);
         }
     }
 
-    // Emit final batch if any rows remain
-    if (batch_rows_ > 0) {
-        SEXP df = PROTECT(build_dataframe(batch_columns_, batch_rows_));
-        SEXP call = PROTECT(Rf_lang2(callback, df));
-        int error_occurred = 0;
-        R_tryEval(call, R_GlobalEnv, &error_occurred);
-        UNPROTECT(2);
-        if (error_occurred) {
-            throw ParseError("Callback error during streaming", 0, 0, "", filepath_);
+    // Time not spent building batches or in the callback is parsing, or
+    // with a pipeline, the worker's time
+    Stats* st = stats::active();
+    auto start = stats::Clock::now();
+    if (st) st->add_phase("parse", 0);
+
+    auto emit_batch = [&](Batch& batch) {
+        SEXP df;
+        {
+            PhaseTimer timer("build");
+            df = PROTECT(build_dataframe(batch.columns, batch.rows, opts_.as_factor));
+            if (st) {
+                std::vector<ColumnStats> cols;
+                for (const auto& col : batch.columns) cols.push_back(col.stats());
+                st->merge_columns(cols, false);
+                st->allocations += batch.columns.size() + 1;
+            }
+        }
+        {
+            PhaseTimer timer("callback");
+            run_callback(callback, df, filepath_);
+        }
+        UNPROTECT(1);
+    };
+
+    double parse_seconds;
+    if (opts_.pipeline) {
+        parse_seconds = stream_pipelined(emit_batch);
+    } else {
+        Batch batch;
+        while (fill_batch(batch, true)) {
+            emit_batch(batch);
         }
+        parse_seconds = stats::seconds_since(start);
+        if (st) parse_seconds -= st->phase("build") + st->phase("callback");
     }
 
-    // Check row count mismatch
-    if (declared_rows_ > 0 && observed_rows_ != declared_rows_) {
+    if (st) {
+        st->add_input(*reader_);
+        st->rows += observed_rows_;
+        st->schema_expansions += schema_expansions_;
+        st->add_phase("parse", parse_seconds);
+    }
+
+    // Check row count mismatch (rows before row_start were not counted)
+    if (opts_.row_start == 0 && declared_rows_ > 0 && observed_rows_ != declared_rows_) {
         if (opts_.n_mismatch == "error") {
             throw ParseError("Declared [" + std::to_string(declared_rows_) + "] but observed " +
                 std::to_string(observed_rows_) + " rows", 0, 0, "", filepath_);
@@ -350,8 +522,20 @@ void RowStreamer::stream(SEXP callback) {
         }
     }
 
+    // Sampled types that did not hold for the whole stream
+    if (!escalated_.empty() && opts_.warn) {
+        std::string msg = "Column types changed after sampling:";
+        for (size_t k = 0; k < escalated_.size(); k++) {
+            size_t i = escalated_[k].first;
+            msg += std::string(k > 0 ? ", " : " ") + field_names_[i] + " (" +
+                col_type_name(escalated_[k].second) + " -> " + col_type_name(batch_types_[i]) + ")";
+        }
+        msg += ". Earlier batches have the sampled types; increase sample_rows to avoid this.";
+        warnings_.push_back(Warning("type_escalation", msg));
+    }
+
     // Ragged row warning
-    if (min_fields_ != max_fields_ && opts_.warn) {
+    if (min_fields_ < max_fields_ && opts_.warn) {
         std::string msg = "Tabular rows had inconsistent field counts (min=" +
             std::to_string(min_fields_) + ", max=" + std::to_string(max_fields_) + ").";
         if (schema_expansions_ > 0) {
@@ -363,27 +547,237 @@ void RowStreamer::stream(SEXP callback) {
 }
 
 // ItemStreamer implementation
+
+namespace {
+
+// Thrown once the target array is complete, to stop the parse without
+// reading the rest of the input
+struct TargetDone {};
+
+// Forwards the events of each item of the target array (the root, or
+// root[key]) to a SexpBuilder and collects the finished items into batches
+// for the callback. Events outside the target are dropped, so memory is
+// bounded by one batch.
+class ItemCollector : public ParseHandler {
+public:
+    ItemCollector(const StreamOptions& opts, SEXP callback, const std::string& filepath)
+        : opts_(opts), callback_(callback), filepath_(filepath), builder_(opts.simplify) {
+        batch_ = Rf_allocVector(VECSXP, opts_.batch_size);
+        R_PreserveObject(batch_);
+    }
+
+    ~ItemCollector() override {
+        R_ReleaseObject(batch_);
+    }
+
+    ItemCollector(const ItemCollector&) = delete;
+    ItemCollector& operator=(const ItemCollector&) = delete;
+
+    bool found() const { return found_; }
+
+    // Pass the items collected so far to the callback
+    void flush() {
+        if (n_items_ == 0) return;
+
+        SEXP batch = batch_;
+        if (n_items_ < opts_.batch_size) {
+            batch = Rf_xlengthgets(batch_, n_items_);
+        }
+        PROTECT(batch);
+        run_callback(callback_, batch, filepath_);
+        UNPROTECT(1);
+
+        // Start a fresh batch so the old one can be collected
+        SEXP fresh = Rf_allocVector(VECSXP, opts_.batch_size);
+        R_PreserveObject(fresh);
+        R_ReleaseObject(batch_);
+        batch_ = fresh;
+        n_items_ = 0;
+
+        R_CheckUserInterrupt();
+    }
+
+    void null_value() override {
+        if (!forward_value()) return;
+        builder_.null_value();
+        value_done();
+    }
+
+    void bool_value(bool v) override {
+        if (!forward_value()) return;
+        builder_.bool_value(v);
+        value_done();
+    }
+
+    void int_value(int64_t v) override {
+        if (!forward_value()) return;
+        builder_.int_value(v);
+        value_done();
+    }
+
+    void double_value(double v) override {
+        if (!forward_value()) return;
+        builder_.double_value(v);
+        value_done();
+    }
+
+    void string_value(std::string_view v) override {
+        if (!forward_value()) return;
+        builder_.string_value(v);
+        value_done();
+    }
+
+    void start_array(size_t declared, const TabularHeader* header) override {
+        if (in_target_) {
+            builder_.start_array(declared, header);
+            nested_++;
+            return;
+        }
+        if (target_is_next()) {
+            in_target_ = found_ = true;
+            key_matched_ = false;
+            tabular_ = header != nullptr;
+            if (header) fields_ = header->fields;
+            return;
+        }
+        depth_++;
+    }
+
+    void end_array() override {
+        if (!in_target_) {
+            depth_--;
+            return;
+        }
+        if (nested_ == 0) {
+            flush();
+            throw TargetDone();
+        }
+        builder_.end_array();
+        nested_--;
+        value_done();
+    }
+
+    void start_object() override {
+        if (in_target_) {
+            builder_.start_object();
+            nested_++;
+            return;
+        }
+        if (target_is_next()) not_an_array();
+        depth_++;
+    }
+
+    void key(std::string_view k, size_t replaces) override {
+        if (in_target_) {
+            builder_.key(k, replaces);
+        } else if (opts_.key && depth_ == 1) {
+            // Member of the root object
+            key_matched_ = !found_ && k == *opts_.key;
+        }
+    }
+
+    void field_key(size_t index) override {
+        if (!in_target_) return;
+        if (tabular_ && nested_ == 1) {
+            // A row of the target itself: its header was not forwarded
+            builder_.key(fields_[index], NEW_KEY);
+        } else {
+            builder_.field_key(index);
+        }
+    }
+
+    void end_object() override {
+        if (!in_target_) {
+            depth_--;
+            return;
+        }
+        builder_.end_object();
+        nested_--;
+        value_done();
+    }
+
+private:
+    // The next value is the target: the root value, or the value of the
+    // root member named key
+    bool target_is_next() const {
+        return opts_.key ? key_matched_ : (depth_ == 0 && !found_);
+    }
+
+    [[noreturn]] void not_an_array() const {
+        if (opts_.key) {
+            throw ParseError("Value at key '" + *opts_.key + "' is not an array", 0, 0, "", filepath_);
+        }
+        throw ParseError("Root value is not an array", 0, 0, "", filepath_);
+    }
+
+    // True if a value event belongs to an item and must be forwarded
+    bool forward_value() {
+        if (in_target_) return true;
+        if (target_is_next()) not_an_array();
+        return false;
+    }
+
+    // Collect the item once its outermost value is complete
+    void value_done() {
+        if (nested_ > 0) return;
+        SET_VECTOR_ELT(batch_, n_items_++, builder_.result());
+        if (n_items_ == opts_.batch_size) {
+            flush();
+        }
+    }
+
+    const StreamOptions& opts_;
+    SEXP callback_;
+    const std::string& filepath_;
+    SexpBuilder builder_;
+
+    SEXP batch_;
+    size_t n_items_ = 0;
+
+    size_t depth_ = 0;          // Containers open outside the target
+    bool key_matched_ = false;  // Last root member key was opts_.key
+    bool in_target_ = false;
+    bool found_ = false;
+    size_t nested_ = 0;         // Containers open within the current item
+    bool tabular_ = false;
+    std::vector<std::string> fields_;
+};
+
+} // namespace
+
 ItemStreamer::ItemStreamer(const std::string& filepath, const StreamOptions& opts)
     : filepath_(filepath), opts_(opts) {}
 
 void ItemStreamer::stream(SEXP callback) {
-    // Parse as general TOON and stream array items
-    // For simplicity, use the general parser
-    BufferedReader reader(filepath_);
-    if (reader.has_error()) {
-        throw ParseError(reader.error_message(), 0, 0, "", filepath_);
+    ParseOptions parse_opts;
+    parse_opts.strict = opts_.strict;
+    parse_opts.simplify = opts_.simplify;
+    parse_opts.allow_comments = opts_.allow_comments;
+    parse_opts.allow_duplicate_keys = opts_.allow_duplicate_keys;
+    parse_opts.warn = opts_.warn;
+
+    Parser parser(parse_opts);
+    ItemCollector collector(opts_, callback, filepath_);
+    try {
+        parser.parse_file(filepath_, collector);
+    } catch (const TargetDone&) {
+        // Rest of the input is not needed
     }
+    warnings_ = parser.warnings();
 
-    // This is a simplified implementation - full implementation would
-    // parse and stream items incrementally
-    // For now, throw not implemented
-    throw ParseError("Item streaming not fully implemented in this version", 0, 0, "", filepath_);
+    if (!collector.found()) {
+        if (opts_.key) {
+            throw ParseError("Key '" + *opts_.key + "' not found in root object", 0, 0, "", filepath_);
+        }
+        throw ParseError("No array found", 0, 0, "", filepath_);
+    }
 }
 
 // StreamWriter implementation
-StreamWriter::StreamWriter(const std::string& filepath, const std::vector<std::string>& schema, int indent)
-    : filepath_(filepath), schema_(schema), indent_(indent) {
-    file_.open(filepath, std::ios::binary);
+StreamWriter::StreamWriter(const std::string& filepath, const std::vector<std::string>& schema,
+                           const StreamWriterOptions& opts)
+    : filepath_(filepath), schema_(schema), opts_(opts),
+      file_(filepath), out_(std::min(opts.buffer_size, WriteBuffer::DEFAULT_CAPACITY)) {
     if (!file_.is_open()) {
         throw ParseError("Cannot open file for writing: " + filepath, 0, 0, "", filepath);
     }
@@ -399,93 +793,128 @@ StreamWriter::~StreamWriter() {
     }
 }
 
-void StreamWriter::write_header() {
-    if (header_written_) return;
+void write_counted_header(OutputFile& file, const std::vector<std::string>& fields) {
+    // Fixed-width placeholder (12 digits supports up to 999 billion rows);
+    // just the count is overwritten at the end
+    WriteBuffer out(0);
+    out.append("[000000000000]{", 15);
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (i > 0) out.append_char(',');
+        out.append(fields[i]);
+    }
+    out.append("}:\n", 3);
+    file.write_patchable(out.view());
+}
 
-    // Write fixed-width placeholder header (12 digits supports up to 999 billion rows)
-    // Format: [000000000000]{field1,field2,...}:
-    // We'll overwrite just the count at close() using seek
-    file_ << "[000000000000]{";
-    for (size_t i = 0; i < schema_.size(); i++) {
-        if (i > 0) file_ << ",";
-        file_ << schema_[i];
+bool patch_row_count(const std::string& filepath, size_t rows) {
+    std::fstream update(filepath, std::ios::binary | std::ios::in | std::ios::out);
+    if (!update.is_open()) {
+        return false;
     }
-    file_ << "}:\n";
 
-    header_written_ = true;
+    // Overwrite the 12-digit placeholder right after '['
+    char count_buf[13];
+    snprintf(count_buf, sizeof(count_buf), "%012zu", rows);
+    bool ok = patch_stored_prefix(update, 1, std::string_view(count_buf, 12));
+    update.close();
+    return ok && static_cast<bool>(update);
 }
 
-void StreamWriter::write_row(SEXP df, R_xlen_t row) {
-    R_xlen_t ncol = Rf_xlength(df);
-
-    for (int i = 0; i < indent_; i++) {
-        file_ << ' ';
-    }
+void StreamWriter::write_header() {
+    if (header_written_) return;
 
-    for (R_xlen_t j = 0; j < ncol; j++) {
-        if (j > 0) file_ << ", ";
+    write_counted_header(file_, schema_);
+    header_written_ = true;
+}
 
-        SEXP col = VECTOR_ELT(df, j);
+void StreamWriter::flush_buffer() {
+    if (out_.size() > 0) {
+        std::string_view data = out_.view();
+        file_.write(data.data(), static_cast<std::streamsize>(data.size()));
+        out_.clear();
+    }
+    if (opts_.flush_batch) {
+        file_.flush();
+    }
+    if (!file_.good()) {
+        throw ParseError("Error writing to file: " + filepath_, 0, 0, "", filepath_);
+    }
+}
 
-        switch (TYPEOF(col)) {
-            case LGLSXP: {
-                int val = LOGICAL(col)[row];
+void StreamWriter::format_column(SEXP col, R_xlen_t nrow, CellColumn& cells) {
+    WriteBuffer& text = cells.text;
+    text.clear();
+    cells.ends.resize(static_cast<size_t>(nrow));
+    size_t* ends = cells.ends.data();
+
+    switch (TYPEOF(col)) {
+        case LGLSXP: {
+            const int* data = LOGICAL(col);
+            for (R_xlen_t i = 0; i < nrow; i++) {
+                int val = data[i];
                 if (val == NA_LOGICAL) {
-                    file_ << "null";
+                    text.append("null", 4);
+                } else if (val) {
+                    text.append("true", 4);
                 } else {
-                    file_ << (val ? "true" : "false");
+                    text.append("false", 5);
                 }
-                break;
+                ends[i] = text.size();
             }
-            case INTSXP: {
-                int val = INTEGER(col)[row];
+            break;
+        }
+        case INTSXP: {
+            const int* data = INTEGER(col);
+            SEXP levels = Rf_isFactor(col) ? Rf_getAttrib(col, R_LevelsSymbol) : R_NilValue;
+            R_xlen_t nlevels = Rf_isNull(levels) ? 0 : Rf_xlength(levels);
+            for (R_xlen_t i = 0; i < nrow; i++) {
+                int val = data[i];
                 if (val == NA_INTEGER) {
-                    file_ << "null";
+                    text.append("null", 4);
+                } else if (Rf_isNull(levels)) {
+                    text.append_int(val);
+                } else if (val >= 1 && val <= nlevels) {
+                    SEXP level = STRING_ELT(levels, val - 1);
+                    text.append_escaped_string(std::string_view(CHAR(level), LENGTH(level)));
                 } else {
-                    file_ << val;
+                    text.append("null", 4);
                 }
-                break;
+                ends[i] = text.size();
             }
-            case REALSXP: {
-                double val = REAL(col)[row];
-                if (ISNA(val) || ISNAN(val)) {
-                    file_ << "null";
+            break;
+        }
+        case REALSXP: {
+            const double* data = REAL(col);
+            for (R_xlen_t i = 0; i < nrow; i++) {
+                double val = data[i];
+                if (!std::isfinite(val)) {
+                    text.append("null", 4);
                 } else {
-                    file_ << std::setprecision(17) << val;
+                    text.append_double(val);
                 }
-                break;
+                ends[i] = text.size();
             }
-            case STRSXP: {
-                SEXP elem = STRING_ELT(col, row);
+            break;
+        }
+        case STRSXP: {
+            for (R_xlen_t i = 0; i < nrow; i++) {
+                SEXP elem = STRING_ELT(col, i);
                 if (elem == NA_STRING) {
-                    file_ << "null";
+                    text.append("null", 4);
                 } else {
-                    // Write escaped string
-                    file_ << '"';
-                    const char* s = CHAR(elem);
-                    while (*s) {
-                        switch (*s) {
-                            case '"': file_ << "\\\""; break;
-                            case '\\': file_ << "\\\\"; break;
-                            case '\n': file_ << "\\n"; break;
-                            case '\r': file_ << "\\r"; break;
-                            case '\t': file_ << "\\t"; break;
-                            default: file_ << *s; break;
-                        }
-                        s++;
-                    }
-                    file_ << '"';
+                    text.append_escaped_string(std::string_view(CHAR(elem), LENGTH(elem)));
                 }
-                break;
+                ends[i] = text.size();
             }
-            default:
-                file_ << "null";
-                break;
+            break;
         }
+        default:
+            for (R_xlen_t i = 0; i < nrow; i++) {
+                text.append("null", 4);
+                ends[i] = text.size();
+            }
+            break;
     }
-
-    file_ << '\n';
-    rows_written_++;
 }
 
 void StreamWriter::write_batch(SEXP df_batch) {
@@ -493,33 +922,50 @@ void StreamWriter::write_batch(SEXP df_batch) {
         write_header();
     }
 
+    R_xlen_t ncol = Rf_xlength(df_batch);
+    if (ncol == 0) return;
     R_xlen_t nrow = Rf_xlength(VECTOR_ELT(df_batch, 0));
+
+    // Format every column first so type dispatch happens once per column
+    if (cells_.size() < static_cast<size_t>(ncol)) {
+        cells_.resize(static_cast<size_t>(ncol));
+    }
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        format_column(VECTOR_ELT(df_batch, j), nrow, cells_[j]);
+    }
+
+    const std::string indent(static_cast<size_t>(std::max(opts_.indent, 0)), ' ');
     for (R_xlen_t i = 0; i < nrow; i++) {
-        write_row(df_batch, i);
+        out_.append(indent);
+        for (R_xlen_t j = 0; j < ncol; j++) {
+            if (j > 0) out_.append(", ", 2);
+            const CellColumn& c = cells_[j];
+            size_t begin = i == 0 ? 0 : c.ends[i - 1];
+            out_.append(c.text.view().substr(begin, c.ends[i] - begin));
+        }
+        out_.append_char('\n');
+
+        if (out_.size() >= opts_.buffer_size) {
+            flush_buffer();
+        }
+    }
+    rows_written_ += static_cast<size_t>(nrow);
+
+    if (opts_.flush_batch) {
+        flush_buffer();
     }
 }
 
 void StreamWriter::close() {
     if (closed_) return;
+    closed_ = true;
 
+    write_header();
+    flush_buffer();
     file_.close();
 
-    // Update the header row count in-place using seek
-    // Header format is: [000000000000]{...}:
-    // We need to overwrite the 12-digit placeholder at position 1 (after '[')
-    std::fstream update(filepath_, std::ios::binary | std::ios::in | std::ios::out);
-    if (update.is_open()) {
-        // Format count as 12-digit zero-padded number
-        char count_buf[13];
-        snprintf(count_buf, sizeof(count_buf), "%012zu", rows_written_);
-
-        // Seek to position 1 (right after '[') and overwrite
-        update.seekp(1, std::ios::beg);
-        update.write(count_buf, 12);
-        update.close();
-    }
-
-    closed_ = true;
+    // Fill in the header row count in place
+    patch_row_count(filepath_, rows_written_);
 }
 
 } // namespace toonlite
@@ -27,6 +27,14 @@ struct StreamOptions {
     std::optional<std::string> key;
     std::vector<std::pair<std::string, ColType>> col_types;
     size_t batch_size = 10000;
+    bool as_factor = false;
+    std::vector<std::string> select;   // Fields to keep (empty: all)
+    std::vector<RowFilter> filters;    // Rows to keep
+    size_t row_start = 0;              // First row to stream (0-based)
+    std::string index_file;            // Row index to use ("" if none)
+    ReaderOptions io;                  // Buffering and read-ahead
+    size_t sample_rows = 0;            // Rows sampled to lock types (0: none)
+    bool pipeline = false;             // Parse the next batch during the callback
 };
 
 // Row streaming parser
@@ -40,11 +48,40 @@ public:
     // Get accumulated warnings
     const std::vector<Warning>& warnings() const { return warnings_; }
 
-private:
-    void process_batch();
+    // Find the tabular header, false if there is none. Its fields are then
+    // in field_names() and its [N] in declared_rows().
     bool find_tabular_header();
+    const std::vector<std::string>& field_names() const { return field_names_; }
+    size_t declared_rows() const { return declared_rows_; }
+
+    // Next data row, trimmed and with any trailing comment removed; blank
+    // and comment lines are skipped. False at end of input.
+    bool next_row(std::string_view& row, size_t& line_no);
+
+private:
+    // Rows of one batch, parsed into columns that are reused for later
+    // batches once handed back
+    struct Batch {
+        std::vector<ColBuilder> columns;
+        size_t rows = 0;
+    };
+
+    // Empty the batch, with a column per field starting at its type in
+    // batch_types_
+    void start_batch(Batch& batch);
+
+    // Parse rows into a started batch until it is full or the rows end.
+    // Only the reader and parse state are touched, so a worker thread may
+    // call it; false if there were no rows.
+    bool fill_batch(Batch& batch, bool check_interrupts);
+
+    // Widen the locked types to those the batch reached (sample_rows)
+    void escalate_types(const Batch& batch);
+
+    // Parse batches on a worker thread, one ahead, passing each to emit on
+    // this thread (the only one to use R). Returns the worker's parse time.
+    double stream_pipelined(const std::function<void(Batch&)>& emit);
     bool parse_header(std::string_view header);
-    std::vector<std::string_view> split_row(std::string_view line, char delimiter);
     std::string_view trim(std::string_view sv);
 
     std::string filepath_;
@@ -52,15 +89,22 @@ private:
     std::unique_ptr<BufferedReader> reader_;
     std::vector<Warning> warnings_;
 
-    // Schema
+    // Schema: names of the output columns (the selected fields if any)
     std::vector<std::string> field_names_;
+    size_t header_columns_ = 0;
     size_t declared_rows_ = 0;
-    size_t observed_rows_ = 0;
+    size_t observed_rows_ = 0;     // rows read, including filtered ones
     char delimiter_ = ',';
+    RowProjection projection_;
+    std::vector<std::string_view> row_fields_;
 
-    // Batch accumulation
-    std::vector<ColBuilder> batch_columns_;
-    size_t batch_rows_ = 0;
+    // Every batch starts its columns at batch_types_: the col_types, and
+    // with sample_rows the sampled types, which are then locked and only
+    // widened when a batch holds values that do not fit.
+    size_t skip_rows_ = 0;
+    size_t check_interrupt_counter_ = 0;
+    std::vector<ColType> batch_types_;
+    std::vector<std::pair<size_t, ColType>> escalated_;  // column, sampled type
 
     // Ragged row tracking
     size_t min_fields_ = SIZE_MAX;
@@ -84,10 +128,30 @@ private:
     std::vector<Warning> warnings_;
 };
 
-// Streaming writer for tabular data
+// Write a tabular header with a placeholder row count, [000000000000]{...}:,
+// at the start of file so that patch_row_count() can fill it in
+void write_counted_header(OutputFile& file, const std::vector<std::string>& fields);
+
+// Fill in the row count of a header written by write_counted_header at
+// the start of filepath; false if the file cannot be updated
+bool patch_row_count(const std::string& filepath, size_t rows);
+
+// Options for StreamWriter
+struct StreamWriterOptions {
+    int indent = 2;
+    // Bytes to accumulate before writing to the file
+    size_t buffer_size = WriteBuffer::DEFAULT_CAPACITY;
+    // Write and flush the file at the end of every batch
+    bool flush_batch = false;
+};
+
+// Streaming writer for tabular data. Each batch is formatted column by
+// column into per-column cell buffers, then interleaved into rows in an
+// output WriteBuffer that is written to the file in large chunks.
 class StreamWriter {
 public:
-    StreamWriter(const std::string& filepath, const std::vector<std::string>& schema, int indent = 2);
+    StreamWriter(const std::string& filepath, const std::vector<std::string>& schema,
+                 const StreamWriterOptions& opts = StreamWriterOptions());
     ~StreamWriter();
 
     // Write a batch of rows
@@ -97,16 +161,25 @@ public:
     void close();
 
 private:
+    // Formatted cells of one column, laid end to end
+    struct CellColumn {
+        WriteBuffer text{0};
+        std::vector<size_t> ends;
+    };
+
     std::string filepath_;
     std::vector<std::string> schema_;
-    int indent_;
-    std::ofstream file_;
+    StreamWriterOptions opts_;
+    OutputFile file_;
+    WriteBuffer out_;
+    std::vector<CellColumn> cells_;
     size_t rows_written_ = 0;
     bool header_written_ = false;
     bool closed_ = false;
 
     void write_header();
-    void write_row(SEXP df, R_xlen_t row);
+    void format_column(SEXP col, R_xlen_t nrow, CellColumn& cells);
+    void flush_buffer();
 };
 
 } // namespace toonlite
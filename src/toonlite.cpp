@@ -1,6 +1,7 @@
 // Include C++ standard library headers BEFORE R headers
 // to avoid conflicts with R macros like 'length'
 #include <string>
+#include <algorithm>
 #include <string_view>
 #include <vector>
 #include <variant>
@@ -10,6 +11,7 @@
 #include <unordered_map>
 #include <fstream>
 #include <cmath>
+#include <cstdio>
 
 #include <R.h>
 #include <Rinternals.h>
@@ -25,156 +27,96 @@
 #include "toon_encoder.h"
 #include "toon_df.h"
 #include "toon_stream.h"
+#include "toon_csv.h"
+#include "toon_arrow.h"
+#include "toon_cache.h"
+#include "toon_sexp.h"
 #include "toon_errors.h"
 
 using namespace toonlite;
 
-// Helper to convert Node to SEXP
-static SEXP node_to_sexp(const NodePtr& node, bool simplify) {
-    if (!node) return R_NilValue;
-
-    switch (node->kind) {
-        case NodeKind::N_NULL:
-            return R_NilValue;
-
-        case NodeKind::N_BOOL: {
-            SEXP result = PROTECT(Rf_allocVector(LGLSXP, 1));
-            LOGICAL(result)[0] = node->bool_val ? TRUE : FALSE;
-            UNPROTECT(1);
-            return result;
-        }
+// Add the size of a finished output file to the active profile
+static void record_output(const std::string& filepath) {
+    Stats* st = stats::active();
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if (st && file_stamp(filepath, size, mtime)) {
+        st->bytes_written += static_cast<size_t>(size);
+    }
+}
 
-        case NodeKind::N_INT: {
-            SEXP result = PROTECT(Rf_allocVector(INTSXP, 1));
-            INTEGER(result)[0] = static_cast<int>(node->int_val);
-            UNPROTECT(1);
-            return result;
-        }
+// Helper to make a CHARSXP from a view into the document's string arena
+static inline SEXP mk_char(std::string_view sv) {
+    return make_charsxp(sv);
+}
 
-        case NodeKind::N_DOUBLE: {
-            SEXP result = PROTECT(Rf_allocVector(REALSXP, 1));
-            REAL(result)[0] = node->double_val;
-            UNPROTECT(1);
-            return result;
+// Field names of a select argument (NULL: all fields)
+static std::vector<std::string> parse_select(SEXP select) {
+    std::vector<std::string> names;
+    if (select != R_NilValue) {
+        for (R_xlen_t i = 0; i < Rf_xlength(select); i++) {
+            names.push_back(CHAR(STRING_ELT(select, i)));
         }
+    }
+    return names;
+}
 
-        case NodeKind::N_STRING: {
-            SEXP result = PROTECT(Rf_allocVector(STRSXP, 1));
-            SET_STRING_ELT(result, 0, Rf_mkCharCE(node->string_val.c_str(), CE_UTF8));
-            UNPROTECT(1);
-            return result;
-        }
-
-        case NodeKind::N_ARRAY: {
-            size_t n = node->array_items.size();
-
-            if (simplify && n > 0) {
-                // Check if all items are same primitive type
-                NodeKind first_kind = node->array_items[0]->kind;
-                bool all_same = true;
-                bool all_primitive = true;
-
-                for (const auto& item : node->array_items) {
-                    if (item->kind == NodeKind::N_ARRAY || item->kind == NodeKind::N_OBJECT) {
-                        all_primitive = false;
-                        break;
-                    }
-                    if (item->kind != first_kind && item->kind != NodeKind::N_NULL) {
-                        if (first_kind == NodeKind::N_NULL) {
-                            first_kind = item->kind;
-                        } else {
-                            all_same = false;
-                        }
-                    }
-                }
-
-                if (all_primitive && all_same) {
-                    // Convert to atomic vector
-                    switch (first_kind) {
-                        case NodeKind::N_BOOL: {
-                            SEXP result = PROTECT(Rf_allocVector(LGLSXP, n));
-                            int* data = LOGICAL(result);
-                            for (size_t i = 0; i < n; i++) {
-                                if (node->array_items[i]->kind == NodeKind::N_NULL) {
-                                    data[i] = NA_LOGICAL;
-                                } else {
-                                    data[i] = node->array_items[i]->bool_val ? TRUE : FALSE;
-                                }
-                            }
-                            UNPROTECT(1);
-                            return result;
-                        }
-                        case NodeKind::N_INT: {
-                            SEXP result = PROTECT(Rf_allocVector(INTSXP, n));
-                            int* data = INTEGER(result);
-                            for (size_t i = 0; i < n; i++) {
-                                if (node->array_items[i]->kind == NodeKind::N_NULL) {
-                                    data[i] = NA_INTEGER;
-                                } else {
-                                    data[i] = static_cast<int>(node->array_items[i]->int_val);
-                                }
-                            }
-                            UNPROTECT(1);
-                            return result;
-                        }
-                        case NodeKind::N_DOUBLE: {
-                            SEXP result = PROTECT(Rf_allocVector(REALSXP, n));
-                            double* data = REAL(result);
-                            for (size_t i = 0; i < n; i++) {
-                                if (node->array_items[i]->kind == NodeKind::N_NULL) {
-                                    data[i] = NA_REAL;
-                                } else {
-                                    data[i] = node->array_items[i]->double_val;
-                                }
-                            }
-                            UNPROTECT(1);
-                            return result;
-                        }
-                        case NodeKind::N_STRING: {
-                            SEXP result = PROTECT(Rf_allocVector(STRSXP, n));
-                            for (size_t i = 0; i < n; i++) {
-                                if (node->array_items[i]->kind == NodeKind::N_NULL) {
-                                    SET_STRING_ELT(result, i, NA_STRING);
-                                } else {
-                                    SET_STRING_ELT(result, i,
-                                        Rf_mkCharCE(node->array_items[i]->string_val.c_str(), CE_UTF8));
-                                }
-                            }
-                            UNPROTECT(1);
-                            return result;
-                        }
-                        default:
-                            break;
-                    }
-                }
-            }
-
-            // Return as list
-            SEXP result = PROTECT(Rf_allocVector(VECSXP, n));
-            for (size_t i = 0; i < n; i++) {
-                SET_VECTOR_ELT(result, i, node_to_sexp(node->array_items[i], simplify));
-            }
-            UNPROTECT(1);
-            return result;
-        }
+// Column types from a named character vector of R type names
+static std::vector<std::pair<std::string, ColType>> parse_col_types(SEXP col_types) {
+    std::vector<std::pair<std::string, ColType>> types;
+    if (col_types == R_NilValue || Rf_xlength(col_types) == 0) {
+        return types;
+    }
+    SEXP ct_names = Rf_getAttrib(col_types, R_NamesSymbol);
+    for (R_xlen_t i = 0; i < Rf_xlength(col_types); i++) {
+        std::string name(CHAR(STRING_ELT(ct_names, i)));
+        std::string type_str(CHAR(STRING_ELT(col_types, i)));
+
+        ColType ctype = ColType::STRING;
+        if (type_str == "logical") ctype = ColType::LOGICAL;
+        else if (type_str == "integer") ctype = ColType::INTEGER;
+        else if (type_str == "double") ctype = ColType::DOUBLE;
+        else if (type_str == "character") ctype = ColType::STRING;
+
+        types.push_back({name, ctype});
+    }
+    return types;
+}
 
-        case NodeKind::N_OBJECT: {
-            size_t n = node->object_items.size();
-            SEXP result = PROTECT(Rf_allocVector(VECSXP, n));
-            SEXP names = PROTECT(Rf_allocVector(STRSXP, n));
+// Reader options from c(prefetch, buffer_size), checked in R
+static ReaderOptions parse_reader_options(SEXP io) {
+    ReaderOptions opts;
+    if (io != R_NilValue) {
+        opts.prefetch = static_cast<size_t>(REAL(io)[0]);
+        opts.buffer_size = static_cast<size_t>(REAL(io)[1]);
+    }
+    return opts;
+}
 
-            for (size_t i = 0; i < n; i++) {
-                SET_STRING_ELT(names, i, Rf_mkCharCE(node->object_items[i].first.c_str(), CE_UTF8));
-                SET_VECTOR_ELT(result, i, node_to_sexp(node->object_items[i].second, simplify));
+// Row filters from a named list, normalized in R: each element is either a
+// character vector of values or a numeric c(min, max)
+static std::vector<RowFilter> parse_filters(SEXP filter) {
+    std::vector<RowFilter> filters;
+    if (filter == R_NilValue) {
+        return filters;
+    }
+    SEXP names = Rf_getAttrib(filter, R_NamesSymbol);
+    for (R_xlen_t i = 0; i < Rf_xlength(filter); i++) {
+        SEXP cond = VECTOR_ELT(filter, i);
+        RowFilter f;
+        f.column = CHAR(STRING_ELT(names, i));
+        if (TYPEOF(cond) == REALSXP) {
+            f.is_range = true;
+            f.min = REAL(cond)[0];
+            f.max = REAL(cond)[1];
+        } else {
+            for (R_xlen_t j = 0; j < Rf_xlength(cond); j++) {
+                f.values.push_back(CHAR(STRING_ELT(cond, j)));
             }
-
-            Rf_setAttrib(result, R_NamesSymbol, names);
-            UNPROTECT(2);
-            return result;
         }
+        filters.push_back(std::move(f));
     }
-
-    return R_NilValue;
+    return filters;
 }
 
 // Helper to emit warnings from parser
@@ -184,6 +126,75 @@ static void emit_warnings(const std::vector<Warning>& warnings) {
     }
 }
 
+// Columns of df named in select, in that order
+static SEXP select_columns(SEXP df, const std::vector<std::string>& select,
+                           const std::string& file) {
+    SEXP names = Rf_getAttrib(df, R_NamesSymbol);
+    R_xlen_t ncol = static_cast<R_xlen_t>(select.size());
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, ncol));
+    SEXP out_names = PROTECT(Rf_allocVector(STRSXP, ncol));
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        R_xlen_t k = 0;
+        while (k < Rf_xlength(names) && select[j] != CHAR(STRING_ELT(names, k))) k++;
+        if (k == Rf_xlength(names)) {
+            throw ParseError("Column not found: " + select[j], 0, 0, "", file);
+        }
+        SET_VECTOR_ELT(out, j, VECTOR_ELT(df, k));
+        SET_STRING_ELT(out_names, j, STRING_ELT(names, k));
+    }
+    size_t nrow = Rf_xlength(df) > 0 ? static_cast<size_t>(Rf_xlength(VECTOR_ELT(df, 0))) : 0;
+    set_dataframe_attrs(out, out_names, nrow);
+    UNPROTECT(2);
+    return out;
+}
+
+// Read a tabular file through the cache at cache_path: build the result
+// from the cache if it holds this read of the file, else parse the file
+// and write the cache. The cache holds every column, so it serves any
+// select.
+static SEXP read_toon_df_cached(const std::string& filepath, const std::string& cache_path,
+                                const TabularParseOptions& opts) {
+    CacheKey key;
+    bool keyed = CacheKey::of(filepath, opts, key);
+    if (keyed) {
+        PhaseTimer timer("cache");
+        TableCache cache;
+        if (cache.open(cache_path, key)) {
+            SEXP df = PROTECT(cache.build(opts.select, opts.as_factor, filepath));
+            if (Stats* st = stats::active()) {
+                st->bytes_read += cache.bytes();
+                st->rows += cache.rows();
+                st->allocations += static_cast<size_t>(Rf_xlength(df)) + 1;
+            }
+            emit_warnings(cache.warnings());
+            UNPROTECT(1);
+            return df;
+        }
+    }
+
+    TabularParseOptions all = opts;
+    all.select.clear();
+    TabularParser parser(all);
+    SEXP df = PROTECT(parser.parse_file(filepath));
+    std::vector<Warning> warnings = parser.warnings();
+    if (keyed) {
+        PhaseTimer timer("cache");
+        try {
+            TableCache::save(cache_path, key, df, warnings);
+            record_output(cache_path);
+        } catch (const ParseError& e) {
+            warnings.push_back(Warning("cache", std::string(e.what()) + "; the read was not cached."));
+        }
+    }
+    if (!opts.select.empty()) {
+        df = select_columns(df, opts.select, filepath);
+    }
+    PROTECT(df);
+    emit_warnings(warnings);
+    UNPROTECT(2);
+    return df;
+}
+
 extern "C" {
 
 // Parse TOON string to R object
@@ -208,10 +219,11 @@ SEXP C_from_toon(SEXP text, SEXP strict, SEXP simplify, SEXP allow_comments, SEX
             len = strlen(data);
         }
 
-        NodePtr node = parser.parse_string(data, len);
+        SexpBuilder builder(opts.simplify);
+        parser.parse_string(data, len, builder);
         emit_warnings(parser.warnings());
 
-        return node_to_sexp(node, opts.simplify);
+        return builder.result();
     } catch (const ParseError& e) {
         Rf_error("%s", e.formatted_message().c_str());
     } catch (const std::exception& e) {
@@ -233,10 +245,15 @@ SEXP C_read_toon(SEXP file, SEXP strict, SEXP simplify, SEXP allow_comments, SEX
         Parser parser(opts);
         std::string filepath(CHAR(STRING_ELT(file, 0)));
 
-        NodePtr node = parser.parse_file(filepath);
+        SexpBuilder builder(opts.simplify);
+        {
+            PhaseTimer timer("parse");
+            parser.parse_file(filepath, builder);
+        }
         emit_warnings(parser.warnings());
+        if (Stats* st = stats::active()) st->strings_created += builder.strings_created();
 
-        return node_to_sexp(node, opts.simplify);
+        return builder.result();
     } catch (const ParseError& e) {
         Rf_error("%s", e.formatted_message().c_str());
     } catch (const std::exception& e) {
@@ -255,10 +272,10 @@ SEXP C_to_toon(SEXP x, SEXP pretty, SEXP indent, SEXP strict) {
         opts.strict = Rf_asLogical(strict) == TRUE;
 
         Encoder encoder(opts);
-        std::string result = encoder.encode(x);
+        std::string_view result = encoder.encode_view(x);
 
         SEXP out = PROTECT(Rf_allocVector(STRSXP, 1));
-        SET_STRING_ELT(out, 0, Rf_mkCharCE(result.c_str(), CE_UTF8));
+        SET_STRING_ELT(out, 0, Rf_mkCharLenCE(result.data(), static_cast<int>(result.size()), CE_UTF8));
 
         // Set class
         SEXP class_attr = PROTECT(Rf_allocVector(STRSXP, 1));
@@ -276,22 +293,166 @@ SEXP C_to_toon(SEXP x, SEXP pretty, SEXP indent, SEXP strict) {
     return R_NilValue;
 }
 
+// Encode to a file through a bounded buffer
+SEXP C_write_toon(SEXP x, SEXP file, SEXP pretty, SEXP indent, SEXP strict) {
+    try {
+        std::string filepath(CHAR(STRING_ELT(file, 0)));
+        EncodeOptions opts;
+        opts.pretty = Rf_asLogical(pretty) == TRUE;
+        opts.indent = Rf_asInteger(indent);
+        opts.strict = Rf_asLogical(strict) == TRUE;
+
+        // Encoded beside the target, which is only replaced once the whole
+        // document is written
+        std::string tmp = filepath + ".tmp";
+        OutputFile out(tmp, compression_for_path(filepath));
+        if (!out.is_open()) {
+            throw ParseError("Cannot open file for writing: " + tmp);
+        }
+
+        Encoder encoder(opts);
+        try {
+            {
+                PhaseTimer timer("encode");
+                encoder.encode_to(x, out);
+                out.put('\n');
+                out.close();
+            }
+            if (!out) {
+                throw ParseError("Error writing to file: " + filepath);
+            }
+        } catch (...) {
+            // Do not leave a partial document behind
+            out.close();
+            std::remove(tmp.c_str());
+            throw;
+        }
+        if (!replace_file(tmp, filepath)) {
+            throw ParseError("Error writing to file: " + filepath);
+        }
+        record_output(filepath);
+
+        return R_NilValue;
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error encoding to TOON: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
+// Character scalar, NA if s is empty
+static SEXP string_or_na(const std::string& s) {
+    SEXP out = PROTECT(Rf_allocVector(STRSXP, 1));
+    SET_STRING_ELT(out, 0, s.empty() ? NA_STRING : Rf_mkCharCE(s.c_str(), CE_UTF8));
+    UNPROTECT(1);
+    return out;
+}
+
+// Structured error object for validate_toon: type, message, line, column,
+// snippet, file
+static SEXP validation_error_info(const std::string& message, size_t line, size_t column,
+                                  const std::string& snippet, const std::string& file) {
+    SEXP error_info = PROTECT(Rf_allocVector(VECSXP, 6));
+    SEXP error_names = PROTECT(Rf_allocVector(STRSXP, 6));
+
+    SET_STRING_ELT(error_names, 0, Rf_mkChar("type"));
+    SET_STRING_ELT(error_names, 1, Rf_mkChar("message"));
+    SET_STRING_ELT(error_names, 2, Rf_mkChar("line"));
+    SET_STRING_ELT(error_names, 3, Rf_mkChar("column"));
+    SET_STRING_ELT(error_names, 4, Rf_mkChar("snippet"));
+    SET_STRING_ELT(error_names, 5, Rf_mkChar("file"));
+
+    SET_VECTOR_ELT(error_info, 0, Rf_mkString("parse_error"));
+    SET_VECTOR_ELT(error_info, 1, string_or_na(message));
+    SET_VECTOR_ELT(error_info, 2, Rf_ScalarInteger(line > 0 ? static_cast<int>(line) : NA_INTEGER));
+    SET_VECTOR_ELT(error_info, 3, Rf_ScalarInteger(column > 0 ? static_cast<int>(column) : NA_INTEGER));
+    SET_VECTOR_ELT(error_info, 4, string_or_na(snippet));
+    SET_VECTOR_ELT(error_info, 5, string_or_na(file));
+
+    Rf_setAttrib(error_info, R_NamesSymbol, error_names);
+    UNPROTECT(2);
+    return error_info;
+}
+
+// Error object of a failed element of from_toon(): its 1-based position,
+// then the components of a validation error
+static SEXP element_error_info(size_t index, const ParseError& e) {
+    SEXP info = PROTECT(validation_error_info(e.what(), e.line(), e.column(), e.snippet(),
+                                              e.file()));
+    SEXP info_names = Rf_getAttrib(info, R_NamesSymbol);
+    R_xlen_t n = Rf_xlength(info);
+
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, n + 1));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, n + 1));
+    SET_VECTOR_ELT(out, 0, Rf_ScalarInteger(static_cast<int>(index + 1)));
+    SET_STRING_ELT(names, 0, Rf_mkChar("index"));
+    for (R_xlen_t k = 0; k < n; k++) {
+        SET_VECTOR_ELT(out, k + 1, VECTOR_ELT(info, k));
+        SET_STRING_ELT(names, k + 1, STRING_ELT(info_names, k));
+    }
+    Rf_setAttrib(out, R_NamesSymbol, names);
+    UNPROTECT(3);
+    return out;
+}
+
+// Parse each element of a character vector of TOON documents into a list.
+// With on_error = "null" failed elements are NULL and their errors are
+// listed in attr(, "errors").
+SEXP C_from_toon_many(SEXP text, SEXP strict, SEXP simplify, SEXP allow_comments,
+                      SEXP allow_duplicate_keys, SEXP threads, SEXP on_error) {
+    try {
+        ParseOptions opts;
+        opts.strict = Rf_asLogical(strict) == TRUE;
+        opts.simplify = Rf_asLogical(simplify) == TRUE;
+        opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
+        opts.allow_duplicate_keys = Rf_asLogical(allow_duplicate_keys) == TRUE;
+        bool collect_errors = std::string(CHAR(STRING_ELT(on_error, 0))) == "null";
+
+        std::vector<std::pair<size_t, ParseError>> errors;
+        std::vector<Warning> warnings;
+        SEXP result = PROTECT(parse_documents(text, opts, Rf_asInteger(threads), collect_errors,
+                                              errors, warnings));
+        if (!errors.empty()) {
+            SEXP all = PROTECT(Rf_allocVector(VECSXP, errors.size()));
+            for (size_t k = 0; k < errors.size(); k++) {
+                SET_VECTOR_ELT(all, k, element_error_info(errors[k].first, errors[k].second));
+            }
+            Rf_setAttrib(result, Rf_install("errors"), all);
+            UNPROTECT(1);
+        }
+        emit_warnings(warnings);
+
+        UNPROTECT(1);
+        return result;
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error parsing TOON: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
 // Validate TOON text or file
-SEXP C_validate_toon(SEXP x, SEXP is_file, SEXP strict, SEXP allow_comments, SEXP allow_duplicate_keys) {
+SEXP C_validate_toon(SEXP x, SEXP is_file, SEXP strict, SEXP allow_comments, SEXP allow_duplicate_keys,
+                     SEXP max_errors) {
     ParseOptions opts;
     opts.strict = Rf_asLogical(strict) == TRUE;
     opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
     opts.allow_duplicate_keys = Rf_asLogical(allow_duplicate_keys) == TRUE;
+    size_t max_errs = static_cast<size_t>(std::max(Rf_asInteger(max_errors), 1));
 
     Parser parser(opts);
     ValidationResult vr;
 
     if (Rf_asLogical(is_file) == TRUE) {
         std::string filepath(CHAR(STRING_ELT(x, 0)));
-        vr = parser.validate_file(filepath);
+        vr = parser.validate_file(filepath, max_errs);
     } else {
         const char* text = CHAR(STRING_ELT(x, 0));
-        vr = parser.validate_string(text);
+        vr = parser.validate_string(text, max_errs);
     }
 
     // Create result
@@ -299,56 +460,32 @@ SEXP C_validate_toon(SEXP x, SEXP is_file, SEXP strict, SEXP allow_comments, SEX
     LOGICAL(result)[0] = vr.valid ? TRUE : FALSE;
 
     if (!vr.valid) {
-        // Attach error info
-        SEXP error_info = PROTECT(Rf_allocVector(VECSXP, 6));
-        SEXP error_names = PROTECT(Rf_allocVector(STRSXP, 6));
-
-        SET_STRING_ELT(error_names, 0, Rf_mkChar("type"));
-        SET_STRING_ELT(error_names, 1, Rf_mkChar("message"));
-        SET_STRING_ELT(error_names, 2, Rf_mkChar("line"));
-        SET_STRING_ELT(error_names, 3, Rf_mkChar("column"));
-        SET_STRING_ELT(error_names, 4, Rf_mkChar("snippet"));
-        SET_STRING_ELT(error_names, 5, Rf_mkChar("file"));
-
-        SEXP type_str = PROTECT(Rf_allocVector(STRSXP, 1));
-        SET_STRING_ELT(type_str, 0, Rf_mkChar("parse_error"));
-        SET_VECTOR_ELT(error_info, 0, type_str);
-
-        SEXP msg_str = PROTECT(Rf_allocVector(STRSXP, 1));
-        SET_STRING_ELT(msg_str, 0, Rf_mkCharCE(vr.message.c_str(), CE_UTF8));
-        SET_VECTOR_ELT(error_info, 1, msg_str);
-
-        SEXP line_int = PROTECT(Rf_allocVector(INTSXP, 1));
-        INTEGER(line_int)[0] = vr.line > 0 ? static_cast<int>(vr.line) : NA_INTEGER;
-        SET_VECTOR_ELT(error_info, 2, line_int);
-
-        SEXP col_int = PROTECT(Rf_allocVector(INTSXP, 1));
-        INTEGER(col_int)[0] = vr.column > 0 ? static_cast<int>(vr.column) : NA_INTEGER;
-        SET_VECTOR_ELT(error_info, 3, col_int);
-
-        SEXP snip_str = PROTECT(Rf_allocVector(STRSXP, 1));
-        SET_STRING_ELT(snip_str, 0, vr.snippet.empty() ? NA_STRING : Rf_mkCharCE(vr.snippet.c_str(), CE_UTF8));
-        SET_VECTOR_ELT(error_info, 4, snip_str);
-
-        SEXP file_str = PROTECT(Rf_allocVector(STRSXP, 1));
-        SET_STRING_ELT(file_str, 0, vr.file.empty() ? NA_STRING : Rf_mkCharCE(vr.file.c_str(), CE_UTF8));
-        SET_VECTOR_ELT(error_info, 5, file_str);
-
-        Rf_setAttrib(error_info, R_NamesSymbol, error_names);
-        Rf_setAttrib(result, Rf_install("error"), error_info);
-
-        UNPROTECT(9);  // result + error_info + error_names + 6 component SEXPs
-    } else {
-        UNPROTECT(1);  // just result
+        // First error, plus all of them in input order
+        SEXP first = PROTECT(validation_error_info(vr.message, vr.line, vr.column,
+                                                   vr.snippet, vr.file));
+        Rf_setAttrib(result, Rf_install("error"), first);
+
+        SEXP all = PROTECT(Rf_allocVector(VECSXP, vr.errors.size()));
+        for (size_t i = 0; i < vr.errors.size(); i++) {
+            const ParseError& e = vr.errors[i];
+            SET_VECTOR_ELT(all, i, validation_error_info(e.what(), e.line(), e.column(),
+                                                         e.snippet(), e.file()));
+        }
+        Rf_setAttrib(result, Rf_install("errors"), all);
+        UNPROTECT(2);
     }
 
+    UNPROTECT(1);
     return result;
 }
 
 // Read tabular TOON to data.frame
 SEXP C_read_toon_df(SEXP file, SEXP key, SEXP strict, SEXP allow_comments,
                     SEXP allow_duplicate_keys, SEXP warn, SEXP col_types,
-                    SEXP ragged_rows, SEXP n_mismatch, SEXP max_extra_cols) {
+                    SEXP ragged_rows, SEXP n_mismatch, SEXP max_extra_cols,
+                    SEXP threads, SEXP as_factor, SEXP select, SEXP filter,
+                    SEXP rows, SEXP index, SEXP io, SEXP sample_rows, SEXP id,
+                    SEXP cache, SEXP lazy) {
     try {
         TabularParseOptions opts;
         opts.strict = Rf_asLogical(strict) == TRUE;
@@ -365,29 +502,55 @@ SEXP C_read_toon_df(SEXP file, SEXP key, SEXP strict, SEXP allow_comments,
 
         double max_cols = Rf_asReal(max_extra_cols);
         opts.max_extra_cols = std::isinf(max_cols) ? SIZE_MAX : static_cast<size_t>(max_cols);
+        opts.threads = Rf_asInteger(threads);
+        opts.as_factor = Rf_asLogical(as_factor) == TRUE;
+        opts.select = parse_select(select);
+        opts.filters = parse_filters(filter);
+
+        // Row range as c(start, count), start 0-based
+        if (rows != R_NilValue) {
+            opts.row_start = static_cast<size_t>(REAL(rows)[0]);
+            opts.row_count = static_cast<size_t>(REAL(rows)[1]);
+        }
+        if (index != R_NilValue) {
+            opts.index_file = CHAR(STRING_ELT(index, 0));
+        }
 
-        // Parse col_types if provided
-        if (col_types != R_NilValue && Rf_xlength(col_types) > 0) {
-            SEXP ct_names = Rf_getAttrib(col_types, R_NamesSymbol);
-            for (R_xlen_t i = 0; i < Rf_xlength(col_types); i++) {
-                std::string name(CHAR(STRING_ELT(ct_names, i)));
-                std::string type_str(CHAR(STRING_ELT(col_types, i)));
-
-                ColType ctype = ColType::STRING;
-                if (type_str == "logical") ctype = ColType::LOGICAL;
-                else if (type_str == "integer") ctype = ColType::INTEGER;
-                else if (type_str == "double") ctype = ColType::DOUBLE;
-                else if (type_str == "character") ctype = ColType::STRING;
+        opts.col_types = parse_col_types(col_types);
+        opts.io = parse_reader_options(io);
+        opts.sample_rows = static_cast<size_t>(Rf_asReal(sample_rows));
 
-                opts.col_types.push_back({name, ctype});
-            }
+        if (cache != R_NilValue) {
+            return read_toon_df_cached(CHAR(STRING_ELT(file, 0)), CHAR(STRING_ELT(cache, 0)),
+                                       opts);
         }
 
         TabularParser parser(opts);
-        std::string filepath(CHAR(STRING_ELT(file, 0)));
-
-        SEXP result = parser.parse_file(filepath);
+        SEXP result;
+        if (Rf_length(file) == 1 && id == R_NilValue) {
+            std::string filepath(CHAR(STRING_ELT(file, 0)));
+            result = Rf_asLogical(lazy) == TRUE ? parser.parse_file_lazy(filepath)
+                                                : parser.parse_file(filepath);
+        } else {
+            // Several files, or one with an id column as list(name, labels)
+            std::vector<std::string> files;
+            for (R_xlen_t i = 0; i < Rf_xlength(file); i++) {
+                files.push_back(CHAR(STRING_ELT(file, i)));
+            }
+            std::string id_column;
+            std::vector<std::string> labels;
+            if (id != R_NilValue) {
+                id_column = CHAR(STRING_ELT(VECTOR_ELT(id, 0), 0));
+                SEXP values = VECTOR_ELT(id, 1);
+                for (R_xlen_t i = 0; i < Rf_xlength(values); i++) {
+                    labels.push_back(CHAR(STRING_ELT(values, i)));
+                }
+            }
+            result = parser.parse_files(files, id_column, labels);
+        }
+        PROTECT(result);
         emit_warnings(parser.warnings());
+        UNPROTECT(1);
 
         return result;
     } catch (const ParseError& e) {
@@ -399,25 +562,70 @@ SEXP C_read_toon_df(SEXP file, SEXP key, SEXP strict, SEXP allow_comments,
     return R_NilValue;
 }
 
+// Build the sidecar row index of a tabular TOON file
+SEXP C_build_index(SEXP file, SEXP key, SEXP allow_comments, SEXP every, SEXP index_file) {
+    try {
+        TabularParseOptions opts;
+        opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
+        if (key != R_NilValue) {
+            opts.key = std::string(CHAR(STRING_ELT(key, 0)));
+        }
+
+        TabularParser parser(opts);
+        RowIndex index = parser.build_index(CHAR(STRING_ELT(file, 0)),
+                                            static_cast<size_t>(Rf_asReal(every)));
+        index.save(CHAR(STRING_ELT(index_file, 0)));
+
+        return R_NilValue;
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error building row index: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
 // Write data.frame to tabular TOON
-SEXP C_write_toon_df(SEXP df, SEXP file, SEXP tabular, SEXP pretty, SEXP indent, SEXP strict) {
+SEXP C_write_toon_df(SEXP df, SEXP file, SEXP pretty, SEXP indent, SEXP strict, SEXP threads) {
     try {
         EncodeOptions opts;
         opts.pretty = Rf_asLogical(pretty) == TRUE;
         opts.indent = Rf_asInteger(indent);
         opts.strict = Rf_asLogical(strict) == TRUE;
 
-        Encoder encoder(opts);
-        std::string result = encoder.encode_dataframe(df, Rf_asLogical(tabular) == TRUE);
+        // Rows are formatted in chunks and written as they are ready, so
+        // the file is only opened once the values have been checked
+        TabularWriter writer(df, opts);
+        {
+            PhaseTimer timer("check");
+            writer.check_values();
+        }
 
-        // Write to file
+        // Written beside the target, which is only replaced once complete
         std::string filepath(CHAR(STRING_ELT(file, 0)));
-        std::ofstream out(filepath, std::ios::binary);
+        std::string tmp = filepath + ".tmp";
+        OutputFile out(tmp, compression_for_path(filepath));
         if (!out.is_open()) {
-            Rf_error("Cannot open file for writing: %s", filepath.c_str());
+            throw ParseError("Cannot open file for writing: " + tmp);
         }
-        out << result;
-        out.close();
+        try {
+            PhaseTimer timer("write");
+            writer.write(out, Rf_asInteger(threads));
+            out.close();
+            if (!out) {
+                throw ParseError("Error writing to file: " + filepath);
+            }
+        } catch (...) {
+            out.close();
+            std::remove(tmp.c_str());
+            throw;
+        }
+        if (!replace_file(tmp, filepath)) {
+            throw ParseError("Error writing to file: " + filepath);
+        }
+        if (Stats* st = stats::active()) st->rows += static_cast<size_t>(writer.nrow());
+        record_output(filepath);
 
         return R_NilValue;
     } catch (const ParseError& e) {
@@ -433,7 +641,8 @@ SEXP C_write_toon_df(SEXP df, SEXP file, SEXP tabular, SEXP pretty, SEXP indent,
 SEXP C_stream_rows(SEXP file, SEXP key, SEXP callback, SEXP batch_size,
                    SEXP strict, SEXP allow_comments, SEXP allow_duplicate_keys,
                    SEXP warn, SEXP col_types, SEXP ragged_rows, SEXP n_mismatch,
-                   SEXP max_extra_cols) {
+                   SEXP max_extra_cols, SEXP as_factor, SEXP select, SEXP filter,
+                   SEXP start, SEXP index, SEXP io, SEXP sample_rows, SEXP pipeline) {
     try {
         StreamOptions opts;
         opts.strict = Rf_asLogical(strict) == TRUE;
@@ -441,6 +650,16 @@ SEXP C_stream_rows(SEXP file, SEXP key, SEXP callback, SEXP batch_size,
         opts.allow_duplicate_keys = Rf_asLogical(allow_duplicate_keys) == TRUE;
         opts.warn = Rf_asLogical(warn) == TRUE;
         opts.batch_size = static_cast<size_t>(Rf_asInteger(batch_size));
+        opts.as_factor = Rf_asLogical(as_factor) == TRUE;
+        opts.select = parse_select(select);
+        opts.filters = parse_filters(filter);
+        opts.row_start = static_cast<size_t>(Rf_asReal(start));
+        opts.io = parse_reader_options(io);
+        opts.sample_rows = static_cast<size_t>(Rf_asReal(sample_rows));
+        opts.pipeline = Rf_asLogical(pipeline) == TRUE;
+        if (index != R_NilValue) {
+            opts.index_file = CHAR(STRING_ELT(index, 0));
+        }
 
         if (key != R_NilValue) {
             opts.key = std::string(CHAR(STRING_ELT(key, 0)));
@@ -452,25 +671,171 @@ SEXP C_stream_rows(SEXP file, SEXP key, SEXP callback, SEXP batch_size,
         double max_cols = Rf_asReal(max_extra_cols);
         opts.max_extra_cols = std::isinf(max_cols) ? SIZE_MAX : static_cast<size_t>(max_cols);
 
-        // Parse col_types
-        if (col_types != R_NilValue && Rf_xlength(col_types) > 0) {
-            SEXP ct_names = Rf_getAttrib(col_types, R_NamesSymbol);
-            for (R_xlen_t i = 0; i < Rf_xlength(col_types); i++) {
-                std::string name(CHAR(STRING_ELT(ct_names, i)));
-                std::string type_str(CHAR(STRING_ELT(col_types, i)));
+        opts.col_types = parse_col_types(col_types);
 
-                ColType ctype = ColType::STRING;
-                if (type_str == "logical") ctype = ColType::LOGICAL;
-                else if (type_str == "integer") ctype = ColType::INTEGER;
-                else if (type_str == "double") ctype = ColType::DOUBLE;
-                else if (type_str == "character") ctype = ColType::STRING;
+        std::string filepath(CHAR(STRING_ELT(file, 0)));
+        RowStreamer streamer(filepath, opts);
+        streamer.stream(callback);
+        emit_warnings(streamer.warnings());
 
-                opts.col_types.push_back({name, ctype});
-            }
+        return R_NilValue;
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error streaming TOON: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
+// Empty ArrowArrayStream owned by an external pointer, which releases any
+// stream still in it when collected. Its address, as a double, is in the
+// "address" attribute for arrow's import_from_c()/export_to_c().
+static SEXP new_arrow_stream() {
+    auto* stream = new ArrowArrayStream();
+    stream->release = nullptr;
+
+    SEXP ptr = PROTECT(R_MakeExternalPtr(stream, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, [](SEXP p) {
+        auto* st = static_cast<ArrowArrayStream*>(R_ExternalPtrAddr(p));
+        if (st) {
+            if (st->release) st->release(st);
+            delete st;
+            R_ClearExternalPtr(p);
+        }
+    }, TRUE);
+
+    SEXP address = PROTECT(Rf_ScalarReal(static_cast<double>(reinterpret_cast<uintptr_t>(stream))));
+    Rf_setAttrib(ptr, Rf_install("address"), address);
+
+    UNPROTECT(2);
+    return ptr;
+}
+
+SEXP C_arrow_stream_new() {
+    return new_arrow_stream();
+}
+
+// Read tabular TOON into an Arrow stream of record batches
+SEXP C_toon_arrow_stream(SEXP file, SEXP key, SEXP strict, SEXP allow_comments, SEXP warn,
+                         SEXP threads, SEXP batch_size) {
+    try {
+        TabularParseOptions opts;
+        opts.strict = Rf_asLogical(strict) == TRUE;
+        opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
+        opts.warn = Rf_asLogical(warn) == TRUE;
+        opts.threads = Rf_asInteger(threads);
+        if (key != R_NilValue) {
+            opts.key = std::string(CHAR(STRING_ELT(key, 0)));
+        }
+
+        TabularParser parser(opts);
+        SEXP ptr = PROTECT(new_arrow_stream());
+        parser.parse_file_arrow(CHAR(STRING_ELT(file, 0)),
+                                static_cast<size_t>(Rf_asInteger(batch_size)),
+                                static_cast<ArrowArrayStream*>(R_ExternalPtrAddr(ptr)));
+        emit_warnings(parser.warnings());
+
+        UNPROTECT(1);
+        return ptr;
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error reading tabular TOON: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
+// Write the record batches of an Arrow stream as tabular TOON
+SEXP C_write_toon_arrow(SEXP stream, SEXP file, SEXP strict, SEXP indent) {
+    try {
+        auto* st = static_cast<ArrowArrayStream*>(R_ExternalPtrAddr(stream));
+        if (st == nullptr || st->release == nullptr) {
+            throw ParseError("Arrow stream has been released");
+        }
+
+        EncodeOptions opts;
+        opts.strict = Rf_asLogical(strict) == TRUE;
+        opts.indent = Rf_asInteger(indent);
+
+        size_t rows = write_arrow_toon(st, CHAR(STRING_ELT(file, 0)), opts);
+        st->release(st);
+        return Rf_ScalarReal(static_cast<double>(rows));
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error writing TOON: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
+// Convert CSV to tabular TOON without building a data.frame
+SEXP C_csv_to_toon(SEXP csv_file, SEXP toon_file, SEXP strict, SEXP indent, SEXP col_types) {
+    try {
+        CsvToToonOptions opts;
+        opts.strict = Rf_asLogical(strict) == TRUE;
+        opts.indent = Rf_asInteger(indent);
+        opts.col_types = parse_col_types(col_types);
+
+        size_t rows = csv_to_toon(CHAR(STRING_ELT(csv_file, 0)), CHAR(STRING_ELT(toon_file, 0)),
+                                  opts);
+        return Rf_ScalarReal(static_cast<double>(rows));
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error converting CSV to TOON: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
+// Convert tabular TOON to CSV without building a data.frame
+SEXP C_toon_to_csv(SEXP toon_file, SEXP csv_file, SEXP key, SEXP strict,
+                   SEXP allow_comments, SEXP warn) {
+    try {
+        StreamOptions opts;
+        opts.strict = Rf_asLogical(strict) == TRUE;
+        opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
+        opts.warn = Rf_asLogical(warn) == TRUE;
+        if (key != R_NilValue) {
+            opts.key = std::string(CHAR(STRING_ELT(key, 0)));
+        }
+
+        std::vector<Warning> warnings;
+        size_t rows = toon_to_csv(CHAR(STRING_ELT(toon_file, 0)), CHAR(STRING_ELT(csv_file, 0)),
+                                  opts, warnings);
+        emit_warnings(warnings);
+        return Rf_ScalarReal(static_cast<double>(rows));
+    } catch (const ParseError& e) {
+        Rf_error("%s", e.formatted_message().c_str());
+    } catch (const std::exception& e) {
+        Rf_error("Error converting TOON to CSV: %s", e.what());
+    }
+
+    return R_NilValue;
+}
+
+// Stream non-tabular array items
+SEXP C_stream_items(SEXP file, SEXP key, SEXP callback, SEXP batch_size,
+                    SEXP strict, SEXP allow_comments, SEXP allow_duplicate_keys,
+                    SEXP warn, SEXP simplify) {
+    try {
+        StreamOptions opts;
+        opts.strict = Rf_asLogical(strict) == TRUE;
+        opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
+        opts.allow_duplicate_keys = Rf_asLogical(allow_duplicate_keys) == TRUE;
+        opts.warn = Rf_asLogical(warn) == TRUE;
+        opts.simplify = Rf_asLogical(simplify) == TRUE;
+        opts.batch_size = static_cast<size_t>(Rf_asInteger(batch_size));
+
+        if (key != R_NilValue) {
+            opts.key = std::string(CHAR(STRING_ELT(key, 0)));
         }
 
         std::string filepath(CHAR(STRING_ELT(file, 0)));
-        RowStreamer streamer(filepath, opts);
+        ItemStreamer streamer(filepath, opts);
         streamer.stream(callback);
         emit_warnings(streamer.warnings());
 
@@ -492,14 +857,14 @@ SEXP C_format_toon(SEXP x, SEXP is_file, SEXP indent, SEXP canonical, SEXP allow
         parse_opts.simplify = false;
 
         Parser parser(parse_opts);
-        NodePtr node;
+        Document doc;
 
         if (Rf_asLogical(is_file) == TRUE) {
             std::string filepath(CHAR(STRING_ELT(x, 0)));
-            node = parser.parse_file(filepath);
+            doc = parser.parse_file(filepath);
         } else {
             const char* text = CHAR(STRING_ELT(x, 0));
-            node = parser.parse_string(text);
+            doc = parser.parse_string(text);
         }
 
         EncodeOptions enc_opts;
@@ -507,12 +872,12 @@ SEXP C_format_toon(SEXP x, SEXP is_file, SEXP indent, SEXP canonical, SEXP allow
         enc_opts.indent = Rf_asInteger(indent);
         enc_opts.canonical = Rf_asLogical(canonical) == TRUE;
 
-        Encoder encoder(enc_opts);
-        SEXP r_node = node_to_sexp(node, false);
-        std::string result = encoder.encode(r_node);
+        // Straight from the parsed tree to text, without R objects between
+        WriteBuffer buf;
+        format_document(doc, enc_opts, buf);
 
         SEXP out = PROTECT(Rf_allocVector(STRSXP, 1));
-        SET_STRING_ELT(out, 0, Rf_mkCharCE(result.c_str(), CE_UTF8));
+        SET_STRING_ELT(out, 0, mk_char(buf.view()));
         UNPROTECT(1);
         return out;
     } catch (const ParseError& e) {
@@ -538,59 +903,38 @@ SEXP C_toon_peek(SEXP file, SEXP n, SEXP allow_comments) {
         std::vector<std::string> lines;
         std::string_view line;
         size_t line_no;
-        std::string top_type = "unknown";
-        std::vector<std::string> first_keys;
-
-        while (reader.next_line(line, line_no) && static_cast<int>(lines.size()) < max_lines) {
+        while (static_cast<int>(lines.size()) < max_lines && reader.next_line(line, line_no)) {
             lines.push_back(std::string(line));
+        }
 
-            // Try to determine top-level type from first non-empty line
-            if (top_type == "unknown" && !line.empty()) {
-                size_t indent = 0;
-                while (indent < line.size() && (line[indent] == ' ' || line[indent] == '\t')) {
-                    indent++;
-                }
-                if (indent < line.size()) {
-                    char c = line[indent];
-                    if (c == '[') {
-                        if (line.find('{') != std::string::npos) {
-                            top_type = "tabular_array";
-                        } else {
-                            top_type = "array";
-                        }
-                    } else if (c == '-') {
-                        top_type = "array";
-                    } else if (c != '#' && c != '/') {
-                        // Look for colon
-                        size_t colon = line.find(':');
-                        if (colon != std::string::npos) {
-                            top_type = "object";
-                            std::string key(line.substr(indent, colon - indent));
-                            // Trim key
-                            while (!key.empty() && std::isspace(key.back())) key.pop_back();
-                            if (!key.empty() && first_keys.size() < 5) {
-                                first_keys.push_back(key);
-                            }
-                        }
-                    }
-                }
-            } else if (top_type == "object" && first_keys.size() < 5) {
-                // Collect more keys
-                size_t indent = 0;
-                while (indent < line.size() && (line[indent] == ' ' || line[indent] == '\t')) {
-                    indent++;
-                }
-                if (indent == 0) {  // Top-level key
-                    size_t colon = line.find(':');
-                    if (colon != std::string::npos) {
-                        std::string key(line.substr(0, colon));
-                        while (!key.empty() && std::isspace(key.back())) key.pop_back();
-                        if (!key.empty()) {
-                            first_keys.push_back(key);
-                        }
-                    }
-                }
-            }
+        // Type and keys from the same lines, read structurally
+        ParseOptions opts;
+        opts.strict = false;
+        opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
+        ScanOptions scan_opts;
+        scan_opts.max_lines = static_cast<size_t>(max_lines);
+
+        Parser parser(opts);
+        ScanResult scan = parser.scan_file(filepath, scan_opts);
+
+        const char* top_type = "unknown";
+        switch (scan.top_type) {
+            case LineType::KEY_VALUE:
+            case LineType::KEY_NESTED:
+                top_type = "object";
+                break;
+            case LineType::LIST_ITEM:
+            case LineType::ARRAY_HEADER:
+                top_type = "array";
+                break;
+            case LineType::TABULAR_HEADER:
+                top_type = "tabular_array";
+                break;
+            case LineType::RAW_VALUE:
+                top_type = "primitive";
+                break;
+            default:
+                break;
         }
 
         // Build result list
@@ -603,13 +947,13 @@ SEXP C_toon_peek(SEXP file, SEXP n, SEXP allow_comments) {
 
         // Type
         SEXP type_str = PROTECT(Rf_allocVector(STRSXP, 1));
-        SET_STRING_ELT(type_str, 0, Rf_mkChar(top_type.c_str()));
+        SET_STRING_ELT(type_str, 0, Rf_mkChar(top_type));
         SET_VECTOR_ELT(result, 0, type_str);
 
         // First keys
-        SEXP keys_vec = PROTECT(Rf_allocVector(STRSXP, first_keys.size()));
-        for (size_t i = 0; i < first_keys.size(); i++) {
-            SET_STRING_ELT(keys_vec, i, Rf_mkCharCE(first_keys[i].c_str(), CE_UTF8));
+        SEXP keys_vec = PROTECT(Rf_allocVector(STRSXP, scan.top_keys.size()));
+        for (size_t i = 0; i < scan.top_keys.size(); i++) {
+            SET_STRING_ELT(keys_vec, i, mk_char(scan.top_keys[i]));
         }
         SET_VECTOR_ELT(result, 1, keys_vec);
 
@@ -632,76 +976,77 @@ SEXP C_toon_peek(SEXP file, SEXP n, SEXP allow_comments) {
 }
 
 // Get TOON file info
-SEXP C_toon_info(SEXP file, SEXP allow_comments) {
+SEXP C_toon_info(SEXP file, SEXP allow_comments, SEXP header_only) {
     try {
         ParseOptions opts;
         opts.allow_comments = Rf_asLogical(allow_comments) == TRUE;
-        opts.simplify = false;
+        ScanOptions scan_opts;
+        scan_opts.header_only = Rf_asLogical(header_only) == TRUE;
 
         std::string filepath(CHAR(STRING_ELT(file, 0)));
 
+        // One pass over the lines, without building the document
         Parser parser(opts);
-        NodePtr node = parser.parse_file(filepath);
-
-        // Count arrays and objects recursively
-        std::function<void(const NodePtr&, int&, int&, bool&, size_t&)> count_nodes;
-        count_nodes = [&count_nodes](const NodePtr& n, int& arrays, int& objects, bool& has_tabular, size_t& declared_rows) {
-            if (!n) return;
-
-            if (n->kind == NodeKind::N_ARRAY) {
-                arrays++;
-                // Check if it's a tabular array (all items are objects with same keys)
-                if (!n->array_items.empty()) {
-                    bool all_objects = true;
-                    for (const auto& item : n->array_items) {
-                        if (item->kind != NodeKind::N_OBJECT) {
-                            all_objects = false;
-                            break;
-                        }
-                    }
-                    if (all_objects) {
-                        has_tabular = true;
-                        declared_rows = n->array_items.size();
-                    }
-                }
-                for (const auto& item : n->array_items) {
-                    count_nodes(item, arrays, objects, has_tabular, declared_rows);
-                }
-            } else if (n->kind == NodeKind::N_OBJECT) {
-                objects++;
-                for (const auto& item : n->object_items) {
-                    count_nodes(item.second, arrays, objects, has_tabular, declared_rows);
-                }
+        ScanResult scan = parser.scan_file(filepath, scan_opts);
+        bool has_tabular = !scan.tables.empty();
+
+        // One list per tabular array
+        SEXP tables = PROTECT(Rf_allocVector(VECSXP, scan.tables.size()));
+        const char* table_names[] = {"path", "line", "offset", "declared_rows", "rows", "fields"};
+        for (size_t i = 0; i < scan.tables.size(); i++) {
+            const ScanTable& t = scan.tables[i];
+            SEXP table = PROTECT(Rf_allocVector(VECSXP, 6));
+            SEXP names = PROTECT(Rf_allocVector(STRSXP, 6));
+            for (int j = 0; j < 6; j++) {
+                SET_STRING_ELT(names, j, Rf_mkChar(table_names[j]));
             }
-        };
-
-        int array_count = 0, object_count = 0;
-        bool has_tabular = false;
-        size_t declared_rows = 0;
-        count_nodes(node, array_count, object_count, has_tabular, declared_rows);
+            SEXP path = Rf_allocVector(STRSXP, 1);
+            SET_VECTOR_ELT(table, 0, path);
+            SET_STRING_ELT(path, 0, mk_char(t.path));
+            SET_VECTOR_ELT(table, 1, Rf_ScalarInteger(static_cast<int>(t.line)));
+            SET_VECTOR_ELT(table, 2, Rf_ScalarReal(static_cast<double>(t.offset)));
+            SET_VECTOR_ELT(table, 3, Rf_ScalarInteger(static_cast<int>(t.declared)));
+            SET_VECTOR_ELT(table, 4, Rf_ScalarInteger(static_cast<int>(t.rows)));
+            SEXP fields = Rf_allocVector(STRSXP, t.fields.size());
+            SET_VECTOR_ELT(table, 5, fields);
+            for (size_t j = 0; j < t.fields.size(); j++) {
+                SET_STRING_ELT(fields, j, mk_char(t.fields[j]));
+            }
+            Rf_setAttrib(table, R_NamesSymbol, names);
+            SET_VECTOR_ELT(tables, i, table);
+            UNPROTECT(2);
+        }
 
         // Build result
-        SEXP result = PROTECT(Rf_allocVector(VECSXP, 4));
-        SEXP result_names = PROTECT(Rf_allocVector(STRSXP, 4));
+        SEXP result = PROTECT(Rf_allocVector(VECSXP, 7));
+        SEXP result_names = PROTECT(Rf_allocVector(STRSXP, 7));
 
         SET_STRING_ELT(result_names, 0, Rf_mkChar("array_count"));
         SET_STRING_ELT(result_names, 1, Rf_mkChar("object_count"));
         SET_STRING_ELT(result_names, 2, Rf_mkChar("has_tabular"));
         SET_STRING_ELT(result_names, 3, Rf_mkChar("declared_rows"));
+        SET_STRING_ELT(result_names, 4, Rf_mkChar("max_depth"));
+        SET_STRING_ELT(result_names, 5, Rf_mkChar("tables"));
+        SET_STRING_ELT(result_names, 6, Rf_mkChar("complete"));
 
-        SEXP arr_int = PROTECT(Rf_ScalarInteger(array_count));
-        SEXP obj_int = PROTECT(Rf_ScalarInteger(object_count));
+        SEXP arr_int = PROTECT(Rf_ScalarInteger(static_cast<int>(scan.arrays)));
+        SEXP obj_int = PROTECT(Rf_ScalarInteger(static_cast<int>(scan.objects)));
         SEXP tab_lgl = PROTECT(Rf_ScalarLogical(has_tabular ? TRUE : FALSE));
-        SEXP rows_int = PROTECT(Rf_ScalarInteger(has_tabular ? static_cast<int>(declared_rows) : NA_INTEGER));
+        SEXP rows_int = PROTECT(Rf_ScalarInteger(has_tabular ? static_cast<int>(scan.tables[0].declared) : NA_INTEGER));
+        SEXP depth_int = PROTECT(Rf_ScalarInteger(static_cast<int>(scan.max_depth)));
+        SEXP complete_lgl = PROTECT(Rf_ScalarLogical(scan.complete ? TRUE : FALSE));
 
         SET_VECTOR_ELT(result, 0, arr_int);
         SET_VECTOR_ELT(result, 1, obj_int);
         SET_VECTOR_ELT(result, 2, tab_lgl);
         SET_VECTOR_ELT(result, 3, rows_int);
+        SET_VECTOR_ELT(result, 4, depth_int);
+        SET_VECTOR_ELT(result, 5, tables);
+        SET_VECTOR_ELT(result, 6, complete_lgl);
 
         Rf_setAttrib(result, R_NamesSymbol, result_names);
 
-        UNPROTECT(6);
+        UNPROTECT(9);
         return result;
     } catch (const ParseError& e) {
         Rf_error("%s", e.formatted_message().c_str());
@@ -733,22 +1078,7 @@ SEXP C_from_toon_df(SEXP text, SEXP key, SEXP strict, SEXP allow_comments,
         double max_cols = Rf_asReal(max_extra_cols);
         opts.max_extra_cols = std::isinf(max_cols) ? SIZE_MAX : static_cast<size_t>(max_cols);
 
-        // Parse col_types
-        if (col_types != R_NilValue && Rf_xlength(col_types) > 0) {
-            SEXP ct_names = Rf_getAttrib(col_types, R_NamesSymbol);
-            for (R_xlen_t i = 0; i < Rf_xlength(col_types); i++) {
-                std::string name(CHAR(STRING_ELT(ct_names, i)));
-                std::string type_str(CHAR(STRING_ELT(col_types, i)));
-
-                ColType ctype = ColType::STRING;
-                if (type_str == "logical") ctype = ColType::LOGICAL;
-                else if (type_str == "integer") ctype = ColType::INTEGER;
-                else if (type_str == "double") ctype = ColType::DOUBLE;
-                else if (type_str == "character") ctype = ColType::STRING;
-
-                opts.col_types.push_back({name, ctype});
-            }
-        }
+        opts.col_types = parse_col_types(col_types);
 
         const char* data;
         size_t len;
@@ -776,7 +1106,7 @@ SEXP C_from_toon_df(SEXP text, SEXP key, SEXP strict, SEXP allow_comments,
 }
 
 // Stream write rows
-SEXP C_stream_write_init(SEXP file, SEXP schema, SEXP indent) {
+SEXP C_stream_write_init(SEXP file, SEXP schema, SEXP indent, SEXP flush_batch, SEXP buffer_size) {
     try {
         std::string filepath(CHAR(STRING_ELT(file, 0)));
         std::vector<std::string> schema_vec;
@@ -785,7 +1115,12 @@ SEXP C_stream_write_init(SEXP file, SEXP schema, SEXP indent) {
             schema_vec.push_back(CHAR(STRING_ELT(schema, i)));
         }
 
-        auto* writer = new StreamWriter(filepath, schema_vec, Rf_asInteger(indent));
+        StreamWriterOptions opts;
+        opts.indent = Rf_asInteger(indent);
+        opts.flush_batch = Rf_asLogical(flush_batch) == TRUE;
+        opts.buffer_size = static_cast<size_t>(Rf_asReal(buffer_size));
+
+        auto* writer = new StreamWriter(filepath, schema_vec, opts);
 
         SEXP ptr = PROTECT(R_MakeExternalPtr(writer, R_NilValue, R_NilValue));
         R_RegisterCFinalizerEx(ptr, [](SEXP p) {
@@ -836,4 +1171,89 @@ SEXP C_stream_write_close(SEXP ptr) {
     return R_NilValue;
 }
 
+// Profiles (profile = TRUE)
+SEXP C_profile_start(SEXP operation) {
+    stats::start(CHAR(STRING_ELT(operation, 0)));
+    return R_NilValue;
+}
+
+SEXP C_profile_stop(void) {
+    stats::stop();
+    return R_NilValue;
+}
+
+// The last profile as a list, the columns as parallel vectors; NULL if
+// nothing has been profiled
+SEXP C_last_stats(void) {
+    const Stats* st = stats::last();
+    if (!st) return R_NilValue;
+
+    const char* result_names[] = {"operation", "seconds", "phases", "bytes_read", "lines_read",
+                                  "buffer_refills", "scratch_copies", "io_wait", "bytes_written",
+                                  "rows", "schema_expansions", "strings_created", "allocations",
+                                  "peak_builder_bytes", "columns"};
+    const int n_result = 15;
+    SEXP result = PROTECT(Rf_allocVector(VECSXP, n_result));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, n_result));
+    for (int i = 0; i < n_result; i++) {
+        SET_STRING_ELT(names, i, Rf_mkChar(result_names[i]));
+    }
+
+    SET_VECTOR_ELT(result, 0, Rf_mkString(st->operation.c_str()));
+    SET_VECTOR_ELT(result, 1, Rf_ScalarReal(st->seconds));
+
+    SEXP phases = Rf_allocVector(REALSXP, st->phases.size());
+    SET_VECTOR_ELT(result, 2, phases);
+    SEXP phase_names = PROTECT(Rf_allocVector(STRSXP, st->phases.size()));
+    for (size_t i = 0; i < st->phases.size(); i++) {
+        SET_STRING_ELT(phase_names, i, Rf_mkChar(st->phases[i].first.c_str()));
+        REAL(phases)[i] = st->phases[i].second;
+    }
+    Rf_setAttrib(phases, R_NamesSymbol, phase_names);
+    UNPROTECT(1);
+
+    // Counts as doubles: they can pass INT_MAX
+    const double counts[] = {
+        static_cast<double>(st->bytes_read), static_cast<double>(st->lines_read),
+        static_cast<double>(st->buffer_refills), static_cast<double>(st->scratch_copies),
+        st->io_wait, static_cast<double>(st->bytes_written), static_cast<double>(st->rows),
+        static_cast<double>(st->schema_expansions), static_cast<double>(st->strings_created),
+        static_cast<double>(st->allocations), static_cast<double>(st->peak_builder_bytes)};
+    for (int i = 0; i < 11; i++) {
+        SET_VECTOR_ELT(result, 3 + i, Rf_ScalarReal(counts[i]));
+    }
+
+    const char* column_names[] = {"name", "type", "promotions", "promoted_values", "unescaped",
+                                  "strings", "allocations", "peak_bytes"};
+    size_t ncol = st->columns.size();
+    SEXP columns = PROTECT(Rf_allocVector(VECSXP, 8));
+    SEXP col_names = PROTECT(Rf_allocVector(STRSXP, 8));
+    for (int j = 0; j < 8; j++) {
+        SET_STRING_ELT(col_names, j, Rf_mkChar(column_names[j]));
+        SET_VECTOR_ELT(columns, j, Rf_allocVector(j < 3 ? STRSXP : REALSXP, ncol));
+    }
+    for (size_t i = 0; i < ncol; i++) {
+        const ColumnStats& c = st->columns[i];
+        std::string promotions;
+        for (const auto& p : c.promotions) {
+            if (!promotions.empty()) promotions += ", ";
+            promotions += p;
+        }
+        SET_STRING_ELT(VECTOR_ELT(columns, 0), i, mk_char(c.name));
+        SET_STRING_ELT(VECTOR_ELT(columns, 1), i, Rf_mkChar(c.type.c_str()));
+        SET_STRING_ELT(VECTOR_ELT(columns, 2), i, mk_char(promotions));
+        REAL(VECTOR_ELT(columns, 3))[i] = static_cast<double>(c.promoted_values);
+        REAL(VECTOR_ELT(columns, 4))[i] = static_cast<double>(c.unescaped);
+        REAL(VECTOR_ELT(columns, 5))[i] = static_cast<double>(c.strings);
+        REAL(VECTOR_ELT(columns, 6))[i] = static_cast<double>(c.allocations);
+        REAL(VECTOR_ELT(columns, 7))[i] = static_cast<double>(c.peak_bytes);
+    }
+    Rf_setAttrib(columns, R_NamesSymbol, col_names);
+    SET_VECTOR_ELT(result, 14, columns);
+
+    Rf_setAttrib(result, R_NamesSymbol, names);
+    UNPROTECT(4);
+    return result;
+}
+
 } // extern "C"
@@ -0,0 +1,510 @@
+// Stage benchmarks for the toonlite C++ core
+//
+// Times each stage of reading and writing separately -- line scanning,
+// structural scanning, row splitting, primitive parsing, type inference,
+// column finalization, encoding and double formatting -- plus whole
+// tabular and document reads, on the fixtures from generate_fixtures.R.
+// R is embedded so that the stages building R vectors run as they do in
+// the package.
+//
+// Usage: bench [options] [data_dir]
+//   --reps N          timed repetitions per stage (default 10)
+//   --filter TEXT     only run stages or fixtures whose name contains TEXT
+//   --out FILE        write results as tab-separated values
+//   --baseline FILE   compare with results written earlier by --out
+//   --tolerance X     slowdown against the baseline counted as a
+//                     regression (default 0.10, i.e. 10%)
+//
+// With --baseline the exit status is 1 if any stage regressed.
+
+#include "toon_parser.h"
+#include "toon_df.h"
+#include "toon_encoder.h"
+#include "toon_scan.h"
+#include "toon_io.h"
+#include "toon_errors.h"
+
+#include <Rembedded.h>
+#define CSTACK_DEFNS
+#include <Rinterface.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace toonlite;
+
+namespace {
+
+// Results are folded in here so no stage can be optimized away
+volatile size_t g_sink = 0;
+
+constexpr double MB = 1024.0 * 1024.0;
+
+// Amount of input (or output) one run of a stage handles
+struct Work {
+    size_t bytes = 0;
+    size_t rows = 0;
+};
+
+struct Result {
+    std::string stage;
+    std::string fixture;
+    Work work;
+    int reps = 0;
+    double median_sec = 0;
+    double mb_per_sec = 0;     // median over repetitions
+    double mb_per_sec_sd = 0;
+    double rows_per_sec = 0;   // median over repetitions
+};
+
+// Rows of a fixture's root tabular array, split ahead of time so the
+// column stages see only their own work
+struct Table {
+    std::vector<std::string> names;
+    char delimiter = ',';
+    std::vector<std::string_view> rows;    // without indent
+    size_t row_bytes = 0;
+    std::vector<std::string_view> cells;   // every field of every row
+    std::vector<size_t> row_start;         // rows.size() + 1 offsets into cells
+    std::vector<ColType> types;            // as inferred from all rows
+};
+
+struct Fixture {
+    std::string name;
+    std::string path;
+    std::string text;
+    size_t lines = 0;
+    std::unique_ptr<Table> table;      // null without a root tabular array
+    std::unique_ptr<Document> doc;
+    SEXP df = R_NilValue;              // preserved
+    std::vector<double> doubles;       // finite cells of double columns
+};
+
+double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+double stddev(const std::vector<double>& v) {
+    if (v.size() < 2) return 0;
+    double mean = 0;
+    for (double x : v) mean += x;
+    mean /= v.size();
+    double ss = 0;
+    for (double x : v) ss += (x - mean) * (x - mean);
+    return std::sqrt(ss / (v.size() - 1));
+}
+
+// Time `run` after one untimed warmup. `setup`, if given, runs untimed
+// before each repetition.
+Result measure(const std::string& stage, const Fixture& fix, int reps,
+               const std::function<void()>& setup, const std::function<Work()>& run) {
+    if (setup) setup();
+    Work work = run();
+
+    std::vector<double> secs, mbps, rps;
+    for (int i = 0; i < reps; i++) {
+        if (setup) setup();
+        auto start = std::chrono::steady_clock::now();
+        work = run();
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        s = std::max(s, 1e-9);
+        secs.push_back(s);
+        mbps.push_back(work.bytes / MB / s);
+        rps.push_back(work.rows / s);
+    }
+
+    Result r;
+    r.stage = stage;
+    r.fixture = fix.name;
+    r.work = work;
+    r.reps = reps;
+    r.median_sec = median(secs);
+    r.mb_per_sec = median(mbps);
+    r.mb_per_sec_sd = stddev(mbps);
+    r.rows_per_sec = median(rps);
+    return r;
+}
+
+std::string slurp(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+size_t indent_of(std::string_view line) {
+    size_t n = 0;
+    while (n < line.size() && line[n] == ' ') n++;
+    return n;
+}
+
+// Locate the root tabular array, if any, and split its rows
+std::unique_ptr<Table> load_table(const Fixture& fix) {
+    ScanOptions scan_opts;
+    scan_opts.header_only = true;
+    ScanResult scan = Parser().scan_file(fix.path, scan_opts);
+    if (scan.tables.empty() || !scan.tables[0].path.empty()) return nullptr;
+    const ScanTable& st = scan.tables[0];
+
+    auto table = std::make_unique<Table>();
+    table->names = st.fields;
+
+    std::string_view text(fix.text);
+    size_t pos = st.offset;
+    size_t end = text.find('\n', pos);
+    std::string_view header = text.substr(pos, end == std::string_view::npos ? end : end - pos);
+    std::string_view bracket = header.substr(0, header.find(']'));
+    if (bracket.find('\t') != std::string_view::npos) {
+        table->delimiter = '\t';
+    } else if (bracket.find('|') != std::string_view::npos) {
+        table->delimiter = '|';
+    }
+    size_t header_indent = indent_of(header);
+
+    while (end != std::string_view::npos) {
+        pos = end + 1;
+        end = text.find('\n', pos);
+        std::string_view line = text.substr(pos, end == std::string_view::npos ? end : end - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        size_t indent = indent_of(line);
+        if (indent == line.size() || indent <= header_indent) break;
+        table->rows.push_back(line.substr(indent));
+        table->row_bytes += line.size() + 1;
+    }
+
+    std::vector<std::string_view> fields;
+    for (std::string_view row : table->rows) {
+        table->row_start.push_back(table->cells.size());
+        split_fields(row, table->delimiter, fields);
+        table->cells.insert(table->cells.end(), fields.begin(), fields.end());
+    }
+    table->row_start.push_back(table->cells.size());
+    return table;
+}
+
+// Append every row to fresh columns, with types forced if given
+std::vector<ColBuilder> build_columns(const Table& table, const std::vector<ColType>* types) {
+    std::vector<ColBuilder> cols;
+    cols.reserve(table.names.size());
+    for (size_t j = 0; j < table.names.size(); j++) {
+        cols.emplace_back(table.names[j], table.rows.size());
+        if (types && (*types)[j] != ColType::UNKNOWN) cols.back().force_type((*types)[j]);
+    }
+    for (size_t r = 0; r < table.rows.size(); r++) {
+        size_t begin = table.row_start[r];
+        size_t n = std::min(table.row_start[r + 1] - begin, cols.size());
+        for (size_t j = 0; j < n; j++) cols[j].append(table.cells[begin + j]);
+        for (size_t j = n; j < cols.size(); j++) cols[j].append_null();
+    }
+    return cols;
+}
+
+Fixture load_fixture(const std::filesystem::path& path) {
+    Fixture fix;
+    fix.name = path.filename().string();
+    fix.path = path.string();
+    fix.text = slurp(fix.path);
+    fix.lines = static_cast<size_t>(std::count(fix.text.begin(), fix.text.end(), '\n'));
+    if (!fix.text.empty() && fix.text.back() != '\n') fix.lines++;
+
+    fix.doc = std::make_unique<Document>(Parser().parse_file(fix.path));
+    fix.table = load_table(fix);
+    if (fix.table) {
+        for (const auto& col : build_columns(*fix.table, nullptr)) {
+            fix.table->types.push_back(col.type());
+        }
+        fix.df = TabularParser().parse_file(fix.path);
+        R_PreserveObject(fix.df);
+        for (R_xlen_t j = 0; j < Rf_xlength(fix.df); j++) {
+            SEXP col = VECTOR_ELT(fix.df, j);
+            if (TYPEOF(col) != REALSXP) continue;
+            for (R_xlen_t i = 0; i < XLENGTH(col); i++) {
+                if (std::isfinite(REAL(col)[i])) fix.doubles.push_back(REAL(col)[i]);
+            }
+        }
+    }
+    return fix;
+}
+
+// Run every stage that applies to the fixture
+void run_stages(const Fixture& fix, int reps, const std::string& filter, std::vector<Result>& out) {
+    auto wanted = [&](const std::string& stage) {
+        return filter.empty() || stage.find(filter) != std::string::npos ||
+            fix.name.find(filter) != std::string::npos;
+    };
+    auto add = [&](const std::string& stage, const std::function<void()>& setup,
+                   const std::function<Work()>& run) {
+        if (wanted(stage)) out.push_back(measure(stage, fix, reps, setup, run));
+    };
+    const size_t file_bytes = fix.text.size();
+
+    add("lines", nullptr, [&] {
+        BufferedReader reader(fix.path);
+        std::string_view line;
+        size_t line_no, n = 0, bytes = 0;
+        while (reader.next_line(line, line_no)) {
+            n++;
+            bytes += line.size();
+        }
+        g_sink += bytes;
+        return Work{file_bytes, n};
+    });
+
+    add("scan", nullptr, [&] {
+        ScanResult scan = Parser().scan_file(fix.path);
+        g_sink += scan.max_depth;
+        return Work{file_bytes, fix.lines};
+    });
+
+    add("read_dom", nullptr, [&] {
+        Document doc = Parser().parse_file(fix.path);
+        g_sink += doc.root();
+        return Work{file_bytes, fix.lines};
+    });
+
+    add("format", nullptr, [&] {
+        WriteBuffer buf;
+        format_document(*fix.doc, EncodeOptions(), buf);
+        g_sink += buf.size();
+        return Work{buf.size(), fix.lines};
+    });
+
+    if (!fix.table) return;
+    const Table& table = *fix.table;
+
+    add("split", nullptr, [&] {
+        std::vector<std::string_view> fields;
+        size_t n = 0;
+        for (std::string_view row : table.rows) {
+            split_fields(row, table.delimiter, fields);
+            n += fields.size();
+        }
+        g_sink += n;
+        return Work{table.row_bytes, table.rows.size()};
+    });
+
+    add("parse", nullptr, [&] {
+        auto cols = build_columns(table, &table.types);
+        g_sink += cols.size();
+        return Work{table.row_bytes, table.rows.size()};
+    });
+
+    add("infer", nullptr, [&] {
+        auto cols = build_columns(table, nullptr);
+        g_sink += cols.size();
+        return Work{table.row_bytes, table.rows.size()};
+    });
+
+    std::vector<ColBuilder> built;
+    add("finalize", [&] { built = build_columns(table, nullptr); }, [&] {
+        for (auto& col : built) {
+            SEXP v = PROTECT(col.finalize());
+            g_sink += static_cast<size_t>(XLENGTH(v));
+            UNPROTECT(1);
+        }
+        return Work{table.row_bytes, table.rows.size()};
+    });
+    built.clear();
+
+    add("read_df", nullptr, [&] {
+        SEXP df = PROTECT(TabularParser().parse_file(fix.path));
+        g_sink += static_cast<size_t>(Rf_xlength(df));
+        UNPROTECT(1);
+        return Work{file_bytes, table.rows.size()};
+    });
+
+    add("write_df", nullptr, [&] {
+        Encoder encoder;
+        std::string_view text = encoder.encode_view(fix.df);
+        g_sink += text.size();
+        return Work{text.size(), table.rows.size()};
+    });
+
+    if (!fix.doubles.empty()) {
+        add("doubles", nullptr, [&] {
+            WriteBuffer buf;
+            for (double v : fix.doubles) {
+                buf.append_double(v);
+                buf.append_char(',');
+            }
+            g_sink += buf.size();
+            return Work{buf.size(), fix.doubles.size()};
+        });
+    }
+}
+
+void print_result(const Result& r) {
+    double cv = r.mb_per_sec > 0 ? 100 * r.mb_per_sec_sd / r.mb_per_sec : 0;
+    std::printf("  %-10s %9.2f MB/s +/- %5.1f%%  %14.0f rows/s  %8.4f sec\n",
+                r.stage.c_str(), r.mb_per_sec, cv, r.rows_per_sec, r.median_sec);
+}
+
+const char* TSV_HEADER = "stage\tfixture\tbytes\trows\treps\tmedian_sec\tmb_per_sec\tmb_per_sec_sd\trows_per_sec";
+
+bool write_results(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << TSV_HEADER << "\n";
+    char line[512];
+    for (const auto& r : results) {
+        std::snprintf(line, sizeof(line), "%s\t%s\t%zu\t%zu\t%d\t%.6g\t%.6g\t%.6g\t%.6g\n",
+                      r.stage.c_str(), r.fixture.c_str(), r.work.bytes, r.work.rows, r.reps,
+                      r.median_sec, r.mb_per_sec, r.mb_per_sec_sd, r.rows_per_sec);
+        out << line;
+    }
+    return static_cast<bool>(out);
+}
+
+// Results written by write_results(), keyed by "fixture/stage"
+std::map<std::string, Result> read_results(const std::string& path) {
+    std::map<std::string, Result> results;
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line) || line != TSV_HEADER) {
+        throw std::runtime_error("Not a results file: " + path);
+    }
+    while (std::getline(in, line)) {
+        std::vector<std::string> f;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, '\t')) f.push_back(field);
+        if (f.size() != 9) continue;
+        Result r;
+        r.stage = f[0];
+        r.fixture = f[1];
+        r.work.bytes = std::stoull(f[2]);
+        r.work.rows = std::stoull(f[3]);
+        r.reps = std::stoi(f[4]);
+        r.median_sec = std::stod(f[5]);
+        r.mb_per_sec = std::stod(f[6]);
+        r.mb_per_sec_sd = std::stod(f[7]);
+        r.rows_per_sec = std::stod(f[8]);
+        results[r.fixture + "/" + r.stage] = r;
+    }
+    return results;
+}
+
+// Report the change against the baseline; returns the number of regressions
+int compare(const std::vector<Result>& results, const std::map<std::string, Result>& baseline,
+            double tolerance) {
+    std::printf("\n=== Against baseline (tolerance %.0f%%) ===\n", tolerance * 100);
+    int regressions = 0;
+    for (const auto& r : results) {
+        auto it = baseline.find(r.fixture + "/" + r.stage);
+        if (it == baseline.end()) {
+            std::printf("  %-28s %-10s        new\n", r.fixture.c_str(), r.stage.c_str());
+            continue;
+        }
+        double change = it->second.mb_per_sec > 0 ? r.mb_per_sec / it->second.mb_per_sec - 1 : 0;
+        bool regressed = change < -tolerance;
+        regressions += regressed;
+        std::printf("  %-28s %-10s %+8.1f%%%s\n", r.fixture.c_str(), r.stage.c_str(),
+                    change * 100, regressed ? "  REGRESSION" : "");
+    }
+    std::printf("\n%d regression(s)\n", regressions);
+    return regressions;
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "Usage: bench [--reps N] [--filter TEXT] [--out FILE] [--baseline FILE]\n"
+                 "             [--tolerance X] [data_dir]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string data_dir = "bench_data";
+    std::string filter, out_file, baseline_file;
+    int reps = 10;
+    double tolerance = 0.10;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--reps" && has_value) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--filter" && has_value) {
+            filter = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            out_file = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            baseline_file = argv[++i];
+        } else if (arg == "--tolerance" && has_value) {
+            tolerance = std::atof(argv[++i]);
+        } else if (!arg.empty() && arg[0] != '-') {
+            data_dir = arg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::vector<std::filesystem::path> paths;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(data_dir, ec)) {
+        if (entry.path().extension() == ".toon") paths.push_back(entry.path());
+    }
+    if (ec || paths.empty()) {
+        std::fprintf(stderr, "No .toon fixtures in %s\nRun generate_fixtures.R first.\n",
+                     data_dir.c_str());
+        return 2;
+    }
+    std::sort(paths.begin(), paths.end());
+
+    const char* r_argv[] = {"bench", "--vanilla", "--silent", "--no-echo"};
+    Rf_initEmbeddedR(4, const_cast<char**>(r_argv));
+    R_CStackLimit = static_cast<uintptr_t>(-1);
+
+    std::printf("=== toonlite C++ Stage Benchmarks ===\n");
+    std::printf("Data directory: %s\n", data_dir.c_str());
+    std::printf("Repetitions: %d\n", reps);
+
+    std::vector<Result> results;
+    int status = 0;
+    try {
+        for (const auto& path : paths) {
+            Fixture fix = load_fixture(path);
+            size_t first = results.size();
+            run_stages(fix, reps, filter, results);
+            if (fix.df != R_NilValue) R_ReleaseObject(fix.df);
+            if (results.size() == first) continue;
+
+            std::printf("\n%s (%.2f MB, %zu lines)\n", fix.name.c_str(), fix.text.size() / MB,
+                        fix.lines);
+            for (size_t i = first; i < results.size(); i++) print_result(results[i]);
+        }
+
+        if (!out_file.empty() && !write_results(out_file, results)) {
+            std::fprintf(stderr, "Cannot write %s\n", out_file.c_str());
+            status = 2;
+        }
+        if (!baseline_file.empty() && compare(results, read_results(baseline_file), tolerance) > 0) {
+            status = 1;
+        }
+    } catch (const ParseError& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        status = 2;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        status = 2;
+    }
+
+    Rf_endEmbeddedR(0);
+    return status;
+}